@@ -0,0 +1,499 @@
+#define _CRT_SECURE_NO_WARNINGS
+#include "batch.h"
+#include "registers.h"
+#include "io.h"
+#include "disk.h"
+#include "interrupts.h"
+#include "instruction_decode.h"
+#include "fast_execution.h"
+#include "block_cache.h"
+#include "jit_x86_64.h"
+#include "image.h"
+#include "lockstep.h"
+#include "monitor.h"
+#include "threads.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+// Per-thread state, reused for all jobs the thread runs
+typedef struct BatchWorker {
+	struct BatchRunner *runner;
+	int index;
+	Thread thread;
+
+	// Work queue: the job indices [top, bottom). The owner pops from the bottom, thieves take from the top.
+	Mutex lock;
+	int top;
+	int bottom;
+
+	// Translation caches derived from the shared program, kept across jobs
+	BlockCache cache;
+	JitState jit;
+	LockstepGroup *group;            // Lanes of the lockstep mode, NULL otherwise
+	Monitor *monitors;               // One per lockstep lane if the manifest has a monitor, NULL otherwise
+
+	// Per-instance simulator state
+	Registers registers;
+	Memory memory;
+	IORegisters io;
+	Disk disk;
+	IRQ2Data irq2;
+} BatchWorker;
+
+// State shared by all workers
+typedef struct BatchRunner {
+	const ThreadedProgram *threaded; // Immutable, shared by every worker
+	BatchManifest *manifest;
+	BatchWorker *workers;
+	int worker_count;
+} BatchRunner;
+
+// Load a batch manifest
+int load_batch_manifest(const char *filename, BatchManifest *manifest) {
+	char line[4 * BATCH_PATH_MAX + 64];
+	int line_number = 0;
+
+	manifest->jobs = NULL;
+	manifest->count = 0;
+	manifest->capacity = 0;
+	manifest->dump_mode = DUMP_FULL;
+	manifest->geometry = default_memory_geometry();
+	manifest->monitor = 0;
+	manifest->capture_period = 0;
+
+	FILE *file = fopen(filename, "r");
+	if (!file) {
+		printf("Error: Could not open batch manifest: %s\n", filename);
+		return 0;
+	}
+
+	while (fgets(line, sizeof(line), file)) {
+		char *start = line;
+		line_number++;
+		while (*start == ' ' || *start == '\t') {
+			start++;
+		}
+		if (*start == '#' || *start == '\n' || *start == '\r' || *start == '\0') {
+			continue;
+		}
+
+		if (manifest->count >= manifest->capacity) {
+			int capacity = (manifest->capacity == 0) ? 16 : manifest->capacity * 2;
+			BatchJob *jobs = realloc(manifest->jobs, capacity * sizeof(BatchJob));
+			if (!jobs) {
+				printf("Error: Memory allocation failed while loading the batch manifest\n");
+				fclose(file);
+				free_batch_manifest(manifest);
+				return 0;
+			}
+			manifest->jobs = jobs;
+			manifest->capacity = capacity;
+		}
+
+		BatchJob *job = &manifest->jobs[manifest->count];
+		memset(job, 0, sizeof(*job));
+		if (sscanf(start, "%1023s %1023s %1023s %1023s", job->dmem_file, job->disk_file, job->irq2_file, job->output_dir) != 4) {
+			printf("Error: %s line %d: expected \"dmemin diskin irq2in output_dir\"\n", filename, line_number);
+			fclose(file);
+			free_batch_manifest(manifest);
+			return 0;
+		}
+		manifest->count++;
+	}
+
+	fclose(file);
+	return 1;
+}
+
+// Free the jobs of a manifest
+void free_batch_manifest(BatchManifest *manifest) {
+	free(manifest->jobs);
+	manifest->jobs = NULL;
+	manifest->count = 0;
+	manifest->capacity = 0;
+}
+
+// Create an output directory, an existing one is reused
+static int make_directory(const char *path) {
+#ifdef _WIN32
+	int result = _mkdir(path);
+#else
+	int result = mkdir(path, 0777);
+#endif
+	return result == 0 || errno == EEXIST;
+}
+
+// Open a file inside a job's output directory
+static FILE *open_output(const BatchJob *job, const char *name, char *path) {
+	snprintf(path, BATCH_PATH_MAX + 32, "%s/%s", job->output_dir, name);
+	return fopen(path, "w");
+}
+
+// Write regout.txt, cycles.txt and summary.txt of a job
+static int write_job_reports(const BatchJob *job, const Registers *registers) {
+	char path[BATCH_PATH_MAX + 32];
+	int ok = 1;
+
+	FILE *file = open_output(job, "regout.txt", path);
+	if (!file) {
+		return 0;
+	}
+	for (int i = 3; i < NUM_REGISTERS; i++) { // R3 to R15
+		fprintf(file, "%08X\n", registers->regs[i]);
+	}
+	ok &= fclose(file) == 0;
+
+	file = open_output(job, "cycles.txt", path);
+	if (!file) {
+		return 0;
+	}
+	fprintf(file, "%llu\n", (unsigned long long)job->cycles);
+	ok &= fclose(file) == 0;
+
+	file = open_output(job, "summary.txt", path);
+	if (!file) {
+		return 0;
+	}
+	fprintf(file, "cycles %llu\nwall_ms %.3f\n", (unsigned long long)job->cycles, job->wall_ms);
+	ok &= fclose(file) == 0;
+	return ok;
+}
+
+// Load the inputs of a job, errors mark the job failed
+static int load_job_inputs(BatchJob *job, Memory *memory, Disk *disk, IRQ2Data *irq2) {
+	job->status = BATCH_JOB_FAILED;
+	if (load_image(job->dmem_file, IMAGE_DATA, memory->data) < 0) {
+		printf("Error: Could not load data memory file: %s\n", job->dmem_file);
+		return 0;
+	}
+	if (load_image(job->disk_file, IMAGE_DISK, disk->data) < 0) {
+		printf("Error: Could not load disk input file: %s\n", job->disk_file);
+		return 0;
+	}
+	if (read_irq2_events(job->irq2_file, irq2) <= 0) {
+		printf("Error: Could not load IRQ2 input file: %s\n", job->irq2_file);
+		return 0;
+	}
+	return 1;
+}
+
+// Attach a job's monitor and start its capture, the output directory is created for the capture.
+// monitor is NULL if the worker could not allocate its monitors.
+static int start_job_monitor(const BatchManifest *manifest, BatchJob *job, Monitor *monitor, IORegisters *io) {
+	char path[BATCH_PATH_MAX + 32];
+
+	if (!monitor) {
+		return 0;
+	}
+	init_monitor(monitor);
+	if (!attach_monitor(monitor, io)) {
+		return 0;
+	}
+	if (manifest->capture_period == 0) {
+		return 1;
+	}
+	if (!make_directory(job->output_dir)) {
+		printf("Error: Could not create output directory: %s\n", job->output_dir);
+		return 0;
+	}
+	snprintf(path, sizeof(path), "%s/monitor.cap", job->output_dir);
+	return start_monitor_capture(monitor, path, manifest->capture_period);
+}
+
+// Write the outputs of a finished job, monitor is NULL if the job has none
+static void write_job_outputs(BatchJob *job, DumpMode mode, const Memory *memory, const Disk *disk,
+	const Monitor *monitor, const Registers *registers, double start) {
+	char dmem_path[BATCH_PATH_MAX + 32];
+	char disk_path[BATCH_PATH_MAX + 32];
+	char monitor_path[BATCH_PATH_MAX + 32];
+
+	if (!make_directory(job->output_dir)) {
+		printf("Error: Could not create output directory: %s\n", job->output_dir);
+		return;
+	}
+	snprintf(dmem_path, sizeof(dmem_path), "%s/dmemout.txt", job->output_dir);
+	snprintf(disk_path, sizeof(disk_path), "%s/diskout.txt", job->output_dir);
+	snprintf(monitor_path, sizeof(monitor_path), "%s/monitor.txt", job->output_dir);
+	TextDump dumps[3] = {
+		{ dmem_path, IMAGE_DATA, memory->data, (int)memory->depth, mode, memory->dirty, 0 },
+		{ disk_path, IMAGE_DISK, disk->data, DISK_SECTORS, mode, disk->dirty, 0 },
+		{ monitor_path, IMAGE_MONITOR, monitor ? monitor->pixels : NULL, MONITOR_PIXELS, mode, monitor ? monitor->dirty : NULL, 0 }
+	};
+	int ok = write_text_dumps(dumps, monitor ? 3 : 2);
+	if (monitor) {
+		snprintf(monitor_path, sizeof(monitor_path), "%s/monitor.yuv", job->output_dir);
+		ok &= write_monitor_yuv(monitor, monitor_path);
+	}
+
+	job->wall_ms = monotonic_time_ms() - start;
+	ok &= write_job_reports(job, registers);
+	if (!ok) {
+		printf("Error: Could not write the outputs to %s\n", job->output_dir);
+		return;
+	}
+	job->status = BATCH_JOB_DONE;
+
+	// A trapped run keeps its outputs for inspection but does not count as done
+	if (memory->faulted) {
+		printf("Error: Job %s stopped on data memory address %d\n", job->output_dir, (int)memory->fault_address);
+		job->status = BATCH_JOB_FAILED;
+	}
+}
+
+// Reset a job's memory and IO registers to the geometry of the manifest
+static void init_job_geometry(const BatchManifest *manifest, Memory *memory, IORegisters *io) {
+	set_memory_geometry(memory, &manifest->geometry);
+	set_io_geometry(io, &manifest->geometry);
+}
+
+// Run one job on a worker
+static void run_job(BatchWorker *worker, BatchJob *job) {
+	double start = monotonic_time_ms();
+	uint16_t pc = 0;
+	int in_isr = 0;
+
+	job->worker = worker->index;
+	init_registers(&worker->registers);
+	init_memory(&worker->memory);
+	init_io(&worker->io);
+	init_job_geometry(worker->runner->manifest, &worker->memory, &worker->io);
+	init_disk(&worker->disk);
+	if (!load_job_inputs(job, &worker->memory, &worker->disk, &worker->irq2)) {
+		return;
+	}
+	Monitor *monitor = worker->runner->manifest->monitor ? worker->monitors : NULL;
+	if (worker->runner->manifest->monitor && !start_job_monitor(worker->runner->manifest, job, monitor, &worker->io)) {
+		free_irq2_data(&worker->irq2);
+		return;
+	}
+
+	job->cycles = run_jit_engine(&worker->jit, &worker->cache, worker->runner->threaded, &worker->registers,
+		&worker->memory, &worker->io, &worker->disk, &worker->irq2, &pc, &in_isr);
+	free_irq2_data(&worker->irq2);
+	if (worker->cache.failed) {
+		printf("Error: Job %s stopped, a block could not be translated\n", job->output_dir);
+		free_block_cache(&worker->cache); // The next job starts from an empty cache
+		return;
+	}
+	if (monitor && monitor->capture && !finish_monitor_capture(monitor, worker->io.IORegister[8])) {
+		printf("Error: Could not write the monitor capture of %s\n", job->output_dir);
+		return;
+	}
+
+	write_job_outputs(job, worker->runner->manifest->dump_mode, &worker->memory, &worker->disk, monitor, &worker->registers, start);
+}
+
+// Run up to LOCKSTEP_LANES jobs as the lanes of one lockstep group
+static void run_lockstep_jobs(BatchWorker *worker, BatchJob **jobs, int count) {
+	LockstepGroup *group = worker->group;
+	double start = monotonic_time_ms();
+	unsigned int lanes = 0;
+
+	init_lockstep_group(group);
+	for (int lane = 0; lane < LOCKSTEP_LANES; lane++) {
+		init_job_geometry(worker->runner->manifest, &group->memory[lane], &group->io[lane]); // Idle lanes too, lane 0 sets it for all
+	}
+	for (int lane = 0; lane < count; lane++) {
+		jobs[lane]->worker = worker->index;
+		if (load_job_inputs(jobs[lane], &group->memory[lane], &group->disk[lane], &group->irq2[lane])) {
+			Monitor *monitor = worker->monitors ? &worker->monitors[lane] : NULL;
+			if (!worker->runner->manifest->monitor || start_job_monitor(worker->runner->manifest, jobs[lane], monitor, &group->io[lane])) {
+				lanes |= 1u << lane;
+			}
+		}
+	}
+
+	run_lockstep_group(group, worker->runner->threaded->program, lanes);
+
+	for (int lane = 0; lane < count; lane++) {
+		if (lanes & (1u << lane)) {
+			Monitor *monitor = worker->monitors ? &worker->monitors[lane] : NULL;
+			jobs[lane]->cycles = group->cycle[lane];
+			get_lane_registers(group, lane, &worker->registers);
+			if (monitor && monitor->capture && !finish_monitor_capture(monitor, group->io[lane].IORegister[8])) {
+				printf("Error: Could not write the monitor capture of %s\n", jobs[lane]->output_dir);
+			}
+			else {
+				write_job_outputs(jobs[lane], worker->runner->manifest->dump_mode, &group->memory[lane], &group->disk[lane], monitor, &worker->registers, start);
+			}
+		}
+		free_irq2_data(&group->irq2[lane]);
+	}
+}
+
+// Take the next job: newest from the own queue, otherwise the oldest from another worker
+static int take_job(BatchWorker *worker) {
+	BatchRunner *runner = worker->runner;
+	int job = -1;
+
+	mutex_lock(&worker->lock);
+	if (worker->bottom > worker->top) {
+		job = --worker->bottom;
+	}
+	mutex_unlock(&worker->lock);
+
+	for (int i = 1; job < 0 && i < runner->worker_count; i++) {
+		BatchWorker *victim = &runner->workers[(worker->index + i) % runner->worker_count];
+		mutex_lock(&victim->lock);
+		if (victim->bottom > victim->top) {
+			job = victim->top++;
+		}
+		mutex_unlock(&victim->lock);
+	}
+	return job;
+}
+
+// Worker thread: run jobs until every queue is empty (no jobs are added once the batch runs)
+static void worker_thread(void *argument) {
+	BatchWorker *worker = argument;
+	int job;
+
+	if (worker->group == NULL) {
+		while ((job = take_job(worker)) >= 0) {
+			run_job(worker, &worker->runner->manifest->jobs[job]);
+		}
+		return;
+	}
+
+	// Lockstep: fill the lanes of a group with the next jobs
+	while (1) {
+		BatchJob *jobs[LOCKSTEP_LANES];
+		int count = 0;
+		while (count < LOCKSTEP_LANES && (job = take_job(worker)) >= 0) {
+			jobs[count++] = &worker->runner->manifest->jobs[job];
+		}
+		if (count == 0) {
+			return;
+		}
+		run_lockstep_jobs(worker, jobs, count);
+	}
+}
+
+// Run every job of a manifest on a work-stealing thread pool
+int run_batch(const ProgramImage *image, BatchManifest *manifest, int threads, int lockstep) {
+	BatchRunner runner;
+	int failed = 0;
+
+	if (threads <= 0) {
+		threads = cpu_count();
+	}
+	if (lockstep) {
+		// Keep the lanes full: one worker per LOCKSTEP_LANES jobs at most
+		int groups = (manifest->count + LOCKSTEP_LANES - 1) / LOCKSTEP_LANES;
+		if (threads > groups) {
+			threads = (groups > 0) ? groups : 1;
+		}
+	}
+	if (threads > manifest->count) {
+		threads = (manifest->count > 0) ? manifest->count : 1;
+	}
+
+	// One immutable predecoded and threaded copy of the program for all workers
+	DecodedProgram *decoded = cache_aligned_alloc(sizeof(DecodedProgram));
+	ThreadedProgram *threaded = cache_aligned_alloc(sizeof(ThreadedProgram));
+	BatchWorker *workers = calloc((size_t)threads, sizeof(BatchWorker));
+	if (!decoded || !threaded || !workers) {
+		printf("Error: Memory allocation failed while starting the batch\n");
+		cache_aligned_free(decoded);
+		cache_aligned_free(threaded);
+		free(workers);
+		return manifest->count;
+	}
+	predecode_program(image, decoded);
+	prepare_threaded_program(decoded, threaded);
+
+	runner.threaded = threaded;
+	runner.manifest = manifest;
+	runner.workers = workers;
+	runner.worker_count = threads;
+
+	// Deal the jobs out in contiguous ranges
+	for (int i = 0; i < threads; i++) {
+		BatchWorker *worker = &workers[i];
+		worker->runner = &runner;
+		worker->index = i;
+		worker->top = (int)((int64_t)manifest->count * i / threads);
+		worker->bottom = (int)((int64_t)manifest->count * (i + 1) / threads);
+		mutex_init(&worker->lock);
+		if (lockstep) {
+			worker->group = malloc(sizeof(LockstepGroup));
+			if (!worker->group) {
+				printf("Error: Memory allocation failed for lockstep worker %d, it runs single jobs\n", i);
+			}
+		}
+		if (manifest->monitor) {
+			worker->monitors = malloc(LOCKSTEP_LANES * sizeof(Monitor));
+			if (!worker->monitors) {
+				printf("Error: Memory allocation failed for the monitors of batch worker %d, its jobs fail\n", i);
+			}
+		}
+		init_block_cache(&worker->cache);
+		init_jit(&worker->jit);
+	}
+	for (int i = 0; i < manifest->count; i++) {
+		manifest->jobs[i].status = BATCH_JOB_PENDING;
+	}
+
+	// The calling thread works as worker 0
+	int started = 1;
+	for (int i = 1; i < threads; i++) {
+		if (!thread_start(&workers[i].thread, worker_thread, &workers[i])) {
+			printf("Error: Could not start batch worker thread %d\n", i);
+			break;
+		}
+		started++;
+	}
+	worker_thread(&workers[0]);
+	for (int i = 1; i < started; i++) {
+		thread_join(&workers[i].thread);
+	}
+
+	for (int i = 0; i < threads; i++) {
+		free_jit(&workers[i].jit);
+		free_block_cache(&workers[i].cache);
+		free(workers[i].group);
+		free(workers[i].monitors);
+		mutex_destroy(&workers[i].lock);
+	}
+	for (int i = 0; i < manifest->count; i++) {
+		if (manifest->jobs[i].status != BATCH_JOB_DONE) {
+			failed++;
+		}
+	}
+
+	free(workers);
+	cache_aligned_free(threaded);
+	cache_aligned_free(decoded);
+	return failed;
+}
+
+// Print the per-job results and the batch totals
+void print_batch_summary(const BatchManifest *manifest, double total_ms) {
+	uint64_t total_cycles = 0;
+	double busy_ms = 0;
+	int failed = 0;
+
+	printf("%-6s %-6s %14s %12s  %s\n", "job", "worker", "cycles", "wall_ms", "output");
+	for (int i = 0; i < manifest->count; i++) {
+		const BatchJob *job = &manifest->jobs[i];
+		if (job->status != BATCH_JOB_DONE) {
+			printf("%-6d %-6d %14s %12s  %s\n", i, job->worker, "failed", "-", job->output_dir);
+			failed++;
+			continue;
+		}
+		printf("%-6d %-6d %14llu %12.3f  %s\n", i, job->worker, (unsigned long long)job->cycles, job->wall_ms, job->output_dir);
+		total_cycles += job->cycles;
+		busy_ms += job->wall_ms;
+	}
+
+	printf("%d jobs, %d failed, %llu cycles in %.3f ms (%.3f ms of job time)\n", manifest->count, failed,
+		(unsigned long long)total_cycles, total_ms, busy_ms);
+}
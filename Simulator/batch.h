@@ -0,0 +1,80 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <stdint.h>
+#include "memory.h" // For the shared program image
+
+// Longest path accepted in a batch manifest
+#define BATCH_PATH_MAX 1024
+
+// Outcome of a batch job
+typedef enum {
+	BATCH_JOB_PENDING,
+	BATCH_JOB_DONE,
+	BATCH_JOB_FAILED
+} BatchJobStatus;
+
+// One input set of a batch, and its results
+typedef struct {
+	char dmem_file[BATCH_PATH_MAX];
+	char disk_file[BATCH_PATH_MAX];
+	char irq2_file[BATCH_PATH_MAX];
+	char output_dir[BATCH_PATH_MAX];
+	int status;        // BatchJobStatus
+	uint64_t cycles;   // Cycles until halt
+	double wall_ms;    // Wall time of the run, loading and writing included
+	int worker;        // Worker thread that ran the job
+} BatchJob;
+
+// The jobs listed in a manifest
+typedef struct {
+	BatchJob *jobs;
+	int count;
+	int capacity;
+	DumpMode dump_mode; // Format of dmemout.txt and diskout.txt, DUMP_FULL by default
+	MemoryGeometry geometry; // Memory sizes and out-of-range policy of every job, checked by the caller
+	int monitor;             // 1 to give every job a monitor, written to monitor.txt and monitor.yuv
+	uint32_t capture_period; // Cycles per frame of monitor.cap, 0 for no capture (needs monitor)
+} BatchManifest;
+
+
+// Function declaration
+
+/*
+-Functionality: Loads a batch manifest. Each line holds "dmemin diskin irq2in output_dir", separated
+ by whitespace; blank lines and lines starting with '#' are skipped.
+-return 1 on success, 0 if the file could not be opened or a line is malformed.
+-parameter1: filename - Name of the manifest file.
+-parameter2: manifest - Pointer to the BatchManifest structure to fill.
+*/
+int load_batch_manifest(const char *filename, BatchManifest *manifest);
+
+/*
+-Functionality: Frees the jobs of a manifest.
+-parameter1: manifest - Pointer to the BatchManifest structure.
+*/
+void free_batch_manifest(BatchManifest *manifest);
+
+/*
+-Functionality: Runs every job of a manifest on a work-stealing thread pool. All workers share one
+ predecoded copy of the program, each job gets its own registers, data memory, IO, disk and IRQ2
+ state. Each output directory receives dmemout.txt, regout.txt, cycles.txt, diskout.txt and summary.txt,
+ plus monitor.txt, monitor.yuv and monitor.cap if the manifest asks for them; the memory, disk and
+ monitor dumps are written in parallel in the dump_mode of the manifest.
+-return The number of failed jobs, a job stopped by MEMORY_TRAP counts as failed.
+-parameter1: image - Pointer to the loaded ProgramImage.
+-parameter2: manifest - Pointer to the BatchManifest, the job results are filled in.
+-parameter3: threads - Number of worker threads, 0 for one per processor.
+-parameter4: lockstep - 1 to run the jobs of each worker LOCKSTEP_LANES at a time as the lanes of a
+ lockstep group (parameter sweeps of one program), 0 to run them one by one.
+*/
+int run_batch(const ProgramImage *image, BatchManifest *manifest, int threads, int lockstep);
+
+/*
+-Functionality: Prints the per-job cycles and wall time and the batch totals.
+-parameter1: manifest - Pointer to the BatchManifest after run_batch.
+-parameter2: total_ms - Wall time of the whole batch.
+*/
+void print_batch_summary(const BatchManifest *manifest, double total_ms);
+
+#endif
@@ -0,0 +1,570 @@
+#define _CRT_SECURE_NO_WARNINGS
+#include "block_cache.h"
+#include "instruction_fetch.h"
+#include "idle.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+// Initialize an empty block cache
+void init_block_cache(BlockCache *cache) {
+	memset(cache->map, 0, sizeof(cache->map));
+	cache->block_count = 0;
+	cache->pc_mask = INSTRUCTION_MEM_DEPTH - 1;
+	cache->ops = NULL;
+	cache->op_count = 0;
+	cache->op_capacity = 0;
+	cache->failed = 0;
+}
+
+// Free the micro-op pool
+void free_block_cache(BlockCache *cache) {
+	if (cache->ops != NULL) {
+		free(cache->ops);
+	}
+	init_block_cache(cache);
+}
+
+// Match the cache to the instruction depth of a run
+void set_block_cache_pc_mask(BlockCache *cache, uint16_t pc_mask) {
+	if (cache->pc_mask != pc_mask) {
+		free_block_cache(cache); // Blocks were cut at the old last PC
+		cache->pc_mask = pc_mask;
+	}
+}
+
+// Check whether a handler ends a block
+static int is_block_terminator(uint8_t handler) {
+	return (handler >= FAST_BEQ && handler <= FAST_JAL) || handler == FAST_JUMP ||
+		handler == FAST_RETI || handler == FAST_IN || handler == FAST_IN_DISCARD ||
+		handler == FAST_OUT || handler == FAST_HALT || handler == FAST_INVALID;
+}
+
+// Build a micro-op from a threaded instruction
+static MicroOp make_micro_op(const ThreadedInstruction *instruction, uint8_t offset) {
+	MicroOp op;
+	op.handler = instruction->handler;
+	op.rd = instruction->rd;
+	op.rs = instruction->rs;
+	op.rt = instruction->rt;
+	op.rm = instruction->rm;
+	op.opcode = instruction->opcode;
+	op.offset = offset;
+	op.reserved = 0;
+	op.imm1 = instruction->imm1;
+	op.imm2 = instruction->imm2;
+	return op;
+}
+
+// Append a micro-op to the pool, growing it as needed, returns 0 if the pool could not grow
+static int push_micro_op(BlockCache *cache, MicroOp op) {
+	if (cache->op_count >= cache->op_capacity) {
+		int capacity = (cache->op_capacity == 0) ? 1024 : cache->op_capacity * 2;
+		MicroOp *ops = realloc(cache->ops, capacity * sizeof(MicroOp));
+		if (!ops) {
+			printf("Error: Memory allocation failed while translating a block\n");
+			return 0;
+		}
+		cache->ops = ops;
+		cache->op_capacity = capacity;
+	}
+	cache->ops[cache->op_count++] = op;
+	return 1;
+}
+
+// Translate the block starting at a PC, NULL if the micro-op pool could not grow
+static Block *translate_block(BlockCache *cache, const ThreadedProgram *threaded, uint16_t start_pc) {
+	Block *block = &cache->blocks[cache->block_count++];
+	uint16_t address = start_pc;
+
+	block->start_pc = start_pc;
+	block->cycles = 0;
+	block->op_count = 0;
+	block->terminated = 0;
+	block->quiet = 1;
+	block->first_op = cache->op_count;
+	block->taken = NULL;
+	block->taken_pc = 0;
+	block->not_taken = NULL;
+	block->native_code = NULL;
+	block->native_ops = 0;
+	block->hits = 0;
+
+	while (1) {
+		const ThreadedInstruction *instruction = &threaded->code[address];
+		block->cycles++;
+
+		if (instruction->handler == FAST_SW || instruction->handler == FAST_OUT ||
+			instruction->handler == FAST_RETI || instruction->handler == FAST_INVALID) {
+			block->quiet = 0;
+		}
+
+		// Writes to $zero/$imm1/$imm2 have no effect, only their cycle is kept
+		if (instruction->handler != FAST_NOP) {
+			if (!push_micro_op(cache, make_micro_op(instruction, (uint8_t)(block->cycles - 1)))) {
+				goto failed;
+			}
+			block->op_count++;
+		}
+
+		if (is_block_terminator(instruction->handler)) {
+			block->terminated = 1;
+			break;
+		}
+		if (address == cache->pc_mask || block->cycles == BLOCK_MAX_LENGTH) {
+			break;
+		}
+		address++;
+	}
+
+	// The run loop leaves a block without a terminator through a fall-through micro-op
+	if (!block->terminated) {
+		MicroOp fall_through;
+		memset(&fall_through, 0, sizeof(fall_through));
+		fall_through.handler = BLOCK_FALL_THROUGH;
+		fall_through.offset = (uint8_t)(block->cycles - 1);
+		if (!push_micro_op(cache, fall_through)) {
+			goto failed;
+		}
+	}
+
+	block->end_pc = address;
+	cache->map[start_pc] = block;
+	return block;
+
+failed:
+	// Drop the partial block, the run stops before it
+	cache->op_count = block->first_op;
+	cache->block_count--;
+	cache->failed = 1;
+	return NULL;
+}
+
+// Return the block starting at a PC
+Block *lookup_block(BlockCache *cache, const ThreadedProgram *threaded, uint16_t pc) {
+	Block *block = cache->map[pc];
+	if (block == NULL) {
+		block = translate_block(cache, threaded, pc);
+	}
+	return block;
+}
+
+// Advance the PC by one, increment_pc reports the overflow
+#define ADVANCE_PC(pc, pc_mask) do { if (*(pc) < (pc_mask)) { (*(pc))++; } else { increment_pc(pc, pc_mask); } } while (0)
+
+// Execute a straight-line micro-op (no control flow, no IO)
+static void execute_body_op(const MicroOp *op, uint32_t *regs, Memory *memory) {
+	uint32_t address;
+
+	regs[REG_IMM1] = op->imm1;
+	regs[REG_IMM2] = op->imm2;
+
+	switch (op->handler) {
+	case FAST_ADD: regs[op->rd] = regs[op->rs] + regs[op->rt] + regs[op->rm]; break;
+	case FAST_SUB: regs[op->rd] = regs[op->rs] - regs[op->rt] - regs[op->rm]; break;
+	case FAST_MAC: regs[op->rd] = (regs[op->rs] * regs[op->rt]) + regs[op->rm]; break;
+	case FAST_AND: regs[op->rd] = regs[op->rs] & regs[op->rt] & regs[op->rm]; break;
+	case FAST_OR:  regs[op->rd] = regs[op->rs] | regs[op->rt] | regs[op->rm]; break;
+	case FAST_XOR: regs[op->rd] = regs[op->rs] ^ regs[op->rt] ^ regs[op->rm]; break;
+	case FAST_SLL: regs[op->rd] = regs[op->rs] << regs[op->rt]; break;
+	case FAST_SRA: regs[op->rd] = (uint32_t)((int32_t)regs[op->rs] >> regs[op->rt]); break;
+	case FAST_SRL: regs[op->rd] = regs[op->rs] >> regs[op->rt]; break;
+
+	case FAST_LW:
+		address = regs[op->rs] + regs[op->rt];
+		regs[op->rd] = ((address <= memory->mask) ? memory->data[address] : read_data_out_of_range(memory, address)) + regs[op->rm];
+		break;
+
+	case FAST_LW_DISCARD:
+		address = regs[op->rs] + regs[op->rt];
+		if (address > memory->mask) {
+			read_data_out_of_range(memory, address); // Reports the invalid address
+		}
+		break;
+
+	case FAST_SW:
+		address = regs[op->rs] + regs[op->rt];
+		if (address <= memory->mask) {
+			memory->data[address] = regs[op->rm] + regs[op->rd];
+			mark_data_dirty(memory, address);
+		}
+		else {
+			write_data_out_of_range(memory, address, regs[op->rm] + regs[op->rd]);
+		}
+		break;
+
+	default:
+		break;
+	}
+}
+
+// Execute any micro-op including control flow and IO, returns 1 on halt
+static int execute_micro_op(const MicroOp *op, uint32_t *regs, Memory *memory, IORegisters *io, Disk *disk, Scheduler *scheduler, uint16_t *pc, int *isr) {
+	uint16_t pc_mask = io_pc_mask(io);
+	uint32_t rs, rt, rm;
+
+	switch (op->handler) {
+	case FAST_BEQ: case FAST_BNE: case FAST_BLT: case FAST_BGT: case FAST_BLE: case FAST_BGE: {
+		int taken = 0;
+		regs[REG_IMM1] = op->imm1;
+		regs[REG_IMM2] = op->imm2;
+		rs = regs[op->rs];
+		rt = regs[op->rt];
+		switch (op->handler) {
+		case FAST_BEQ: taken = (rs == rt); break;
+		case FAST_BNE: taken = (rs != rt); break;
+		case FAST_BLT: taken = ((int32_t)rs < (int32_t)rt); break;
+		case FAST_BGT: taken = ((int32_t)rs > (int32_t)rt); break;
+		case FAST_BLE: taken = ((int32_t)rs <= (int32_t)rt); break;
+		default:       taken = ((int32_t)rs >= (int32_t)rt); break;
+		}
+		if (taken) {
+			*pc = regs[op->rm] & pc_mask;
+		}
+		else {
+			ADVANCE_PC(pc, pc_mask);
+		}
+		return 0;
+	}
+
+	case FAST_JAL:
+	case FAST_JUMP:
+		regs[REG_IMM1] = op->imm1;
+		regs[REG_IMM2] = op->imm2;
+		rm = regs[op->rm];
+		if (op->handler == FAST_JAL) {
+			regs[op->rd] = *pc + 1; // Save return address
+		}
+		*pc = rm & pc_mask;
+		return 0;
+
+	case FAST_RETI:
+		regs[REG_IMM1] = op->imm1;
+		regs[REG_IMM2] = op->imm2;
+		sync_io_registers(scheduler, io, disk); // The irqreturn read may be traced
+		*pc = (uint16_t)io_read(io, IO_IRQ_RETURN);
+		*isr = 0;
+		request_cycle_check(scheduler); // A pending interrupt is taken on the next cycle
+		return 0;
+
+	case FAST_IN:
+	case FAST_IN_DISCARD:
+		regs[REG_IMM1] = op->imm1;
+		regs[REG_IMM2] = op->imm2;
+		sync_io_registers(scheduler, io, disk);
+		rs = io_read(io, (int)(regs[op->rs] + regs[op->rt]));
+		if (op->handler == FAST_IN) {
+			regs[op->rd] = rs;
+		}
+		ADVANCE_PC(pc, pc_mask);
+		return 0;
+
+	case FAST_OUT: {
+		int reg_index;
+		regs[REG_IMM1] = op->imm1;
+		regs[REG_IMM2] = op->imm2;
+		reg_index = (int)(regs[op->rs] + regs[op->rt]);
+		sync_io_registers(scheduler, io, disk);
+		io_write(io, reg_index, regs[op->rm]);
+		scheduler_io_written(scheduler, io, reg_index);
+		ADVANCE_PC(pc, pc_mask);
+		return 0;
+	}
+
+	case FAST_HALT:
+		regs[REG_IMM1] = op->imm1;
+		regs[REG_IMM2] = op->imm2;
+		return 1;
+
+	case FAST_INVALID:
+		regs[REG_IMM1] = op->imm1;
+		regs[REG_IMM2] = op->imm2;
+		printf("Error: Unsupported opcode %d\n", op->opcode);
+		return 0;
+
+	default:
+		execute_body_op(op, regs, memory);
+		ADVANCE_PC(pc, pc_mask);
+		return 0;
+	}
+}
+
+// Follow the chained successor of a block, linking it on first use
+Block *chain_successor(BlockCache *cache, const ThreadedProgram *threaded, Block *block, uint16_t pc) {
+	if (pc == block->end_pc + 1) {
+		if (block->not_taken == NULL) {
+			block->not_taken = lookup_block(cache, threaded, pc);
+		}
+		return block->not_taken;
+	}
+	if (block->taken == NULL || block->taken_pc != pc) {
+		block->taken = lookup_block(cache, threaded, pc);
+		block->taken_pc = pc;
+	}
+	return block->taken;
+}
+
+// Execute a single instruction from the threaded program
+int execute_single_instruction(const ThreadedProgram *threaded, uint32_t *regs, Memory *memory, IORegisters *io, Disk *disk, Scheduler *scheduler, uint16_t *pc, int *isr) {
+	MicroOp op = make_micro_op(&threaded->code[*pc], 0);
+	return execute_micro_op(&op, regs, memory, io, disk, scheduler, pc, isr);
+}
+
+// Execute the instructions of a block before an event
+void execute_block_prefix(const BlockCache *cache, const Block *block, uint32_t cycles, uint32_t *regs, Memory *memory, uint16_t *pc) {
+	const MicroOp *ops = &cache->ops[block->first_op];
+
+	for (int i = 0; i < block->op_count && ops[i].offset < cycles; i++) {
+		execute_body_op(&ops[i], regs, memory);
+	}
+	*pc = (uint16_t)(block->start_pc + cycles);
+}
+
+#define RS regs[op->rs]
+#define RT regs[op->rt]
+#define RM regs[op->rm]
+#define RD regs[op->rd]
+
+// Run the micro-op at op: load its IMM registers, then jump to its handler
+#ifdef SIM_DISPATCH_COMPUTED_GOTO
+#define HANDLER(kind) L_##kind:
+#define DISPATCH() do { regs[REG_IMM1] = op->imm1; regs[REG_IMM2] = op->imm2; goto *labels[op->handler]; } while (0)
+#else
+#define HANDLER(kind) case kind:
+#define DISPATCH() goto dispatch
+#endif
+#define NEXT() do { op++; DISPATCH(); } while (0)
+
+// Leave the block with its terminator at end_pc, falling through to the next PC
+#define FALL_THROUGH() do { pc = block->end_pc; ADVANCE_PC(&pc, pc_mask); } while (0)
+
+// Enter the block, through enter_native when there is a compiler
+#define ENTER_BLOCK() do { \
+	if (compiler != NULL) { \
+		goto enter_native; \
+	} \
+	op = &cache->ops[block->first_op]; \
+	DISPATCH(); \
+} while (0)
+
+// Enter the chained successor at the PC if it ends before the next event, otherwise go back to the
+// per-cycle handling of next_block. A PC that did not move forward may close an idle loop.
+#define END_BLOCK() do { \
+	if (pc <= block->end_pc && idle_check_due(&idle)) { \
+		idle_scheduled_back_edge(&idle, regs, pc, isr, memory, io, disk, &scheduler, deadline); \
+	} \
+	block = chain_successor(cache, threaded, block, pc); \
+	if (block == NULL) { \
+		goto halted; \
+	} \
+	if (scheduler.cycle + block->cycles >= deadline) { \
+		goto next_block; \
+	} \
+	scheduler.cycle += block->cycles; \
+	ENTER_BLOCK(); \
+} while (0)
+
+// Run the program block by block until halt
+uint64_t run_block_engine(BlockCache *cache, const ThreadedProgram *threaded, BlockCompiler compiler, void *context, Registers *registers, Memory *memory, IORegisters *io, Disk *disk, IRQ2Data *irq2, uint16_t *pc_ptr, int *in_isr) {
+	uint32_t *regs = registers->regs;
+	uint16_t pc = *pc_ptr;
+	const uint16_t pc_mask = io_pc_mask(io);
+	int isr = *in_isr;
+	Block *block = NULL;
+	const MicroOp *op;
+	Scheduler scheduler;
+	uint64_t deadline;
+	uint32_t address;
+	uint32_t next_pc;
+	int stepping = (memory->policy == MEMORY_TRAP); // A trap must stop right after its instruction
+	IdleDetector idle;
+
+	init_scheduler(&scheduler, io, disk, irq2);
+	set_block_cache_pc_mask(cache, pc_mask);
+	deadline = next_event_cycle(&scheduler);
+	init_idle_detector(&idle, !stepping && io->trace == NULL && io->breakpoints == NULL); // Skipped accesses are not traced
+
+#ifdef SIM_DISPATCH_COMPUTED_GOTO
+	static const void *const labels[FAST_HANDLER_COUNT + 1] = {
+		&&L_FAST_ADD, &&L_FAST_SUB, &&L_FAST_MAC, &&L_FAST_AND, &&L_FAST_OR, &&L_FAST_XOR,
+		&&L_FAST_SLL, &&L_FAST_SRA, &&L_FAST_SRL,
+		&&L_FAST_BEQ, &&L_FAST_BNE, &&L_FAST_BLT, &&L_FAST_BGT, &&L_FAST_BLE, &&L_FAST_BGE, &&L_FAST_JAL,
+		&&L_FAST_LW, &&L_FAST_SW, &&L_FAST_RETI, &&L_FAST_IN, &&L_FAST_OUT, &&L_FAST_HALT,
+		&&L_FAST_NOP, &&L_FAST_JUMP, &&L_FAST_LW_DISCARD, &&L_FAST_IN_DISCARD, &&L_FAST_INVALID,
+		&&L_BLOCK_FALL_THROUGH
+	};
+#endif
+
+next_block:
+	// The first cycle of the block, with the per-cycle handling if an event is due
+	if (++scheduler.cycle >= deadline) {
+		run_due_cycle(&scheduler, memory, io, disk, irq2, &pc, &isr);
+		deadline = next_event_cycle(&scheduler);
+		idle_wake(&idle);
+	}
+
+	if (block == NULL || block->start_pc != pc) {
+		block = lookup_block(cache, threaded, pc);
+		if (block == NULL) {
+			goto halted;
+		}
+	}
+
+	if (stepping) {
+		if (execute_single_instruction(threaded, regs, memory, io, disk, &scheduler, &pc, &isr) || memory->faulted) {
+			goto halted;
+		}
+		deadline = next_event_cycle(&scheduler);
+		block = NULL;
+		goto next_block;
+	}
+
+	// An event inside the block, or an interrupt pending from this cycle, would change
+	// the timing: run the instructions before it, the block after it is looked up anew
+	if (scheduler.cycle + block->cycles > deadline) {
+		uint32_t cycles = (uint32_t)(deadline - scheduler.cycle);
+		execute_block_prefix(cache, block, cycles, regs, memory, &pc);
+		scheduler.cycle += cycles - 1u;
+		block = NULL;
+		goto next_block;
+	}
+
+	// Run the block and its chained successors while they end before the next event. out and
+	// reti schedule a check on the next cycle, which ends the chain.
+	scheduler.cycle += block->cycles - 1u;
+	ENTER_BLOCK();
+
+	// Run the native code of a compiled block, compiling it once it is hot
+enter_native:
+	idle.clean &= block->quiet; // The sw of the native code do not clear it themselves
+	if (block->native_code == NULL) {
+		if (block->hits < BLOCK_HOT_THRESHOLD && ++block->hits == BLOCK_HOT_THRESHOLD) {
+			compiler(context, cache, block);
+		}
+		if (block->native_code == NULL) {
+			op = &cache->ops[block->first_op];
+			DISPATCH();
+		}
+	}
+	next_pc = ((NativeBlockFunction)block->native_code)(regs, memory->data, memory);
+	if (block->native_ops < block->op_count) {
+		op = &cache->ops[block->first_op + block->native_ops];
+		DISPATCH();
+	}
+	pc = (uint16_t)next_pc;
+	END_BLOCK();
+
+#ifndef SIM_DISPATCH_COMPUTED_GOTO
+dispatch:
+	regs[REG_IMM1] = op->imm1;
+	regs[REG_IMM2] = op->imm2;
+	switch (op->handler) {
+#endif
+
+	// Block body
+
+	HANDLER(FAST_ADD) RD = RS + RT + RM; NEXT();
+	HANDLER(FAST_SUB) RD = RS - RT - RM; NEXT();
+	HANDLER(FAST_MAC) RD = (RS * RT) + RM; NEXT();
+	HANDLER(FAST_AND) RD = RS & RT & RM; NEXT();
+	HANDLER(FAST_OR)  RD = RS | RT | RM; NEXT();
+	HANDLER(FAST_XOR) RD = RS ^ RT ^ RM; NEXT();
+	HANDLER(FAST_SLL) RD = RS << RT; NEXT();
+	HANDLER(FAST_SRA) RD = (uint32_t)((int32_t)RS >> RT); NEXT();
+	HANDLER(FAST_SRL) RD = RS >> RT; NEXT();
+	HANDLER(FAST_NOP) NEXT();
+
+	HANDLER(FAST_LW)
+		address = RS + RT;
+		RD = ((address <= memory->mask) ? memory->data[address] : read_data_out_of_range(memory, address)) + RM;
+		NEXT();
+
+	HANDLER(FAST_LW_DISCARD)
+		address = RS + RT;
+		if (address > memory->mask) {
+			read_data_out_of_range(memory, address); // Reports the invalid address
+		}
+		NEXT();
+
+	HANDLER(FAST_SW)
+		address = RS + RT;
+		idle.clean = 0;
+		if (address <= memory->mask) {
+			memory->data[address] = RM + RD;
+			mark_data_dirty(memory, address);
+		}
+		else {
+			write_data_out_of_range(memory, address, RM + RD);
+		}
+		NEXT();
+
+	// Block terminators
+
+	HANDLER(FAST_BEQ) if (RS == RT) { pc = RM & pc_mask; } else { FALL_THROUGH(); } END_BLOCK();
+	HANDLER(FAST_BNE) if (RS != RT) { pc = RM & pc_mask; } else { FALL_THROUGH(); } END_BLOCK();
+	HANDLER(FAST_BLT) if ((int32_t)RS < (int32_t)RT) { pc = RM & pc_mask; } else { FALL_THROUGH(); } END_BLOCK();
+	HANDLER(FAST_BGT) if ((int32_t)RS > (int32_t)RT) { pc = RM & pc_mask; } else { FALL_THROUGH(); } END_BLOCK();
+	HANDLER(FAST_BLE) if ((int32_t)RS <= (int32_t)RT) { pc = RM & pc_mask; } else { FALL_THROUGH(); } END_BLOCK();
+	HANDLER(FAST_BGE) if ((int32_t)RS >= (int32_t)RT) { pc = RM & pc_mask; } else { FALL_THROUGH(); } END_BLOCK();
+	HANDLER(FAST_JAL) { uint32_t target = RM & pc_mask; RD = block->end_pc + 1; pc = (uint16_t)target; } END_BLOCK();
+	HANDLER(FAST_JUMP) pc = RM & pc_mask; END_BLOCK();
+	HANDLER(BLOCK_FALL_THROUGH) FALL_THROUGH(); END_BLOCK();
+
+	HANDLER(FAST_RETI)
+		sync_io_registers(&scheduler, io, disk); // The irqreturn read may be traced
+		pc = (uint16_t)io_read(io, IO_IRQ_RETURN);
+		isr = 0;
+		request_cycle_check(&scheduler); // A pending interrupt is taken on the next cycle
+		deadline = next_event_cycle(&scheduler);
+		idle.clean = 0;
+		END_BLOCK();
+
+	HANDLER(FAST_IN) {
+		sync_io_registers(&scheduler, io, disk);
+		uint32_t value = io_read(io, (int)(RS + RT));
+		if (!idle_quiet_in(io, RS + RT)) {
+			idle.clean = 0;
+		}
+		idle_wake(&idle);
+		RD = value;
+		FALL_THROUGH();
+	} END_BLOCK();
+
+	HANDLER(FAST_IN_DISCARD)
+		sync_io_registers(&scheduler, io, disk); // The access may be traced
+		io_read(io, (int)(RS + RT));
+		if (!idle_quiet_in(io, RS + RT)) {
+			idle.clean = 0;
+		}
+		idle_wake(&idle);
+		FALL_THROUGH();
+		END_BLOCK();
+
+	HANDLER(FAST_OUT) {
+		int reg_index = (int)(RS + RT);
+		sync_io_registers(&scheduler, io, disk);
+		io_write(io, reg_index, RM);
+		scheduler_io_written(&scheduler, io, reg_index);
+		deadline = next_event_cycle(&scheduler);
+		idle.clean = 0;
+		FALL_THROUGH();
+	} END_BLOCK();
+
+	HANDLER(FAST_INVALID) printf("Error: Unsupported opcode %d\n", op->opcode); idle.clean = 0; pc = block->end_pc; END_BLOCK();
+
+	HANDLER(FAST_HALT) pc = block->end_pc; goto halted;
+
+#ifndef SIM_DISPATCH_COMPUTED_GOTO
+	default:
+		pc = block->end_pc;
+		goto halted;
+	}
+#endif
+
+halted:
+	sync_io_registers(&scheduler, io, disk);
+	*pc_ptr = pc;
+	*in_isr = isr;
+	return scheduler.cycle;
+}
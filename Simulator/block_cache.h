@@ -0,0 +1,166 @@
+#ifndef BLOCK_CACHE_H
+#define BLOCK_CACHE_H
+
+#include <stdint.h>
+#include "registers.h"      // For the register file
+#include "memory.h"         // For memory-related instructions
+#include "io.h"             // To access and modify the io registers
+#include "disk.h"           // For the disk timer
+#include "interrupts.h"     // For the IRQ2 events and interrupt handling
+#include "fast_execution.h" // For the threaded program and handler kinds
+#include "scheduler.h"      // For the peripheral events
+
+// Maximum number of instructions (cycles) in a single block
+#define BLOCK_MAX_LENGTH 64
+
+// Number of executions after which a block is handed to the BlockCompiler of the run
+#define BLOCK_HOT_THRESHOLD 16
+
+// Handler kind of the micro-op stored after a block that has no terminator, it falls through
+// to the next PC. It is not counted in the op_count of the block.
+#define BLOCK_FALL_THROUGH FAST_HANDLER_COUNT
+
+// One micro-op of a translated block (16 bytes)
+typedef struct {
+	uint8_t handler;  // FastHandler kind
+	uint8_t rd;
+	uint8_t rs;
+	uint8_t rt;
+	uint8_t rm;
+	uint8_t opcode;   // Original opcode (for error reporting)
+	uint8_t offset;   // Index of its instruction within the block
+	uint8_t reserved;
+	uint32_t imm1;    // Sign-extended
+	uint32_t imm2;    // Sign-extended
+} MicroOp;
+
+// A basic block: straight-line instructions up to a branch, jal, reti, in, out or halt
+typedef struct Block {
+	uint16_t start_pc;        // PC of the first instruction
+	uint16_t end_pc;          // PC of the last instruction
+	uint16_t cycles;          // Number of instructions, one cycle each
+	uint16_t op_count;        // Number of micro-ops (dropped writes removed)
+	int terminated;           // 1 if the last micro-op is a control/IO terminator
+	int quiet;                // 1 if it has no sw, out, reti or invalid instruction (idle.h)
+	uint32_t first_op;        // Index of the first micro-op in the cache pool
+	struct Block *taken;      // Chained successor for a branch or jump
+	uint16_t taken_pc;        // Target PC the taken link was made for
+	struct Block *not_taken;  // Chained fall-through successor (end_pc + 1)
+	void *native_code;        // Compiled native code (JIT), a NativeBlockFunction, NULL while interpreted
+	uint16_t native_ops;      // Micro-ops the native code runs, the terminator after them is interpreted
+	uint32_t hits;            // Executions counted towards BLOCK_HOT_THRESHOLD
+} Block;
+
+// Translation cache keyed by the start PC
+typedef struct {
+	Block *map[INSTRUCTION_MEM_MAX];      // Block starting at each PC, NULL until translated
+	Block blocks[INSTRUCTION_MEM_MAX];    // At most one block per start PC
+	int block_count;
+	MicroOp *ops;                         // Micro-op pool shared by all blocks
+	int op_count;
+	int op_capacity;
+	uint16_t pc_mask;                     // Last PC of the instruction depth, blocks end there
+	int failed;                           // 1 once a block could not be translated (out of memory), the run stopped before it
+} BlockCache;
+
+// Native code of a block: runs its first native_ops micro-ops and returns the next PC (ignored
+// when the terminator is left to the interpreter)
+typedef uint32_t (*NativeBlockFunction)(uint32_t *regs, uint32_t *data, Memory *memory);
+
+// Compiles a hot block (the JIT backend): sets native_code and native_ops, or leaves native_code
+// NULL for a block that stays interpreted
+typedef void (*BlockCompiler)(void *context, const BlockCache *cache, Block *block);
+
+
+// Function declaration
+
+/*
+-Functionality: Initializes an empty block cache.
+-parameter1: cache - Pointer to the BlockCache structure.
+*/
+void init_block_cache(BlockCache *cache);
+
+/*
+-Functionality: Frees the micro-op pool of a block cache.
+-parameter1: cache - Pointer to the BlockCache structure.
+*/
+void free_block_cache(BlockCache *cache);
+
+/*
+-Functionality: Matches the cache to the instruction depth of a run, flushing it when the depth changed.
+-parameter1: cache - Pointer to the BlockCache structure.
+-parameter2: pc_mask - The PC mask of the run (io_pc_mask).
+*/
+void set_block_cache_pc_mask(BlockCache *cache, uint16_t pc_mask);
+
+/*
+-Functionality: Returns the block starting at a PC, translating it on first use.
+-return A pointer to the translated block, NULL if it could not be translated (cache->failed is set).
+-parameter1: cache - Pointer to the BlockCache structure.
+-parameter2: threaded - Pointer to the prepared ThreadedProgram.
+-parameter3: pc - The start PC of the block.
+*/
+Block *lookup_block(BlockCache *cache, const ThreadedProgram *threaded, uint16_t pc);
+
+/*
+-Functionality: Returns the successor of a block for the PC it exited with, linking the
+ taken or fall-through chain on first use.
+-return A pointer to the successor block, NULL if it could not be translated (cache->failed is set).
+-parameter1: cache - Pointer to the BlockCache structure.
+-parameter2: threaded - Pointer to the prepared ThreadedProgram.
+-parameter3: block - Pointer to the block that just executed.
+-parameter4: pc - The PC the block exited with.
+*/
+Block *chain_successor(BlockCache *cache, const ThreadedProgram *threaded, Block *block, uint16_t pc);
+
+/*
+-Functionality: Executes the first instructions of a block, all of them before its terminator
+ (no per-cycle handling), and leaves the PC after them.
+-parameter1: cache - Pointer to the BlockCache structure.
+-parameter2: block - The block.
+-parameter3: cycles - Number of instructions to execute, less than block->cycles.
+-parameter4: regs - The register file.
+-parameter5: memory - Pointer to the Memory structure.
+-parameter6: pc - Pointer to the Program counter.
+*/
+void execute_block_prefix(const BlockCache *cache, const Block *block, uint32_t cycles, uint32_t *regs, Memory *memory, uint16_t *pc);
+
+/*
+-Functionality: Executes the single instruction at the PC (no per-cycle handling).
+-return 1 if the instruction is halt, 0 otherwise.
+-parameter1: threaded - Pointer to the prepared ThreadedProgram.
+-parameter2: regs - The register file.
+-parameter3: memory - Pointer to the Memory structure.
+-parameter4: io - Pointer to the IORegisters structure.
+-parameter5: disk - Pointer to the Disk structure.
+-parameter6: scheduler - Pointer to the Scheduler, synced before in/out.
+-parameter7: pc - Pointer to the Program counter.
+-parameter8: isr - Pointer to the flag the indicates if the code is in the ISR.
+*/
+int execute_single_instruction(const ThreadedProgram *threaded, uint32_t *regs, Memory *memory, IORegisters *io, Disk *disk, Scheduler *scheduler, uint16_t *pc, int *isr);
+
+/*
+-Functionality: Runs the program block by block until a halt instruction, with the same
+ per-cycle interrupt timing as simulator_main_loop. Chained blocks run without per-cycle
+ handling up to the next scheduled event, and a block the event falls in runs up to it. The
+ micro-ops are dispatched like run_fast_engine, each terminator enters the chained successor
+ directly. With a compiler, blocks that reach BLOCK_HOT_THRESHOLD executions are compiled and
+ their native code runs in place of the micro-ops. Under MEMORY_TRAP every instruction is stepped
+ on its own, so a trapped access stops the run right after it. A block that cannot be translated
+ stops the run before it with cache->failed set.
+-parameter1: cache - Pointer to the BlockCache structure.
+-parameter2: threaded - Pointer to the prepared ThreadedProgram.
+-parameter3: compiler - The BlockCompiler of hot blocks, NULL to interpret every block.
+-parameter4: context - Passed to the compiler.
+-parameter5: registers - Pointer to the Registers structure.
+-parameter6: memory - Pointer to the Memory structure.
+-parameter7: io - Pointer to the IORegisters structure.
+-parameter8: disk - Pointer to the Disk structure.
+-parameter9: irq2 - Pointer to the IRQ2Data structure.
+-parameter10: pc - Pointer to the Program counter, left at the halt instruction.
+-parameter11: in_isr - Pointer to the flag the indicates if the code is in the ISR.
+-return The number of cycles executed, including the halt cycle.
+*/
+uint64_t run_block_engine(BlockCache *cache, const ThreadedProgram *threaded, BlockCompiler compiler, void *context, Registers *registers, Memory *memory, IORegisters *io, Disk *disk, IRQ2Data *irq2, uint16_t *pc, int *in_isr);
+
+#endif
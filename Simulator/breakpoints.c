@@ -0,0 +1,168 @@
+#define _CRT_SECURE_NO_WARNINGS
+#include "breakpoints.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Initialize an empty set of points
+void init_breakpoints(Breakpoints *breakpoints, DecodedProgram *program) {
+	memset(breakpoints, 0, sizeof(*breakpoints));
+	breakpoints->program = program;
+	breakpoints->next_id = 1;
+}
+
+// Rebuild the program marks and the watched bitmaps from the points
+static void update_marks(Breakpoints *breakpoints) {
+	for (int pc = 0; pc < INSTRUCTION_MEM_MAX; pc++) {
+		breakpoints->program->entries[pc].breakpoint = 0;
+	}
+	memset(breakpoints->watched, 0, sizeof(breakpoints->watched));
+	breakpoints->watched_io = 0;
+
+	for (int i = 0; i < breakpoints->count; i++) {
+		const Breakpoint *point = &breakpoints->points[i];
+		uint32_t block = point->address >> DATA_BLOCK_SHIFT;
+		switch (point->kind) {
+		case BREAK_PC:
+			breakpoints->program->entries[point->address].breakpoint = 1;
+			break;
+		case BREAK_DATA:
+			breakpoints->watched[block >> 6] |= (uint64_t)1 << (block & 63);
+			break;
+		case BREAK_IO:
+			breakpoints->watched_io |= 1u << point->address;
+			break;
+		}
+	}
+}
+
+// Remove every point
+void free_breakpoints(Breakpoints *breakpoints) {
+	breakpoints->count = 0;
+	update_marks(breakpoints);
+	free(breakpoints->points);
+	breakpoints->points = NULL;
+	breakpoints->capacity = 0;
+}
+
+// Add a point
+int add_breakpoint(Breakpoints *breakpoints, const Breakpoint *point, uint16_t pc_mask) {
+	if ((point->kind == BREAK_PC && point->address > pc_mask) ||
+		(point->kind == BREAK_DATA && point->address >= DATA_MEM_MAX) ||
+		(point->kind == BREAK_IO && point->address >= NUM_IO_REGISTERS)) {
+		printf("Error: Invalid %s address %u\n", (point->kind == BREAK_PC) ? "breakpoint" : "watchpoint", point->address);
+		return 0;
+	}
+	if (breakpoints->count == breakpoints->capacity) {
+		int capacity = (breakpoints->capacity == 0) ? 16 : breakpoints->capacity * 2;
+		Breakpoint *points = realloc(breakpoints->points, capacity * sizeof(Breakpoint));
+		if (!points) {
+			printf("Error: Memory allocation failed for a breakpoint\n");
+			return 0;
+		}
+		breakpoints->points = points;
+		breakpoints->capacity = capacity;
+	}
+
+	Breakpoint *added = &breakpoints->points[breakpoints->count++];
+	*added = *point;
+	added->id = breakpoints->next_id++;
+	added->hits = 0;
+	update_marks(breakpoints);
+	return added->id;
+}
+
+// Remove a point
+int remove_breakpoint(Breakpoints *breakpoints, int id) {
+	for (int i = 0; i < breakpoints->count; i++) {
+		if (breakpoints->points[i].id == id) {
+			memmove(&breakpoints->points[i], &breakpoints->points[i + 1], (breakpoints->count - i - 1) * sizeof(Breakpoint));
+			breakpoints->count--;
+			update_marks(breakpoints);
+			return 1;
+		}
+	}
+	return 0;
+}
+
+// Find a point
+Breakpoint *find_breakpoint(Breakpoints *breakpoints, int id) {
+	for (int i = 0; i < breakpoints->count; i++) {
+		if (breakpoints->points[i].id == id) {
+			return &breakpoints->points[i];
+		}
+	}
+	return NULL;
+}
+
+// Arm the points on a machine
+void attach_breakpoints(Breakpoints *breakpoints, Machine *machine) {
+	machine->breakpoints = breakpoints;
+	machine->memory->watched = breakpoints->watched;
+	machine->memory->breakpoints = breakpoints;
+	machine->io.breakpoints = breakpoints;
+}
+
+// Disarm the points of a machine
+void detach_breakpoints(Machine *machine) {
+	machine->breakpoints = NULL;
+	machine->memory->watched = NULL;
+	machine->memory->breakpoints = NULL;
+	machine->io.breakpoints = NULL;
+}
+
+// Count a hit of a point, returns 1 if it stops the machine
+static int count_hit(Breakpoints *breakpoints, Breakpoint *point, int access, uint32_t value, uint32_t previous) {
+	point->hits++;
+	if (point->hits <= point->ignore || breakpoints->hit != 0) {
+		return 0;
+	}
+	breakpoints->hit = point->id;
+	breakpoints->hit_access = access;
+	breakpoints->hit_value = value;
+	breakpoints->hit_previous = previous;
+	return 1;
+}
+
+// Count the hits of the PC breakpoints at an address
+int hit_pc_breakpoints(Breakpoints *breakpoints, uint16_t pc) {
+	int stop = 0;
+
+	for (int i = 0; i < breakpoints->count; i++) {
+		Breakpoint *point = &breakpoints->points[i];
+		if (point->kind == BREAK_PC && point->address == pc) {
+			stop |= count_hit(breakpoints, point, 0, pc, pc);
+		}
+	}
+	return stop;
+}
+
+// Count the hits of the watchpoints of a kind at an address
+static void hit_watchpoints(Breakpoints *breakpoints, BreakKind kind, uint32_t address, uint32_t value, uint32_t previous,
+	int access) {
+	for (int i = 0; i < breakpoints->count; i++) {
+		Breakpoint *point = &breakpoints->points[i];
+		if (point->kind != kind || point->address != address || !(point->access & access)) {
+			continue;
+		}
+		if ((point->condition == BREAK_EQUALS && value != point->value) ||
+			(point->condition == BREAK_CHANGED && (access != WATCH_WRITE || value == previous))) {
+			continue;
+		}
+		count_hit(breakpoints, point, access, value, previous);
+	}
+}
+
+// An access to a watched data memory block
+void watch_data_access(Memory *memory, uint32_t address, uint32_t value, int access) {
+	if (memory->breakpoints != NULL) {
+		hit_watchpoints(memory->breakpoints, BREAK_DATA, address, value, memory->data[address], access);
+	}
+}
+
+// An in or out
+void watch_io_access(const IORegisters *io, int reg_index, uint32_t value, uint32_t previous, int access) {
+	if ((io->breakpoints->watched_io >> reg_index) & 1) {
+		hit_watchpoints(io->breakpoints, BREAK_IO, (uint32_t)reg_index, value, previous, access);
+	}
+}
@@ -0,0 +1,141 @@
+#ifndef BREAKPOINTS_H
+#define BREAKPOINTS_H
+
+#include <stdint.h>
+#include "machine.h"
+
+/*
+ Breakpoints and watchpoints of the reference loop.
+
+ A PC breakpoint marks the entry of its instruction in the DecodedProgram. After every instruction
+ run_machine looks at the mark of the next one, so no PC is compared on the way; a marked entry
+ stops the machine before the cycle that fetches it. An interrupt taken in that cycle still runs
+ first, so a breakpoint at the handler entry only stops fetches that are not taken by an interrupt.
+
+ A watchpoint sets the bit of its data memory block (DATA_BLOCK_WORDS words) in a bitmap that
+ read_data and write_data test, or the bit of its IO register, tested by io_read and io_write. Only
+ the accesses of lw, sw, in, out and reti are watched, not the DMA of the disk. The machine stops
+ after the instruction that hit it.
+
+ Both count the hits that meet their condition and stop once the hits exceed their ignore count.
+*/
+
+// What a point watches
+typedef enum {
+	BREAK_PC = 0,      // Fetch of an instruction
+	BREAK_DATA = 1,    // Data memory word
+	BREAK_IO = 2       // IO register
+} BreakKind;
+
+// When a hit counts
+typedef enum {
+	BREAK_ALWAYS = 0,
+	BREAK_EQUALS = 1,  // The value read or written equals value
+	BREAK_CHANGED = 2  // A write changes the value
+} BreakCondition;
+
+// One breakpoint or watchpoint
+typedef struct {
+	int id;                   // Set by add_breakpoint
+	BreakKind kind;
+	uint32_t address;         // PC, data memory address or IO register
+	int access;               // WATCH_READ | WATCH_WRITE, for a watchpoint
+	BreakCondition condition; // For a watchpoint
+	uint32_t value;           // For BREAK_EQUALS
+	uint64_t ignore;          // Hits let through before the point stops the machine
+	uint64_t hits;            // Hits that met the condition
+} Breakpoint;
+
+// The points of one machine and the last stop
+typedef struct Breakpoints {
+	Breakpoint *points;
+	int count;
+	int capacity;
+	int next_id;
+	DecodedProgram *program;                    // Marked at the PC breakpoints
+	uint64_t watched[(DATA_BLOCKS + 63) / 64];  // Data memory blocks holding a watchpoint
+	uint32_t watched_io;                        // IO registers holding a watchpoint, one bit each
+
+	// Set by the hit that stops run_machine, cleared when run_machine starts
+	int hit;                  // Id of the point, 0 if none
+	int hit_access;           // WATCH_READ or WATCH_WRITE, 0 for a PC breakpoint
+	uint32_t hit_value;       // Value read or written
+	uint32_t hit_previous;    // Value before a write
+} Breakpoints;
+
+
+// Function declarations
+
+/*
+-Functionality: Initializes an empty set of points for a program.
+-parameter1: breakpoints - Pointer to the Breakpoints structure.
+-parameter2: program - Pointer to the DecodedProgram run with them, marked while they are set.
+*/
+void init_breakpoints(Breakpoints *breakpoints, DecodedProgram *program);
+
+/*
+-Functionality: Removes every point, clearing the marks of the program.
+-parameter1: breakpoints - Pointer to the Breakpoints structure.
+*/
+void free_breakpoints(Breakpoints *breakpoints);
+
+/*
+-Functionality: Adds a point.
+-return Its id, 0 if the address is invalid or memory could not be allocated.
+-parameter1: breakpoints - Pointer to the Breakpoints structure.
+-parameter2: point - The point, its id and hits are set here.
+-parameter3: pc_mask - io_pc_mask of the machine, a PC breakpoint must be within it.
+*/
+int add_breakpoint(Breakpoints *breakpoints, const Breakpoint *point, uint16_t pc_mask);
+
+/*
+-Functionality: Removes a point.
+-return 1 on success, 0 if there is no point with the id.
+-parameter1: breakpoints - Pointer to the Breakpoints structure.
+-parameter2: id - Id of the point.
+*/
+int remove_breakpoint(Breakpoints *breakpoints, int id);
+
+/*
+-Functionality: Finds a point.
+-return Pointer to the point, NULL if there is no point with the id.
+-parameter1: breakpoints - Pointer to the Breakpoints structure.
+-parameter2: id - Id of the point.
+*/
+Breakpoint *find_breakpoint(Breakpoints *breakpoints, int id);
+
+/*
+-Functionality: Arms the points on a machine: run_machine stops at them (and no longer fast-forwards
+ idle loops). They stay armed when a snapshot is restored into the machine.
+-parameter1: breakpoints - Pointer to the Breakpoints structure.
+-parameter2: machine - Pointer to the Machine structure.
+*/
+void attach_breakpoints(Breakpoints *breakpoints, Machine *machine);
+
+/*
+-Functionality: Disarms the points of a machine, e.g. while a seek runs through its history.
+-parameter1: machine - Pointer to the Machine structure.
+*/
+void detach_breakpoints(Machine *machine);
+
+/*
+-Functionality: Counts a hit of the PC breakpoints at an address (called for a marked entry).
+-return 1 if one of them stops the machine, 0 otherwise.
+-parameter1: breakpoints - Pointer to the Breakpoints structure.
+-parameter2: pc - The PC about to be fetched.
+*/
+int hit_pc_breakpoints(Breakpoints *breakpoints, uint16_t pc);
+
+/*
+-Functionality: Called by run_machine after every instruction: checks for a watchpoint hit by it,
+ or a breakpoint on the next instruction.
+-return 1 to stop the machine, 0 otherwise.
+-parameter1: breakpoints - Pointer to the Breakpoints structure.
+-parameter2: program - Pointer to the DecodedProgram.
+-parameter3: pc - The next PC.
+*/
+static inline int breakpoint_stop(Breakpoints *breakpoints, const DecodedProgram *program, uint16_t pc) {
+	return breakpoints->hit != 0 || (program->entries[pc].breakpoint && hit_pc_breakpoints(breakpoints, pc));
+}
+
+#endif
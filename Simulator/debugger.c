@@ -0,0 +1,241 @@
+#define _CRT_SECURE_NO_WARNINGS
+#include "debugger.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define DEBUGGER_LINE_MAX 256
+#define DEBUGGER_ARGS_MAX 8
+
+// Print where the machine is
+static void print_position(const Machine *machine) {
+	printf("cycle %llu pc %0*X%s%s\n", (unsigned long long)machine->cycles, pc_hex_digits(io_pc_mask(&machine->io)), machine->pc,
+		machine->in_isr ? " (isr)" : "", machine->halted ? " halted" : "");
+}
+
+// Print the registers
+static void print_registers(const Machine *machine) {
+	print_position(machine);
+	for (int i = 0; i < NUM_REGISTERS; i++) {
+		printf("R%-2d %08X%s", i, machine->registers.regs[i], (i % 4 == 3) ? "\n" : "  ");
+	}
+}
+
+// Print data memory words
+static void print_memory(const Machine *machine, uint32_t address, uint32_t count) {
+	for (uint32_t i = 0; i < count && address + i <= machine->memory->mask; i++) {
+		printf("%05X: %08X\n", address + i, machine->memory->data[address + i]);
+	}
+}
+
+// Print the IO registers
+static void print_io(const Machine *machine) {
+	for (int i = 0; i < NUM_IO_REGISTERS; i++) {
+		printf("IO%-2d %08X%s", i, machine->io.IORegister[i], (i % 4 == 3 || i == NUM_IO_REGISTERS - 1) ? "\n" : "  ");
+	}
+}
+
+// Print the checkpoints and undo log
+static void print_timeline(const Timeline *timeline, const Machine *machine) {
+	printf("%d checkpoints every %llu cycles, %zu of %zu bytes\n", timeline->count,
+		(unsigned long long)timeline->spacing, timeline->bytes, timeline->budget);
+	printf("undo log: %llu cycles back (to cycle %llu), %zu of %zu entries\n", (unsigned long long)timeline->frames,
+		(unsigned long long)(machine->cycles - timeline->frames), timeline->undo_used, timeline->undo_capacity);
+}
+
+// Print one breakpoint or watchpoint
+static void print_point(const Breakpoint *point, int pc_digits) {
+	static const char *const access_names[] = { "", "read", "write", "access" };
+
+	if (point->kind == BREAK_PC) {
+		printf("%d: break at pc %0*X", point->id, pc_digits, point->address);
+	}
+	else {
+		printf("%d: watch %s %s%s%X", point->id, access_names[point->access & 3],
+			(point->kind == BREAK_IO) ? "io " : "", (point->kind == BREAK_IO) ? "" : "address ", point->address);
+		if (point->condition == BREAK_EQUALS) {
+			printf(" equals %08X", point->value);
+		}
+		else if (point->condition == BREAK_CHANGED) {
+			printf(" changed");
+		}
+	}
+	if (point->ignore != 0) {
+		printf(" after %llu", (unsigned long long)point->ignore);
+	}
+	printf(", %llu hits\n", (unsigned long long)point->hits);
+}
+
+// Print what stopped a run
+static void print_stop(Breakpoints *breakpoints, int pc_digits) {
+	const Breakpoint *point = find_breakpoint(breakpoints, breakpoints->hit);
+
+	if (point == NULL) {
+		return;
+	}
+	if (point->kind == BREAK_PC) {
+		printf("Breakpoint %d at pc %0*X, hit %llu times\n", point->id, pc_digits, point->address, (unsigned long long)point->hits);
+	}
+	else if (breakpoints->hit_access == WATCH_WRITE) {
+		printf("Watchpoint %d: %s %X written %08X (was %08X)\n", point->id, (point->kind == BREAK_IO) ? "io" : "address",
+			point->address, breakpoints->hit_value, breakpoints->hit_previous);
+	}
+	else {
+		printf("Watchpoint %d: %s %X read %08X\n", point->id, (point->kind == BREAK_IO) ? "io" : "address",
+			point->address, breakpoints->hit_value);
+	}
+}
+
+// Parse a number argument (decimal or 0x hex), def when it is missing
+static uint64_t parse_count(const char *arg, uint64_t def) {
+	return (arg != NULL) ? strtoull(arg, NULL, 0) : def;
+}
+
+// Parse a break or watch command into a point, returns 0 if an argument is not valid
+static int parse_point(char *args[], int count, int watch, Breakpoint *point) {
+	int i = 0;
+
+	memset(point, 0, sizeof(*point));
+	point->kind = watch ? BREAK_DATA : BREAK_PC;
+	point->access = watch ? WATCH_WRITE : 0;
+	if (watch && i < count && strcmp(args[i], "io") == 0) {
+		point->kind = BREAK_IO;
+		i++;
+	}
+	if (i == count) {
+		return 0;
+	}
+	point->address = (uint32_t)parse_count(args[i++], 0);
+
+	for (; i < count; i++) {
+		if (strncmp(args[i], "after=", 6) == 0) {
+			point->ignore = parse_count(args[i] + 6, 0);
+		}
+		else if (watch && strcmp(args[i], "read") == 0) {
+			point->access = WATCH_READ;
+		}
+		else if (watch && strcmp(args[i], "write") == 0) {
+			point->access = WATCH_WRITE;
+		}
+		else if (watch && strcmp(args[i], "access") == 0) {
+			point->access = WATCH_READ | WATCH_WRITE;
+		}
+		else if (watch && strncmp(args[i], "equals=", 7) == 0) {
+			point->condition = BREAK_EQUALS;
+			point->value = (uint32_t)parse_count(args[i] + 7, 0);
+		}
+		else if (watch && strcmp(args[i], "changed") == 0) {
+			point->condition = BREAK_CHANGED;
+		}
+		else {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+// Move to a cycle without stopping at the breakpoints on the way
+static int seek_cycle(Timeline *timeline, Machine *machine, const ProgramImage *image, const DecodedProgram *program,
+	Breakpoints *breakpoints, uint64_t cycle) {
+	detach_breakpoints(machine);
+	int ok = timeline_seek(timeline, machine, image, program, cycle);
+	attach_breakpoints(breakpoints, machine);
+	return ok;
+}
+
+// Run the debugger on a machine
+int run_debugger(Machine *machine, const ProgramImage *image, const DecodedProgram *program, Timeline *timeline,
+	Breakpoints *breakpoints, FILE *in) {
+	char line[DEBUGGER_LINE_MAX];
+	char *args[DEBUGGER_ARGS_MAX];
+	int pc_digits = pc_hex_digits(io_pc_mask(&machine->io));
+	int ok = 1;
+
+	attach_breakpoints(breakpoints, machine);
+	print_position(machine);
+	while (fgets(line, sizeof(line), in) != NULL) {
+		char *command = strtok(line, " \t\r\n");
+		int count = 0;
+		while (count < DEBUGGER_ARGS_MAX && (args[count] = strtok(NULL, " \t\r\n")) != NULL) {
+			count++;
+		}
+		char *arg1 = (count > 0) ? args[0] : NULL;
+		char *arg2 = (count > 1) ? args[1] : NULL;
+		Breakpoint point;
+
+		if (command == NULL) {
+			continue;
+		}
+		if (strcmp(command, "step") == 0 || strcmp(command, "s") == 0) {
+			breakpoints->hit = 0;
+			timeline_run(timeline, machine, image, program, parse_count(arg1, 1));
+			print_stop(breakpoints, pc_digits);
+			print_position(machine);
+		}
+		else if (strcmp(command, "back") == 0 || strcmp(command, "b") == 0) {
+			uint64_t back = parse_count(arg1, 1);
+			ok &= seek_cycle(timeline, machine, image, program, breakpoints, (back < machine->cycles) ? machine->cycles - back : 0);
+			print_position(machine);
+		}
+		else if (strcmp(command, "seek") == 0 && arg1 != NULL) {
+			ok &= seek_cycle(timeline, machine, image, program, breakpoints, parse_count(arg1, 0));
+			print_position(machine);
+		}
+		else if (strcmp(command, "continue") == 0 || strcmp(command, "c") == 0) {
+			breakpoints->hit = 0;
+			timeline_run(timeline, machine, image, program, UINT64_MAX);
+			print_stop(breakpoints, pc_digits);
+			print_position(machine);
+		}
+		else if (strcmp(command, "regs") == 0 || strcmp(command, "r") == 0) {
+			print_registers(machine);
+		}
+		else if ((strcmp(command, "mem") == 0 || strcmp(command, "x") == 0) && arg1 != NULL) {
+			print_memory(machine, (uint32_t)parse_count(arg1, 0), (uint32_t)parse_count(arg2, 1));
+		}
+		else if (strcmp(command, "io") == 0) {
+			print_io(machine);
+		}
+		else if (strcmp(command, "info") == 0) {
+			print_timeline(timeline, machine);
+		}
+		else if (strcmp(command, "break") == 0 || strcmp(command, "watch") == 0) {
+			int id = 0;
+			if (parse_point(args, count, command[0] == 'w', &point)) {
+				id = add_breakpoint(breakpoints, &point, io_pc_mask(&machine->io));
+			}
+			else {
+				printf("Error: Invalid %s command, try help\n", command);
+			}
+			if (id != 0) {
+				print_point(find_breakpoint(breakpoints, id), pc_digits);
+			}
+			ok &= id != 0;
+		}
+		else if (strcmp(command, "delete") == 0 && arg1 != NULL) {
+			if (!remove_breakpoint(breakpoints, (int)parse_count(arg1, 0))) {
+				printf("Error: No breakpoint %s\n", arg1);
+				ok = 0;
+			}
+		}
+		else if (strcmp(command, "list") == 0) {
+			for (int i = 0; i < breakpoints->count; i++) {
+				print_point(&breakpoints->points[i], pc_digits);
+			}
+		}
+		else if (strcmp(command, "help") == 0) {
+			printf("step [n], back [n], seek <cycle>, continue, regs, mem <addr> [n], io, info,\n");
+			printf("break <pc> [after=<n>], watch [io] <addr> [read|write|access] [equals=<value>|changed] [after=<n>],\n");
+			printf("delete <id>, list, quit\n");
+		}
+		else if (strcmp(command, "quit") == 0 || strcmp(command, "q") == 0) {
+			break;
+		}
+		else {
+			printf("Error: Unknown command %s, try help\n", command);
+			ok = 0;
+		}
+		fflush(stdout);
+	}
+	detach_breakpoints(machine);
+	return ok;
+}
@@ -0,0 +1,47 @@
+#ifndef DEBUGGER_H
+#define DEBUGGER_H
+
+#include <stdio.h>
+#include "machine.h"
+#include "timeline.h"
+#include "breakpoints.h"
+
+/*
+ Line commands of the debugger, a count or cycle defaults to 1:
+  step [n]          s   run n cycles forward, stopping at a breakpoint
+  back [n]          b   go n cycles back
+  seek <cycle>          go to a cycle, forward or back
+  continue          c   run until halt or a breakpoint
+  regs              r   the cycle, PC, ISR state and registers
+  mem <addr> [n]    x   n data memory words from an address
+  io                    the IO registers
+  info                  checkpoints and undo log of the timeline
+  break <pc> [after=<n>]
+                        stop before the instruction at pc, after n hits are let through
+  watch [io] <addr> [read|write|access] [equals=<value>|changed] [after=<n>]
+                        stop after an access to a data word (or an IO register), writes by default
+  delete <id>           remove a breakpoint or watchpoint
+  list                  the breakpoints and watchpoints with their hits
+  help                  this list
+  quit              q
+ Numbers are decimal or 0x hex.
+*/
+
+// Function declarations
+
+/*
+-Functionality: Runs the debugger on a machine loaded with its inputs at power-on, reading commands
+ from a stream until quit or its end. Every cycle goes through the timeline, so any cycle run so
+ far can be returned to.
+-return 1 if every command succeeded, 0 otherwise.
+-parameter1: machine - Pointer to the Machine structure.
+-parameter2: image - Pointer to the ProgramImage.
+-parameter3: program - Pointer to the DecodedProgram.
+-parameter4: timeline - Pointer to a Timeline made by init_timeline.
+-parameter5: breakpoints - Pointer to Breakpoints made by init_breakpoints for the program.
+-parameter6: in - The command stream.
+*/
+int run_debugger(Machine *machine, const ProgramImage *image, const DecodedProgram *program, Timeline *timeline,
+	Breakpoints *breakpoints, FILE *in);
+
+#endif
@@ -1,97 +1,408 @@
 #define _CRT_SECURE_NO_WARNINGS
 #include "disk.h"
+#include "image.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#if defined(__unix__) || defined(__APPLE__)
+#define SIM_DISK_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Whole-sector byte swapping with SSSE3 on x86 GCC/Clang builds, used when the host supports it
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__)) && !defined(SIM_NO_SIMD)
+#define SIM_DISK_SSSE3
+#include <tmmintrin.h>
+#endif
+
 // Initialize the disk structure
 void init_disk(Disk *disk) {
 	memset(disk->data, 0, sizeof(disk->data));
 	disk->timer = 0;
+	memset(disk->dirty, 0, sizeof(disk->dirty));
+	disk->image = NULL;
 }
 
-// Load disk content from an input file
-void load_disk(const char *filename, Disk *disk) {
-	FILE *file = fopen(filename, "r");
+// Check whether a sector was written
+static int is_sector_dirty(const Disk *disk, uint64_t sector) {
+	const uint64_t *dirty = disk->image ? disk->image->dirty : disk->dirty;
+	return (dirty[sector >> 6] >> (sector & 63)) & 1;
+}
+
+// Size of a base image file, or -1 if it cannot be opened
+static int64_t base_image_size(const char *base) {
+	FILE *file = fopen(base, "rb");
 	if (!file) {
-		printf("Error: Could not open disk input file: %s\n", filename);
-		exit(1);
-	}
-
-	char line[9]; // 8 hex digits + null terminator
-	int sector = 0, byte_index = 0;
-	while (fgets(line, sizeof(line), file)) {
-		line[strcspn(line, "\r\n")] = '\0';
-		uint8_t byte = (uint8_t)strtol(line, NULL, 16);
-		disk->data[sector][byte_index] = byte;
-		byte_index++;
-		if (byte_index == SECTOR_SIZE) {
-			byte_index = 0;
-			sector++;
-			if (sector == DISK_SECTORS) break;
+		return -1;
+	}
+	fseek(file, 0, SEEK_END);
+	int64_t size = ftell(file);
+	fclose(file);
+	return size;
+}
+
+// Map the sectors of an image: zero pages with the base file mapped copy-on-write over the front
+static uint8_t *map_image_data(DiskImage *image, const char *base, uint64_t base_size) {
+	size_t size = (size_t)(image->sectors * SECTOR_SIZE);
+	size_t base_bytes = (base_size < size) ? (size_t)base_size : size;
+
+#ifdef SIM_DISK_MMAP
+	int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+#ifdef MAP_NORESERVE
+	flags |= MAP_NORESERVE;
+#endif
+	void *data = mmap(NULL, size, PROT_READ | PROT_WRITE, flags, -1, 0);
+	if (data != MAP_FAILED) {
+		if (base_bytes > 0) {
+			int fd = open(base, O_RDONLY);
+			void *view = (fd < 0) ? MAP_FAILED :
+				mmap(data, base_bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, 0);
+			if (fd >= 0) {
+				close(fd);
+			}
+			if (view == MAP_FAILED) {
+				munmap(data, size);
+				return NULL;
+			}
 		}
+		image->size = size;
+		return data;
+	}
+#endif
+
+	// No mmap: the whole image on the heap
+	uint8_t *heap = calloc(1, size);
+	if (heap && base_bytes > 0) {
+		FILE *file = fopen(base, "rb");
+		if (!file || fread(heap, 1, base_bytes, file) != base_bytes) {
+			free(heap);
+			heap = NULL;
+		}
+		if (file) {
+			fclose(file);
+		}
+	}
+	image->size = 0;
+	return heap;
+}
+
+// Attach a runtime-sized disk image backed by a raw base file
+int open_disk_image(Disk *disk, const char *base, uint64_t sectors) {
+	int64_t base_size = 0;
+
+	if (base != NULL) {
+		base_size = base_image_size(base);
+		if (base_size < 0) {
+			printf("Error: Could not open disk image: %s\n", base);
+			return 0;
+		}
+	}
+	if (sectors == 0) {
+		sectors = ((uint64_t)base_size + SECTOR_SIZE - 1) / SECTOR_SIZE;
+	}
+	if (sectors == 0 || sectors > (uint64_t)SIZE_MAX / SECTOR_SIZE ||
+		sectors > ((uint64_t)1 << (32 + DISK_SECTOR_LOW_BITS))) {
+		printf("Error: Invalid disk image size of %llu sectors\n", (unsigned long long)sectors);
+		return 0;
+	}
+
+	DiskImage *image = calloc(1, sizeof(DiskImage));
+	if (!image) {
+		printf("Error: Memory allocation failed for the disk image\n");
+		return 0;
+	}
+	image->sectors = sectors;
+	image->dirty = calloc((size_t)((sectors + 63) / 64), sizeof(uint64_t));
+	image->data = image->dirty ? map_image_data(image, base, (uint64_t)base_size) : NULL;
+	if (!image->data) {
+		printf("Error: Could not map a disk image of %llu sectors\n", (unsigned long long)sectors);
+		free(image->dirty);
+		free(image);
+		return 0;
+	}
+
+	close_disk_image(disk);
+	disk->image = image;
+	return 1;
+}
+
+// Detach and release the image of a disk
+void close_disk_image(Disk *disk) {
+	DiskImage *image = disk->image;
+	if (image == NULL) {
+		return;
+	}
+#ifdef SIM_DISK_MMAP
+	if (image->size > 0) {
+		munmap(image->data, image->size);
+	}
+	else
+#endif
+	{
+		free(image->data);
+	}
+	free(image->dirty);
+	free(image);
+	disk->image = NULL;
+}
+
+// Little-endian 64-bit field helpers for the delta format
+static void store_le64(uint8_t *bytes, uint64_t value) {
+	for (int i = 0; i < 8; i++) {
+		bytes[i] = (uint8_t)(value >> (8 * i));
+	}
+}
+
+static uint64_t load_le64(const uint8_t *bytes) {
+	uint64_t value = 0;
+	for (int i = 7; i >= 0; i--) {
+		value = (value << 8) | bytes[i];
+	}
+	return value;
+}
+
+// Write the modified sectors as a delta file
+int write_disk_delta(const Disk *disk, const char *filename) {
+	uint64_t sectors = disk_sector_count(disk);
+	uint64_t count = 0;
+	uint8_t header[24];
+	int ok;
+
+	for (uint64_t sector = 0; sector < sectors; sector++) {
+		count += (uint64_t)is_sector_dirty(disk, sector);
+	}
+
+	FILE *file = fopen(filename, "wb");
+	if (!file) {
+		return 0;
+	}
+	memcpy(header, DISK_DELTA_MAGIC, 4);
+	header[4] = DISK_DELTA_VERSION & 0xFF;
+	header[5] = DISK_DELTA_VERSION >> 8;
+	header[6] = 0;
+	header[7] = 0;
+	store_le64(header + 8, sectors);
+	store_le64(header + 16, count);
+	ok = fwrite(header, 1, sizeof(header), file) == sizeof(header);
+
+	for (uint64_t sector = 0; sector < sectors && ok; sector++) {
+		if (is_sector_dirty(disk, sector)) {
+			uint8_t index[8];
+			store_le64(index, sector);
+			ok = fwrite(index, 1, 8, file) == 8 && fwrite(disk_sector(disk, sector), 1, SECTOR_SIZE, file) == SECTOR_SIZE;
+		}
+	}
+
+	if (fclose(file) != 0) {
+		ok = 0;
+	}
+	return ok;
+}
+
+// Apply a delta file to a disk
+int apply_disk_delta(Disk *disk, const char *filename) {
+	MappedFile file;
+	int ok = 1;
+
+	if (!map_file(filename, &file)) {
+		return 0;
+	}
+	if (file.size < 24 || memcmp(file.data, DISK_DELTA_MAGIC, 4) != 0 ||
+		(file.data[4] | (file.data[5] << 8)) != DISK_DELTA_VERSION) {
+		unmap_file(&file);
+		return 0;
+	}
+
+	uint64_t count = load_le64(file.data + 16);
+	if (count > (file.size - 24) / (8 + SECTOR_SIZE)) {
+		unmap_file(&file);
+		return 0;
+	}
+	const uint8_t *entry = file.data + 24;
+	for (uint64_t i = 0; i < count && ok; i++, entry += 8 + SECTOR_SIZE) {
+		uint64_t sector = load_le64(entry);
+		if (sector >= disk_sector_count(disk)) {
+			ok = 0;
+			break;
+		}
+		memcpy(disk_sector(disk, sector), entry + 8, SECTOR_SIZE);
+		mark_sector_dirty(disk, sector);
+	}
+
+	unmap_file(&file);
+	return ok;
+}
+
+// Write the whole disk as a raw image
+int write_disk_image(const Disk *disk, const char *filename) {
+	const uint8_t *data = disk_sector(disk, 0);
+	uint64_t size = disk_sector_count(disk) * SECTOR_SIZE;
+	uint64_t done = 0;
+	int ok = 1;
+
+	FILE *file = fopen(filename, "wb");
+	if (!file) {
+		return 0;
+	}
+	while (done < size && ok) {
+		size_t chunk = (size - done < ((size_t)1 << 20)) ? (size_t)(size - done) : ((size_t)1 << 20);
+		ok = fwrite(data + done, 1, chunk, file) == chunk;
+		done += chunk;
+	}
+	if (fclose(file) != 0) {
+		ok = 0;
+	}
+	return ok;
+}
+
+// Load disk content from an input file
+int load_disk(const char *filename, Disk *disk) {
+	int count = load_image(filename, IMAGE_DISK, disk->data);
+	if (count == IMAGE_ERROR_OPEN) {
+		printf("Error: Could not open disk input file: %s\n", filename);
+		return 0;
+	}
+	if (count < 0) {
+		printf("Error: Invalid disk image: %s\n", filename);
+		return 0;
 	}
 
-	fclose(file);
 	printf("Disk loaded from %s\n", filename);
+	return 1;
 }
 
 // Write disk content to an output file
-void write_disk(const char *filename, const Disk *disk) {
-	FILE *file = fopen(filename, "w");
-	if (!file) {
+void write_disk(const char *filename, const Disk *disk, DumpMode mode) {
+	if (disk->image != NULL) {
+		printf("Error: The disk image of %llu sectors is not written as text, save it as a delta or raw image\n",
+			(unsigned long long)disk->image->sectors);
+		return;
+	}
+	if (!write_text_dump(filename, IMAGE_DISK, disk->data, DISK_SECTORS, mode, disk->dirty)) {
 		printf("Error: Could not open disk output file: %s\n", filename);
 		return;
 	}
 
-	for (int sector = 0; sector < DISK_SECTORS; sector++) {
-		for (int byte = 0; byte < SECTOR_SIZE; byte++) {
-			fprintf(file, "%02X\n", disk->data[sector][byte]);
-		}
+	printf("Disk written to %s\n", filename);
+}
+
+#ifdef SIM_DISK_SSSE3
+// Reverse the bytes of each 32-bit word, four words at a time, returns the number of words done
+__attribute__((target("ssse3")))
+static int swap_word_bytes_ssse3(void *out, const void *in, int count) {
+	const __m128i swap = _mm_set_epi8(12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3);
+	int i = 0;
+	for (; i + 4 <= count; i += 4) {
+		__m128i chunk = _mm_loadu_si128((const __m128i *)((const uint8_t *)in + i * 4));
+		_mm_storeu_si128((__m128i *)((uint8_t *)out + i * 4), _mm_shuffle_epi8(chunk, swap));
 	}
+	return i;
+}
+#endif
 
-	fclose(file);
-	printf("Disk written to %s\n", filename);
+// Convert big-endian sector bytes to memory words
+static void sector_bytes_to_words(uint32_t *words, const uint8_t *bytes, int count) {
+	int i = 0;
+#ifdef SIM_DISK_SSSE3
+	if (__builtin_cpu_supports("ssse3")) {
+		i = swap_word_bytes_ssse3(words, bytes, count);
+	}
+#endif
+	for (; i < count; i++) {
+		const uint8_t *b = bytes + i * 4;
+		words[i] = ((uint32_t)b[0] << 24) | ((uint32_t)b[1] << 16) | ((uint32_t)b[2] << 8) | (uint32_t)b[3];
+	}
 }
 
-// Read a sector from the disk into memory
-void read_sector(Memory *memory, const IORegisters *io, const Disk *disk) {
-	int sector = io->IORegister[15];
-	int buffer = io->IORegister[16];
+// Convert memory words to big-endian sector bytes
+static void sector_words_to_bytes(uint8_t *bytes, const uint32_t *words, int count) {
+	int i = 0;
+#ifdef SIM_DISK_SSSE3
+	if (__builtin_cpu_supports("ssse3")) {
+		i = swap_word_bytes_ssse3(bytes, words, count);
+	}
+#endif
+	for (; i < count; i++) {
+		uint8_t *b = bytes + i * 4;
+		b[0] = (uint8_t)(words[i] >> 24);
+		b[1] = (uint8_t)(words[i] >> 16);
+		b[2] = (uint8_t)(words[i] >> 8);
+		b[3] = (uint8_t)words[i];
+	}
+}
 
-	if (sector < 0 || sector >= DISK_SECTORS) {
-		printf("Error: Invalid sector number %d\n", sector);
-		return;
+// Validate a sector and the DMA buffer range once
+int check_dma_request(const IORegisters *io, const Disk *disk, uint32_t depth, uint64_t *sector, int *buffer, int *first, int *count) {
+	*sector = ((uint64_t)io->IORegister[DISK_SECTOR_HIGH_REGISTER] << DISK_SECTOR_LOW_BITS) | io->IORegister[IO_DISK_SECTOR];
+	*buffer = io->IORegister[IO_DISK_BUFFER];
+
+	if (*sector >= disk_sector_count(disk)) {
+		printf("Error: Invalid sector number %llu\n", (unsigned long long)*sector);
+		return 0;
 	}
 
-	for (int i = 0; i < SECTOR_SIZE; i++) {
-		uint32_t word = read_data(memory, buffer + (i / 4)); 	// Read the 32-bit word from memory
-		word &= ~(0xFF << ((3 - (i % 4)) * 8));					// Clear the target byte in the word by creating a mask
-		word |= (disk->data[sector][i] << ((3 - (i % 4)) * 8));	// Insert the new byte from the disk
-		write_data(memory, buffer + (i / 4), word);				// Write the updated word back to memory
+	int64_t start = *buffer;
+	int64_t end = start + SECTOR_WORDS;
+	*first = (start < 0) ? (int)(-start) : 0;
+	*count = SECTOR_WORDS - *first;
+	if (end > (int64_t)depth) {
+		*count -= (int)(end - (int64_t)depth);
+	}
+	if (*count <= 0) {
+		*first = 0;
+		*count = 0;
+	}
+
+	if (*count != SECTOR_WORDS) {
+		printf("Error: Disk buffer %d is outside data memory, %d of %d words are not transferred\n",
+			*buffer, SECTOR_WORDS - *count, SECTOR_WORDS);
+	}
+	return 1;
+}
+
+// Read a sector from the disk into memory
+void read_sector(Memory *memory, const IORegisters *io, const Disk *disk) {
+	uint64_t sector;
+	int buffer, first, count;
+
+	if (check_dma_request(io, disk, memory->depth, &sector, &buffer, &first, &count) && count > 0) {
+		sector_bytes_to_words(&memory->data[buffer + first], disk_sector(disk, sector) + first * 4, count);
+		for (uint32_t address = (uint32_t)(buffer + first) & ~(uint32_t)(DATA_BLOCK_WORDS - 1);
+			address < (uint32_t)(buffer + first + count); address += DATA_BLOCK_WORDS) {
+			mark_data_dirty(memory, address);
+		}
 	}
 }
 
 // Write a sector from memory to the disk
 void write_sector(const Memory *memory, const IORegisters *io, Disk *disk) {
-	int sector = io->IORegister[15];
-	int buffer = io->IORegister[16];
+	uint64_t sector;
+	int buffer, first, count;
 
-	if (sector < 0 || sector >= DISK_SECTORS) {
-		printf("Error: Invalid sector number %d\n", sector);
+	if (!check_dma_request(io, disk, memory->depth, &sector, &buffer, &first, &count)) {
 		return;
 	}
 
-	for (int i = 0; i < SECTOR_SIZE; i++) {
-		uint32_t word = read_data(memory, buffer + (i / 4)); 			// Read the 32-bit word from memory
-		disk->data[sector][i] = (word >> ((3 - (i % 4)) * 8)) & 0xFF;	// Extract the relevant byte from the word 
+	uint8_t *bytes = disk_sector(disk, sector);
+	mark_sector_dirty(disk, sector);
+
+	// Words outside data memory read as zero
+	if (count != SECTOR_WORDS) {
+		memset(bytes, 0, SECTOR_SIZE);
+	}
+	if (count > 0) {
+		sector_words_to_bytes(bytes + first * 4, &memory->data[buffer + first], count);
 	}
 }
 
-// Handle disk commands and update DMA/IRQ
-void handle_disk_command(Memory *memory, IORegisters *io, Disk *disk) {
+// Advance the disk by one cycle, returns the command whose transfer starts
+int step_disk(IORegisters *io, Disk *disk) {
 	// Check if the disk is busy
-	if (io->IORegister[17] == 1) {
+	if (io->IORegister[IO_DISK_STATUS] == 1) {
 		// If the disk is busy, decrement the timer
 		if (disk->timer > 0) {
 			disk->timer--;
@@ -99,37 +410,74 @@ void handle_disk_command(Memory *memory, IORegisters *io, Disk *disk) {
 			// When the timer reaches 0, complete the operation
 			if (disk->timer == 0) {
 				// Reset diskcmd and diskstatus
-				io->IORegister[14] = 0; // Clear diskcmd
-				io->IORegister[17] = 0; // Set diskstatus to "ready"
+				io->IORegister[IO_DISK_CMD] = 0; // Clear diskcmd
+				io->IORegister[IO_DISK_STATUS] = 0; // Set diskstatus to "ready"
+				io->active &= ~IO_ACTIVE_DISK;
 
 				// Raise the interrupt to signal that the operation is complete
-				io->IORegister[4] = 1; // Set irq1status
+				io->IORegister[IO_IRQ1_STATUS] = 1; // Set irq1status
 			}
 		}
-		return; // Exit since the disk is still busy
+		return 0; // Exit since the disk is still busy
 	}
 
 	// If the disk is ready, check if a new command is issued
-	else if (io->IORegister[14] != 0) {
-		// Perform the operation specified in diskcmd
-		switch (io->IORegister[14]) {
-		case 1: // Read sector
-			read_sector(memory, io, disk); // Perform the read operation
-			break;
+	if (io->IORegister[IO_DISK_CMD] == 0) {
+		return 0;
+	}
 
-		case 2: // Write sector
-			write_sector(memory, io, disk); // Perform the write operation
-			break;
+	// Start the 1024-cycle countdown
+	disk->timer = 1024;
 
-		default:
-			break; // Ignore invalid commands
-		}
+	// Set diskstatus to "not ready"
+	io->IORegister[IO_DISK_STATUS] = 1; // Disk is busy
+	return (int)io->IORegister[IO_DISK_CMD];
+}
+
+// diskcmd or diskstatus write: a command runs, or starts on the next cycle
+void disk_written(void *device, IORegisters *io, int reg_index, uint32_t previous) {
+	(void)device;
+	(void)reg_index;
+	(void)previous;
+	if (io->IORegister[IO_DISK_STATUS] == 1 || io->IORegister[IO_DISK_CMD] != 0) {
+		io->active |= IO_ACTIVE_DISK;
+	}
+	else {
+		io->active &= ~IO_ACTIVE_DISK;
+	}
+}
 
-		// Start the 1024-cycle countdown
-		disk->timer = 1024;
+// Cycles until the disk next needs a step
+uint64_t disk_cycles_to_event(const IORegisters *io, const Disk *disk) {
+	if (!(io->active & IO_ACTIVE_DISK)) {
+		return UINT64_MAX;
+	}
+	if (io->IORegister[IO_DISK_STATUS] != 1) {
+		return 1; // The command in diskcmd starts
+	}
+	return (disk->timer > 0) ? (uint64_t)disk->timer : UINT64_MAX;
+}
 
-		// Set diskstatus to "not ready"
-		io->IORegister[17] = 1; // Disk is busy
+// Count a running disk down over quiet cycles
+void skip_disk_cycles(const IORegisters *io, Disk *disk, uint32_t cycles) {
+	if ((io->active & IO_ACTIVE_DISK) && io->IORegister[IO_DISK_STATUS] == 1 && disk->timer > 0) {
+		disk->timer -= (int)cycles;
 	}
 }
 
+// Handle disk commands and update DMA/IRQ
+void handle_disk_command(Memory *memory, IORegisters *io, Disk *disk) {
+	// Perform the operation specified in diskcmd
+	switch (step_disk(io, disk)) {
+	case 1: // Read sector
+		read_sector(memory, io, disk); // Perform the read operation
+		break;
+
+	case 2: // Write sector
+		write_sector(memory, io, disk); // Perform the write operation
+		break;
+
+	default:
+		break; // No transfer, or an invalid command
+	}
+}
@@ -6,39 +6,143 @@
 #include "io.h"
 
 // Disk constants
-#define DISK_SECTORS 128  // Number of sectors in the disk
+#define DISK_SECTORS 128  // Number of sectors in the built-in disk
 #define SECTOR_SIZE 512   // Bytes per sector
+#define SECTOR_WORDS (SECTOR_SIZE / 4) // Memory words per sector
+
+// Extended sector addressing: sector = (disksectorhigh << DISK_SECTOR_LOW_BITS) | disksector.
+// disksector (IO 15) keeps its 7 bits, disksectorhigh (IO 18) adds 32 more for large images.
+#define DISK_SECTOR_LOW_BITS 7
+#define DISK_SECTOR_HIGH_REGISTER 18
+
+/*
+ Disk delta file format (version 1), all fields little-endian:
+ -"SIMD", u16 version, u16 reserved
+ -u64 sector count of the disk, u64 number of sectors n that follow
+ -n times: u64 sector, then its SECTOR_SIZE bytes
+*/
+#define DISK_DELTA_MAGIC "SIMD"
+#define DISK_DELTA_VERSION 1
+
+// A runtime-sized disk image. On Linux it is a private copy-on-write mapping of a raw base file:
+// opening it is instant, only the sectors the guest touches are read, and writes stay in memory.
+typedef struct {
+	uint8_t *data;           // sectors * SECTOR_SIZE bytes
+	uint64_t sectors;        // Geometry, chosen when the image is opened
+	size_t size;             // Size of the mapping, 0 if data was allocated on the heap
+	uint64_t *dirty;         // One bit per sector written since the image was opened
+} DiskImage;
 
 // Disk structure
 typedef struct {
-	uint8_t data[DISK_SECTORS][SECTOR_SIZE]; // Disk sectors
+	uint8_t data[DISK_SECTORS][SECTOR_SIZE]; // Built-in disk sectors, used when no image is attached
 	int timer;                               // Timer for disk operations
+	uint64_t dirty[(DISK_SECTORS + 63) / 64]; // Built-in sectors written since the disk was loaded
+	DiskImage *image;                        // Attached runtime-sized image, NULL for the built-in disk
 } Disk;
 
+// Number of sectors of a disk
+static inline uint64_t disk_sector_count(const Disk *disk) {
+	return disk->image ? disk->image->sectors : DISK_SECTORS;
+}
+
+// First byte of a sector, which must be below disk_sector_count
+static inline uint8_t *disk_sector(const Disk *disk, uint64_t sector) {
+	return disk->image ? disk->image->data + sector * SECTOR_SIZE : (uint8_t *)disk->data[sector];
+}
+
+// Mark a sector as written
+static inline void mark_sector_dirty(Disk *disk, uint64_t sector) {
+	uint64_t *dirty = disk->image ? disk->image->dirty : disk->dirty;
+	dirty[sector >> 6] |= (uint64_t)1 << (sector & 63);
+}
+
 // Function declarations
 
 /*
--Functionality: Initializes the disk structure.
+-Functionality: Initializes the disk structure. Clears the data and the dirty sectors, and detaches
+ any image (close it with close_disk_image first).
 -parameter1: disk - Pointer to the Disk structure.
 */
 void init_disk(Disk *disk);
 
 /*
--Functionality: Load the disk content from an input file.
+-Functionality: Attaches a runtime-sized disk image backed by a raw base file (SECTOR_SIZE bytes per
+ sector). The base file is mapped copy-on-write and never modified. Sectors past the end of the base
+ file, or all sectors if base is NULL, read as zero.
+-return 1 on success, 0 if the base file could not be opened or the image could not be mapped.
+-parameter1: disk - Pointer to the Disk structure.
+-parameter2: base - Name of the raw base image, NULL for a blank disk.
+-parameter3: sectors - Number of sectors, 0 to use the size of the base file.
+*/
+int open_disk_image(Disk *disk, const char *base, uint64_t sectors);
+
+/*
+-Functionality: Detaches and releases the image of a disk. The built-in disk is left unchanged.
+-parameter1: disk - Pointer to the Disk structure.
+*/
+void close_disk_image(Disk *disk);
+
+/*
+-Functionality: Writes the sectors modified since the disk was loaded or opened as a delta file.
+-return 1 on success, 0 if the file could not be written.
+-parameter1: disk - Pointer to the Disk structure.
+-parameter2: filename - Name of the delta file.
+*/
+int write_disk_delta(const Disk *disk, const char *filename);
+
+/*
+-Functionality: Applies a delta file written by write_disk_delta. The sectors it holds are marked
+ dirty, so they are part of the next delta.
+-return 1 on success, 0 if the file could not be read, is not a delta or does not fit the disk.
+-parameter1: disk - Pointer to the Disk structure.
+-parameter2: filename - Name of the delta file.
+*/
+int apply_disk_delta(Disk *disk, const char *filename);
+
+/*
+-Functionality: Writes the whole disk, base and modified sectors merged, as a raw image.
+-return 1 on success, 0 if the file could not be written.
+-parameter1: disk - Pointer to the Disk structure.
+-parameter2: filename - Name of the raw output image.
+*/
+int write_disk_image(const Disk *disk, const char *filename);
+
+/*
+-Functionality: Load the built-in disk content from an input file. The loaded sectors are not marked dirty.
+-return 1 on success, 0 if the file could not be read or is not a valid image (the error is printed).
 -parameter1: filename - Name of the input file (diskin.txt).
 -parameter2: disk - Pointer to the Disk structure.
 */
-void load_disk(const char *filename, Disk *disk);
+int load_disk(const char *filename, Disk *disk);
 
 /*
--Functionality: Write the disk content to an output file.
+-Functionality: Write the built-in disk content to an output file. A disk with an attached image is
+ too large for the text format, save it with write_disk_delta or write_disk_image instead.
 -parameter1: filename - Name of the output file (diskout.txt).
 -parameter2: disk - Pointer to the Disk structure.
+-parameter3: mode - The DumpMode, DUMP_FULL for the complete format.
+*/
+void write_disk(const char *filename, const Disk *disk, DumpMode mode);
+
+/*
+-Functionality: Validates the sector and the buffer of a DMA transfer once, printing what is wrong.
+-return 0 for an invalid sector, otherwise 1 with the sector words [first, first + count) that map
+ inside data memory.
+-parameter1: io - Pointer to the IORegisters structure (disksector, diskbuffer, disksectorhigh).
+-parameter2: disk - Pointer to the Disk structure.
+-parameter3: depth - Depth of data memory.
+-parameter4: sector - Receives the sector.
+-parameter5: buffer - Receives the diskbuffer address.
+-parameter6: first - Receives the first sector word transferred.
+-parameter7: count - Receives the number of words transferred.
 */
-void write_disk(const char *filename, const Disk *disk);
+int check_dma_request(const IORegisters *io, const Disk *disk, uint32_t depth, uint64_t *sector, int *buffer, int *first, int *count);
 
 /*
--Functionality: Handle a read sector operation from the disk.
+-Functionality: Handle a read sector operation from the disk. The sector (extended addressing) and buffer range are
+ validated once, words of a buffer past the end of data memory are not transferred. The memory
+ blocks written are marked dirty.
 -parameter1: memory - Pointer to the Memory structure.
 -parameter2: io - Pointer to the IORegisters structure.
 -parameter3: disk - Pointer to the Disk structure.
@@ -46,13 +150,23 @@ void write_disk(const char *filename, const Disk *disk);
 void read_sector(Memory *memory, const IORegisters *io, const Disk *disk);
 
 /*
--Functionality: Handle a write sector operation to the disk.
+-Functionality: Handle a write sector operation to the disk. Words of a buffer past the end of
+ data memory are written to the disk as zero. The sector is marked dirty.
 -parameter1: memory - Pointer to the Memory structure.
 -parameter2: io - Pointer to the IORegisters structure.
 -parameter3: disk - Pointer to the Disk structure.
 */
 void write_sector(const Memory *memory, const IORegisters *io, Disk *disk);
 
+/*
+-Functionality: Advances the disk by one cycle: counts down a busy disk and completes it (irq1), or
+ starts the command in diskcmd. The caller performs the transfer of a command that starts.
+-return The command that starts this cycle (1 read, 2 write, or an invalid one to ignore), 0 if none.
+-parameter1: io - Pointer to the IORegisters structure.
+-parameter2: disk - Pointer to the Disk structure.
+*/
+int step_disk(IORegisters *io, Disk *disk);
+
 /*
 -Functionality: Handle the disk command and update DMA or IRQs as needed.
 -parameter1: memory - Pointer to the Memory structure.
@@ -61,4 +175,31 @@ void write_sector(const Memory *memory, const IORegisters *io, Disk *disk);
 */
 void handle_disk_command(Memory *memory, IORegisters *io, Disk *disk);
 
+/*
+-Functionality: Bus callback of diskcmd and diskstatus: the disk is active, and stepped every cycle,
+ while a command runs or one is waiting to start.
+-parameter1: device - Unused.
+-parameter2: io - Pointer to the IORegisters structure.
+-parameter3: reg_index - The register written.
+-parameter4: previous - Its previous value.
+*/
+void disk_written(void *device, IORegisters *io, int reg_index, uint32_t previous);
+
+/*
+-Functionality: Returns the cycles until the disk next needs a step: 1 for a command that starts,
+ the countdown of a running one.
+-return The cycles, UINT64_MAX while the disk is idle.
+-parameter1: io - Pointer to the IORegisters structure.
+-parameter2: disk - Pointer to the Disk structure.
+*/
+uint64_t disk_cycles_to_event(const IORegisters *io, const Disk *disk);
+
+/*
+-Functionality: Counts a running disk down over cycles that hold no event.
+-parameter1: io - Pointer to the IORegisters structure.
+-parameter2: disk - Pointer to the Disk structure.
+-parameter3: cycles - Number of cycles, fewer than disk_cycles_to_event.
+*/
+void skip_disk_cycles(const IORegisters *io, Disk *disk, uint32_t cycles);
+
 #endif 
@@ -10,8 +10,7 @@ void execute_instruction(const Instruction *decoded_instruction, Registers *regi
 	uint32_t rt = get_register(registers, decoded_instruction->rt);
 	uint32_t rm = get_register(registers, decoded_instruction->rm);
 	uint32_t rd = get_register(registers, decoded_instruction->rd);
-	uint32_t imm1 = get_register(registers, REG_IMM1);
-	uint32_t imm2 = get_register(registers, REG_IMM2);
+	uint16_t pc_mask = io_pc_mask(IORegister); // The PC is as wide as the instruction depth
 	uint32_t result = 0;
 
 	switch (decoded_instruction->opcode) {
@@ -21,19 +20,19 @@ void execute_instruction(const Instruction *decoded_instruction, Registers *regi
 	case 0: // add
 		result = rs + rt + rm;
 		set_register(registers, decoded_instruction->rd, result);
-		increment_pc(pc);
+		increment_pc(pc, pc_mask);
 		break;
 
 	case 1: // sub
 		result = rs - rt - rm;
 		set_register(registers, decoded_instruction->rd, result);
-		increment_pc(pc);
+		increment_pc(pc, pc_mask);
 		break;
 
 	case 2: // mac
 		result = (rs * rt) + rm;
 		set_register(registers, decoded_instruction->rd, result);
-		increment_pc(pc);
+		increment_pc(pc, pc_mask);
 		break;
 
 	// Logical Instructions
@@ -41,19 +40,19 @@ void execute_instruction(const Instruction *decoded_instruction, Registers *regi
 	case 3: // and
 		result = rs & rt & rm;
 		set_register(registers, decoded_instruction->rd, result);
-		increment_pc(pc);
+		increment_pc(pc, pc_mask);
 		break;
 
 	case 4: // or
 		result = rs | rt | rm;
 		set_register(registers, decoded_instruction->rd, result);
-		increment_pc(pc);
+		increment_pc(pc, pc_mask);
 		break;
 
 	case 5: // xor
 		result = rs ^ rt ^ rm;
 		set_register(registers, decoded_instruction->rd, result);
-		increment_pc(pc);
+		increment_pc(pc, pc_mask);
 		break;
 
 	// Shift Instructions
@@ -61,80 +60,80 @@ void execute_instruction(const Instruction *decoded_instruction, Registers *regi
 	case 6: // sll
 		result = rs << rt;
 		set_register(registers, decoded_instruction->rd, result);
-		increment_pc(pc);
+		increment_pc(pc, pc_mask);
 		break;
 
 	case 7: // sra
 		result = (int32_t)rs >> rt;
 		set_register(registers, decoded_instruction->rd, result);
-		increment_pc(pc);
+		increment_pc(pc, pc_mask);
 		break;
 
 	case 8: // srl
 		result = rs >> rt;
 		set_register(registers, decoded_instruction->rd, result);
-		increment_pc(pc);
+		increment_pc(pc, pc_mask);
 		break;
 
 	// Branch Instructions
 	
 	case 9: // beq
 		if (rs == rt) {
-			*pc = rm & 0x0FFF; // Use the lower 12 bits of R[rm]
+			*pc = rm & pc_mask; // Use the lower bits of R[rm]
 		}
 		else {
-			increment_pc(pc);
+			increment_pc(pc, pc_mask);
 		}
 		break;
 
 	case 10: // bne
 		if (rs != rt) {
-			*pc = rm & 0x0FFF;
+			*pc = rm & pc_mask;
 		}
 		else {
-			increment_pc(pc);
+			increment_pc(pc, pc_mask);
 		}
 		break;
 
 	case 11: // blt
 		if ((int32_t)rs < (int32_t)rt) {
-			*pc = rm & 0x0FFF;
+			*pc = rm & pc_mask;
 		}
 		else {
-			increment_pc(pc);
+			increment_pc(pc, pc_mask);
 		}
 		break;
 
 	case 12: // bgt
 		if ((int32_t)rs > (int32_t)rt) {
-			*pc = rm & 0x0FFF;
+			*pc = rm & pc_mask;
 		}
 		else {
-			increment_pc(pc);
+			increment_pc(pc, pc_mask);
 		}
 		break;
 
 	case 13: // ble
 		if ((int32_t)rs <= (int32_t)rt) {
-			*pc = rm & 0x0FFF;
+			*pc = rm & pc_mask;
 		}
 		else {
-			increment_pc(pc);
+			increment_pc(pc, pc_mask);
 		}
 		break;
 
 	case 14: // bge
 		if ((int32_t)rs >= (int32_t)rt) {
-			*pc = rm & 0x0FFF;
+			*pc = rm & pc_mask;
 		}
 		else {
-			increment_pc(pc);
+			increment_pc(pc, pc_mask);
 		}
 		break;
 
 	case 15: // jal
 		set_register(registers, decoded_instruction->rd, *pc + 1); // Save return address
-		*pc = rm & 0x0FFF; // Jump to the address in the lower 12 bits of R[rm]
+		*pc = rm & pc_mask; // Jump to the address in the lower bits of R[rm]
 		break;
 
 	// Memory Access Instructions
@@ -142,34 +141,34 @@ void execute_instruction(const Instruction *decoded_instruction, Registers *regi
 	case 16: // lw
 		result = read_data(memory, rs + rt) + rm;
 		set_register(registers, decoded_instruction->rd, result);
-		increment_pc(pc);
+		increment_pc(pc, pc_mask);
 		break;
 
 	case 17: // sw
 		write_data(memory, rs + rt, rm + rd);
-		increment_pc(pc);
+		increment_pc(pc, pc_mask);
 		break;
 
 	// I/O and Control Instructions
 	
 	case 18: // reti
-		*pc = io_read(IORegister, 7);
+		*pc = io_read(IORegister, IO_IRQ_RETURN);
 		*in_isr = 0;                 // Mark ISR as finished
 		break;
 
 	case 19: // in
 		result = io_read(IORegister, rs + rt); // Read from I/O register indexed by rs
 		set_register(registers, decoded_instruction->rd, result); // Write to destination register
-		increment_pc(pc);
+		increment_pc(pc, pc_mask);
 		break;
 
 	case 20: // out
 		io_write(IORegister, rs + rt, rm); // Write to I/O register
-		increment_pc(pc);
+		increment_pc(pc, pc_mask);
 		break;
 
-	case 21: // halt
-		exit(0);
+	case 21: // halt, the caller stops the machine instead of executing it
+		break;
 
 	default:
 		printf("Error: Unsupported opcode %d\n", decoded_instruction->opcode);
@@ -0,0 +1,295 @@
+#define _CRT_SECURE_NO_WARNINGS
+#include "fast_execution.h"
+#include "execution.h"
+#include "instruction_fetch.h"
+#include "idle.h"
+#include <stdio.h>
+
+
+// Check whether a register index is one of $zero, $imm1, $imm2
+static int is_protected_register(uint8_t reg_index) {
+	return reg_index == REG_ZERO || reg_index == REG_IMM1 || reg_index == REG_IMM2;
+}
+
+// Select the handler for a single predecoded instruction
+static uint8_t select_handler(const Instruction *instruction) {
+	int protected_rd = is_protected_register(instruction->rd);
+
+	if (instruction->opcode <= 8) { // Arithmetic, logical and shift
+		return protected_rd ? FAST_NOP : instruction->opcode;
+	}
+	if (instruction->opcode == 15) { // jal
+		return protected_rd ? FAST_JUMP : FAST_JAL;
+	}
+	if (instruction->opcode == 16) { // lw
+		return protected_rd ? FAST_LW_DISCARD : FAST_LW;
+	}
+	if (instruction->opcode == 19) { // in
+		return protected_rd ? FAST_IN_DISCARD : FAST_IN;
+	}
+	if (instruction->opcode <= 21) {
+		return instruction->opcode;
+	}
+	return FAST_INVALID;
+}
+
+// Translate the predecoded program into threaded code
+void prepare_threaded_program(const DecodedProgram *program, ThreadedProgram *threaded) {
+	for (int address = 0; address < INSTRUCTION_MEM_MAX; address++) {
+		const Instruction *instruction = &program->entries[address];
+		ThreadedInstruction *op = &threaded->code[address];
+
+		op->label = NULL;
+		op->handler = select_handler(instruction);
+		op->opcode = instruction->opcode;
+		op->rd = instruction->rd;
+		op->rs = instruction->rs;
+		op->rt = instruction->rt;
+		op->rm = instruction->rm;
+		op->imm1 = instruction->imm1;
+		op->imm2 = instruction->imm2;
+	}
+	threaded->program = program;
+	threaded->resolved = 0;
+}
+
+#ifdef SIM_CHECKED_EXECUTION
+
+// Debug mode: the checked fetch-decode-execute path of simulator_main_loop
+uint64_t run_fast_engine(ThreadedProgram *threaded, Registers *registers, Memory *memory, IORegisters *io, Disk *disk, IRQ2Data *irq2, uint16_t *pc, int *in_isr) {
+	uint64_t cycles = 0;
+
+	while (1) {
+		cycles++;
+		increment_clock(io);
+		update_timer(io);
+		check_and_trigger_irq2(io, irq2, io->IORegister[8]);
+		handle_interrupts(io, pc, in_isr);
+		handle_disk_command(memory, io, disk);
+
+		const Instruction *decoded = fetch_decoded_instruction(threaded->program, pc);
+		load_immediates(registers, decoded);
+		if (decoded->opcode == 21) { // halt
+			return cycles;
+		}
+		execute_instruction(decoded, registers, memory, io, pc, in_isr);
+		if (memory->faulted) {
+			return cycles;
+		}
+	}
+}
+
+#else
+
+// Advance one cycle, the per-cycle clock, timer, IRQ2, interrupt and disk handling
+// only runs on cycles with a scheduled event
+#define CYCLE_PROLOGUE() do { \
+	if (++scheduler.cycle >= deadline) { \
+		run_due_cycle(&scheduler, memory, io, disk, irq2, &pc, &isr); \
+		deadline = next_event_cycle(&scheduler); \
+		idle_wake(&idle); \
+	} \
+	op = &code[pc]; \
+	regs[REG_IMM1] = op->imm1; \
+	regs[REG_IMM2] = op->imm2; \
+} while (0)
+
+// Advance the PC by one, increment_pc reports the overflow
+#define ADVANCE_PC() do { if (pc < pc_mask) { pc++; } else { increment_pc(&pc, pc_mask); } } while (0)
+
+// Jump to a target, one that does not move the PC forward may close an idle loop
+#define TAKE_BRANCH(target) do { \
+	uint16_t from = pc; \
+	pc = (uint16_t)(target); \
+	if (pc <= from && idle_check_due(&idle)) { \
+		idle_scheduled_back_edge(&idle, regs, pc, isr, memory, io, disk, &scheduler, deadline); \
+	} \
+} while (0)
+
+// Stop after an out-of-range access trapped (MEMORY_TRAP), only checked on the out-of-range path
+#define CHECK_TRAP() do { if (memory->faulted) { goto halted; } } while (0)
+
+#define RS regs[op->rs]
+#define RT regs[op->rt]
+#define RM regs[op->rm]
+#define RD regs[op->rd]
+
+#ifdef SIM_DISPATCH_COMPUTED_GOTO
+#define HANDLER(kind) L_##kind:
+#define NEXT() do { CYCLE_PROLOGUE(); goto *op->label; } while (0)
+#else
+#define HANDLER(kind) case kind:
+#define NEXT() goto next_cycle
+#endif
+
+// Run the threaded program until halt
+uint64_t run_fast_engine(ThreadedProgram *threaded, Registers *registers, Memory *memory, IORegisters *io, Disk *disk, IRQ2Data *irq2, uint16_t *pc_ptr, int *in_isr) {
+	const ThreadedInstruction *code = threaded->code;
+	const ThreadedInstruction *op;
+	uint32_t regs[NUM_REGISTERS];
+	uint16_t pc = *pc_ptr;
+	const uint16_t pc_mask = io_pc_mask(io);
+	const uint32_t data_mask = memory->mask;
+	int isr = *in_isr;
+	Scheduler scheduler;
+	uint64_t deadline;
+	IdleDetector idle;
+
+	init_scheduler(&scheduler, io, disk, irq2);
+	deadline = next_event_cycle(&scheduler);
+	init_idle_detector(&idle, io->trace == NULL && io->breakpoints == NULL); // Skipped accesses are not traced
+
+	for (int i = 0; i < NUM_REGISTERS; i++) {
+		regs[i] = registers->regs[i];
+	}
+
+#ifdef SIM_DISPATCH_COMPUTED_GOTO
+	static const void *const labels[FAST_HANDLER_COUNT] = {
+		&&L_FAST_ADD, &&L_FAST_SUB, &&L_FAST_MAC, &&L_FAST_AND, &&L_FAST_OR, &&L_FAST_XOR,
+		&&L_FAST_SLL, &&L_FAST_SRA, &&L_FAST_SRL,
+		&&L_FAST_BEQ, &&L_FAST_BNE, &&L_FAST_BLT, &&L_FAST_BGT, &&L_FAST_BLE, &&L_FAST_BGE, &&L_FAST_JAL,
+		&&L_FAST_LW, &&L_FAST_SW, &&L_FAST_RETI, &&L_FAST_IN, &&L_FAST_OUT, &&L_FAST_HALT,
+		&&L_FAST_NOP, &&L_FAST_JUMP, &&L_FAST_LW_DISCARD, &&L_FAST_IN_DISCARD, &&L_FAST_INVALID
+	};
+
+	// Resolve the handler kinds to label addresses once per program
+	if (!threaded->resolved) {
+		for (int address = 0; address < INSTRUCTION_MEM_MAX; address++) {
+			threaded->code[address].label = labels[threaded->code[address].handler];
+		}
+		threaded->resolved = 1;
+	}
+
+	NEXT();
+#else
+next_cycle:
+	CYCLE_PROLOGUE();
+	switch (op->handler) {
+#endif
+
+	// Arithmetic Instructions
+
+	HANDLER(FAST_ADD) RD = RS + RT + RM; ADVANCE_PC(); NEXT();
+	HANDLER(FAST_SUB) RD = RS - RT - RM; ADVANCE_PC(); NEXT();
+	HANDLER(FAST_MAC) RD = (RS * RT) + RM; ADVANCE_PC(); NEXT();
+
+	// Logical Instructions
+
+	HANDLER(FAST_AND) RD = RS & RT & RM; ADVANCE_PC(); NEXT();
+	HANDLER(FAST_OR)  RD = RS | RT | RM; ADVANCE_PC(); NEXT();
+	HANDLER(FAST_XOR) RD = RS ^ RT ^ RM; ADVANCE_PC(); NEXT();
+
+	// Shift Instructions
+
+	HANDLER(FAST_SLL) RD = RS << RT; ADVANCE_PC(); NEXT();
+	HANDLER(FAST_SRA) RD = (uint32_t)((int32_t)RS >> RT); ADVANCE_PC(); NEXT();
+	HANDLER(FAST_SRL) RD = RS >> RT; ADVANCE_PC(); NEXT();
+
+	// Branch Instructions
+
+	HANDLER(FAST_BEQ) if (RS == RT) { TAKE_BRANCH(RM & pc_mask); } else { ADVANCE_PC(); } NEXT();
+	HANDLER(FAST_BNE) if (RS != RT) { TAKE_BRANCH(RM & pc_mask); } else { ADVANCE_PC(); } NEXT();
+	HANDLER(FAST_BLT) if ((int32_t)RS < (int32_t)RT) { TAKE_BRANCH(RM & pc_mask); } else { ADVANCE_PC(); } NEXT();
+	HANDLER(FAST_BGT) if ((int32_t)RS > (int32_t)RT) { TAKE_BRANCH(RM & pc_mask); } else { ADVANCE_PC(); } NEXT();
+	HANDLER(FAST_BLE) if ((int32_t)RS <= (int32_t)RT) { TAKE_BRANCH(RM & pc_mask); } else { ADVANCE_PC(); } NEXT();
+	HANDLER(FAST_BGE) if ((int32_t)RS >= (int32_t)RT) { TAKE_BRANCH(RM & pc_mask); } else { ADVANCE_PC(); } NEXT();
+	HANDLER(FAST_JAL) { uint32_t target = RM & pc_mask; RD = pc + 1; TAKE_BRANCH(target); } NEXT();
+	HANDLER(FAST_JUMP) TAKE_BRANCH(RM & pc_mask); NEXT();
+
+	// Memory Access Instructions
+
+	HANDLER(FAST_LW) {
+		uint32_t address = RS + RT;
+		if (address > data_mask) {
+			RD = read_data_out_of_range(memory, address) + RM;
+			ADVANCE_PC();
+			CHECK_TRAP();
+			NEXT();
+		}
+		RD = memory->data[address] + RM;
+		ADVANCE_PC();
+	} NEXT();
+	HANDLER(FAST_LW_DISCARD) {
+		uint32_t address = RS + RT;
+		if (address > data_mask) {
+			read_data_out_of_range(memory, address); // Reports the invalid address
+			ADVANCE_PC();
+			CHECK_TRAP();
+			NEXT();
+		}
+		ADVANCE_PC();
+	} NEXT();
+	HANDLER(FAST_SW) {
+		uint32_t address = RS + RT;
+		idle.clean = 0;
+		if (address > data_mask) {
+			write_data_out_of_range(memory, address, RM + RD);
+			ADVANCE_PC();
+			CHECK_TRAP();
+			NEXT();
+		}
+		memory->data[address] = RM + RD;
+		mark_data_dirty(memory, address);
+		ADVANCE_PC();
+	} NEXT();
+
+	// I/O and Control Instructions
+
+	HANDLER(FAST_RETI) {
+		sync_io_registers(&scheduler, io, disk); // The irqreturn read may be traced
+		pc = (uint16_t)io_read(io, IO_IRQ_RETURN);
+		isr = 0;
+		idle.clean = 0;
+		request_cycle_check(&scheduler); // A pending interrupt is taken on the next cycle
+		deadline = next_event_cycle(&scheduler);
+	} NEXT();
+	HANDLER(FAST_IN) {
+		sync_io_registers(&scheduler, io, disk);
+		uint32_t value = io_read(io, (int)(RS + RT));
+		if (!idle_quiet_in(io, RS + RT)) {
+			idle.clean = 0;
+		}
+		idle_wake(&idle);
+		RD = value;
+		ADVANCE_PC();
+	} NEXT();
+	HANDLER(FAST_IN_DISCARD) {
+		sync_io_registers(&scheduler, io, disk); // The access may be traced
+		io_read(io, (int)(RS + RT));
+		if (!idle_quiet_in(io, RS + RT)) {
+			idle.clean = 0;
+		}
+		idle_wake(&idle);
+		ADVANCE_PC();
+	} NEXT();
+	HANDLER(FAST_OUT) {
+		int reg_index = (int)(RS + RT);
+		sync_io_registers(&scheduler, io, disk);
+		io_write(io, reg_index, RM);
+		scheduler_io_written(&scheduler, io, reg_index);
+		deadline = next_event_cycle(&scheduler);
+		idle.clean = 0;
+		ADVANCE_PC();
+	} NEXT();
+	HANDLER(FAST_NOP) ADVANCE_PC(); NEXT();
+	HANDLER(FAST_INVALID) printf("Error: Unsupported opcode %d\n", op->opcode); idle.clean = 0; NEXT();
+
+	HANDLER(FAST_HALT) goto halted;
+
+#ifndef SIM_DISPATCH_COMPUTED_GOTO
+	default:
+		goto halted;
+	}
+#endif
+
+halted:
+	sync_io_registers(&scheduler, io, disk);
+	for (int i = 0; i < NUM_REGISTERS; i++) {
+		registers->regs[i] = regs[i];
+	}
+	*pc_ptr = pc;
+	*in_isr = isr;
+	return scheduler.cycle;
+}
+
+#endif
@@ -0,0 +1,82 @@
+#ifndef FAST_EXECUTION_H
+#define FAST_EXECUTION_H
+
+#include <stdint.h>
+#include "registers.h"          // For the register file
+#include "memory.h"             // For memory-related instructions
+#include "io.h"                 // To access and modify the io registers
+#include "disk.h"               // For the per-cycle disk handling
+#include "interrupts.h"         // For the IRQ2 events and interrupt handling
+#include "instruction_decode.h" // For the predecoded program
+#include "scheduler.h"          // For the event-driven peripheral handling
+
+/*
+ Dispatch selection (build time):
+ -SIM_DISPATCH_SWITCH     forces the portable switch dispatch.
+ -SIM_CHECKED_EXECUTION   runs every instruction through execute_instruction and the
+                          checked get_register/set_register path (debug mode).
+ Otherwise GCC/Clang builds use direct-threaded dispatch with computed goto.
+*/
+#if !defined(SIM_DISPATCH_SWITCH) && (defined(__GNUC__) || defined(__clang__))
+#define SIM_DISPATCH_COMPUTED_GOTO
+#endif
+
+// Handler kinds, one per opcode plus the specialized variants
+typedef enum {
+	FAST_ADD, FAST_SUB, FAST_MAC, FAST_AND, FAST_OR, FAST_XOR, FAST_SLL, FAST_SRA, FAST_SRL,
+	FAST_BEQ, FAST_BNE, FAST_BLT, FAST_BGT, FAST_BLE, FAST_BGE, FAST_JAL,
+	FAST_LW, FAST_SW, FAST_RETI, FAST_IN, FAST_OUT, FAST_HALT,
+	FAST_NOP,        // Arithmetic/logical/shift into $zero/$imm1/$imm2, the write is dropped
+	FAST_JUMP,       // jal with a protected rd, only the jump remains
+	FAST_LW_DISCARD, // lw into a protected rd, only the address check remains
+	FAST_IN_DISCARD, // in into a protected rd, only the index check remains
+	FAST_INVALID,    // Unsupported opcode
+	FAST_HANDLER_COUNT
+} FastHandler;
+
+// One entry of the threaded program
+typedef struct {
+	const void *label; // Handler address (computed goto builds only)
+	uint8_t handler;   // FastHandler kind
+	uint8_t opcode;    // Original opcode (for error reporting)
+	uint8_t rd;
+	uint8_t rs;
+	uint8_t rt;
+	uint8_t rm;
+	uint32_t imm1;     // Sign-extended
+	uint32_t imm2;     // Sign-extended
+} ThreadedInstruction;
+
+// The whole instruction memory translated to threaded code
+typedef struct CACHE_ALIGNED {
+	ThreadedInstruction code[INSTRUCTION_MEM_MAX];
+	const DecodedProgram *program; // The predecoded program it was prepared from
+	int resolved; // 1 once the handler labels have been filled in
+} ThreadedProgram;
+
+
+// Function declaration
+
+/*
+-Functionality: Translates the predecoded program into threaded code, selecting the specialized handler per instruction.
+-parameter1: program - Pointer to the predecoded program.
+-parameter2: threaded - Pointer to the ThreadedProgram to fill.
+*/
+void prepare_threaded_program(const DecodedProgram *program, ThreadedProgram *threaded);
+
+/*
+-Functionality: Runs the threaded program until a halt instruction. The clock, timer, IRQ2,
+ interrupt and disk handling of simulator_main_loop only runs on cycles with a scheduled event.
+-parameter1: threaded - Pointer to the prepared ThreadedProgram.
+-parameter2: registers - Pointer to the Registers structure.
+-parameter3: memory - Pointer to the Memory structure.
+-parameter4: io - Pointer to the IORegisters structure.
+-parameter5: disk - Pointer to the Disk structure.
+-parameter6: irq2 - Pointer to the IRQ2Data structure.
+-parameter7: pc - Pointer to the Program counter, left at the halt instruction.
+-parameter8: in_isr - Pointer to the flag the indicates if the code is in the ISR.
+-return The number of cycles executed, including the halt cycle.
+*/
+uint64_t run_fast_engine(ThreadedProgram *threaded, Registers *registers, Memory *memory, IORegisters *io, Disk *disk, IRQ2Data *irq2, uint16_t *pc, int *in_isr);
+
+#endif
@@ -0,0 +1,109 @@
+#define _CRT_SECURE_NO_WARNINGS
+#include "idle.h"
+#include <string.h>
+
+// Reset the detector
+void init_idle_detector(IdleDetector *idle, int enabled) {
+	memset(idle, 0, sizeof(*idle));
+	idle->enabled = enabled;
+	idle->backoff = IDLE_BACKOFF;
+}
+
+// Cycles until the next device event, the same events the scheduler of the fast engines keeps
+uint64_t cycles_to_next_event(const IORegisters *io, const Disk *disk, const IRQ2Data *irq2, int in_isr) {
+	const uint64_t wrap = (uint64_t)1 << 32; // A 32-bit counter needs a full wrap to match again
+	uint64_t next;
+	uint64_t cycles;
+
+	// A pending interrupt is handled on the next cycle
+	if (!in_isr && interrupt_pending(io)) {
+		return 1;
+	}
+
+	// Timer expiry, and a disk command that starts or completes, from the devices
+	next = timer_cycles_to_event(io);
+	cycles = disk_cycles_to_event(io, disk);
+	next = (cycles < next) ? cycles : next;
+
+	// Next IRQ2 event, matched against clks after it is incremented
+	if (irq2->current_index < irq2->count) {
+		cycles = (uint32_t)((uint32_t)irq2->events[irq2->current_index] - io->IORegister[IO_CLKS]);
+		cycles = (cycles == 0) ? wrap : cycles;
+		next = (cycles < next) ? cycles : next;
+	}
+	return next;
+}
+
+// Record the state at a point the loop may come back to
+static void record_point(IdleDetector *idle, const uint32_t *regs, uint16_t pc, int in_isr, uint32_t reports,
+	uint64_t cycle, uint64_t quiet) {
+	idle->armed = 1;
+	idle->head = pc;
+	idle->in_isr = in_isr;
+	memcpy(idle->regs, regs, sizeof(idle->regs));
+	idle->armed_at = cycle;
+	idle->quiet = quiet;
+	idle->reports = reports;
+	idle->clean = 1;
+}
+
+// Count the cycles of a proven idle loop to skip before the next event and the budget, then
+// record the new point after them
+static uint64_t idle_loop_skip(IdleDetector *idle, const uint32_t *regs, uint16_t pc, int in_isr, uint32_t reports,
+	uint64_t cycle, uint64_t quiet, uint64_t budget) {
+	uint64_t period = cycle - idle->armed_at;
+	uint64_t skipped = 0;
+
+	// The iteration since the recorded point was quiet, ran before any event and came back to
+	// the same state, so the following ones repeat it until the next event
+	if (idle->armed && idle->head == pc && period > 0 && period <= IDLE_MAX_PERIOD) {
+		if (!idle->clean || idle->in_isr != in_isr || idle->reports != reports || period >= idle->quiet ||
+			memcmp(idle->regs, regs, sizeof(idle->regs)) != 0) {
+			// A busy loop: record a fresh point once the back-off ran out
+			idle->armed = 0;
+			idle->wait = idle->backoff;
+			if (idle->backoff < IDLE_MAX_BACKOFF) {
+				idle->backoff *= 2;
+			}
+			return 0;
+		}
+		uint64_t iterations = (quiet - 1) / period;
+		if (iterations > budget / period) {
+			iterations = budget / period;
+		}
+		if (iterations > (uint64_t)UINT32_MAX / period) {
+			iterations = (uint64_t)UINT32_MAX / period; // One wrap of clks at most
+		}
+		skipped = iterations * period;
+	}
+
+	record_point(idle, regs, pc, in_isr, reports, cycle + skipped, quiet - skipped);
+	return skipped;
+}
+
+// Skip the iterations of a proven idle loop, then record the new point
+uint64_t idle_back_edge(IdleDetector *idle, const Registers *registers, const Memory *memory, uint16_t pc, int in_isr,
+	IORegisters *io, Disk *disk, const IRQ2Data *irq2, uint64_t cycle, uint64_t budget) {
+	uint64_t quiet = cycles_to_next_event(io, disk, irq2, in_isr);
+	uint64_t skipped = idle_loop_skip(idle, registers->regs, pc, in_isr, memory->reports, cycle, quiet, budget);
+
+	// The skipped cycles only advance the counters, exactly like the reference loop does
+	if (skipped > 0) {
+		skip_timer_cycles(io, (uint32_t)skipped);
+		skip_disk_cycles(io, disk, (uint32_t)skipped);
+	}
+	return skipped;
+}
+
+// Skip the iterations of a proven idle loop up to the deadline of a scheduler, then record the new point
+void idle_scheduled_back_edge(IdleDetector *idle, const uint32_t *regs, uint16_t pc, int in_isr, const Memory *memory,
+	IORegisters *io, Disk *disk, Scheduler *scheduler, uint64_t deadline) {
+	uint64_t skipped = idle_loop_skip(idle, regs, pc, in_isr, memory->reports, scheduler->cycle,
+		deadline - scheduler->cycle, UINT64_MAX);
+
+	// Synced first, the counters never lag behind by more than one wrap
+	if (skipped > 0) {
+		sync_io_registers(scheduler, io, disk);
+		skip_cycles(scheduler, (uint32_t)skipped);
+	}
+}
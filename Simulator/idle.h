@@ -0,0 +1,163 @@
+#ifndef IDLE_H
+#define IDLE_H
+
+#include <stdint.h>
+#include "registers.h"
+#include "memory.h"
+#include "io.h"
+#include "disk.h"
+#include "interrupts.h"
+#include "instruction_decode.h"
+#include "scheduler.h"
+
+/*
+ Idle-loop fast-forward of the reference loop and of the fast and block engines.
+
+ Whenever the PC does not move forward (a backward branch, jal or a branch to itself), the
+ detector records the registers, the PC and the ISR state. If the PC comes back to the same
+ point with the same state, and every instruction in between was "quiet" (no sw, out, reti or
+ halt, no in from clks, timercurrent or a device with a read handler, no out-of-range access),
+ and no device event fell inside that iteration, then every later iteration repeats it exactly
+ until the next device event: nothing it reads can change before then. The whole iterations
+ that fit before that event are skipped at once by advancing clks, timercurrent and the disk
+ timer, so the run stays cycle-exact. The fast and block engines count the cycles to the next
+ event from the deadline of their Scheduler and skip by advancing its cycle, the lazily synced
+ counters then catch up on their own.
+*/
+
+// Largest loop iteration the detector looks at, in cycles
+#define IDLE_MAX_PERIOD 64
+
+// Back edges the fast and block engines let through unchecked after a loop came around in a
+// different state, doubled on each such loop up to IDLE_MAX_BACKOFF, so a busy loop does not pay
+// for recording its registers on every iteration. A device event or an in resets it: an idle
+// loop waits for one or polls with the other.
+#define IDLE_BACKOFF 16
+#define IDLE_MAX_BACKOFF 4096
+
+// State of the detector, local to one run_machine call
+typedef struct {
+	int enabled;
+	int armed;                       // 1 once a loop head was recorded
+	uint16_t head;                   // PC of the recorded point
+	int in_isr;
+	uint32_t regs[NUM_REGISTERS];    // Registers at the recorded point
+	uint64_t armed_at;               // Cycle (of the run) the point was recorded on
+	uint64_t quiet;                  // Cycles from it to the next device event, that one included
+	uint32_t reports;                // Out-of-range accesses reported before it (Memory.reports)
+	int clean;                       // 0 once an instruction since the recorded point was not quiet
+	uint32_t wait;                   // Back edges left to let through unchecked
+	uint32_t backoff;                // wait after the next busy loop
+} IdleDetector;
+
+
+// Function declarations
+
+/*
+-Functionality: Resets the detector.
+-parameter1: idle - Pointer to the IdleDetector structure.
+-parameter2: enabled - 0 to step through every cycle (tracing, profiling or exact stepping).
+*/
+void init_idle_detector(IdleDetector *idle, int enabled);
+
+/*
+-Functionality: Counts the cycles until the next device event: the timer reaching timermax, the
+ next IRQ2 event, a disk command starting or completing, or a pending interrupt being taken.
+-return n >= 1: the next n - 1 cycles only advance clks, timercurrent and the disk timer, the
+ n-th runs the event. UINT64_MAX if no event is coming.
+-parameter1: io - Pointer to the IORegisters structure.
+-parameter2: disk - Pointer to the Disk structure.
+-parameter3: irq2 - Pointer to the IRQ2Data structure.
+-parameter4: in_isr - The ISR state.
+*/
+uint64_t cycles_to_next_event(const IORegisters *io, const Disk *disk, const IRQ2Data *irq2, int in_isr);
+
+/*
+-Functionality: Checks whether an in reads a register that only changes on a device event or an out.
+-return 1 if it does, 0 for the clock, the timer count, a device with a read handler or an invalid index.
+-parameter1: io - Pointer to the IORegisters structure.
+-parameter2: address - The register index read.
+*/
+static inline int idle_quiet_in(const IORegisters *io, uint32_t address) {
+	return address < NUM_IO_REGISTERS && address != IO_CLKS && address != IO_TIMER_CURRENT &&
+		io->bus[address].read == NULL;
+}
+
+/*
+-Functionality: Checks an instruction about to execute, with its immediates loaded, and marks
+ the recorded iteration as not idle if it is not quiet. An out-of-range lw is caught by the
+ report count instead.
+-parameter1: idle - Pointer to the IdleDetector structure.
+-parameter2: decoded - The instruction.
+-parameter3: registers - Pointer to the Registers structure.
+-parameter4: io - Pointer to the IORegisters structure.
+*/
+static inline void idle_check_instruction(IdleDetector *idle, const Instruction *decoded, const Registers *registers,
+	const IORegisters *io) {
+	if (decoded->opcode <= 16) { // ALU, branches, jal and lw
+		return;
+	}
+	if (decoded->opcode == 19 && idle_quiet_in(io, registers->regs[decoded->rs] + registers->regs[decoded->rt])) {
+		return;
+	}
+	idle->clean = 0;
+}
+
+/*
+-Functionality: Counts down the back-off after a busy loop came around.
+-return 1 if the back edge is to be checked with idle_loop_skip, 0 to let it through.
+-parameter1: idle - Pointer to the IdleDetector structure.
+*/
+static inline int idle_check_due(IdleDetector *idle) {
+	if (idle->wait > 0) {
+		idle->wait--;
+		return 0;
+	}
+	return idle->enabled;
+}
+
+/*
+-Functionality: Resets the back-off on a device event or an in, after which a loop may be idle.
+-parameter1: idle - Pointer to the IdleDetector structure.
+*/
+static inline void idle_wake(IdleDetector *idle) {
+	idle->wait = 0;
+	idle->backoff = IDLE_BACKOFF;
+}
+
+/*
+-Functionality: Called when the PC did not move forward and idle_check_due. Skips the iterations of a proven idle
+ loop that fit before the next device event and the cycle budget, then records the new point.
+-return The number of cycles skipped (clks, timercurrent and the disk timer are advanced by it).
+-parameter1: idle - Pointer to the IdleDetector structure.
+-parameter2: registers - Pointer to the Registers structure.
+-parameter3: memory - Pointer to the Memory structure.
+-parameter4: pc - The PC of the next instruction.
+-parameter5: in_isr - The ISR state.
+-parameter6: io - Pointer to the IORegisters structure.
+-parameter7: disk - Pointer to the Disk structure.
+-parameter8: irq2 - Pointer to the IRQ2Data structure.
+-parameter9: cycle - Cycles run so far in this run.
+-parameter10: budget - Cycles the run may still use.
+*/
+uint64_t idle_back_edge(IdleDetector *idle, const Registers *registers, const Memory *memory, uint16_t pc, int in_isr,
+	IORegisters *io, Disk *disk, const IRQ2Data *irq2, uint64_t cycle, uint64_t budget);
+
+/*
+-Functionality: idle_back_edge of the engines that keep the device events in a Scheduler. Skips the
+ iterations of a proven idle loop that fit before the deadline by advancing the scheduler cycle,
+ the lazily synced counters catch up on their own, then records the new point.
+-parameter1: idle - Pointer to the IdleDetector structure.
+-parameter2: regs - The register file.
+-parameter3: pc - The PC of the next instruction.
+-parameter4: in_isr - The ISR state.
+-parameter5: memory - Pointer to the Memory structure.
+-parameter6: io - Pointer to the IORegisters structure.
+-parameter7: disk - Pointer to the Disk structure.
+-parameter8: scheduler - Pointer to the Scheduler, its cycle is the one of the back edge.
+-parameter9: deadline - Cycle of the next event (next_event_cycle).
+*/
+void idle_scheduled_back_edge(IdleDetector *idle, const uint32_t *regs, uint16_t pc, int in_isr, const Memory *memory,
+	IORegisters *io, Disk *disk, Scheduler *scheduler, uint64_t deadline);
+
+#endif
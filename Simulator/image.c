@@ -0,0 +1,590 @@
+#define _CRT_SECURE_NO_WARNINGS
+#include "image.h"
+#include "memory.h"
+#include "disk.h"
+#include "monitor.h"
+#include "threads.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define SIM_IMAGE_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// The hex classification pass uses SSE2 when the compiler targets it
+#if (defined(__SSE2__) || defined(_M_X64)) && !defined(SIM_NO_SIMD)
+#define SIM_IMAGE_SSE2
+#include <emmintrin.h>
+#endif
+
+#define IMAGE_HEADER_SIZE 16
+#define NOT_HEX 0xFF
+
+// Upper-case hex of every byte value, two characters per byte
+#define HEX_PAIR_ROW(high) high "0" high "1" high "2" high "3" high "4" high "5" high "6" high "7" \
+	high "8" high "9" high "A" high "B" high "C" high "D" high "E" high "F"
+static const char hex_pairs[] =
+	HEX_PAIR_ROW("0") HEX_PAIR_ROW("1") HEX_PAIR_ROW("2") HEX_PAIR_ROW("3")
+	HEX_PAIR_ROW("4") HEX_PAIR_ROW("5") HEX_PAIR_ROW("6") HEX_PAIR_ROW("7")
+	HEX_PAIR_ROW("8") HEX_PAIR_ROW("9") HEX_PAIR_ROW("A") HEX_PAIR_ROW("B")
+	HEX_PAIR_ROW("C") HEX_PAIR_ROW("D") HEX_PAIR_ROW("E") HEX_PAIR_ROW("F");
+
+// Hex digits of an "@address" line
+#define ADDRESS_DIGITS 8
+
+// Layout of each image kind
+typedef struct {
+	int entries;     // Entries the payload can hold
+	int defaults;    // Entries written by default (the default memory depths)
+	int entry_size;  // Bytes per entry in the payload and in binary images
+	int digits;      // Hex digits per text line
+	int block_lines; // Text lines per dirty-tracked block
+} ImageLayout;
+
+// Return the layout of an image kind
+static ImageLayout image_layout(ImageKind kind) {
+	ImageLayout layout;
+	switch (kind) {
+	case IMAGE_INSTRUCTIONS:
+		layout.entries = INSTRUCTION_MEM_MAX;
+		layout.defaults = INSTRUCTION_MEM_DEPTH;
+		layout.entry_size = 6;
+		layout.digits = 12;
+		layout.block_lines = INSTRUCTION_MEM_DEPTH; // Not tracked
+		break;
+	case IMAGE_DATA:
+		layout.entries = DATA_MEM_MAX;
+		layout.defaults = DATA_MEM_DEPTH;
+		layout.entry_size = 4;
+		layout.digits = 8;
+		layout.block_lines = DATA_BLOCK_WORDS;
+		break;
+	case IMAGE_MONITOR: // One text line per pixel
+		layout.entries = MONITOR_PIXELS;
+		layout.defaults = MONITOR_PIXELS;
+		layout.entry_size = 1;
+		layout.digits = 2;
+		layout.block_lines = MONITOR_WIDTH;
+		break;
+	default: // IMAGE_DISK, one text line per byte
+		layout.entries = DISK_SECTORS;
+		layout.defaults = DISK_SECTORS;
+		layout.entry_size = SECTOR_SIZE;
+		layout.digits = 2;
+		layout.block_lines = SECTOR_SIZE;
+		break;
+	}
+	return layout;
+}
+
+// Map a whole file into memory
+int map_file(const char *filename, MappedFile *file) {
+	file->data = NULL;
+	file->size = 0;
+	file->mapped = 0;
+
+#ifdef SIM_IMAGE_MMAP
+	int fd = open(filename, O_RDONLY);
+	if (fd < 0) {
+		return 0;
+	}
+	struct stat info;
+	if (fstat(fd, &info) != 0) {
+		close(fd);
+		return 0;
+	}
+	if (info.st_size > 0) {
+		void *view = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (view != MAP_FAILED) {
+			file->data = view;
+			file->size = (size_t)info.st_size;
+			file->mapped = 1;
+			close(fd);
+			return 1;
+		}
+	}
+	close(fd);
+	if (info.st_size == 0) {
+		return 1; // Empty file
+	}
+#endif
+
+	// No mmap: one bulk read into a heap buffer
+	FILE *stream = fopen(filename, "rb");
+	if (!stream) {
+		return 0;
+	}
+	fseek(stream, 0, SEEK_END);
+	long size = ftell(stream);
+	fseek(stream, 0, SEEK_SET);
+	if (size > 0) {
+		uint8_t *buffer = malloc((size_t)size);
+		if (!buffer || fread(buffer, 1, (size_t)size, stream) != (size_t)size) {
+			free(buffer);
+			fclose(stream);
+			return 0;
+		}
+		file->data = buffer;
+		file->size = (size_t)size;
+	}
+	fclose(stream);
+	return 1;
+}
+
+// Release a mapped file
+void unmap_file(MappedFile *file) {
+	if (file->data != NULL) {
+#ifdef SIM_IMAGE_MMAP
+		if (file->mapped) {
+			munmap((void *)file->data, file->size);
+		}
+		else {
+			free((void *)file->data);
+		}
+#else
+		free((void *)file->data);
+#endif
+	}
+	file->data = NULL;
+	file->size = 0;
+	file->mapped = 0;
+}
+
+// Little-endian field helpers for the binary format
+static uint32_t load_le32(const uint8_t *bytes) {
+	return (uint32_t)bytes[0] | ((uint32_t)bytes[1] << 8) | ((uint32_t)bytes[2] << 16) | ((uint32_t)bytes[3] << 24);
+}
+
+static void store_le32(uint8_t *bytes, uint32_t value) {
+	bytes[0] = (uint8_t)value;
+	bytes[1] = (uint8_t)(value >> 8);
+	bytes[2] = (uint8_t)(value >> 16);
+	bytes[3] = (uint8_t)(value >> 24);
+}
+
+// Copy dmem words from the little-endian file layout
+static void copy_words_from_le(uint32_t *words, const uint8_t *bytes, int count) {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	for (int i = 0; i < count; i++) {
+		words[i] = load_le32(bytes + i * 4);
+	}
+#else
+	memcpy(words, bytes, (size_t)count * 4);
+#endif
+}
+
+// Load a binary image, returns the number of entries or IMAGE_ERROR_FORMAT
+static int load_binary_image(const MappedFile *file, ImageKind kind, void *payload) {
+	ImageLayout layout = image_layout(kind);
+	const uint8_t *bytes = file->data;
+	ImageHeader header;
+
+	if (file->size < IMAGE_HEADER_SIZE) {
+		return IMAGE_ERROR_FORMAT;
+	}
+	memcpy(header.magic, bytes, 4);
+	header.version = (uint16_t)(bytes[4] | (bytes[5] << 8));
+	header.kind = (uint16_t)(bytes[6] | (bytes[7] << 8));
+	header.entry_count = load_le32(bytes + 8);
+	header.entry_size = load_le32(bytes + 12);
+
+	if (header.version != IMAGE_VERSION || header.kind != kind || header.entry_size != (uint32_t)layout.entry_size) {
+		return IMAGE_ERROR_FORMAT;
+	}
+	if (header.entry_count > (uint32_t)layout.entries ||
+		file->size - IMAGE_HEADER_SIZE < (size_t)header.entry_count * layout.entry_size) {
+		return IMAGE_ERROR_FORMAT;
+	}
+
+	int count = (int)header.entry_count;
+	if (kind == IMAGE_DATA) {
+		copy_words_from_le(payload, bytes + IMAGE_HEADER_SIZE, count);
+	}
+	else {
+		memcpy(payload, bytes + IMAGE_HEADER_SIZE, (size_t)count * layout.entry_size);
+	}
+	return count;
+}
+
+// Nibble value of every byte of a text buffer, NOT_HEX for anything that is not a hex digit
+static void classify_hex(const uint8_t *text, uint8_t *nibbles, size_t size) {
+	size_t i = 0;
+#ifdef SIM_IMAGE_SSE2
+	const __m128i zero_char = _mm_set1_epi8('0');
+	const __m128i lower_a = _mm_set1_epi8('a');
+	const __m128i case_bit = _mm_set1_epi8(0x20);
+	const __m128i nine = _mm_set1_epi8(9);
+	const __m128i five = _mm_set1_epi8(5);
+	const __m128i ten = _mm_set1_epi8(10);
+	const __m128i zero = _mm_setzero_si128();
+
+	for (; i + 16 <= size; i += 16) {
+		__m128i chunk = _mm_loadu_si128((const __m128i *)(text + i));
+		__m128i digit = _mm_sub_epi8(chunk, zero_char);
+		__m128i letter = _mm_sub_epi8(_mm_or_si128(chunk, case_bit), lower_a);
+		__m128i is_digit = _mm_cmpeq_epi8(_mm_subs_epu8(digit, nine), zero);   // digit <= 9 (unsigned)
+		__m128i is_letter = _mm_cmpeq_epi8(_mm_subs_epu8(letter, five), zero); // letter <= 5 (unsigned)
+		__m128i value = _mm_or_si128(_mm_and_si128(is_digit, digit),
+			_mm_and_si128(is_letter, _mm_add_epi8(letter, ten)));
+		__m128i invalid = _mm_andnot_si128(_mm_or_si128(is_digit, is_letter), _mm_set1_epi8((char)NOT_HEX));
+		_mm_storeu_si128((__m128i *)(nibbles + i), _mm_or_si128(value, invalid));
+	}
+#endif
+	for (; i < size; i++) {
+		uint8_t c = text[i];
+		if (c >= '0' && c <= '9') {
+			nibbles[i] = (uint8_t)(c - '0');
+		}
+		else if ((c | 0x20) >= 'a' && (c | 0x20) <= 'f') {
+			nibbles[i] = (uint8_t)((c | 0x20) - 'a' + 10);
+		}
+		else {
+			nibbles[i] = NOT_HEX;
+		}
+	}
+}
+
+// Store one parsed text line into the payload
+static void store_text_entry(ImageKind kind, void *payload, int index, uint64_t value) {
+	if (kind == IMAGE_INSTRUCTIONS) {
+		uint8_t *instruction = (uint8_t *)payload + (size_t)index * 6;
+		for (int i = 0; i < 6; i++) {
+			instruction[i] = (uint8_t)(value >> ((5 - i) * 8)); // Most significant byte first
+		}
+	}
+	else if (kind == IMAGE_DATA) {
+		((uint32_t *)payload)[index] = (uint32_t)value;
+	}
+	else {
+		((uint8_t *)payload)[index] = (uint8_t)value;
+	}
+}
+
+// Check whether the rest of a text holds nothing but whitespace
+static int only_whitespace(const uint8_t *text, size_t size) {
+	for (size_t i = 0; i < size; i++) {
+		if (text[i] != ' ' && text[i] != '\t' && text[i] != '\r' && text[i] != '\n') {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+// Parse a hex text image: one entry per line, the leading hex digits of the line are its value,
+// "@address" lines move to another entry. A line without hex digits is rejected, except for blank
+// lines at the end of the file.
+static int load_text_image(const MappedFile *file, ImageKind kind, void *payload) {
+	ImageLayout layout = image_layout(kind);
+	int max_entries = (kind == IMAGE_DISK) ? layout.entries * layout.entry_size : layout.entries;
+	const uint8_t *text = file->data;
+	size_t size = file->size;
+	int count = 0;
+	int loaded = 0;
+
+	if (size == 0) {
+		return 0;
+	}
+
+	uint8_t *nibbles = malloc(size);
+	if (!nibbles) {
+		return IMAGE_ERROR_OPEN;
+	}
+	classify_hex(text, nibbles, size);
+
+	size_t pos = 0;
+	while (pos < size && count < max_entries) {
+		uint64_t value = 0;
+		int digits = 0;
+
+		while (pos < size && (text[pos] == ' ' || text[pos] == '\t')) {
+			pos++;
+		}
+		int is_address = pos < size && text[pos] == '@';
+		pos += is_address;
+		int max_digits = is_address ? ADDRESS_DIGITS : layout.digits;
+		while (pos < size && nibbles[pos] != NOT_HEX && digits < max_digits) {
+			value = (value << 4) | nibbles[pos];
+			pos++;
+			digits++;
+		}
+		if (digits == 0) {
+			if (!is_address && only_whitespace(text + pos, size - pos)) {
+				break;
+			}
+			free(nibbles);
+			return IMAGE_ERROR_FORMAT;
+		}
+		if (is_address) {
+			count = (value < (uint64_t)max_entries) ? (int)value : max_entries;
+		}
+		else {
+			store_text_entry(kind, payload, count++, value);
+			loaded++;
+		}
+
+		// Skip the rest of the line
+		const uint8_t *end = memchr(text + pos, '\n', size - pos);
+		pos = end ? (size_t)(end - text) + 1 : size;
+	}
+
+	free(nibbles);
+	return loaded;
+}
+
+// Load an image held in memory, binary or hex text
+int load_image_buffer(const uint8_t *data, size_t size, ImageKind kind, void *payload) {
+	MappedFile file;
+
+	file.data = data;
+	file.size = size;
+	file.mapped = 0;
+	if (size >= 4 && memcmp(data, IMAGE_MAGIC, 4) == 0) {
+		return load_binary_image(&file, kind, payload);
+	}
+	return load_text_image(&file, kind, payload);
+}
+
+// Load an image file, binary or hex text
+int load_image(const char *filename, ImageKind kind, void *payload) {
+	MappedFile file;
+
+	if (!map_file(filename, &file)) {
+		return IMAGE_ERROR_OPEN;
+	}
+	int count = load_image_buffer(file.data, file.size, kind, payload);
+	unmap_file(&file);
+	return count;
+}
+
+// Write a payload as a binary image
+int write_binary_image(const char *filename, ImageKind kind, const void *payload, int entries) {
+	ImageLayout layout = image_layout(kind);
+	uint8_t header[IMAGE_HEADER_SIZE];
+	size_t payload_size = (size_t)entries * layout.entry_size;
+	int ok;
+
+	FILE *file = fopen(filename, "wb");
+	if (!file) {
+		return 0;
+	}
+
+	memcpy(header, IMAGE_MAGIC, 4);
+	header[4] = IMAGE_VERSION & 0xFF;
+	header[5] = IMAGE_VERSION >> 8;
+	header[6] = (uint8_t)kind;
+	header[7] = 0;
+	store_le32(header + 8, (uint32_t)entries);
+	store_le32(header + 12, (uint32_t)layout.entry_size);
+	ok = fwrite(header, 1, sizeof(header), file) == sizeof(header);
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	if (kind == IMAGE_DATA) {
+		const uint32_t *words = payload;
+		for (int i = 0; i < entries && ok; i++) {
+			uint8_t bytes[4];
+			store_le32(bytes, words[i]);
+			ok = fwrite(bytes, 1, 4, file) == 4;
+		}
+		payload_size = 0;
+	}
+#endif
+	if (ok && payload_size > 0) {
+		ok = fwrite(payload, 1, payload_size, file) == payload_size;
+	}
+
+	if (fclose(file) != 0) {
+		ok = 0;
+	}
+	return ok;
+}
+
+// Format a value as fixed-width upper-case hex followed by a newline, digits is even
+static char *format_hex_line(char *out, uint64_t value, int digits) {
+	for (int i = digits - 2; i >= 0; i -= 2) {
+		memcpy(out + i, &hex_pairs[(value & 0xFF) * 2], 2);
+		value >>= 8;
+	}
+	out[digits] = '\n';
+	return out + digits + 1;
+}
+
+// Format the text lines [first, end) of a payload
+static char *format_text_lines(char *out, ImageKind kind, const void *payload, int first, int end) {
+	if (kind == IMAGE_DISK || kind == IMAGE_MONITOR) {
+		const uint8_t *bytes = payload;
+		for (int i = first; i < end; i++) {
+			memcpy(out, &hex_pairs[bytes[i] * 2], 2);
+			out[2] = '\n';
+			out += 3;
+		}
+	}
+	else if (kind == IMAGE_DATA) {
+		const uint32_t *words = payload;
+		for (int i = first; i < end; i++) {
+			out = format_hex_line(out, words[i], 8);
+		}
+	}
+	else {
+		for (int i = first; i < end; i++) {
+			const uint8_t *instruction = (const uint8_t *)payload + (size_t)i * 6;
+			for (int b = 0; b < 6; b++) {
+				memcpy(out + b * 2, &hex_pairs[instruction[b] * 2], 2);
+			}
+			out[12] = '\n';
+			out += 13;
+		}
+	}
+	return out;
+}
+
+// Number of text lines up to the last nonzero entry of a payload
+static int trimmed_lines(const void *payload, int lines, int bytes_per_line) {
+	const uint8_t *bytes = payload;
+	size_t size = (size_t)lines * bytes_per_line;
+	while (size > 0 && bytes[size - 1] == 0) {
+		size--;
+	}
+	return (int)((size + bytes_per_line - 1) / bytes_per_line);
+}
+
+// Write a whole buffer to a new file with one write
+static int write_whole_file(const char *filename, const char *buffer, size_t size) {
+#ifdef SIM_IMAGE_MMAP
+	int fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+	if (fd < 0) {
+		return 0;
+	}
+	size_t done = 0;
+	while (done < size) {
+		ssize_t written = write(fd, buffer + done, size - done);
+		if (written <= 0) {
+			close(fd);
+			return 0;
+		}
+		done += (size_t)written;
+	}
+	return close(fd) == 0;
+#else
+	FILE *file = fopen(filename, "w");
+	if (!file) {
+		return 0;
+	}
+	int ok = fwrite(buffer, 1, size, file) == size;
+	if (fclose(file) != 0) {
+		ok = 0;
+	}
+	return ok;
+#endif
+}
+
+// Write a payload in the full hex text format
+int write_text_image(const char *filename, ImageKind kind, const void *payload, int entries) {
+	return write_text_dump(filename, kind, payload, entries, DUMP_FULL, NULL);
+}
+
+// Write a payload in the hex text format, full, trimmed or dirty blocks only
+int write_text_dump(const char *filename, ImageKind kind, const void *payload, int entries, DumpMode mode, const uint64_t *dirty) {
+	ImageLayout layout = image_layout(kind);
+	int lines = (kind == IMAGE_DISK) ? entries * layout.entry_size : entries;
+	int blocks = (lines + layout.block_lines - 1) / layout.block_lines; // The last one is partial for small depths
+	int ok;
+
+	if (mode == DUMP_DIRTY && (dirty == NULL || kind == IMAGE_INSTRUCTIONS)) {
+		mode = DUMP_FULL;
+	}
+
+	// Worst case: every line, plus an address line for every other block
+	char *buffer = malloc((size_t)lines * (layout.digits + 1) + (size_t)(blocks / 2 + 1) * (ADDRESS_DIGITS + 2));
+	if (!buffer) {
+		return 0;
+	}
+
+	char *out = buffer;
+	if (mode == DUMP_DIRTY) {
+		int block = 0;
+		while (block < blocks) {
+			if (!(dirty[block >> 6] & ((uint64_t)1 << (block & 63)))) {
+				block++;
+				continue;
+			}
+			int run_end = block + 1;
+			while (run_end < blocks && (dirty[run_end >> 6] & ((uint64_t)1 << (run_end & 63)))) {
+				run_end++;
+			}
+			*out++ = '@';
+			out = format_hex_line(out, (uint64_t)block * layout.block_lines, ADDRESS_DIGITS);
+			int end = (run_end * layout.block_lines < lines) ? run_end * layout.block_lines : lines;
+			out = format_text_lines(out, kind, payload, block * layout.block_lines, end);
+			block = run_end;
+		}
+	}
+	else {
+		int end = (mode == DUMP_TRIMMED) ? trimmed_lines(payload, lines, layout.digits / 2) : lines;
+		out = format_text_lines(out, kind, payload, 0, end);
+	}
+
+	ok = write_whole_file(filename, buffer, (size_t)(out - buffer));
+	free(buffer);
+	return ok;
+}
+
+// Thread entry of write_text_dumps
+static void text_dump_thread(void *argument) {
+	TextDump *dump = argument;
+	dump->ok = write_text_dump(dump->filename, dump->kind, dump->payload, dump->entries, dump->mode, dump->dirty);
+}
+
+// Write independent hex text dumps in parallel
+int write_text_dumps(TextDump *dumps, int count) {
+	Thread threads[8];
+	int started[8] = { 0 };
+	int ok = 1;
+
+	// The first dump is written on the calling thread, files past the thread slots as well
+	for (int i = 1; i < count && i <= 8; i++) {
+		started[i - 1] = thread_start(&threads[i - 1], text_dump_thread, &dumps[i]);
+	}
+	for (int i = 0; i < count; i++) {
+		if (i == 0 || i > 8 || !started[i - 1]) {
+			text_dump_thread(&dumps[i]);
+		}
+	}
+	for (int i = 1; i < count && i <= 8; i++) {
+		if (started[i - 1]) {
+			thread_join(&threads[i - 1]);
+		}
+	}
+	for (int i = 0; i < count; i++) {
+		ok &= dumps[i].ok;
+	}
+	return ok;
+}
+
+// Convert an image between the hex text and the binary format
+int convert_image(const char *input, const char *output, ImageKind kind, int to_binary) {
+	ImageLayout layout = image_layout(kind);
+	int entries = layout.defaults;
+	int ok;
+
+	void *payload = calloc((size_t)layout.entries, (size_t)layout.entry_size);
+	if (!payload) {
+		return 0;
+	}
+	int count = load_image(input, kind, payload);
+	if (count < 0) {
+		free(payload);
+		return 0;
+	}
+	// Images larger than the default depth keep their length
+	if (kind != IMAGE_DISK && count > entries) {
+		entries = count;
+	}
+	ok = to_binary ? write_binary_image(output, kind, payload, entries) : write_text_image(output, kind, payload, entries);
+	free(payload);
+	return ok;
+}
@@ -0,0 +1,160 @@
+#ifndef IMAGE_H
+#define IMAGE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ Binary image format (version 1), one file per imem, dmem, disk or monitor image:
+ -ImageHeader (16 bytes, little-endian fields)
+ -entry_count entries of entry_size bytes:
+   imem: 6 bytes per instruction, most significant byte first (as in ProgramImage.instructions)
+   dmem: 4 bytes per word, little-endian
+   disk: 512 bytes per sector (as in Disk.data)
+   monitor: 1 byte per pixel (as in Monitor.pixels)
+ Files that do not start with IMAGE_MAGIC are parsed as the hex text formats
+ (imemin.txt, dmemin.txt, diskin.txt, monitor.txt). A text line "@address" (hex, counted in text
+ lines) moves the following lines to that address, as written by DUMP_DIRTY.
+*/
+#define IMAGE_MAGIC "SIMG"
+#define IMAGE_VERSION 1
+
+// load_image errors
+#define IMAGE_ERROR_OPEN -1   // The file could not be opened or read
+#define IMAGE_ERROR_FORMAT -2 // A binary image with an unsupported header or a truncated payload, or a text line without hex digits
+
+// Kinds of images
+typedef enum {
+	IMAGE_INSTRUCTIONS = 1, // Instruction memory, uint8_t[INSTRUCTION_MEM_MAX][6]
+	IMAGE_DATA = 2,         // Data memory, uint32_t[DATA_MEM_MAX]
+	IMAGE_DISK = 3,         // Disk, uint8_t[DISK_SECTORS][SECTOR_SIZE]
+	IMAGE_MONITOR = 4       // Monitor frame, uint8_t[MONITOR_PIXELS]
+} ImageKind;
+
+// How write_text_dump lays out a hex text file
+typedef enum {
+	DUMP_FULL = 0,    // Every entry, the original output format
+	DUMP_TRIMMED = 1, // Entries up to the last nonzero one, the missing lines load as zero
+	DUMP_DIRTY = 2    // Only the dirty blocks, each run of them preceded by an "@address" line
+} DumpMode;
+
+// Header of a binary image
+typedef struct {
+	char magic[4];        // IMAGE_MAGIC
+	uint16_t version;     // IMAGE_VERSION
+	uint16_t kind;        // ImageKind
+	uint32_t entry_count; // Number of entries that follow
+	uint32_t entry_size;  // Bytes per entry
+} ImageHeader;
+
+// A whole input file, memory-mapped where the host supports it
+typedef struct {
+	const uint8_t *data;
+	size_t size;
+	int mapped;           // 1 if data is an mmap'd view, 0 if it was read into a heap buffer
+} MappedFile;
+
+
+// One file written by write_text_dumps
+typedef struct {
+	const char *filename;
+	ImageKind kind;
+	const void *payload;
+	int entries;           // Entries to write, see write_text_dump
+	DumpMode mode;
+	const uint64_t *dirty; // Dirty block bitmap for DUMP_DIRTY (Memory.dirty, Disk.dirty or Monitor.dirty)
+	int ok;                // Set to 1 once the file was written
+} TextDump;
+
+
+// Function declaration
+
+/*
+-Functionality: Maps a whole file into memory (mmap, or one bulk read on other hosts).
+-return 1 on success, 0 if the file could not be opened or read.
+-parameter1: filename - Name of the file.
+-parameter2: file - Pointer to the MappedFile structure to fill.
+*/
+int map_file(const char *filename, MappedFile *file);
+
+/*
+-Functionality: Releases a file mapped with map_file.
+-parameter1: file - Pointer to the MappedFile structure.
+*/
+void unmap_file(MappedFile *file);
+
+/*
+-Functionality: Loads an image file, binary or hex text, into its payload. Entries the file does
+ not cover are left unchanged.
+-return The number of entries loaded, IMAGE_ERROR_OPEN or IMAGE_ERROR_FORMAT.
+-parameter1: filename - Name of the input file.
+-parameter2: kind - The ImageKind.
+-parameter3: payload - The imem, dmem or disk array to load into.
+*/
+int load_image(const char *filename, ImageKind kind, void *payload);
+
+/*
+-Functionality: Loads an image held in memory, e.g. the contents of an input file, like load_image.
+-return The number of entries loaded, IMAGE_ERROR_OPEN if memory could not be allocated, or IMAGE_ERROR_FORMAT.
+-parameter1: data - The binary or hex text image.
+-parameter2: size - Its size in bytes.
+-parameter3: kind - The ImageKind.
+-parameter4: payload - The imem, dmem or disk array to load into.
+*/
+int load_image_buffer(const uint8_t *data, size_t size, ImageKind kind, void *payload);
+
+/*
+-Functionality: Writes a payload as a binary image.
+-return 1 on success, 0 if the file could not be written.
+-parameter1: filename - Name of the output file.
+-parameter2: kind - The ImageKind.
+-parameter3: payload - The imem, dmem or disk array to write.
+-parameter4: entries - Number of entries to write: instructions, data words or disk sectors.
+*/
+int write_binary_image(const char *filename, ImageKind kind, const void *payload, int entries);
+
+/*
+-Functionality: Writes a payload in the full hex text format, formatted into one buffer and written at once.
+-return 1 on success, 0 if the file could not be written.
+-parameter1: filename - Name of the output file.
+-parameter2: kind - The ImageKind.
+-parameter3: payload - The imem, dmem or disk array to write.
+-parameter4: entries - Number of entries to write: instructions, data words or disk sectors.
+*/
+int write_text_image(const char *filename, ImageKind kind, const void *payload, int entries);
+
+/*
+-Functionality: Writes a payload in the hex text format, full, trimmed after the last nonzero entry,
+ or only its dirty blocks (data memory blocks of DATA_BLOCK_WORDS words, disk sectors, monitor rows). Loading a
+ dirty dump over the image the payload was loaded from gives the payload back. Instruction images
+ have no dirty tracking and are always written in full for DUMP_DIRTY.
+-return 1 on success, 0 if the file could not be written.
+-parameter1: filename - Name of the output file.
+-parameter2: kind - The ImageKind.
+-parameter3: payload - The imem, dmem or disk array to write.
+-parameter4: entries - Number of entries to write: instructions, data words (the memory depth), disk sectors or pixels.
+-parameter5: mode - The DumpMode.
+-parameter6: dirty - The dirty block bitmap of the payload, NULL writes DUMP_DIRTY in full.
+*/
+int write_text_dump(const char *filename, ImageKind kind, const void *payload, int entries, DumpMode mode, const uint64_t *dirty);
+
+/*
+-Functionality: Writes several independent hex text dumps in parallel, one thread per file.
+-return 1 if every file was written, 0 otherwise (the ok field tells which).
+-parameter1: dumps - Array of TextDump descriptions.
+-parameter2: count - Number of dumps.
+*/
+int write_text_dumps(TextDump *dumps, int count);
+
+/*
+-Functionality: Converts an image between the hex text and the binary format.
+-return 1 on success, 0 otherwise.
+-parameter1: input - Name of the input file, binary or text.
+-parameter2: output - Name of the output file.
+-parameter3: kind - The ImageKind.
+-parameter4: to_binary - 1 to write a binary image, 0 to write hex text.
+ Memory images longer than the default depth keep their length.
+*/
+int convert_image(const char *input, const char *output, ImageKind kind, int to_binary);
+
+#endif
@@ -1,10 +1,27 @@
 #define _CRT_SECURE_NO_WARNINGS
 #include "instruction_decode.h"
 #include <stdio.h> 
+#include <stdlib.h>
+#ifdef _WIN32
+#include <malloc.h>
+#endif
 
 
 // Decode the instruction from instruction fetch
 void decode_instruction(const uint8_t *instruction_line, Instruction *decoded_instruction, Registers *registers) {
+	decode_fields(instruction_line, decoded_instruction);
+
+	registers->imm = 1;
+
+	// Update $imm1 and $imm2 with the sign-extended immediates
+	set_register(registers, 1, decoded_instruction->imm1);
+	set_register(registers, 2, decoded_instruction->imm2);
+
+	registers->imm = 0;
+}
+
+// Decode the instruction fields only
+void decode_fields(const uint8_t *instruction_line, Instruction *decoded_instruction) {
 	// Decode the opcode (bits 47:40)
 	decoded_instruction->opcode = instruction_line[0];
 
@@ -14,18 +31,30 @@ void decode_instruction(const uint8_t *instruction_line, Instruction *decoded_in
 	decoded_instruction->rt = (instruction_line[2] >> 4) & 0x0F; // Upper 4 bits of byte 2
 	decoded_instruction->rm = instruction_line[2] & 0x0F;        // Lower 4 bits of byte 2
 
-	registers->imm = 1;
+	decoded_instruction->breakpoint = 0;
+	decoded_instruction->reserved[0] = 0;
+	decoded_instruction->reserved[1] = 0;
 
-	// Decode imm1 (bits 23:12) and update $imm1
+	// Decode imm1 (bits 23:12)
 	uint16_t immediate1 = ((instruction_line[3] << 4) | (instruction_line[4] >> 4)) & 0x0FFF; // byte 3 and Upper 4 bits of byte 4
-	set_register(registers, 1, sign_extend(immediate1, 12));
-
+	decoded_instruction->imm1 = (uint32_t)sign_extend(immediate1, 12);
 
-	// Decode imm2 (bits 11:0) and update $imm2
+	// Decode imm2 (bits 11:0)
 	uint16_t immediate2 = ((instruction_line[4] & 0x0F) << 8) | instruction_line[5]; // Lower 4 bits of byte 4 and byte 5
-	set_register(registers, 2, sign_extend(immediate2, 12));
+	decoded_instruction->imm2 = (uint32_t)sign_extend(immediate2, 12);
+}
 
-	registers->imm = 0;
+// Decode the whole instruction memory once
+void predecode_program(const ProgramImage *image, DecodedProgram *program) {
+	for (int address = 0; address < INSTRUCTION_MEM_MAX; address++) {
+		decode_fields(image->instructions[address], &program->entries[address]);
+	}
+}
+
+// Load the predecoded immediates into $imm1 and $imm2
+void load_immediates(Registers *registers, const Instruction *decoded_instruction) {
+	registers->regs[REG_IMM1] = decoded_instruction->imm1;
+	registers->regs[REG_IMM2] = decoded_instruction->imm2;
 }
 
 // Sign Extension Function
@@ -36,4 +65,21 @@ int32_t sign_extend(int16_t value, int bits) {
 	return value;
 }
 
-	
\ No newline at end of file
+// Allocate a block aligned to a cache line
+void *cache_aligned_alloc(size_t size) {
+#ifdef _WIN32
+	return _aligned_malloc(size, CACHE_LINE_SIZE);
+#else
+	void *block;
+	return (posix_memalign(&block, CACHE_LINE_SIZE, size) == 0) ? block : NULL;
+#endif
+}
+
+// Free a block allocated with cache_aligned_alloc
+void cache_aligned_free(void *block) {
+#ifdef _WIN32
+	_aligned_free(block);
+#else
+	free(block);
+#endif
+}
@@ -1,20 +1,38 @@
 #ifndef INSTRUCTION_DECODE_H
 #define INSTRUCTION_DECODE_H
 
+#include <stddef.h>
 #include <stdint.h>
 #include "registers.h" // To access and modify registers
+#include "memory.h"    // For the program image to predecode
 
-// Structure to represent a decoded instruction
+// Cache line size used to align the predecoded instruction table
+#define CACHE_LINE_SIZE 64
+
+#if defined(_MSC_VER)
+#define CACHE_ALIGNED __declspec(align(CACHE_LINE_SIZE))
+#else
+#define CACHE_ALIGNED __attribute__((aligned(CACHE_LINE_SIZE)))
+#endif
+
+// Structure to represent a decoded instruction (16 bytes, 4 per cache line)
 typedef struct {
 	uint8_t opcode;   // 8 bits (bits 47:40)
 	uint8_t rd;       // 4 bits (bits 39:36)
 	uint8_t rs;       // 4 bits (bits 35:32)
 	uint8_t rt;       // 4 bits (bits 31:28)
 	uint8_t rm;       // 4 bits (bits 27:24)
-	uint16_t imm1;    // 12 bits (bits 23:12)
-	uint16_t imm2;    // 12 bits (bits 11:0)
+	uint8_t breakpoint; // Set on the entries of PC breakpoints (breakpoints.h)
+	uint8_t reserved[2]; // Padding, keeps the immediates 4-byte aligned
+	uint32_t imm1;    // 12 bits (bits 23:12), already sign-extended to 32 bits
+	uint32_t imm2;    // 12 bits (bits 11:0), already sign-extended to 32 bits
 } Instruction;
 
+// The whole instruction memory, fully decoded once at load time and indexed by PC
+typedef struct CACHE_ALIGNED {
+	Instruction entries[INSTRUCTION_MEM_MAX];
+} DecodedProgram;
+
 
 // Function declaration
 
@@ -28,6 +46,31 @@ typedef struct {
 void decode_instruction(const uint8_t *instruction_line, Instruction *decoded_instruction, Registers *registers);
 
 
+/*
+-Functionality: Decodes a 48-bit instruction into its fields without touching the registers.
+-parameter1: instruction_line - Pointer to the 48-bit instruction (array of 6 bytes).
+-parameter2: decoded_instruction - Pointer to the Instruction struct to store the decoded fields.
+*/
+void decode_fields(const uint8_t *instruction_line, Instruction *decoded_instruction);
+
+
+/*
+-Functionality: Decodes the whole instruction memory once. Must be called after load_instruction_memory,
+ instruction memory is never written at runtime so the table stays valid for the whole run.
+-parameter1: image - Pointer to the ProgramImage structure holding the loaded instruction memory.
+-parameter2: program - Pointer to the DecodedProgram table to fill.
+*/
+void predecode_program(const ProgramImage *image, DecodedProgram *program);
+
+
+/*
+-Functionality: Loads the predecoded immediates of an instruction into $imm1 and $imm2.
+-parameter1: registers - Pointer to the Registers structure.
+-parameter2: decoded_instruction - Pointer to the predecoded instruction.
+*/
+void load_immediates(Registers *registers, const Instruction *decoded_instruction);
+
+
 /*
 -Functionality: Perform sign extension on a value.
 -return The sign-extended 32-bit value.
@@ -36,4 +79,19 @@ void decode_instruction(const uint8_t *instruction_line, Instruction *decoded_in
 */
 int32_t sign_extend(int16_t value, int bits);
 
-#endif 
\ No newline at end of file
+
+/*
+-Functionality: Allocates a block aligned to a cache line, for heap objects holding CACHE_ALIGNED types
+ (malloc only guarantees 16 bytes).
+-return Pointer to the block, NULL if it could not be allocated.
+-parameter1: size - Size of the block in bytes.
+*/
+void *cache_aligned_alloc(size_t size);
+
+/*
+-Functionality: Frees a block allocated with cache_aligned_alloc.
+-parameter1: block - Pointer to the block, may be NULL.
+*/
+void cache_aligned_free(void *block);
+
+#endif
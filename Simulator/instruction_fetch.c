@@ -4,19 +4,24 @@
 
 
 // Fetch the instruction from instruction memory
-const uint8_t *fetch_instruction(const Memory *memory, uint16_t *pc) {
-	if (*pc > PC_MAX || *pc < 0) {
+const uint8_t *fetch_instruction(const ProgramImage *image, uint16_t *pc) {
+	if (*pc >= INSTRUCTION_MEM_MAX) {
 		printf("Error: Program Counter (PC) out of range: %d\n", *pc);
 		return NULL; // Return NULL for invalid PC
 	}
 
 	// Fetch and return the instruction at the current PC
-	return read_instruction(memory, *pc);
+	return read_instruction(image, *pc);
+}
+
+// Fetch the predecoded instruction, the PC is always kept within the instruction depth
+const Instruction *fetch_decoded_instruction(const DecodedProgram *program, const uint16_t *pc) {
+	return &program->entries[*pc & (INSTRUCTION_MEM_MAX - 1)];
 }
 
 // Increment the Program Counter (PC)
-void increment_pc(uint16_t *pc) {
-	if (*pc < PC_MAX) {
+void increment_pc(uint16_t *pc, uint16_t pc_mask) {
+	if (*pc < pc_mask) {
 		(*pc)++; // Increment PC by 1
 	}
 	else {
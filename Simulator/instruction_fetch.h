@@ -3,9 +3,9 @@
 
 #include <stdint.h>
 #include "memory.h"
+#include "instruction_decode.h" // For the predecoded instruction table
 
-// Maximum value for the PC (12 bits)
-#define PC_MAX 4095
+// The PC is 16 bits wide; a run uses the low bits selected by its instruction depth (io_pc_mask)
 
 // Function declaration
 
@@ -13,16 +13,26 @@
 /*
 -Functionality: Fetches the 48-bit instruction from instruction memory.
 -return A pointer to the 48-bit instruction (array of 6 bytes).
--parameter1: memory -  Pointer to the Memory structure.
+-parameter1: image -  Pointer to the ProgramImage structure.
 -parameter2: pc - Pointer to the Program Counter (PC).
 */
-const uint8_t *fetch_instruction(const Memory *memory, uint16_t *pc);
+const uint8_t *fetch_instruction(const ProgramImage *image, uint16_t *pc);
 
 
 /*
--Functionality: Increments the Program Counter (PC) by 1.
+-Functionality: Fetches the predecoded instruction at the current PC.
+-return A pointer to the predecoded instruction.
+-parameter1: program - Pointer to the predecoded instruction table.
+-parameter2: pc - Pointer to the Program Counter (PC).
+*/
+const Instruction *fetch_decoded_instruction(const DecodedProgram *program, const uint16_t *pc);
+
+
+/*
+-Functionality: Increments the Program Counter (PC) by 1, warning instead at the last instruction.
 -parameter1: pc - Pointer to the Program Counter (PC).
+-parameter2: pc_mask - The largest PC, instruction depth - 1.
 */
-void increment_pc(uint16_t *pc);
+void increment_pc(uint16_t *pc, uint16_t pc_mask);
 
 #endif
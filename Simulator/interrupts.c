@@ -2,39 +2,95 @@
 #include "interrupts.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <ctype.h>
 
-// Load IRQ2 events from a file
-void load_irq2_events(const char *filename, IRQ2Data *irq2) {
-	FILE *file = fopen(filename, "r");
-	if (!file) {
-		printf("Error: Could not open IRQ2 input file: %s\n", filename);
-		exit(1);
-	}
-
-	// Initialize the IRQ2Data structure
+// Initialize an empty IRQ2Data structure
+static void clear_irq2_events(IRQ2Data *irq2) {
 	irq2->events = NULL;
 	irq2->count = 0;
 	irq2->capacity = 0;
 	irq2->current_index = 0;
+}
+
+// Append an event, returns 0 (with the events freed) if memory could not be allocated
+static int add_irq2_event(IRQ2Data *irq2, int event) {
+	// Resize the array if needed
+	if (irq2->count >= irq2->capacity) {
+		int capacity = (irq2->capacity == 0) ? 10 : irq2->capacity * 2;
+		int *events = realloc(irq2->events, capacity * sizeof(int));
+		if (!events) {
+			free_irq2_data(irq2);
+			return 0;
+		}
+		irq2->events = events;
+		irq2->capacity = capacity;
+	}
+
+	// Add the event to the array
+	irq2->events[irq2->count++] = event;
+	return 1;
+}
+
+// Read IRQ2 events from a file
+int read_irq2_events(const char *filename, IRQ2Data *irq2) {
+	clear_irq2_events(irq2);
+
+	FILE *file = fopen(filename, "r");
+	if (!file) {
+		return 0;
+	}
 
 	int event;
 	while (fscanf(file, "%d", &event) == 1) {
-		// Resize the array if needed
-		if (irq2->count >= irq2->capacity) {
-			irq2->capacity = (irq2->capacity == 0) ? 10 : irq2->capacity * 2;
-			irq2->events = realloc(irq2->events, irq2->capacity * sizeof(int));
-			if (!irq2->events) {
-				printf("Error: Memory allocation failed while loading IRQ2 events\n");
-				fclose(file);
-				exit(1);
-			}
+		if (!add_irq2_event(irq2, event)) {
+			fclose(file);
+			return -1;
 		}
-
-		// Add the event to the array
-		irq2->events[irq2->count++] = event;
 	}
 
 	fclose(file);
+	return 1;
+}
+
+// Parse IRQ2 events from a text held in memory, like read_irq2_events
+int parse_irq2_events(const char *text, size_t size, IRQ2Data *irq2) {
+	size_t i = 0;
+
+	clear_irq2_events(irq2);
+	for (;;) {
+		while (i < size && isspace((unsigned char)text[i])) {
+			i++;
+		}
+		int negative = (i < size && (text[i] == '-' || text[i] == '+')) ? (text[i++] == '-') : 0;
+		if (i == size || !isdigit((unsigned char)text[i])) {
+			break; // The end, or a token that is not a number, as fscanf stops there
+		}
+		long long event = 0;
+		while (i < size && isdigit((unsigned char)text[i])) {
+			if (event <= INT32_MAX) {
+				event = event * 10 + (text[i] - '0');
+			}
+			i++;
+		}
+		if (!add_irq2_event(irq2, (int)(negative ? -event : event))) {
+			return -1;
+		}
+	}
+	return 1;
+}
+
+// Load IRQ2 events from a file
+int load_irq2_events(const char *filename, IRQ2Data *irq2) {
+	int result = read_irq2_events(filename, irq2);
+	if (result == 0) {
+		printf("Error: Could not open IRQ2 input file: %s\n", filename);
+		return 0;
+	}
+	if (result < 0) {
+		printf("Error: Memory allocation failed while loading IRQ2 events\n");
+		return 0;
+	}
+	return 1;
 }
 
 // Check and trigger IRQ2 based on the current clock cycle
@@ -79,3 +135,10 @@ void handle_interrupts(IORegisters *io, uint16_t *pc, int *in_isr) {
 		*in_isr = 1;
 	}
 }
+
+// Check whether an enabled interrupt is raised
+int interrupt_pending(const IORegisters *io) {
+	return ((io->IORegister[0] & io->IORegister[3]) | // irq0enable & irq0status
+		(io->IORegister[1] & io->IORegister[4]) | // irq1enable & irq1status
+		(io->IORegister[2] & io->IORegister[5])) == 1; // irq2enable & irq2status
+}
@@ -15,10 +15,28 @@ typedef struct {
 
 /*
 - Functionality: Loads IRQ2 events from an input file.
+- Return: 1 on success, 0 if the file could not be read (the error is printed).
 - Parameter1: filename - Path to the input file specifying IRQ2 trigger clock cycles.
 - Parameter2: irq2 - Pointer to the IRQ2Data structure to populate.
 */
-void load_irq2_events(const char *filename, IRQ2Data *irq2);
+int load_irq2_events(const char *filename, IRQ2Data *irq2);
+
+/*
+- Functionality: Reads IRQ2 events from an input file without printing errors.
+- Return: 1 on success, 0 if the file could not be opened, -1 if memory allocation failed.
+- Parameter1: filename - Path to the input file specifying IRQ2 trigger clock cycles.
+- Parameter2: irq2 - Pointer to the IRQ2Data structure to populate.
+*/
+int read_irq2_events(const char *filename, IRQ2Data *irq2);
+
+/*
+- Functionality: Parses IRQ2 events from a text held in memory (the contents of an irq2in file), like read_irq2_events.
+- Return: 1 on success, -1 if memory could not be allocated.
+- Parameter1: text - The decimal clock cycles, separated by white space. It need not be NUL-terminated.
+- Parameter2: size - Size of the text in bytes.
+- Parameter3: irq2 - Pointer to the IRQ2Data structure to populate.
+*/
+int parse_irq2_events(const char *text, size_t size, IRQ2Data *irq2);
 
 /*
 - Functionality: Checks and triggers IRQ2 based on the current clock cycle.
@@ -42,4 +60,11 @@ void free_irq2_data(IRQ2Data *irq2);
 */
 void handle_interrupts(IORegisters *io, uint16_t *pc, int *in_isr);
 
+/*
+- Functionality: Checks whether an enabled interrupt is raised (irq signal of handle_interrupts).
+- Return: 1 if irq0, irq1 or irq2 is both enabled and raised, 0 otherwise.
+- Parameter1: io - Pointer to the IORegisters structure.
+*/
+int interrupt_pending(const IORegisters *io);
+
 #endif 
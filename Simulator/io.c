@@ -1,10 +1,95 @@
 #include "io.h"
+#include "disk.h"  // For the diskcmd and diskstatus callbacks
+#include "trace.h"
 #include <string.h>
 #include <stdio.h>
 
+static void timer_written(void *device, IORegisters *io, int reg_index, uint32_t previous);
+
+// Name, bit width, flags and built-in device of each register
+static const struct {
+	const char *name;
+	int bit_width;
+	uint32_t flags;
+	IOWriteHandler write;
+} io_register_table[NUM_IO_REGISTERS] = {
+	{ "irq0enable", 1, IO_WAKES_SCHEDULER, NULL }, { "irq1enable", 1, IO_WAKES_SCHEDULER, NULL }, { "irq2enable", 1, IO_WAKES_SCHEDULER, NULL },
+	{ "irq0status", 1, IO_WAKES_SCHEDULER, NULL }, { "irq1status", 1, IO_WAKES_SCHEDULER, NULL }, { "irq2status", 1, IO_WAKES_SCHEDULER, NULL },
+	{ "irqhandler", 12, 0, NULL }, { "irqreturn", 12, 0, NULL },
+	{ "clks", 32, IO_WAKES_SCHEDULER, NULL }, // Moves the next IRQ2 match
+	{ "leds", 32, 0, NULL }, { "display7seg", 32, 0, NULL },
+	{ "timerenable", 1, IO_WAKES_SCHEDULER, timer_written }, { "timercurrent", 32, IO_WAKES_SCHEDULER, NULL }, { "timermax", 32, IO_WAKES_SCHEDULER, NULL },
+	{ "diskcmd", 2, IO_WAKES_SCHEDULER, disk_written }, { "disksector", 7, 0, NULL }, { "diskbuffer", 12, 0, NULL }, { "diskstatus", 1, IO_WAKES_SCHEDULER, disk_written },
+	{ "disksectorhigh", 32, 0, NULL }, { "reserved", 32, 0, NULL },
+	{ "monitoraddr", 16, 0, NULL }, { "monitordata", 8, 0, NULL }, { "monitorcmd", 1, 0, NULL }
+};
+
+// timerenable write: the timer counts while it is set
+static void timer_written(void *device, IORegisters *io, int reg_index, uint32_t previous) {
+	(void)device;
+	(void)reg_index;
+	(void)previous;
+	io->active = (io->IORegister[IO_TIMER_ENABLE] == 1) ? (io->active | IO_ACTIVE_TIMER) : (io->active & ~IO_ACTIVE_TIMER);
+}
+
 // Initialize all I/O registers to 0
 void init_io(IORegisters *io) {
-	memset(io->IORegister, 0, sizeof(io->IORegister));
+	MemoryGeometry geometry = default_memory_geometry();
+
+	memset(io, 0, sizeof(*io));
+	for (int i = 0; i < NUM_IO_REGISTERS; i++) {
+		int bit_width = io_register_table[i].bit_width;
+		io->bus[i].mask = (bit_width == 32) ? 0xFFFFFFFF : (1U << bit_width) - 1;
+		io->bus[i].flags = io_register_table[i].flags;
+		io->bus[i].write = io_register_table[i].write;
+	}
+	set_io_geometry(io, &geometry);
+}
+
+// Size the geometry-dependent registers
+void set_io_geometry(IORegisters *io, const MemoryGeometry *geometry) {
+	io->bus[IO_IRQ_HANDLER].mask = geometry->instruction_depth - 1;
+	io->bus[IO_IRQ_RETURN].mask = geometry->instruction_depth - 1;
+	io->bus[IO_DISK_BUFFER].mask = geometry->data_depth - 1;
+}
+
+// Attach a device to an I/O register
+int attach_io_device(IORegisters *io, int reg_index, IOReadHandler read, IOWriteHandler write, void *device, uint32_t flags) {
+	if (reg_index < 0 || reg_index >= NUM_IO_REGISTERS) {
+		printf("Error: Invalid I/O register index %d\n", reg_index);
+		return 0;
+	}
+
+	IODescriptor *descriptor = &io->bus[reg_index];
+	if (descriptor->read != NULL || descriptor->write != NULL) {
+		printf("Error: I/O register %s already has a device\n", io_register_table[reg_index].name);
+		return 0;
+	}
+	descriptor->read = read;
+	descriptor->write = write;
+	descriptor->device = device;
+	descriptor->flags |= flags;
+	return 1;
+}
+
+// Recompute the active built-in devices from their registers
+void refresh_io_devices(IORegisters *io) {
+	timer_written(NULL, io, IO_TIMER_ENABLE, 0);
+	disk_written(NULL, io, IO_DISK_CMD, 0);
+}
+
+// Copy the register values and widths, keeping the devices and the trace
+void copy_io_registers(IORegisters *io, const IORegisters *source) {
+	memcpy(io->IORegister, source->IORegister, sizeof(io->IORegister));
+	for (int i = 0; i < NUM_IO_REGISTERS; i++) {
+		io->bus[i].mask = source->bus[i].mask;
+	}
+	refresh_io_devices(io);
+}
+
+// Name of an I/O register
+const char *io_register_name(int reg_index) {
+	return io_register_table[reg_index].name;
 }
 
 // Read a value from an I/O register
@@ -13,7 +98,19 @@ uint32_t io_read(const IORegisters *io, int reg_index) {
 		printf("Error: Invalid I/O register index %d\n", reg_index);
 		return 0;
 	}
-	return io->IORegister[reg_index];
+
+	const IODescriptor *descriptor = &io->bus[reg_index];
+	uint32_t value = io->IORegister[reg_index];
+	if (descriptor->read != NULL) {
+		value = descriptor->read(descriptor->device, io, reg_index);
+	}
+	if (io->trace != NULL) {
+		trace_io_access(io->trace, 0, io->IORegister[IO_CLKS], reg_index, value, value);
+	}
+	if (io->breakpoints != NULL) {
+		watch_io_access(io, reg_index, value, value, WATCH_READ);
+	}
+	return value;
 }
 
 // Write a value to an I/O register, respecting its bit width
@@ -23,32 +120,58 @@ void io_write(IORegisters *io, int reg_index, uint32_t value) {
 		return;
 	}
 
-	int bit_width = IO_REGISTER_SIZES[reg_index];
-	if (bit_width > 0) {
-		uint32_t mask = (bit_width == 32) ? 0xFFFFFFFF : (1U << bit_width) - 1;
-		io->IORegister[reg_index] = value & mask;
+	IODescriptor *descriptor = &io->bus[reg_index];
+	uint32_t mask = descriptor->mask;
+	uint32_t previous = io->IORegister[reg_index];
+	io->IORegister[reg_index] = value & mask;
+	if (io->trace != NULL) {
+		trace_io_access(io->trace, 1, io->IORegister[IO_CLKS], reg_index, value & mask, previous);
+	}
+	if (io->breakpoints != NULL) {
+		watch_io_access(io, reg_index, value & mask, previous, WATCH_WRITE);
+	}
+	if (descriptor->write != NULL) {
+		descriptor->write(descriptor->device, io, reg_index, previous);
 	}
 }
 
 // Increment the clock counter
 void increment_clock(IORegisters *io) {
-	io_write(io, 8, io->IORegister[8] + 1); // Increment clks register
+	io->IORegister[IO_CLKS]++; // Increment clks register (32 bits, no mask needed, not an out access)
 }
 
 // Update the timer registers
 void update_timer(IORegisters *io) {
 	// Check if the timer is enabled
-	if (io->IORegister[11] == 1) { // timerenable
+	if (io->IORegister[IO_TIMER_ENABLE] == 1) {
 		// Increment timercurrent
-		io->IORegister[12]++; // Increment 32-bit current timer value
+		io->IORegister[IO_TIMER_CURRENT]++; // Increment 32-bit current timer value
 
 		// Check if timercurrent matches timermax
-		if (io->IORegister[12] == io->IORegister[13]) { // timermax
-			io->IORegister[3] = 1;   // Set irqstatus0 to trigger IRQ0
-			io->IORegister[12] = 0; // Reset timercurrent to 0
+		if (io->IORegister[IO_TIMER_CURRENT] == io->IORegister[IO_TIMER_MAX]) {
+			io->IORegister[IO_IRQ0_STATUS] = 1; // Set irqstatus0 to trigger IRQ0
+			io->IORegister[IO_TIMER_CURRENT] = 0; // Reset timercurrent to 0
 		}
 	}
 }
 
+// Cycles until the timer next raises irq0, UINT64_MAX while it is disabled
+uint64_t timer_cycles_to_event(const IORegisters *io) {
+	if (!(io->active & IO_ACTIVE_TIMER)) {
+		return UINT64_MAX;
+	}
+	// timercurrent is incremented, then compared to timermax: a 32-bit counter needs a full wrap to match again
+	uint32_t cycles = io->IORegister[IO_TIMER_MAX] - io->IORegister[IO_TIMER_CURRENT];
+	return (cycles == 0) ? (uint64_t)1 << 32 : cycles;
+}
+
+// Advance the clock and timer over cycles with no event
+void skip_timer_cycles(IORegisters *io, uint32_t cycles) {
+	io->IORegister[IO_CLKS] += cycles;
+	if (io->active & IO_ACTIVE_TIMER) {
+		io->IORegister[IO_TIMER_CURRENT] += cycles;
+	}
+}
+
 
 
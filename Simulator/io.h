@@ -2,25 +2,131 @@
 #define IO_H
 
 #include <stdint.h>
+#include "memory.h" // For the memory geometry
 
 #define NUM_IO_REGISTERS 23
 
-// Define bit widths for each register
-static const int IO_REGISTER_SIZES[NUM_IO_REGISTERS] = {1,  1,  1,  1,  1,  1,  12, 12, 32, 32, 32, 1, 32, 32, 2, 7, 12, 1, 32, 32, 16, 8, 1};
+// Registers whose width follows the memory geometry
+#define IO_IRQ_HANDLER 6  // irqhandler, as wide as the PC
+#define IO_IRQ_RETURN 7   // irqreturn, as wide as the PC
+#define IO_DISK_BUFFER 16 // diskbuffer, as wide as a data memory address
 
-// Structure for I/O registers
+// Registers of the clock, timer and disk
+#define IO_IRQ0_STATUS 3     // Raised by the timer
+#define IO_IRQ1_STATUS 4     // Raised by the disk
+#define IO_CLKS 8
+#define IO_TIMER_ENABLE 11
+#define IO_TIMER_CURRENT 12
+#define IO_TIMER_MAX 13
+#define IO_DISK_CMD 14
+#define IO_DISK_SECTOR 15
+#define IO_DISK_STATUS 17
+
+// Descriptor flags
+#define IO_WAKES_SCHEDULER 1 // An out may move the next timer, interrupt or disk event
+
+// Built-in devices with work on every cycle, bits of IORegisters.active
+#define IO_ACTIVE_TIMER 1 // timerenable is set, timercurrent counts
+#define IO_ACTIVE_DISK 2  // A disk command runs, or starts on the next cycle
+
+struct Trace;
+struct IORegisters;
+
+// Device callback for an in: returns the value read from one of its registers
+typedef uint32_t (*IOReadHandler)(void *device, const struct IORegisters *io, int reg_index);
+
+// Device callback run after an out stored the masked value in one of its registers
+typedef void (*IOWriteHandler)(void *device, struct IORegisters *io, int reg_index, uint32_t previous);
+
+// Bus entry of one I/O register
 typedef struct {
+	uint32_t mask;        // Value mask, from the register width and the geometry
+	uint32_t flags;       // IO_WAKES_SCHEDULER
+	IOReadHandler read;   // NULL: in returns the stored value
+	IOWriteHandler write; // NULL: out only stores the value
+	void *device;         // Passed to the callbacks
+} IODescriptor;
+
+// Structure for I/O registers
+typedef struct IORegisters {
 	uint32_t  IORegister[NUM_IO_REGISTERS];
+	IODescriptor bus[NUM_IO_REGISTERS];
+	uint32_t active;     // IO_ACTIVE_* devices, kept by the write callbacks of their registers
+	struct Trace *trace; // Logs in/out accesses when not NULL
+	struct Breakpoints *breakpoints; // Checks in/out accesses against the IO watchpoints when not NULL
 } IORegisters;
 
+// Mask of the PC, instruction depth - 1 (a jump target keeps these bits of R[rm])
+static inline uint16_t io_pc_mask(const IORegisters *io) {
+	return (uint16_t)io->bus[IO_IRQ_RETURN].mask;
+}
+
+// Hex digits printed for a PC: 3 up to the default depth of 4096, as many as the depth needs beyond it
+static inline int pc_hex_digits(uint16_t pc_mask) {
+	return (pc_mask > 0xFFF) ? 4 : 3;
+}
+
 
 /*
--Functionality: Initialize all I/O registers to 0.
+-Functionality: Initialize all I/O registers to 0, with tracing off, no device attached and the widths
+ of the default geometry.
 -parameter1: io - Pointer to the I/O registers structure to initialize.
 */
 void init_io(IORegisters *io);
 
 
+/*
+-Functionality: Sizes the PC, irqhandler, irqreturn and diskbuffer to a memory geometry.
+-parameter1: io - Pointer to the I/O registers structure, after init_io.
+-parameter2: geometry - Pointer to the checked MemoryGeometry.
+*/
+void set_io_geometry(IORegisters *io, const MemoryGeometry *geometry);
+
+
+/*
+-Functionality: Attaches a device to an I/O register, so it reacts to in/out accesses of the register
+ on every engine without being polled. A write callback that changes other registers (e.g. raises an
+ irq status) needs IO_WAKES_SCHEDULER.
+-return 1 on success, 0 if the index is invalid or another device owns the register (timerenable,
+ diskcmd and diskstatus belong to the built-in timer and disk).
+-parameter1: io - Pointer to the I/O registers structure, after init_io.
+-parameter2: reg_index - The index of the I/O register.
+-parameter3: read - Callback for in, or NULL.
+-parameter4: write - Callback for out, or NULL.
+-parameter5: device - Context passed to the callbacks.
+-parameter6: flags - Descriptor flags added to the register's own.
+*/
+int attach_io_device(IORegisters *io, int reg_index, IOReadHandler read, IOWriteHandler write, void *device, uint32_t flags);
+
+
+/*
+-Functionality: Recomputes which built-in devices are active from their registers, after the registers
+ were written without io_write (e.g. undone by the debugger).
+-parameter1: io - Pointer to the I/O registers structure.
+*/
+void refresh_io_devices(IORegisters *io);
+
+
+/*
+-Functionality: Copies the register values and widths of another register file, keeping the devices
+ and the trace of this one.
+-parameter1: io - Pointer to the I/O registers structure to overwrite.
+-parameter2: source - Pointer to the I/O registers structure to copy.
+*/
+void copy_io_registers(IORegisters *io, const IORegisters *source);
+
+
+/*
+-Functionality: Returns the name of an I/O register, as written in hwregtrace.txt.
+-parameter1: reg_index - The index of the I/O register (0 to 22).
+*/
+const char *io_register_name(int reg_index);
+
+
+// An in or out of a register, after an out stored its value (defined in breakpoints.c)
+void watch_io_access(const IORegisters *io, int reg_index, uint32_t value, uint32_t previous, int access);
+
+
 /*
 -Functionality:  Read a value from an I/O register.
 -parameter1: io - Pointer to the I/O registers structure.
@@ -51,4 +157,18 @@ void increment_clock(IORegisters *io);
 */
 void update_timer(IORegisters *io);
 
+/*
+-Functionality: Returns the cycles until the timer next raises irq0.
+-return The cycles, UINT64_MAX while the timer is disabled.
+-parameter1: io - Pointer to the I/O registers structure.
+*/
+uint64_t timer_cycles_to_event(const IORegisters *io);
+
+/*
+-Functionality: Advances clks and the timer over cycles that hold no event.
+-parameter1: io - Pointer to the I/O registers structure.
+-parameter2: cycles - Number of cycles, fewer than timer_cycles_to_event.
+*/
+void skip_timer_cycles(IORegisters *io, uint32_t cycles);
+
 #endif 
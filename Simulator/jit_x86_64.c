@@ -0,0 +1,379 @@
+#define _CRT_SECURE_NO_WARNINGS
+#include "jit_x86_64.h"
+#include <stdio.h>
+#include <string.h>
+
+#ifdef SIM_JIT_AVAILABLE
+
+#include <sys/mman.h>
+
+// Host registers used by the generated code
+#define HOST_EAX 0
+#define HOST_ECX 1
+#define HOST_EDX 2
+
+// Granularity of the arena protection changes (the smallest x86-64 page)
+#define JIT_PAGE_SIZE 4096
+
+// Fewest micro-ops worth compiling, calling the native code of a single one costs more than interpreting it
+#define JIT_MIN_NATIVE_OPS 2
+
+// Largest code a single block can produce (64 micro-ops of at most 80 bytes, plus entry/exit)
+#define JIT_MAX_BLOCK_CODE 8192
+
+// Temporary buffer a block is assembled into before it is copied to the arena
+typedef struct {
+	uint8_t bytes[JIT_MAX_BLOCK_CODE];
+	size_t length;
+} CodeBuffer;
+
+// Map the executable code arena
+int init_jit(JitState *jit) {
+	jit->size = JIT_CODE_SIZE;
+	jit->used = 0;
+	jit->compiled = 0;
+	jit->data_depth = DATA_MEM_DEPTH;
+	jit->policy = MEMORY_LOG;
+	jit->pc_mask = INSTRUCTION_MEM_DEPTH - 1;
+	jit->code = mmap(NULL, jit->size, PROT_READ | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (jit->code == MAP_FAILED) {
+		printf("Warning: Could not map JIT code memory, interpreting instead\n");
+		jit->code = NULL;
+		return 0;
+	}
+	return 1;
+}
+
+// Unmap the code arena
+void free_jit(JitState *jit) {
+	if (jit->code != NULL) {
+		munmap(jit->code, jit->size);
+	}
+	jit->code = NULL;
+	jit->used = 0;
+	jit->compiled = 0;
+}
+
+static void emit8(CodeBuffer *buffer, uint8_t value) {
+	buffer->bytes[buffer->length++] = value;
+}
+
+static void emit32(CodeBuffer *buffer, uint32_t value) {
+	for (int i = 0; i < 4; i++) {
+		emit8(buffer, (uint8_t)(value >> (8 * i)));
+	}
+}
+
+static void emit64(CodeBuffer *buffer, uint64_t value) {
+	for (int i = 0; i < 8; i++) {
+		emit8(buffer, (uint8_t)(value >> (8 * i)));
+	}
+}
+
+// host = guest register; $zero and the immediates of this instruction become constants
+static void emit_load_operand(CodeBuffer *buffer, int host, uint8_t reg_index, const MicroOp *op) {
+	if (reg_index == REG_ZERO) {
+		emit8(buffer, 0x31); // xor host, host
+		emit8(buffer, (uint8_t)(0xC0 | (host << 3) | host));
+	}
+	else if (reg_index == REG_IMM1 || reg_index == REG_IMM2) {
+		emit8(buffer, (uint8_t)(0xB8 + host)); // mov host, imm32
+		emit32(buffer, reg_index == REG_IMM1 ? op->imm1 : op->imm2);
+	}
+	else {
+		emit8(buffer, 0x8B); // mov host, [rbx + reg*4]
+		emit8(buffer, (uint8_t)(0x43 | (host << 3)));
+		emit8(buffer, (uint8_t)(reg_index * 4));
+	}
+}
+
+// guest register = eax
+static void emit_store_eax(CodeBuffer *buffer, uint8_t reg_index) {
+	emit8(buffer, 0x89); // mov [rbx + reg*4], eax
+	emit8(buffer, 0x43);
+	emit8(buffer, (uint8_t)(reg_index * 4));
+}
+
+// guest register = constant
+static void emit_store_constant(CodeBuffer *buffer, uint8_t reg_index, uint32_t value) {
+	emit8(buffer, 0xC7); // mov dword [rbx + reg*4], imm32
+	emit8(buffer, 0x43);
+	emit8(buffer, (uint8_t)(reg_index * 4));
+	emit32(buffer, value);
+}
+
+// eax = eax <op> host register, opcode is the "op r/m32, r32" form
+static void emit_alu_eax(CodeBuffer *buffer, uint8_t opcode, int host) {
+	emit8(buffer, opcode);
+	emit8(buffer, (uint8_t)(0xC0 | (host << 3)));
+}
+
+// eax = R[rs] + R[rt], the data memory address of lw/sw
+static void emit_address(CodeBuffer *buffer, const MicroOp *op) {
+	emit_load_operand(buffer, HOST_EAX, op->rs, op);
+	emit_load_operand(buffer, HOST_ECX, op->rt, op);
+	emit_alu_eax(buffer, 0x01, HOST_ECX); // add eax, ecx
+}
+
+// Compare the address in eax against the data memory depth the block is compiled for
+static void emit_bounds_check(CodeBuffer *buffer, const JitState *jit) {
+	emit8(buffer, 0x3D); // cmp eax, depth
+	emit32(buffer, jit->data_depth);
+}
+
+// Wrap the address in eax around the data memory depth (MEMORY_WRAP, no out-of-range path)
+static void emit_address_wrap(CodeBuffer *buffer, const JitState *jit) {
+	emit8(buffer, 0x25); // and eax, depth - 1
+	emit32(buffer, jit->data_depth - 1);
+}
+
+// data[eax] = ecx and mark the block of eax dirty
+static void emit_store_word(CodeBuffer *buffer) {
+	emit8(buffer, 0x41); emit8(buffer, 0x89); emit8(buffer, 0x0C); emit8(buffer, 0x84); // mov [r12 + rax*4], ecx
+	emit8(buffer, 0xC1); emit8(buffer, 0xE8); emit8(buffer, DATA_BLOCK_SHIFT); // shr eax, DATA_BLOCK_SHIFT
+	emit8(buffer, 0x49); emit8(buffer, 0x0F); emit8(buffer, 0xAB); emit8(buffer, 0x85); // bts [r13 + dirty], rax
+	emit32(buffer, (uint32_t)offsetof(Memory, dirty));
+}
+
+// Call a C function with rdi = Memory*, esi = eax (17 bytes, or 19 with edx = ecx)
+static void emit_memory_call(CodeBuffer *buffer, const void *function, int pass_ecx) {
+	emit8(buffer, 0x4C); emit8(buffer, 0x89); emit8(buffer, 0xEF); // mov rdi, r13
+	emit8(buffer, 0x89); emit8(buffer, 0xC6);                       // mov esi, eax
+	if (pass_ecx) {
+		emit8(buffer, 0x89); emit8(buffer, 0xCA);                   // mov edx, ecx
+	}
+	emit8(buffer, 0x48); emit8(buffer, 0xB8);                       // mov rax, imm64
+	emit64(buffer, (uint64_t)(uintptr_t)function);
+	emit8(buffer, 0xFF); emit8(buffer, 0xD0);                       // call rax
+}
+
+// Emit a straight-line micro-op, lw/sw are specialized for the data memory geometry
+static void emit_body_op(CodeBuffer *buffer, const JitState *jit, const MicroOp *op) {
+	int wrap = (jit->policy == MEMORY_WRAP);
+
+	switch (op->handler) {
+	case FAST_ADD: case FAST_SUB: case FAST_AND: case FAST_OR: case FAST_XOR: {
+		uint8_t opcode = (op->handler == FAST_ADD) ? 0x01 : (op->handler == FAST_SUB) ? 0x29 :
+			(op->handler == FAST_AND) ? 0x21 : (op->handler == FAST_OR) ? 0x09 : 0x31;
+		emit_load_operand(buffer, HOST_EAX, op->rs, op);
+		emit_load_operand(buffer, HOST_ECX, op->rt, op);
+		emit_load_operand(buffer, HOST_EDX, op->rm, op);
+		emit_alu_eax(buffer, opcode, HOST_ECX);
+		emit_alu_eax(buffer, opcode, HOST_EDX);
+		emit_store_eax(buffer, op->rd);
+		break;
+	}
+
+	case FAST_MAC:
+		emit_load_operand(buffer, HOST_EAX, op->rs, op);
+		emit_load_operand(buffer, HOST_ECX, op->rt, op);
+		emit_load_operand(buffer, HOST_EDX, op->rm, op);
+		emit8(buffer, 0x0F); emit8(buffer, 0xAF); emit8(buffer, 0xC1); // imul eax, ecx
+		emit_alu_eax(buffer, 0x01, HOST_EDX);                          // add eax, edx
+		emit_store_eax(buffer, op->rd);
+		break;
+
+	case FAST_SLL: case FAST_SRA: case FAST_SRL:
+		emit_load_operand(buffer, HOST_EAX, op->rs, op);
+		emit_load_operand(buffer, HOST_ECX, op->rt, op);
+		emit8(buffer, 0xD3); // shl/sar/shr eax, cl
+		emit8(buffer, (op->handler == FAST_SLL) ? 0xE0 : (op->handler == FAST_SRA) ? 0xF8 : 0xE8);
+		emit_store_eax(buffer, op->rd);
+		break;
+
+	case FAST_LW:
+		emit_address(buffer, op);
+		if (wrap) {
+			emit_address_wrap(buffer, jit);
+		}
+		else {
+			emit_bounds_check(buffer, jit);
+			emit8(buffer, 0x72); emit8(buffer, 19);   // jb fast
+			emit_memory_call(buffer, (const void *)read_data_out_of_range, 0); // Reports the invalid address, returns 0
+			emit8(buffer, 0xEB); emit8(buffer, 4);    // jmp join
+		}
+		emit8(buffer, 0x41); emit8(buffer, 0x8B); emit8(buffer, 0x04); emit8(buffer, 0x84); // fast: mov eax, [r12 + rax*4]
+		emit_load_operand(buffer, HOST_ECX, op->rm, op); // join:
+		emit_alu_eax(buffer, 0x01, HOST_ECX);
+		emit_store_eax(buffer, op->rd);
+		break;
+
+	case FAST_LW_DISCARD:
+		if (wrap) {
+			break; // Every address is valid
+		}
+		emit_address(buffer, op);
+		emit_bounds_check(buffer, jit);
+		emit8(buffer, 0x72); emit8(buffer, 17);   // jb skip
+		emit_memory_call(buffer, (const void *)read_data_out_of_range, 0);
+		break;
+
+	case FAST_SW:
+		emit_address(buffer, op);
+		emit_load_operand(buffer, HOST_ECX, op->rm, op);
+		emit_load_operand(buffer, HOST_EDX, op->rd, op);
+		emit8(buffer, 0x01); emit8(buffer, 0xD1); // add ecx, edx (value)
+		if (wrap) {
+			emit_address_wrap(buffer, jit);
+			emit_store_word(buffer);
+			break;
+		}
+		emit_bounds_check(buffer, jit);
+		emit8(buffer, 0x73); emit8(buffer, 17);   // jae slow
+		emit_store_word(buffer);
+		emit8(buffer, 0xEB); emit8(buffer, 19);   // jmp join
+		emit_memory_call(buffer, (const void *)write_data_out_of_range, 1); // Reports the invalid address
+		break;
+
+	default:
+		break;
+	}
+}
+
+// Emit a branch/jal terminator: eax = next PC
+static void emit_control_op(CodeBuffer *buffer, const JitState *jit, const MicroOp *op, uint16_t pc) {
+	if (op->handler == FAST_JAL || op->handler == FAST_JUMP) {
+		emit_load_operand(buffer, HOST_ECX, op->rm, op);
+		emit8(buffer, 0x81); emit8(buffer, 0xE1); emit32(buffer, jit->pc_mask); // and ecx, pc_mask
+		if (op->handler == FAST_JAL) {
+			emit_store_constant(buffer, op->rd, (uint32_t)pc + 1); // Save return address
+		}
+		emit8(buffer, 0x89); emit8(buffer, 0xC8); // mov eax, ecx
+		return;
+	}
+
+	static const uint8_t condition[] = { 0x44, 0x45, 0x4C, 0x4F, 0x4E, 0x4D }; // cmove, cmovne, cmovl, cmovg, cmovle, cmovge
+	emit_load_operand(buffer, HOST_EDX, op->rm, op);
+	emit8(buffer, 0x81); emit8(buffer, 0xE2); emit32(buffer, jit->pc_mask); // and edx, pc_mask
+	emit_load_operand(buffer, HOST_EAX, op->rs, op);
+	emit_load_operand(buffer, HOST_ECX, op->rt, op);
+	emit8(buffer, 0x39); emit8(buffer, 0xC8); // cmp eax, ecx
+	emit8(buffer, 0xB8); emit32(buffer, (uint32_t)pc + 1); // mov eax, pc + 1 (keeps the flags)
+	emit8(buffer, 0x0F); emit8(buffer, condition[op->handler - FAST_BEQ]); emit8(buffer, 0xC2); // cmovcc eax, edx
+}
+
+// Check whether a terminator is left to the interpreter
+static int is_interpreted_terminator(uint8_t handler) {
+	return handler == FAST_RETI || handler == FAST_IN || handler == FAST_IN_DISCARD ||
+		handler == FAST_OUT || handler == FAST_HALT || handler == FAST_INVALID;
+}
+
+// Check whether the terminator of a compiled block is left to the interpreter
+static int block_has_interpreted_terminator(const BlockCache *cache, const Block *block) {
+	return block->terminated && is_interpreted_terminator(cache->ops[block->first_op + block->op_count - 1].handler);
+}
+
+// Compile a block, returns the native entry point or NULL if it stays interpreted
+static void *compile_block(JitState *jit, const BlockCache *cache, const Block *block) {
+	CodeBuffer buffer; // On the stack, batch workers compile concurrently
+	const MicroOp *ops = &cache->ops[block->first_op];
+	int native_ops = block_has_interpreted_terminator(cache, block) ? block->op_count - 1 : block->op_count;
+
+	// Nothing to gain, or a fall-through (also of a branch not taken) would hit the last-PC warning of increment_pc
+	if (jit->code == NULL || native_ops < JIT_MIN_NATIVE_OPS || block->end_pc == jit->pc_mask) {
+		return NULL;
+	}
+
+	buffer.length = 0;
+	emit8(&buffer, 0x53);                                              // push rbx
+	emit8(&buffer, 0x41); emit8(&buffer, 0x54);                        // push r12
+	emit8(&buffer, 0x41); emit8(&buffer, 0x55);                        // push r13
+	emit8(&buffer, 0x48); emit8(&buffer, 0x89); emit8(&buffer, 0xFB);  // mov rbx, rdi (regs)
+	emit8(&buffer, 0x49); emit8(&buffer, 0x89); emit8(&buffer, 0xF4);  // mov r12, rsi (data)
+	emit8(&buffer, 0x49); emit8(&buffer, 0x89); emit8(&buffer, 0xD5);  // mov r13, rdx (memory)
+
+	for (int i = 0; i < native_ops; i++) {
+		if (block->terminated && i == block->op_count - 1) {
+			emit_control_op(&buffer, jit, &ops[i], block->end_pc);
+		}
+		else {
+			emit_body_op(&buffer, jit, &ops[i]);
+		}
+	}
+	if (!block->terminated) {
+		emit8(&buffer, 0xB8); emit32(&buffer, (uint32_t)block->end_pc + 1); // mov eax, end_pc + 1
+	}
+
+	// $imm1/$imm2 were folded into constants, leave them as the last native instruction set them
+	emit_store_constant(&buffer, REG_IMM1, ops[native_ops - 1].imm1);
+	emit_store_constant(&buffer, REG_IMM2, ops[native_ops - 1].imm2);
+
+	emit8(&buffer, 0x41); emit8(&buffer, 0x5D); // pop r13
+	emit8(&buffer, 0x41); emit8(&buffer, 0x5C); // pop r12
+	emit8(&buffer, 0x5B);                       // pop rbx
+	emit8(&buffer, 0xC3);                       // ret
+
+	size_t start = (jit->used + 15) & ~(size_t)15;
+	if (start + buffer.length > jit->size) {
+		return NULL; // Arena full, keep interpreting
+	}
+
+	// Only the pages the block lands on are made writable, the rest of the arena stays executable
+	uint8_t *first_page = jit->code + (start & ~(size_t)(JIT_PAGE_SIZE - 1));
+	size_t span = (size_t)(jit->code + start + buffer.length - first_page);
+	if (mprotect(first_page, span, PROT_READ | PROT_WRITE) != 0) {
+		return NULL;
+	}
+	memcpy(jit->code + start, buffer.bytes, buffer.length);
+	if (mprotect(first_page, span, PROT_READ | PROT_EXEC) != 0) {
+		printf("Error: Could not make JIT code executable\n");
+		free_jit(jit);
+		return NULL;
+	}
+
+	jit->used = start + buffer.length;
+	jit->compiled++;
+	return jit->code + start;
+}
+
+// Compile a block that became hot, the BlockCompiler of the run
+static void compile_hot_block(void *context, const BlockCache *cache, Block *block) {
+	block->native_code = compile_block((JitState *)context, cache, block);
+	block->native_ops = block_has_interpreted_terminator(cache, block) ? block->op_count - 1 : block->op_count;
+}
+
+// Run the program, compiling hot blocks
+uint64_t run_jit_engine(JitState *jit, BlockCache *cache, const ThreadedProgram *threaded, Registers *registers, Memory *memory, IORegisters *io, Disk *disk, IRQ2Data *irq2, uint16_t *pc_ptr, int *in_isr) {
+	// Traps are precise only when stepping, which the block engine does under MEMORY_TRAP
+	if (jit->code == NULL || memory->policy == MEMORY_TRAP) {
+		return run_block_engine(cache, threaded, NULL, NULL, registers, memory, io, disk, irq2, pc_ptr, in_isr);
+	}
+
+	// Compiled code has the geometry built in, recompile for another one
+	if (jit->data_depth != memory->depth || jit->policy != memory->policy || jit->pc_mask != io_pc_mask(io)) {
+		free_block_cache(cache);
+		jit->used = 0;
+		jit->compiled = 0;
+		jit->data_depth = memory->depth;
+		jit->policy = memory->policy;
+		jit->pc_mask = io_pc_mask(io);
+	}
+
+	return run_block_engine(cache, threaded, compile_hot_block, jit, registers, memory, io, disk, irq2, pc_ptr, in_isr);
+}
+
+#else
+
+// No JIT on this host
+int init_jit(JitState *jit) {
+	jit->code = NULL;
+	jit->size = 0;
+	jit->used = 0;
+	jit->compiled = 0;
+	jit->data_depth = DATA_MEM_DEPTH;
+	jit->policy = MEMORY_LOG;
+	jit->pc_mask = INSTRUCTION_MEM_DEPTH - 1;
+	return 0;
+}
+
+void free_jit(JitState *jit) {
+	init_jit(jit);
+}
+
+// Without a JIT backend the block engine runs the program
+uint64_t run_jit_engine(JitState *jit, BlockCache *cache, const ThreadedProgram *threaded, Registers *registers, Memory *memory, IORegisters *io, Disk *disk, IRQ2Data *irq2, uint16_t *pc, int *in_isr) {
+	(void)jit;
+	return run_block_engine(cache, threaded, NULL, NULL, registers, memory, io, disk, irq2, pc, in_isr);
+}
+
+#endif
@@ -0,0 +1,65 @@
+#ifndef JIT_X86_64_H
+#define JIT_X86_64_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "block_cache.h"        // For the blocks to compile and the block engine helpers
+#include "instruction_fetch.h"  // For increment_pc
+
+// The JIT backend is only built for x86-64 Linux hosts, other hosts run the block engine
+#if defined(__x86_64__) && defined(__linux__) && !defined(SIM_NO_JIT)
+#define SIM_JIT_AVAILABLE
+#endif
+
+// Size of the executable code arena
+#define JIT_CODE_SIZE (4 * 1024 * 1024)
+
+// JIT state: one mmap'd code arena shared by all compiled blocks
+typedef struct {
+	uint8_t *code;   // Start of the arena, NULL if the JIT is unavailable
+	size_t size;     // Arena size in bytes
+	size_t used;     // Bytes already holding compiled blocks
+	int compiled;    // Number of compiled blocks
+	uint32_t data_depth;  // Geometry the compiled code is specialized for: bounds and
+	MemoryPolicy policy;  // wrap masks are immediates, MEMORY_WRAP has no out-of-range path
+	uint16_t pc_mask;
+} JitState;
+
+
+// Function declaration
+
+/*
+-Functionality: Maps the executable code arena.
+-return 1 if the JIT is usable, 0 if the host does not support it (the engine then interprets).
+-parameter1: jit - Pointer to the JitState structure.
+*/
+int init_jit(JitState *jit);
+
+/*
+-Functionality: Unmaps the code arena. Compiled code pointers left in blocks become invalid.
+-parameter1: jit - Pointer to the JitState structure.
+*/
+void free_jit(JitState *jit);
+
+/*
+-Functionality: Runs the program on run_block_engine, compiling blocks that reach
+ BLOCK_HOT_THRESHOLD executions to x86-64 code. in, out, reti and halt always run in the
+ interpreter, and compiled blocks only run inside event-free cycle windows, so timer, IRQ2 and
+ disk events fire on the same cycle as in simulator_main_loop. The code is compiled for the
+ geometry of the run and recompiled (with the block cache flushed) when it changes; MEMORY_TRAP
+ runs on the block engine.
+-parameter1: jit - Pointer to the JitState structure.
+-parameter2: cache - Pointer to the BlockCache structure.
+-parameter3: threaded - Pointer to the prepared ThreadedProgram.
+-parameter4: registers - Pointer to the Registers structure.
+-parameter5: memory - Pointer to the Memory structure.
+-parameter6: io - Pointer to the IORegisters structure.
+-parameter7: disk - Pointer to the Disk structure.
+-parameter8: irq2 - Pointer to the IRQ2Data structure.
+-parameter9: pc - Pointer to the Program counter, left at the halt instruction.
+-parameter10: in_isr - Pointer to the flag the indicates if the code is in the ISR.
+-return The number of cycles executed, including the halt cycle.
+*/
+uint64_t run_jit_engine(JitState *jit, BlockCache *cache, const ThreadedProgram *threaded, Registers *registers, Memory *memory, IORegisters *io, Disk *disk, IRQ2Data *irq2, uint16_t *pc, int *in_isr);
+
+#endif
@@ -0,0 +1,449 @@
+#define _CRT_SECURE_NO_WARNINGS
+#include "journal.h"
+#include "snapshot.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define FNV_OFFSET 0xcbf29ce484222325ULL
+#define FNV_PRIME 0x100000001b3ULL
+
+// Size of the file header: magic, version, reserved, program hash
+#define JOURNAL_HEADER_SIZE 16
+
+// Add bytes to a FNV-1a hash
+static uint64_t hash_bytes(uint64_t hash, const void *data, size_t size) {
+	const uint8_t *bytes = data;
+	for (size_t i = 0; i < size; i++) {
+		hash = (hash ^ bytes[i]) * FNV_PRIME;
+	}
+	return hash;
+}
+
+// Add a 32-bit value to a FNV-1a hash, byte order independent of the host
+static uint64_t hash_u32(uint64_t hash, uint32_t value) {
+	uint8_t bytes[4] = { (uint8_t)value, (uint8_t)(value >> 8), (uint8_t)(value >> 16), (uint8_t)(value >> 24) };
+	return hash_bytes(hash, bytes, 4);
+}
+
+// Hash the architectural state of a machine
+uint64_t hash_machine_state(const Machine *machine) {
+	uint64_t hash = FNV_OFFSET;
+
+	for (int i = 0; i < NUM_REGISTERS; i++) {
+		hash = hash_u32(hash, machine->registers.regs[i]);
+	}
+	hash = hash_u32(hash, machine->pc);
+	hash = hash_u32(hash, (uint32_t)machine->in_isr);
+	for (int i = 0; i < NUM_IO_REGISTERS; i++) {
+		hash = hash_u32(hash, machine->io.IORegister[i]);
+	}
+	hash = hash_u32(hash, (uint32_t)machine->irq2.current_index);
+	hash = hash_u32(hash, (uint32_t)machine->disk->timer);
+	for (uint32_t i = 0; i < machine->memory->depth; i++) {
+		hash = hash_u32(hash, machine->memory->data[i]);
+	}
+
+	// The built-in disk whole, an image by the sectors the run wrote
+	const uint64_t *dirty = machine->disk->image ? machine->disk->image->dirty : NULL;
+	for (uint64_t sector = 0; sector < disk_sector_count(machine->disk); sector++) {
+		if (dirty == NULL || ((dirty[sector >> 6] >> (sector & 63)) & 1)) {
+			hash = hash_bytes(hash, disk_sector(machine->disk, sector), SECTOR_SIZE);
+		}
+	}
+	return hash;
+}
+
+// Hash the instructions of a program
+uint64_t hash_program(const ProgramImage *image, uint32_t depth) {
+	return hash_bytes(FNV_OFFSET, image->instructions, (size_t)depth * 6);
+}
+
+// Append an unsigned LEB128 varint
+static void put_varint(Journal *journal, uint64_t value) {
+	while (value >= 0x80) {
+		putc((int)(value & 0x7F) | 0x80, journal->file);
+		value >>= 7;
+	}
+	putc((int)value, journal->file);
+}
+
+// Append a record header, the cycles since the previous record and the kind
+static void put_record(Journal *journal, int kind, uint64_t cycle) {
+	put_varint(journal, ((cycle - journal->last_cycle) << 3) | (uint64_t)kind);
+	journal->last_cycle = cycle;
+}
+
+// Create a journal file and write its header
+int create_journal(Journal *journal, const char *filename, uint64_t program_hash, uint64_t hash_period,
+	uint64_t snapshot_period) {
+	uint8_t header[JOURNAL_HEADER_SIZE] = { 0 };
+
+	memset(journal, 0, sizeof(*journal));
+	journal->hash_period = (hash_period != 0) ? hash_period : JOURNAL_DEFAULT_HASH_PERIOD;
+	journal->snapshot_period = snapshot_period;
+	journal->file = fopen(filename, "wb");
+	if (!journal->file) {
+		printf("Error: Could not create journal file: %s\n", filename);
+		return 0;
+	}
+
+	memcpy(header, JOURNAL_MAGIC, 4);
+	header[4] = (uint8_t)JOURNAL_VERSION;
+	for (int i = 0; i < 8; i++) {
+		header[8 + i] = (uint8_t)(program_hash >> (8 * i));
+	}
+	fwrite(header, 1, sizeof(header), journal->file);
+	return 1;
+}
+
+// Write the hash of the state, and a snapshot when one is due
+static void write_checkpoint(Journal *journal, const Machine *machine) {
+	MachineSnapshot snapshot;
+	size_t size;
+
+	put_record(journal, JOURNAL_HASH, machine->cycles);
+	put_varint(journal, hash_machine_state(machine));
+
+	if (machine->cycles < journal->next_snapshot) {
+		return;
+	}
+	journal->next_snapshot = (journal->snapshot_period != 0) ? machine->cycles + journal->snapshot_period : UINT64_MAX;
+	if (!take_snapshot(machine, &snapshot)) {
+		journal->write_error = 1;
+		return;
+	}
+	uint8_t *encoded = encode_snapshot(&snapshot, &size);
+	free_snapshot(&snapshot);
+	if (!encoded) {
+		printf("Error: Memory allocation failed for a journal snapshot\n");
+		journal->write_error = 1;
+		return;
+	}
+	put_record(journal, JOURNAL_SNAPSHOT, machine->cycles);
+	put_varint(journal, size);
+	fwrite(encoded, 1, size, journal->file);
+	free(encoded);
+}
+
+// Record a run until halt
+int record_machine(Journal *journal, Machine *machine, const ProgramImage *image, const DecodedProgram *program) {
+	journal->irq2_index = machine->irq2.current_index;
+	journal->disk_status = machine->io.IORegister[17];
+	journal->last_cycle = machine->cycles;
+	journal->next_snapshot = machine->cycles;
+	write_checkpoint(journal, machine);
+
+	// Run to every hash point, the idle fast-forward never crosses one
+	machine->journal = journal;
+	while (!machine->halted && !journal->write_error) {
+		run_machine(machine, image, program, journal->hash_period - machine->cycles % journal->hash_period);
+		if (!machine->halted) {
+			write_checkpoint(journal, machine);
+		}
+	}
+	machine->journal = NULL;
+
+	put_record(journal, JOURNAL_END, machine->cycles);
+	put_varint(journal, hash_machine_state(machine));
+	put_varint(journal, (uint64_t)machine->halted);
+	int ok = !journal->write_error && !ferror(journal->file);
+	ok &= fclose(journal->file) == 0;
+	journal->file = NULL;
+	if (!ok) {
+		printf("Error: Could not write the journal\n");
+	}
+	return ok;
+}
+
+// Describe a record for a divergence report
+static void describe_record(const JournalRecord *record, char *text, size_t size) {
+	switch (record->kind) {
+	case JOURNAL_IRQ2:
+		snprintf(text, size, "IRQ2 event %llu at cycle %llu", (unsigned long long)record->fields[0],
+			(unsigned long long)record->cycle);
+		break;
+	case JOURNAL_DISK_START:
+		snprintf(text, size, "disk command %llu (sector %llu, buffer %llu) at cycle %llu",
+			(unsigned long long)record->fields[0], (unsigned long long)record->fields[1],
+			(unsigned long long)record->fields[2], (unsigned long long)record->cycle);
+		break;
+	case JOURNAL_DISK_DONE:
+		snprintf(text, size, "disk completion at cycle %llu", (unsigned long long)record->cycle);
+		break;
+	default:
+		snprintf(text, size, "end of the journal");
+		break;
+	}
+}
+
+// Report the first difference of a replay
+static void diverge(Journal *journal, uint64_t cycle, const char *expected, const char *found) {
+	if (!journal->diverged) {
+		printf("Error: Replay diverged at cycle %llu: expected %s, found %s\n", (unsigned long long)cycle, expected, found);
+		journal->diverged = 1;
+	}
+}
+
+// Find the next IRQ2 or disk record from an index
+static int next_event_record(const Journal *journal, int index) {
+	while (index < journal->count && journal->records[index].kind != JOURNAL_IRQ2 &&
+		journal->records[index].kind != JOURNAL_DISK_START && journal->records[index].kind != JOURNAL_DISK_DONE) {
+		index++;
+	}
+	return index;
+}
+
+// Record an event, or check it against the journal being replayed
+static void note_event(Journal *journal, const JournalRecord *event) {
+	if (journal->file != NULL) {
+		put_record(journal, event->kind, event->cycle);
+		if (event->kind == JOURNAL_IRQ2) {
+			put_varint(journal, event->fields[0]);
+		}
+		else if (event->kind == JOURNAL_DISK_START) {
+			put_varint(journal, event->fields[0]);
+			put_varint(journal, event->fields[1]);
+			put_varint(journal, event->fields[2]);
+		}
+		return;
+	}
+
+	JournalRecord end = { JOURNAL_END, 0, { 0, 0, 0 } };
+	const JournalRecord *expected = (journal->next_event < journal->count) ? &journal->records[journal->next_event] : &end;
+	if (expected->kind != event->kind || expected->cycle != event->cycle ||
+		memcmp(expected->fields, event->fields, sizeof(event->fields)) != 0) {
+		char want[160], got[160];
+		describe_record(expected, want, sizeof(want));
+		describe_record(event, got, sizeof(got));
+		diverge(journal, event->cycle, want, got);
+		return;
+	}
+	journal->next_event = next_event_record(journal, journal->next_event + 1);
+}
+
+// Notice the IRQ2 and disk events of a cycle
+void journal_cycle(Journal *journal, const Machine *machine, uint64_t cycle) {
+	JournalRecord event;
+
+	memset(&event, 0, sizeof(event));
+	event.cycle = cycle;
+	if (machine->irq2.current_index != journal->irq2_index) {
+		journal->irq2_index = machine->irq2.current_index;
+		event.kind = JOURNAL_IRQ2;
+		event.fields[0] = (uint32_t)machine->irq2.events[journal->irq2_index - 1];
+		note_event(journal, &event);
+	}
+
+	uint32_t status = machine->io.IORegister[17];
+	if (status != journal->disk_status) {
+		journal->disk_status = status;
+		event.kind = (status == 1) ? JOURNAL_DISK_START : JOURNAL_DISK_DONE;
+		event.fields[0] = 0;
+		if (status == 1) {
+			event.fields[0] = machine->io.IORegister[14];
+			event.fields[1] = ((uint64_t)machine->io.IORegister[DISK_SECTOR_HIGH_REGISTER] << DISK_SECTOR_LOW_BITS) |
+				machine->io.IORegister[15];
+			event.fields[2] = machine->io.IORegister[16];
+		}
+		note_event(journal, &event);
+	}
+}
+
+// Read an unsigned LEB128 varint, returns 0 if it runs past the end or overflows
+static int get_varint(const uint8_t **next, const uint8_t *end, uint64_t *value) {
+	*value = 0;
+	for (int shift = 0; shift < 64; shift += 7) {
+		if (*next >= end) {
+			return 0;
+		}
+		uint8_t byte = *(*next)++;
+		*value |= (uint64_t)(byte & 0x7F) << shift;
+		if ((byte & 0x80) == 0) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+// Append a decoded record
+static int add_record(Journal *journal, const JournalRecord *record) {
+	if (journal->count == journal->capacity) {
+		int capacity = (journal->capacity == 0) ? 1024 : journal->capacity * 2;
+		JournalRecord *records = realloc(journal->records, (size_t)capacity * sizeof(JournalRecord));
+		if (!records) {
+			printf("Error: Memory allocation failed while loading a journal\n");
+			return 0;
+		}
+		journal->records = records;
+		journal->capacity = capacity;
+	}
+	journal->records[journal->count++] = *record;
+	return 1;
+}
+
+// Load a journal for a replay
+int load_journal(const char *filename, Journal *journal) {
+	static const int field_counts[] = { 1, 3, 0, 1, 1, 2 };
+
+	memset(journal, 0, sizeof(*journal));
+	if (!map_file(filename, &journal->mapped)) {
+		printf("Error: Could not open journal file: %s\n", filename);
+		return 0;
+	}
+	const uint8_t *data = journal->mapped.data;
+	const uint8_t *end = data + journal->mapped.size;
+	if (journal->mapped.size < JOURNAL_HEADER_SIZE || memcmp(data, JOURNAL_MAGIC, 4) != 0 ||
+		(data[4] | (data[5] << 8)) != JOURNAL_VERSION) {
+		printf("Error: %s is not a version %d journal\n", filename, JOURNAL_VERSION);
+		free_journal(journal);
+		return 0;
+	}
+	for (int i = 0; i < 8; i++) {
+		journal->program_hash |= (uint64_t)data[8 + i] << (8 * i);
+	}
+
+	const uint8_t *next = data + JOURNAL_HEADER_SIZE;
+	uint64_t cycle = 0;
+	JournalRecord record;
+	do {
+		uint64_t header;
+		memset(&record, 0, sizeof(record));
+		int ok = get_varint(&next, end, &header);
+		record.kind = (int)(header & 7);
+		cycle += header >> 3;
+		record.cycle = cycle;
+		ok = ok && record.kind <= JOURNAL_END;
+		for (int i = 0; ok && i < field_counts[record.kind]; i++) {
+			ok = get_varint(&next, end, &record.fields[i]);
+		}
+		if (ok && record.kind == JOURNAL_SNAPSHOT) {
+			// Keep the position of the encoded snapshot, decoded only if the replay starts there
+			record.fields[1] = record.fields[0];
+			record.fields[0] = (uint64_t)(next - data);
+			ok = record.fields[1] <= (uint64_t)(end - next);
+			next += ok ? record.fields[1] : 0;
+		}
+		if (!ok || !add_record(journal, &record)) {
+			printf("Error: Invalid or truncated journal file: %s\n", filename);
+			free_journal(journal);
+			return 0;
+		}
+	} while (record.kind != JOURNAL_END);
+	return 1;
+}
+
+// Restore the snapshot of a record and give the machine the IRQ2 events of the journal
+static int restore_journal_snapshot(Journal *journal, Machine *machine, const JournalRecord *record) {
+	MachineSnapshot snapshot;
+	int count = 0;
+	int delivered = 0;
+
+	if (!decode_snapshot(journal->mapped.data + record->fields[0], (size_t)record->fields[1], "journal snapshot", &snapshot)) {
+		return 0;
+	}
+	int ok = restore_snapshot(machine, &snapshot);
+	free_snapshot(&snapshot);
+	if (!ok) {
+		return 0;
+	}
+
+	for (int i = 0; i < journal->count; i++) {
+		count += journal->records[i].kind == JOURNAL_IRQ2;
+	}
+	int *events = malloc((count > 0 ? count : 1) * sizeof(int));
+	if (!events) {
+		printf("Error: Memory allocation failed while restoring a journal snapshot\n");
+		return 0;
+	}
+	count = 0;
+	for (int i = 0; i < journal->count; i++) {
+		if (journal->records[i].kind == JOURNAL_IRQ2) {
+			delivered += journal->records[i].cycle <= record->cycle;
+			events[count++] = (int)(uint32_t)journal->records[i].fields[0];
+		}
+	}
+	free_irq2_data(&machine->irq2);
+	machine->irq2.events = events;
+	machine->irq2.count = count;
+	machine->irq2.capacity = count;
+	machine->irq2.current_index = delivered;
+	return 1;
+}
+
+// Replay a recorded run between two cycles, checking it against the journal
+int replay_machine(Journal *journal, Machine *machine, const ProgramImage *image, const DecodedProgram *program,
+	uint64_t from, uint64_t to) {
+	int start = -1;
+	char want[64], got[64];
+
+	// The last snapshot at or before the first cycle
+	for (int i = 0; i < journal->count && journal->records[i].cycle <= from; i++) {
+		if (journal->records[i].kind == JOURNAL_SNAPSHOT) {
+			start = i;
+		}
+	}
+	if (start < 0) {
+		printf("Error: The journal has no snapshot at or before cycle %llu\n", (unsigned long long)from);
+		return 0;
+	}
+	if (!restore_journal_snapshot(journal, machine, &journal->records[start])) {
+		return 0;
+	}
+	if (hash_program(image, (uint32_t)io_pc_mask(&machine->io) + 1) != journal->program_hash) {
+		printf("Error: The journal was recorded with another program\n");
+		return 0;
+	}
+
+	journal->diverged = 0;
+	journal->irq2_index = machine->irq2.current_index;
+	journal->disk_status = machine->io.IORegister[17];
+	journal->next_event = next_event_record(journal, start);
+	while (journal->next_event < journal->count && journal->records[journal->next_event].cycle <= machine->cycles) {
+		journal->next_event = next_event_record(journal, journal->next_event + 1);
+	}
+
+	// Run from checkpoint to checkpoint, the hash of the snapshot's own cycle included
+	machine->journal = journal;
+	for (int i = 0; i < journal->count && !journal->diverged; i++) {
+		const JournalRecord *record = &journal->records[i];
+		if (record->cycle < machine->cycles || (record->kind != JOURNAL_HASH && record->kind != JOURNAL_END)) {
+			continue;
+		}
+		if (record->cycle > to) {
+			run_machine(machine, image, program, to - machine->cycles);
+			break;
+		}
+
+		run_machine(machine, image, program, record->cycle - machine->cycles);
+		if (machine->cycles != record->cycle || machine->halted != (record->kind == JOURNAL_END && record->fields[1])) {
+			snprintf(want, sizeof(want), "%s at cycle %llu", (record->kind == JOURNAL_END) ? "the end" : "a hash point",
+				(unsigned long long)record->cycle);
+			snprintf(got, sizeof(got), "%s", machine->halted ? "a halt" : "a running machine");
+			diverge(journal, machine->cycles, want, got);
+		}
+		else if (journal->next_event < journal->count && journal->records[journal->next_event].cycle <= machine->cycles) {
+			describe_record(&journal->records[journal->next_event], want, sizeof(want));
+			diverge(journal, machine->cycles, want, "no such event");
+		}
+		else if (hash_machine_state(machine) != record->fields[0]) {
+			diverge(journal, machine->cycles, "the recorded state hash", "a different state");
+		}
+		if (record->kind == JOURNAL_END) {
+			break;
+		}
+	}
+	machine->journal = NULL;
+	return !journal->diverged;
+}
+
+// Release a journal
+void free_journal(Journal *journal) {
+	if (journal->file != NULL) {
+		fclose(journal->file);
+	}
+	if (journal->mapped.data != NULL) {
+		unmap_file(&journal->mapped);
+	}
+	free(journal->records);
+	memset(journal, 0, sizeof(*journal));
+}
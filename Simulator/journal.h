@@ -0,0 +1,153 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include "machine.h"
+#include "image.h" // For MappedFile
+
+/*
+ Journal file format (version 1):
+ -"SIMJ", u16 version, u16 reserved, u64 program hash (little-endian)
+ -Records up to JOURNAL_END. Each starts with the varint (cycle delta << 3 | kind), the cycles since
+  the previous record, followed by its fields; every varint is unsigned LEB128:
+   JOURNAL_IRQ2        the IRQ2 event delivered (the clks it matched)
+   JOURNAL_DISK_START  diskcmd, sector, diskbuffer
+   JOURNAL_DISK_DONE   no fields
+   JOURNAL_HASH        hash_machine_state
+   JOURNAL_SNAPSHOT    size, then an encoded snapshot (snapshot.h)
+   JOURNAL_END         hash_machine_state, halted
+ The cycle of an IRQ2 or disk record is the cycle it happened in, counted from power-on. Hashes and
+ snapshots are taken between cycles, after that many cycles ran. A journal always starts with the
+ hash and snapshot of its first cycle, so a replay needs only the program.
+*/
+#define JOURNAL_MAGIC "SIMJ"
+#define JOURNAL_VERSION 1
+
+// Default cycles between two state hashes
+#define JOURNAL_DEFAULT_HASH_PERIOD (1u << 20)
+
+// Kinds of journal records
+typedef enum {
+	JOURNAL_IRQ2 = 0,
+	JOURNAL_DISK_START = 1,
+	JOURNAL_DISK_DONE = 2,
+	JOURNAL_HASH = 3,
+	JOURNAL_SNAPSHOT = 4,
+	JOURNAL_END = 5
+} JournalRecordKind;
+
+// One decoded record
+typedef struct {
+	int kind;
+	uint64_t cycle;
+	uint64_t fields[3];        // See the file format, JOURNAL_SNAPSHOT: offset and size in the file
+} JournalRecord;
+
+// A journal being recorded, or loaded for a replay
+typedef struct Journal {
+	// Recording
+	FILE *file;
+	uint64_t hash_period;
+	uint64_t snapshot_period;  // 0 for the first snapshot only
+	uint64_t next_snapshot;
+	uint64_t last_cycle;       // Cycle of the last record written
+	int write_error;
+
+	// Replay
+	MappedFile mapped;
+	uint64_t program_hash;
+	JournalRecord *records;
+	int count;
+	int capacity;
+	int next_event;            // Next IRQ2 or disk record the replay must meet
+	int diverged;              // Set on the first difference, which is printed
+
+	// Device state after the previous cycle, to notice the events
+	int irq2_index;
+	uint32_t disk_status;
+} Journal;
+
+
+// Function declarations
+
+/*
+-Functionality: Hashes the architectural state of a machine (registers, PC, ISR state, IO
+ registers, IRQ2 position, data memory, disk and disk timer) with 64-bit FNV-1a.
+-return The hash.
+-parameter1: machine - Pointer to the Machine structure.
+*/
+uint64_t hash_machine_state(const Machine *machine);
+
+/*
+-Functionality: Hashes the instructions of a program up to the instruction depth.
+-return The hash.
+-parameter1: image - Pointer to the ProgramImage.
+-parameter2: depth - The instruction depth.
+*/
+uint64_t hash_program(const ProgramImage *image, uint32_t depth);
+
+/*
+-Functionality: Creates a journal file and writes its header.
+-return 1 on success, 0 if the file could not be created.
+-parameter1: journal - Pointer to the Journal structure.
+-parameter2: filename - Name of the journal file.
+-parameter3: program_hash - hash_program of the recorded program.
+-parameter4: hash_period - Cycles between two state hashes, 0 for JOURNAL_DEFAULT_HASH_PERIOD.
+-parameter5: snapshot_period - Cycles between two embedded snapshots (rounded up to hashes), 0 for
+ the first one only.
+*/
+int create_journal(Journal *journal, const char *filename, uint64_t program_hash, uint64_t hash_period,
+	uint64_t snapshot_period);
+
+/*
+-Functionality: Runs a machine until halt on the reference loop while recording its IRQ2 and disk
+ events, the state hashes and the snapshots, then writes the end record and closes the journal.
+ The disk must be the built-in one.
+-return 1 on success, 0 if the journal could not be written.
+-parameter1: journal - Pointer to a Journal made by create_journal.
+-parameter2: machine - Pointer to the Machine with its inputs loaded.
+-parameter3: image - Pointer to the ProgramImage, for the trace.
+-parameter4: program - Pointer to the DecodedProgram.
+*/
+int record_machine(Journal *journal, Machine *machine, const ProgramImage *image, const DecodedProgram *program);
+
+/*
+-Functionality: Loads a journal for a replay.
+-return 1 on success, 0 if the file could not be read or is not a valid journal.
+-parameter1: filename - Name of the journal file.
+-parameter2: journal - Pointer to the Journal structure to fill.
+*/
+int load_journal(const char *filename, Journal *journal);
+
+/*
+-Functionality: Replays a recorded run from the last snapshot at or before a cycle, taking the IRQ2
+ events from the journal, and checks every event and state hash on the way up to another cycle
+ (or the end of the run). The first difference is printed.
+-return 1 if the replay followed the journal, 0 if it diverged or could not start.
+-parameter1: journal - Pointer to a Journal loaded with load_journal.
+-parameter2: machine - Pointer to a Machine made by init_machine, which receives the state reached.
+-parameter3: image - Pointer to the ProgramImage of the recorded program.
+-parameter4: program - Pointer to its DecodedProgram.
+-parameter5: from - Cycle to start from, the snapshot before it is restored.
+-parameter6: to - Cycle to stop at, UINT64_MAX for the end of the run.
+*/
+int replay_machine(Journal *journal, Machine *machine, const ProgramImage *image, const DecodedProgram *program,
+	uint64_t from, uint64_t to);
+
+/*
+-Functionality: Releases a journal (closing the file of an unfinished recording).
+-parameter1: journal - Pointer to the Journal structure.
+*/
+void free_journal(Journal *journal);
+
+/*
+-Functionality: Called by run_machine after the device handling of every cycle: records the IRQ2
+ delivery and disk start or completion of the cycle, or checks them against a replayed journal.
+-parameter1: journal - Pointer to the Journal structure.
+-parameter2: machine - Pointer to the Machine structure.
+-parameter3: cycle - The cycle, counted from power-on.
+*/
+void journal_cycle(Journal *journal, const Machine *machine, uint64_t cycle);
+
+#endif
@@ -0,0 +1,207 @@
+#define _CRT_SECURE_NO_WARNINGS
+#include "lockstep.h"
+#include "instruction_fetch.h"
+#include <stdio.h>
+#include <string.h>
+
+// Reset every lane to the power-on state
+void init_lockstep_group(LockstepGroup *group) {
+	memset(group->regs, 0, sizeof(group->regs));
+	for (int lane = 0; lane < LOCKSTEP_LANES; lane++) {
+		init_memory(&group->memory[lane]);
+		init_io(&group->io[lane]);
+		init_disk(&group->disk[lane]);
+		group->irq2[lane].events = NULL;
+		group->irq2[lane].count = 0;
+		group->irq2[lane].capacity = 0;
+		group->irq2[lane].current_index = 0;
+		group->cycle[lane] = 0;
+		group->deadline[lane] = 0;
+		group->pc[lane] = 0;
+		group->in_isr[lane] = 0;
+	}
+	group->running = 0;
+	group->started = 0;
+	group->steps = 0;
+	group->lane_steps = 0;
+}
+
+// Copy the registers of one lane out of the structure of arrays
+void get_lane_registers(const LockstepGroup *group, int lane, Registers *registers) {
+	init_registers(registers);
+	for (int i = 0; i < NUM_REGISTERS; i++) {
+		registers->regs[i] = group->regs[i][lane];
+	}
+}
+
+// Number of lanes in a mask
+static int count_lanes(unsigned int mask) {
+	int count = 0;
+	for (; mask != 0; mask &= mask - 1) {
+		count++;
+	}
+	return count;
+}
+
+// Move one lane to the next instruction
+static void advance_lane(LockstepGroup *group, uint16_t pc, int lane) {
+	uint16_t next = pc;
+	increment_pc(&next, io_pc_mask(&group->io[0])); // Reports the overflow on each lane, like the other engines
+	group->pc[lane] = next;
+}
+
+// One shift result; shift counts use their low 5 bits, as the x86 shift instructions do
+static uint32_t shift_result(int opcode, uint32_t rs, uint32_t rt) {
+	switch (opcode) {
+	case 6: return rs << (rt & 31);                       // sll
+	case 7: return (uint32_t)((int32_t)rs >> (rt & 31));  // sra
+	default: return rs >> (rt & 31);                      // srl
+	}
+}
+
+// Steps every running lane can take before one of them has an event due
+static uint64_t converged_quiet_cycles(const LockstepGroup *group) {
+	uint64_t quiet = UINT64_MAX;
+	for (int lane = 0; lane < LOCKSTEP_LANES; lane++) {
+		if (group->running & (1u << lane)) {
+			if (group->deadline[lane] <= group->cycle[lane] + 1) {
+				return 0;
+			}
+			if (group->deadline[lane] - group->cycle[lane] - 1 < quiet) {
+				quiet = group->deadline[lane] - group->cycle[lane] - 1;
+			}
+		}
+	}
+	return quiet;
+}
+
+// Write back a converged run: every running lane is at pc, steps cycles later
+static void finish_converged(LockstepGroup *group, uint16_t pc, uint64_t steps) {
+	for (int lane = 0; lane < LOCKSTEP_LANES; lane++) {
+		if (group->running & (1u << lane)) {
+			group->pc[lane] = pc;
+			group->cycle[lane] += steps;
+		}
+	}
+	group->steps += steps;
+	group->lane_steps += steps * (uint64_t)count_lanes(group->running);
+}
+
+// Execute sw on the lanes of a mask, returns the lanes whose address was out of range
+static unsigned int execute_sw(LockstepGroup *group, const Instruction *instruction, unsigned int mask) {
+	uint32_t data_mask = group->memory[0].mask;
+	unsigned int outside = 0;
+
+	for (int lane = 0; lane < LOCKSTEP_LANES; lane++) {
+		if (mask & (1u << lane)) {
+			uint32_t address = group->regs[instruction->rs][lane] + group->regs[instruction->rt][lane];
+			uint32_t value = group->regs[instruction->rm][lane] + group->regs[instruction->rd][lane];
+			if (address <= data_mask) {
+				group->memory[lane].data[address] = value;
+				mark_data_dirty(&group->memory[lane], address);
+			}
+			else {
+				write_data_out_of_range(&group->memory[lane], address, value);
+				outside |= 1u << lane;
+			}
+		}
+	}
+	return outside;
+}
+
+// Stop the lanes of a mask whose out-of-range access trapped (MEMORY_TRAP)
+static void stop_trapped_lanes(LockstepGroup *group, unsigned int mask) {
+	for (int lane = 0; mask != 0 && lane < LOCKSTEP_LANES; lane++) {
+		if ((mask & (1u << lane)) && group->memory[lane].faulted) {
+			group->scheduler[lane].cycle = group->cycle[lane];
+			sync_io_registers(&group->scheduler[lane], &group->io[lane], &group->disk[lane]);
+			group->pc[lane] = LOCKSTEP_HALTED;
+			group->running &= ~(1u << lane);
+		}
+	}
+}
+
+// Execute reti, in, out or halt on one lane, against its own devices
+static void execute_lane_control(LockstepGroup *group, const Instruction *instruction, uint16_t pc, int lane) {
+	Scheduler *scheduler = &group->scheduler[lane];
+	IORegisters *io = &group->io[lane];
+	Disk *disk = &group->disk[lane];
+	int reg_index = (int)(group->regs[instruction->rs][lane] + group->regs[instruction->rt][lane]);
+
+	scheduler->cycle = group->cycle[lane];
+	switch (instruction->opcode) {
+	case 18: // reti
+		sync_io_registers(scheduler, io, disk); // The irqreturn read may be traced
+		group->pc[lane] = (uint16_t)io_read(io, IO_IRQ_RETURN);
+		group->in_isr[lane] = 0;
+		request_cycle_check(scheduler); // A pending interrupt is taken on the next cycle
+		group->deadline[lane] = next_event_cycle(scheduler);
+		return;
+
+	case 19: { // in
+		sync_io_registers(scheduler, io, disk);
+		uint32_t value = io_read(io, reg_index);
+		if (instruction->rd > REG_IMM2) {
+			group->regs[instruction->rd][lane] = value;
+		}
+		break;
+	}
+
+	case 20: // out
+		sync_io_registers(scheduler, io, disk);
+		io_write(io, reg_index, group->regs[instruction->rm][lane]);
+		scheduler_io_written(scheduler, io, reg_index);
+		group->deadline[lane] = next_event_cycle(scheduler);
+		break;
+
+	default: // halt
+		sync_io_registers(scheduler, io, disk);
+		group->pc[lane] = LOCKSTEP_HALTED;
+		group->running &= ~(1u << lane);
+		return;
+	}
+	advance_lane(group, pc, lane);
+}
+
+// The portable kernels, and the AVX2 ones on x86 GCC/Clang builds, picked at run time
+#define KERNEL(name) name##_portable
+#define KERNEL_TARGET
+#include "lockstep_kernels.h"
+#undef KERNEL
+#undef KERNEL_TARGET
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__)) && !defined(SIM_NO_SIMD) && LOCKSTEP_LANES == 8
+#define SIM_LOCKSTEP_AVX2
+#include <immintrin.h>
+#define KERNEL(name) name##_avx2
+#define KERNEL_TARGET __attribute__((target("avx2,sse4.1")))
+#include "lockstep_kernels.h"
+#undef KERNEL
+#undef KERNEL_TARGET
+#endif
+
+// Run the lanes of a mask until each of them halts
+void run_lockstep_group(LockstepGroup *group, const DecodedProgram *program, unsigned int lanes) {
+	lanes &= LOCKSTEP_ALL_LANES;
+	group->running = lanes;
+	group->started = 0;
+
+	for (int lane = 0; lane < LOCKSTEP_LANES; lane++) {
+		if (lanes & (1u << lane)) {
+			init_scheduler(&group->scheduler[lane], &group->io[lane], &group->disk[lane], &group->irq2[lane]);
+			group->cycle[lane] = group->scheduler[lane].cycle;
+			group->deadline[lane] = next_event_cycle(&group->scheduler[lane]);
+		}
+		else {
+			group->pc[lane] = LOCKSTEP_HALTED;
+		}
+	}
+
+#ifdef SIM_LOCKSTEP_AVX2
+	if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("sse4.1")) {
+		run_lanes_avx2(group, program);
+		return;
+	}
+#endif
+	run_lanes_portable(group, program);
+}
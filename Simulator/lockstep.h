@@ -0,0 +1,77 @@
+#ifndef LOCKSTEP_H
+#define LOCKSTEP_H
+
+#include <stdint.h>
+#include "registers.h"          // For NUM_REGISTERS
+#include "memory.h"             // For the per-lane data memory
+#include "io.h"                 // For the per-lane IO registers
+#include "disk.h"               // For the per-lane disk
+#include "interrupts.h"         // For the per-lane IRQ2 events
+#include "scheduler.h"          // For the per-lane device events
+#include "instruction_decode.h" // For the shared DecodedProgram
+
+// Number of instances run by one lockstep group, one 32-bit lane of a 256-bit vector each
+#define LOCKSTEP_LANES 8
+
+// Lane mask with every lane set
+#define LOCKSTEP_ALL_LANES ((1u << LOCKSTEP_LANES) - 1)
+
+// PC of a lane that has halted, never selected again
+#define LOCKSTEP_HALTED 0xFFFF
+
+// Up to LOCKSTEP_LANES instances of the same program. Each step executes one instruction on
+// every running lane at the lowest PC; lanes that branch elsewhere wait and rejoin the group
+// when the others reach their PC.
+typedef struct {
+	// Structure of arrays: register r of lane l is regs[r][l], one vector per register
+	uint32_t regs[NUM_REGISTERS][LOCKSTEP_LANES];
+
+	// Lane l's data memory is memory[l], contiguous so the disk DMA and the image loaders
+	// work on a single lane unchanged; lw gathers across the lanes
+	Memory memory[LOCKSTEP_LANES];
+
+	// Per-lane devices, only touched by in/out/reti and the scheduled events
+	IORegisters io[LOCKSTEP_LANES];
+	Disk disk[LOCKSTEP_LANES];
+	IRQ2Data irq2[LOCKSTEP_LANES];
+	Scheduler scheduler[LOCKSTEP_LANES];
+	uint64_t cycle[LOCKSTEP_LANES];       // Current cycle of each lane, copied to its scheduler before each call
+	uint64_t deadline[LOCKSTEP_LANES];    // Next event cycle of each lane
+	uint16_t pc[LOCKSTEP_LANES];          // LOCKSTEP_HALTED once a lane halts
+	int in_isr[LOCKSTEP_LANES];
+
+	unsigned int running;                 // Lanes that have not halted
+	unsigned int started;                 // Lanes whose current cycle already ran its event handling
+	uint64_t steps;                       // Instructions issued for the whole group
+	uint64_t lane_steps;                  // Instructions executed, summed over the lanes
+} LockstepGroup;
+
+
+// Function declaration
+
+/*
+-Functionality: Resets every lane to the power-on state: registers, data memory, IO registers
+ and disk cleared, no IRQ2 events. The caller then loads the inputs of the lanes it uses.
+-parameter1: group - Pointer to the LockstepGroup structure.
+*/
+void init_lockstep_group(LockstepGroup *group);
+
+/*
+-Functionality: Runs the lanes of a mask until each of them halts (or traps under MEMORY_TRAP).
+ Every lane follows exactly the cycle behaviour of the other engines, only the host executes
+ converged lanes together. All lanes must use the memory geometry of lane 0.
+-parameter1: group - Pointer to the LockstepGroup structure with the lane inputs loaded.
+-parameter2: program - Pointer to the DecodedProgram shared by every lane.
+-parameter3: lanes - Mask of the lanes to run.
+*/
+void run_lockstep_group(LockstepGroup *group, const DecodedProgram *program, unsigned int lanes);
+
+/*
+-Functionality: Copies the registers of one lane out of the structure of arrays.
+-parameter1: group - Pointer to the LockstepGroup structure.
+-parameter2: lane - The lane.
+-parameter3: registers - Pointer to the Registers structure to fill.
+*/
+void get_lane_registers(const LockstepGroup *group, int lane, Registers *registers);
+
+#endif
@@ -0,0 +1,472 @@
+/*
+ The step kernels of lockstep.c. The file has no include guard: lockstep.c includes it twice,
+ once portable and, on x86 GCC/Clang builds, once with AVX2 and SSE4.1 (SIM_LOCKSTEP_AVX2),
+ and run_lockstep_group picks the build the host supports. KERNEL(name) gives each build its
+ own function names and KERNEL_TARGET its target attribute.
+*/
+
+// Find the lowest PC among the running lanes and the mask of the lanes at it
+KERNEL_TARGET static uint16_t KERNEL(select_lanes)(const LockstepGroup *group, unsigned int *mask) {
+#ifdef SIM_LOCKSTEP_AVX2
+	// Halted lanes hold LOCKSTEP_HALTED, above every valid PC
+	__m128i pcs = _mm_loadu_si128((const __m128i *)group->pc);
+	uint16_t pc = (uint16_t)_mm_cvtsi128_si32(_mm_minpos_epu16(pcs));
+	__m128i same = _mm_cmpeq_epi16(pcs, _mm_set1_epi16((short)pc));
+	*mask = (unsigned int)_mm_movemask_epi8(_mm_packs_epi16(same, _mm_setzero_si128()));
+	return pc;
+#else
+	uint16_t pc = LOCKSTEP_HALTED;
+	*mask = 0;
+	for (int lane = 0; lane < LOCKSTEP_LANES; lane++) {
+		if (group->pc[lane] < pc) {
+			pc = group->pc[lane];
+			*mask = 1u << lane;
+		}
+		else if (group->pc[lane] == pc) {
+			*mask |= 1u << lane;
+		}
+	}
+	return pc;
+#endif
+}
+
+#ifdef SIM_LOCKSTEP_AVX2
+
+// Expand a lane mask to a vector of all-ones / all-zeros lanes
+KERNEL_TARGET static __m256i lane_mask_vector(unsigned int mask) {
+	const __m256i bits = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+	return _mm256_cmpeq_epi32(_mm256_and_si256(_mm256_set1_epi32((int)mask), bits), bits);
+}
+
+// Load the register row of every lane
+KERNEL_TARGET static __m256i load_row(const uint32_t *row) {
+	return _mm256_loadu_si256((const __m256i *)row);
+}
+
+// Store a vector to the lanes of a mask
+KERNEL_TARGET static void store_lanes(uint32_t *row, __m256i value, unsigned int mask) {
+	if (mask == LOCKSTEP_ALL_LANES) {
+		_mm256_storeu_si256((__m256i *)row, value);
+	}
+	else {
+		_mm256_maskstore_epi32((int *)row, lane_mask_vector(mask), value);
+	}
+}
+
+// Lane mask of the sign bits of a comparison
+KERNEL_TARGET static unsigned int compare_mask(__m256i compare) {
+	return (unsigned int)_mm256_movemask_ps(_mm256_castsi256_ps(compare));
+}
+
+// Set the PCs of the lanes of a mask from a vector of 16-bit PCs
+KERNEL_TARGET static void set_lane_pcs(LockstepGroup *group, __m128i pcs, unsigned int mask) {
+	const __m128i bits = _mm_setr_epi16(1, 2, 4, 8, 16, 32, 64, 128);
+	__m128i lanes = _mm_cmpeq_epi16(_mm_and_si128(_mm_set1_epi16((short)mask), bits), bits);
+	__m128i old = _mm_loadu_si128((const __m128i *)group->pc);
+	_mm_storeu_si128((__m128i *)group->pc, _mm_blendv_epi8(old, pcs, lanes));
+}
+
+#endif
+
+// Set a register to the same value on the lanes of a mask
+KERNEL_TARGET static void KERNEL(set_lanes)(uint32_t *row, uint32_t value, unsigned int mask) {
+#ifdef SIM_LOCKSTEP_AVX2
+	store_lanes(row, _mm256_set1_epi32((int)value), mask);
+#else
+	for (int lane = 0; lane < LOCKSTEP_LANES; lane++) {
+		if (mask & (1u << lane)) {
+			row[lane] = value;
+		}
+	}
+#endif
+}
+
+// Move the lanes of a mask to the next instruction
+KERNEL_TARGET static void KERNEL(advance_lanes)(LockstepGroup *group, uint16_t pc, unsigned int mask) {
+	uint16_t pc_mask = io_pc_mask(&group->io[0]);
+
+	if (pc < pc_mask) {
+#ifdef SIM_LOCKSTEP_AVX2
+		set_lane_pcs(group, _mm_set1_epi16((short)(pc + 1)), mask);
+#else
+		for (int lane = 0; lane < LOCKSTEP_LANES; lane++) {
+			if (mask & (1u << lane)) {
+				group->pc[lane] = (uint16_t)(pc + 1);
+			}
+		}
+#endif
+		return;
+	}
+
+	for (int lane = 0; lane < LOCKSTEP_LANES; lane++) {
+		if (mask & (1u << lane)) {
+			advance_lane(group, pc, lane);
+		}
+	}
+}
+
+// Jump the lanes of a mask to the lower bits of a register, as many as the PC has
+KERNEL_TARGET static void KERNEL(jump_lanes)(LockstepGroup *group, const uint32_t *row, unsigned int mask) {
+	uint16_t pc_mask = io_pc_mask(&group->io[0]);
+#ifdef SIM_LOCKSTEP_AVX2
+	__m256i target = _mm256_and_si256(load_row(row), _mm256_set1_epi32(pc_mask));
+	set_lane_pcs(group, _mm_packus_epi32(_mm256_castsi256_si128(target), _mm256_extracti128_si256(target, 1)), mask);
+#else
+	for (int lane = 0; lane < LOCKSTEP_LANES; lane++) {
+		if (mask & (1u << lane)) {
+			group->pc[lane] = (uint16_t)(row[lane] & pc_mask);
+		}
+	}
+#endif
+}
+
+// Find the jump target of the lanes of a mask, returns 0 if they do not all jump to the same PC
+KERNEL_TARGET static int KERNEL(common_target)(const uint32_t *row, unsigned int mask, uint16_t pc_mask, uint16_t *target) {
+	int first = 0;
+	while (!(mask & (1u << first))) {
+		first++;
+	}
+	*target = (uint16_t)(row[first] & pc_mask);
+#ifdef SIM_LOCKSTEP_AVX2
+	__m256i targets = _mm256_and_si256(load_row(row), _mm256_set1_epi32(pc_mask));
+	return (compare_mask(_mm256_cmpeq_epi32(targets, _mm256_set1_epi32(*target))) & mask) == mask;
+#else
+	for (int lane = first + 1; lane < LOCKSTEP_LANES; lane++) {
+		if ((mask & (1u << lane)) && (uint16_t)(row[lane] & pc_mask) != *target) {
+			return 0;
+		}
+	}
+	return 1;
+#endif
+}
+
+// Advance the cycle of the lanes of a mask, returning the lanes with a due event
+KERNEL_TARGET static unsigned int KERNEL(start_cycles)(LockstepGroup *group, unsigned int mask) {
+#ifdef SIM_LOCKSTEP_AVX2
+	const __m256i sign = _mm256_set1_epi64x(INT64_MIN); // Unsigned compare through the signed one
+	const __m256i bits = _mm256_setr_epi64x(1, 2, 4, 8);
+	unsigned int due = 0;
+
+	for (int half = 0; half < LOCKSTEP_LANES; half += 4) {
+		__m256i lanes = _mm256_cmpeq_epi64(_mm256_and_si256(_mm256_set1_epi64x(mask >> half), bits), bits);
+		__m256i cycle = _mm256_sub_epi64(_mm256_loadu_si256((const __m256i *)&group->cycle[half]), lanes);
+		__m256i deadline = _mm256_loadu_si256((const __m256i *)&group->deadline[half]);
+		_mm256_storeu_si256((__m256i *)&group->cycle[half], cycle);
+		__m256i quiet = _mm256_cmpgt_epi64(_mm256_xor_si256(deadline, sign), _mm256_xor_si256(cycle, sign));
+		due |= (~(unsigned int)_mm256_movemask_pd(_mm256_castsi256_pd(quiet)) & 0xF) << half;
+	}
+	return due & mask;
+#else
+	unsigned int due = 0;
+	for (int lane = 0; lane < LOCKSTEP_LANES; lane++) {
+		if ((mask & (1u << lane)) && ++group->cycle[lane] >= group->deadline[lane]) {
+			due |= 1u << lane;
+		}
+	}
+	return due;
+#endif
+}
+
+// Execute an arithmetic, logical or shift instruction with a writable rd on the lanes of a mask
+KERNEL_TARGET static void KERNEL(execute_alu)(LockstepGroup *group, const Instruction *instruction, unsigned int mask) {
+#ifdef SIM_LOCKSTEP_AVX2
+	const __m256i count_mask = _mm256_set1_epi32(31);
+	__m256i rs = load_row(group->regs[instruction->rs]);
+	__m256i rt = load_row(group->regs[instruction->rt]);
+	__m256i rm = load_row(group->regs[instruction->rm]);
+	__m256i result;
+
+	switch (instruction->opcode) {
+	case 0: result = _mm256_add_epi32(_mm256_add_epi32(rs, rt), rm); break;
+	case 1: result = _mm256_sub_epi32(_mm256_sub_epi32(rs, rt), rm); break;
+	case 2: result = _mm256_add_epi32(_mm256_mullo_epi32(rs, rt), rm); break;
+	case 3: result = _mm256_and_si256(_mm256_and_si256(rs, rt), rm); break;
+	case 4: result = _mm256_or_si256(_mm256_or_si256(rs, rt), rm); break;
+	case 5: result = _mm256_xor_si256(_mm256_xor_si256(rs, rt), rm); break;
+	case 6: result = _mm256_sllv_epi32(rs, _mm256_and_si256(rt, count_mask)); break;
+	case 7: result = _mm256_srav_epi32(rs, _mm256_and_si256(rt, count_mask)); break;
+	default: result = _mm256_srlv_epi32(rs, _mm256_and_si256(rt, count_mask)); break;
+	}
+	store_lanes(group->regs[instruction->rd], result, mask);
+#else
+	const uint32_t *rs = group->regs[instruction->rs];
+	const uint32_t *rt = group->regs[instruction->rt];
+	const uint32_t *rm = group->regs[instruction->rm];
+	uint32_t result[LOCKSTEP_LANES];
+
+	// One loop per operation, so the compiler can vectorize it
+	switch (instruction->opcode) {
+	case 0: for (int lane = 0; lane < LOCKSTEP_LANES; lane++) { result[lane] = rs[lane] + rt[lane] + rm[lane]; } break;
+	case 1: for (int lane = 0; lane < LOCKSTEP_LANES; lane++) { result[lane] = rs[lane] - rt[lane] - rm[lane]; } break;
+	case 2: for (int lane = 0; lane < LOCKSTEP_LANES; lane++) { result[lane] = (rs[lane] * rt[lane]) + rm[lane]; } break;
+	case 3: for (int lane = 0; lane < LOCKSTEP_LANES; lane++) { result[lane] = rs[lane] & rt[lane] & rm[lane]; } break;
+	case 4: for (int lane = 0; lane < LOCKSTEP_LANES; lane++) { result[lane] = rs[lane] | rt[lane] | rm[lane]; } break;
+	case 5: for (int lane = 0; lane < LOCKSTEP_LANES; lane++) { result[lane] = rs[lane] ^ rt[lane] ^ rm[lane]; } break;
+	default: for (int lane = 0; lane < LOCKSTEP_LANES; lane++) { result[lane] = shift_result(instruction->opcode, rs[lane], rt[lane]); } break;
+	}
+	for (int lane = 0; lane < LOCKSTEP_LANES; lane++) {
+		if (mask & (1u << lane)) {
+			group->regs[instruction->rd][lane] = result[lane];
+		}
+	}
+#endif
+}
+
+// Lanes on which a branch is taken
+KERNEL_TARGET static unsigned int KERNEL(branch_taken)(const LockstepGroup *group, const Instruction *instruction) {
+#ifdef SIM_LOCKSTEP_AVX2
+	__m256i rs = load_row(group->regs[instruction->rs]);
+	__m256i rt = load_row(group->regs[instruction->rt]);
+
+	switch (instruction->opcode) {
+	case 9:  return compare_mask(_mm256_cmpeq_epi32(rs, rt));                        // beq
+	case 10: return ~compare_mask(_mm256_cmpeq_epi32(rs, rt)) & LOCKSTEP_ALL_LANES;  // bne
+	case 11: return compare_mask(_mm256_cmpgt_epi32(rt, rs));                        // blt
+	case 12: return compare_mask(_mm256_cmpgt_epi32(rs, rt));                        // bgt
+	case 13: return ~compare_mask(_mm256_cmpgt_epi32(rs, rt)) & LOCKSTEP_ALL_LANES;  // ble
+	default: return ~compare_mask(_mm256_cmpgt_epi32(rt, rs)) & LOCKSTEP_ALL_LANES;  // bge
+	}
+#else
+	unsigned int taken = 0;
+	for (int lane = 0; lane < LOCKSTEP_LANES; lane++) {
+		int32_t rs = (int32_t)group->regs[instruction->rs][lane];
+		int32_t rt = (int32_t)group->regs[instruction->rt][lane];
+		int condition;
+		switch (instruction->opcode) {
+		case 9:  condition = rs == rt; break;
+		case 10: condition = rs != rt; break;
+		case 11: condition = rs < rt; break;
+		case 12: condition = rs > rt; break;
+		case 13: condition = rs <= rt; break;
+		default: condition = rs >= rt; break;
+		}
+		taken |= (unsigned int)condition << lane;
+	}
+	return taken;
+#endif
+}
+
+// Execute lw on the lanes of a mask, returns the lanes whose address was out of range
+KERNEL_TARGET static unsigned int KERNEL(execute_lw)(LockstepGroup *group, const Instruction *instruction, unsigned int mask) {
+	int writes_rd = instruction->rd > REG_IMM2;
+	uint32_t data_mask = group->memory[0].mask; // Every lane has the geometry of lane 0
+	unsigned int outside = 0;
+
+#ifdef SIM_LOCKSTEP_AVX2
+	__m256i address = _mm256_add_epi32(load_row(group->regs[instruction->rs]), load_row(group->regs[instruction->rt]));
+	__m256i in_range = _mm256_cmpeq_epi32(_mm256_min_epu32(address, _mm256_set1_epi32((int)data_mask)), address);
+
+	// Every address valid: gather the words from the lanes' memories at once
+	if ((compare_mask(in_range) & mask) == mask) {
+		if (writes_rd) {
+			const int words_per_lane = (int)(sizeof(Memory) / sizeof(uint32_t));
+			__m256i offsets = _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32(words_per_lane));
+			__m256i value = _mm256_mask_i32gather_epi32(_mm256_setzero_si256(), (const int *)group->memory,
+				_mm256_add_epi32(address, offsets), lane_mask_vector(mask), 4);
+			store_lanes(group->regs[instruction->rd], _mm256_add_epi32(value, load_row(group->regs[instruction->rm])), mask);
+		}
+		return 0;
+	}
+#endif
+
+	for (int lane = 0; lane < LOCKSTEP_LANES; lane++) {
+		if (mask & (1u << lane)) {
+			Memory *memory = &group->memory[lane];
+			uint32_t address = group->regs[instruction->rs][lane] + group->regs[instruction->rt][lane];
+			uint32_t value;
+			if (address <= data_mask) {
+				value = memory->data[address];
+			}
+			else {
+				value = read_data_out_of_range(memory, address);
+				outside |= 1u << lane;
+			}
+			if (writes_rd) {
+				group->regs[instruction->rd][lane] = value + group->regs[instruction->rm][lane];
+			}
+		}
+	}
+	return outside;
+}
+
+// Execute the instruction at pc on the lanes of a mask
+KERNEL_TARGET static void KERNEL(execute_step)(LockstepGroup *group, const Instruction *instruction, uint16_t pc, unsigned int mask) {
+	int writes_rd = instruction->rd > REG_IMM2; // $zero, $imm1 and $imm2 are never written
+
+	KERNEL(set_lanes)(group->regs[REG_IMM1], instruction->imm1, mask);
+	KERNEL(set_lanes)(group->regs[REG_IMM2], instruction->imm2, mask);
+
+	switch (instruction->opcode) {
+	case 0: case 1: case 2: case 3: case 4: case 5: case 6: case 7: case 8:
+		if (writes_rd) {
+			KERNEL(execute_alu)(group, instruction, mask);
+		}
+		KERNEL(advance_lanes)(group, pc, mask);
+		break;
+
+	case 9: case 10: case 11: case 12: case 13: case 14: { // Branches, the lanes may diverge here
+		unsigned int taken = KERNEL(branch_taken)(group, instruction) & mask;
+		if (taken != 0) {
+			KERNEL(jump_lanes)(group, group->regs[instruction->rm], taken);
+		}
+		if (taken != mask) {
+			KERNEL(advance_lanes)(group, pc, mask & ~taken);
+		}
+		break;
+	}
+
+	case 15: // jal, the target is read before rd is written
+		KERNEL(jump_lanes)(group, group->regs[instruction->rm], mask);
+		if (writes_rd) {
+			KERNEL(set_lanes)(group->regs[instruction->rd], (uint32_t)pc + 1, mask);
+		}
+		break;
+
+	case 16: { // lw
+		unsigned int outside = KERNEL(execute_lw)(group, instruction, mask);
+		KERNEL(advance_lanes)(group, pc, mask);
+		stop_trapped_lanes(group, outside);
+		break;
+	}
+
+	case 17: { // sw
+		unsigned int outside = execute_sw(group, instruction, mask);
+		KERNEL(advance_lanes)(group, pc, mask);
+		stop_trapped_lanes(group, outside);
+		break;
+	}
+
+	case 18: case 19: case 20: case 21: // reti, in, out, halt
+		for (int lane = 0; lane < LOCKSTEP_LANES; lane++) {
+			if (mask & (1u << lane)) {
+				execute_lane_control(group, instruction, pc, lane);
+			}
+		}
+		break;
+
+	default: // The PC stays, as in the other engines
+		for (int lane = 0; lane < LOCKSTEP_LANES; lane++) {
+			if (mask & (1u << lane)) {
+				printf("Error: Unsupported opcode %d\n", instruction->opcode);
+			}
+		}
+		break;
+	}
+}
+
+// Run every running lane as one while they stay at a single PC and no event falls due. The PC
+// and the cycle count are kept once for the group, and only the lanes' data is touched per step.
+// Returns the number of steps taken, 0 if the first instruction needs the per-lane path.
+KERNEL_TARGET static uint64_t KERNEL(run_converged)(LockstepGroup *group, const DecodedProgram *program, uint16_t pc) {
+	const unsigned int mask = group->running;
+	const uint16_t pc_mask = io_pc_mask(&group->io[0]);
+	uint64_t quiet = converged_quiet_cycles(group);
+	uint64_t steps = 0;
+
+	while (steps < quiet && pc < pc_mask) { // increment_pc reports the last PC on the per-lane path
+		const Instruction *instruction = &program->entries[pc];
+		int writes_rd = instruction->rd > REG_IMM2;
+		unsigned int taken;
+		unsigned int outside;
+		uint16_t target;
+
+		if (instruction->opcode > 17) { // reti, in, out, halt and invalid opcodes run per lane
+			break;
+		}
+
+		KERNEL(set_lanes)(group->regs[REG_IMM1], instruction->imm1, mask);
+		KERNEL(set_lanes)(group->regs[REG_IMM2], instruction->imm2, mask);
+
+		switch (instruction->opcode) {
+		case 0: case 1: case 2: case 3: case 4: case 5: case 6: case 7: case 8:
+			if (writes_rd) {
+				KERNEL(execute_alu)(group, instruction, mask);
+			}
+			pc++;
+			break;
+
+		case 9: case 10: case 11: case 12: case 13: case 14:
+			taken = KERNEL(branch_taken)(group, instruction) & mask;
+			if (taken == 0) {
+				pc++;
+				break;
+			}
+			if (taken == mask && KERNEL(common_target)(group->regs[instruction->rm], mask, pc_mask, &target)) {
+				pc = target;
+				break;
+			}
+			finish_converged(group, pc, steps + 1); // The lanes diverge
+			KERNEL(jump_lanes)(group, group->regs[instruction->rm], taken);
+			KERNEL(advance_lanes)(group, pc, mask & ~taken);
+			return steps + 1;
+
+		case 15: // jal, the target is read before rd is written
+			if (!KERNEL(common_target)(group->regs[instruction->rm], mask, pc_mask, &target)) {
+				finish_converged(group, pc, steps + 1);
+				KERNEL(jump_lanes)(group, group->regs[instruction->rm], mask);
+				if (writes_rd) {
+					KERNEL(set_lanes)(group->regs[instruction->rd], (uint32_t)pc + 1, mask);
+				}
+				return steps + 1;
+			}
+			if (writes_rd) {
+				KERNEL(set_lanes)(group->regs[instruction->rd], (uint32_t)pc + 1, mask);
+			}
+			pc = target;
+			break;
+
+		default: // lw and sw, an out-of-range access leaves the converged run
+			outside = (instruction->opcode == 16) ? KERNEL(execute_lw)(group, instruction, mask) : execute_sw(group, instruction, mask);
+			pc++;
+			if (outside != 0) {
+				finish_converged(group, pc, steps + 1);
+				stop_trapped_lanes(group, outside);
+				return steps + 1;
+			}
+			break;
+		}
+		steps++;
+	}
+
+	finish_converged(group, pc, steps);
+	return steps;
+}
+
+// Run the lanes of the group until each of them halts
+KERNEL_TARGET static void KERNEL(run_lanes)(LockstepGroup *group, const DecodedProgram *program) {
+	while (group->running) {
+		unsigned int mask;
+		uint16_t pc = KERNEL(select_lanes)(group, &mask);
+
+		// Every running lane at one PC with no cycle started: run them as one
+		if (mask == group->running && group->started == 0 && KERNEL(run_converged)(group, program, pc) != 0) {
+			continue;
+		}
+
+		// Start the cycle of the selected lanes; a lane that takes an interrupt leaves the
+		// group and executes its handler when its PC is selected
+		unsigned int due = KERNEL(start_cycles)(group, mask & ~group->started);
+		for (int lane = 0; due != 0 && lane < LOCKSTEP_LANES; lane++) {
+			if (!(due & (1u << lane))) {
+				continue;
+			}
+			Scheduler *scheduler = &group->scheduler[lane];
+			scheduler->cycle = group->cycle[lane];
+			run_due_cycle(scheduler, &group->memory[lane], &group->io[lane], &group->disk[lane],
+				&group->irq2[lane], &group->pc[lane], &group->in_isr[lane]);
+			group->deadline[lane] = next_event_cycle(scheduler);
+			if (group->pc[lane] != pc) {
+				group->started |= 1u << lane;
+				mask &= ~(1u << lane);
+			}
+		}
+		if (mask == 0) {
+			continue;
+		}
+
+		group->started &= ~mask;
+		group->steps++;
+		group->lane_steps += (uint64_t)count_lanes(mask);
+		KERNEL(execute_step)(group, &program->entries[pc], pc, mask);
+	}
+}
@@ -0,0 +1,189 @@
+#define _CRT_SECURE_NO_WARNINGS
+#include "machine.h"
+#include "instruction_fetch.h"
+#include "execution.h"
+#include "trace.h"
+#include "profile.h"
+#include "idle.h"
+#include "journal.h"
+#include "timeline.h"
+#include "breakpoints.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
+
+// Allocate the storage of a machine and reset it
+int init_machine(Machine *machine) {
+	memset(machine, 0, sizeof(*machine));
+
+	MachineStorage *storage = malloc(sizeof(MachineStorage));
+	if (!storage) {
+		printf("Error: Memory allocation failed for the machine storage\n");
+		return 0;
+	}
+	set_machine_storage(machine, storage, 0);
+
+	init_registers(&machine->registers);
+	init_memory(machine->memory);
+	init_io(&machine->io);
+	init_disk(machine->disk);
+	return 1;
+}
+
+// Release the storage and the IRQ2 events of a machine
+void free_machine(Machine *machine) {
+	set_machine_storage(machine, NULL, 0);
+	free_irq2_data(&machine->irq2);
+}
+
+// Replace the storage of a machine
+void set_machine_storage(Machine *machine, MachineStorage *storage, size_t mapped_size) {
+	if (machine->storage != NULL) {
+		close_disk_image(&machine->storage->disk);
+#ifndef _WIN32
+		if (machine->mapped_size > 0) {
+			munmap(machine->storage, machine->mapped_size);
+		}
+		else
+#endif
+		{
+			free(machine->storage);
+		}
+	}
+
+	machine->storage = storage;
+	machine->mapped_size = mapped_size;
+	machine->memory = storage ? &storage->memory : NULL;
+	machine->disk = storage ? &storage->disk : NULL;
+}
+
+// Select the memory sizes and out-of-range policy of a machine
+int set_machine_geometry(Machine *machine, const MemoryGeometry *geometry) {
+	if (!check_memory_geometry(geometry)) {
+		return 0;
+	}
+	set_memory_geometry(machine->memory, geometry);
+	set_io_geometry(&machine->io, geometry);
+	return 1;
+}
+
+// Run the fetch-decode-execute loop for up to a number of cycles
+uint64_t run_machine(Machine *machine, const ProgramImage *image, const DecodedProgram *program, uint64_t cycles) {
+	IORegisters *io = &machine->io;
+	uint64_t executed = 0;
+	IdleDetector idle;
+	int idle_enabled = !machine->exact_stepping && io->trace == NULL && machine->timeline == NULL &&
+		machine->breakpoints == NULL;
+#ifdef SIM_PROFILE
+	idle_enabled &= machine->profile == NULL;
+#endif
+	init_idle_detector(&idle, idle_enabled);
+	if (machine->breakpoints != NULL) {
+		machine->breakpoints->hit = 0;
+	}
+
+	while (!machine->halted && executed < cycles) {
+		executed++;
+
+		// Note the state the cycle starts from for reverse execution
+		if (machine->timeline != NULL) {
+			timeline_cycle(machine->timeline, machine);
+		}
+
+		// Increment the clock register
+		increment_clock(io);
+
+		// Update the timer, only while timerenable is set
+		if (io->active & IO_ACTIVE_TIMER) {
+			update_timer(io);
+		}
+
+		// Check and trigger IRQ2 based on the current clock cycle
+		check_and_trigger_irq2(io, &machine->irq2, io->IORegister[IO_CLKS]);
+
+		// Handle interrupts if any are pending
+		handle_interrupts(io, &machine->pc, &machine->in_isr);
+
+		// Manage disk operations (e.g., read/write tasks), only while a command runs or waits
+		if (io->active & IO_ACTIVE_DISK) {
+			handle_disk_command(machine->memory, io, machine->disk);
+		}
+
+		// Note the IRQ2 and disk events of the cycle in the journal
+		if (machine->journal != NULL) {
+			journal_cycle(machine->journal, machine, machine->cycles + executed);
+		}
+
+		// Fetch the predecoded instruction at the PC
+		const Instruction *decoded = fetch_decoded_instruction(program, &machine->pc);
+
+		// Load the sign-extended immediates into $imm1 and $imm2
+		load_immediates(&machine->registers, decoded);
+
+		// Hand the cycle to the trace writer thread
+		if (io->trace != NULL) {
+			trace_cpu(io->trace, machine->pc, image->instructions[machine->pc], machine->registers.regs);
+		}
+
+		// Stop on halt, the halt cycle counts
+		if (decoded->opcode == 21) {
+			PROFILE_INSTRUCTION(machine->profile, machine->pc, 21, machine->in_isr, machine->pc);
+			machine->halted = 1;
+			break;
+		}
+
+		// Execute the decoded instruction
+#ifdef SIM_PROFILE
+		uint16_t profiled_pc = machine->pc;
+		int profiled_in_isr = machine->in_isr;
+#endif
+		uint16_t previous_pc = machine->pc;
+		if (idle.enabled) {
+			idle_check_instruction(&idle, decoded, &machine->registers, io);
+		}
+		if (machine->timeline != NULL) {
+			timeline_instruction(machine->timeline, machine, decoded);
+		}
+		execute_instruction(decoded, &machine->registers, machine->memory, io, &machine->pc, &machine->in_isr);
+		PROFILE_INSTRUCTION(machine->profile, profiled_pc, decoded->opcode, profiled_in_isr, machine->pc);
+
+		// A loop may have come around: fast-forward it if it is provably idle
+		if (idle.enabled && machine->pc <= previous_pc) {
+			uint64_t skipped = idle_back_edge(&idle, &machine->registers, machine->memory, machine->pc, machine->in_isr, io,
+				machine->disk, &machine->irq2, executed, cycles - executed);
+			executed += skipped;
+			machine->idle_cycles += skipped;
+		}
+
+		// A trapped out-of-range access stops the machine after the instruction
+		if (machine->memory->faulted) {
+			machine->halted = 1;
+			break;
+		}
+
+		// So does a watchpoint it hit, or a breakpoint on the next instruction
+		if (machine->breakpoints != NULL && breakpoint_stop(machine->breakpoints, program, machine->pc)) {
+			break;
+		}
+	}
+
+	machine->cycles += executed;
+	return executed;
+}
+
+// Run a machine until halt on the threaded-code engine
+uint64_t run_machine_to_halt(Machine *machine, ThreadedProgram *threaded) {
+	if (machine->halted) {
+		return 0;
+	}
+
+	uint64_t executed = run_fast_engine(threaded, &machine->registers, machine->memory, &machine->io,
+		machine->disk, &machine->irq2, &machine->pc, &machine->in_isr);
+	machine->halted = 1;
+	machine->cycles += executed;
+	return executed;
+}
@@ -0,0 +1,105 @@
+#ifndef MACHINE_H
+#define MACHINE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "registers.h"
+#include "memory.h"
+#include "io.h"
+#include "disk.h"
+#include "interrupts.h"
+#include "instruction_decode.h"
+#include "fast_execution.h"
+
+// Data memory and disk of a machine, kept in one block so a snapshot can share it page by page
+typedef struct {
+	Memory memory;
+	Disk disk;      // Including the disk timer
+} MachineStorage;
+
+// The complete state of one simulated SIMP machine
+typedef struct Machine {
+	Registers registers;
+	IORegisters io;
+	IRQ2Data irq2;           // Owns its event list
+	uint16_t pc;             // Program counter, as wide as the instruction depth (io_pc_mask)
+	int in_isr;              // ISR state (0 = not in ISR, 1 = in ISR)
+	int halted;              // 1 once halt was fetched
+	uint64_t cycles;         // Cycles executed since power-on
+	int exact_stepping;      // 1 makes run_machine step through idle loops instead of fast-forwarding them
+	uint64_t idle_cycles;    // Cycles run_machine fast-forwarded in idle loops (counted in cycles)
+
+	MachineStorage *storage; // Heap block, or a copy-on-write view of a snapshot
+	Memory *memory;          // &storage->memory
+	Disk *disk;              // &storage->disk
+	size_t mapped_size;      // Size of the mapping when storage is mapped, 0 for the heap
+	struct Journal *journal; // Records or checks the IRQ2 and disk events of run_machine when not NULL
+	struct Timeline *timeline; // Logs every cycle of run_machine for reverse execution when not NULL
+	struct Breakpoints *breakpoints; // Stops run_machine at breakpoints and watchpoints when not NULL
+#ifdef SIM_PROFILE
+	struct Profile *profile; // Counts the cycles of run_machine when not NULL
+#endif
+} Machine;
+
+
+// Function declaration
+
+/*
+-Functionality: Allocates the storage of a machine and resets it to the power-on state.
+-return 1 on success, 0 if the storage could not be allocated.
+-parameter1: machine - Pointer to the Machine structure.
+*/
+int init_machine(Machine *machine);
+
+/*
+-Functionality: Releases the storage and the IRQ2 events of a machine.
+-parameter1: machine - Pointer to the Machine structure.
+*/
+void free_machine(Machine *machine);
+
+/*
+-Functionality: Replaces the storage of a machine, releasing the previous one and its disk image.
+-parameter1: machine - Pointer to the Machine structure.
+-parameter2: storage - The new storage.
+-parameter3: mapped_size - Size of the mapping if storage is mapped, 0 if it was allocated with malloc.
+*/
+void set_machine_storage(Machine *machine, MachineStorage *storage, size_t mapped_size);
+
+/*
+-Functionality: Selects the memory geometry of a machine after init_machine: the instruction and
+ data depths and what an out-of-range data access does. Load the data memory afterwards so it
+ is checked against the new depth.
+-return 1 on success, 0 if the geometry is not valid (the machine is left unchanged).
+-parameter1: machine - Pointer to the Machine structure.
+-parameter2: geometry - Pointer to the MemoryGeometry.
+*/
+int set_machine_geometry(Machine *machine, const MemoryGeometry *geometry);
+
+/*
+-Functionality: Runs the fetch-decode-execute loop for up to a number of cycles, or until halt
+ (or a MEMORY_TRAP access, which leaves memory->faulted set).
+ Each cycle does the clock, timer, IRQ2, interrupt and disk handling before the instruction.
+ Idle loops are fast-forwarded to the next device event (see idle.h), cycle-exactly, unless the
+ run is traced, profiled, logged to a timeline or has breakpoints, or machine->exact_stepping is set.
+ With machine->breakpoints set the run also stops after an instruction that hit a watchpoint or
+ before one with a breakpoint (see breakpoints.h).
+ The IRQ2 deliveries and disk starts and completions go to machine->journal when it is set, and
+ the old values of everything a cycle writes to machine->timeline (see timeline.h).
+ Built with SIM_PROFILE, every cycle is also counted in machine->profile when it is set.
+-return The number of cycles executed.
+-parameter1: machine - Pointer to the Machine structure.
+-parameter2: image - Pointer to the ProgramImage, for the trace.
+-parameter3: program - Pointer to the DecodedProgram.
+-parameter4: cycles - Largest number of cycles to run, UINT64_MAX to run until halt.
+*/
+uint64_t run_machine(Machine *machine, const ProgramImage *image, const DecodedProgram *program, uint64_t cycles);
+
+/*
+-Functionality: Runs a machine until halt on the threaded-code engine.
+-return The number of cycles executed.
+-parameter1: machine - Pointer to the Machine structure.
+-parameter2: threaded - Pointer to the ThreadedProgram.
+*/
+uint64_t run_machine_to_halt(Machine *machine, ThreadedProgram *threaded);
+
+#endif
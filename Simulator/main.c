@@ -3,6 +3,7 @@
 #include <stdint.h>   // For fixed-width integer types (e.g., uint32_t, uint16_t)
 #include <stdio.h>    // For input/output operations (e.g., printf, fopen)
 #include <stdlib.h>   // For memory allocation and exit handling
+#include <string.h>   // For the command line arguments
 
 // Simulator Includes
 #include "memory.h"      
@@ -13,43 +14,1001 @@
 #include "instruction_fetch.h"
 #include "instruction_decode.h" 
 #include "execution.h" 
+#include "image.h"
+#include "trace.h"
+#include "machine.h"
+#include "batch.h"
+#include "threads.h"
+#include "fast_execution.h"
+#include "block_cache.h"
+#include "jit_x86_64.h"
+#include "monitor.h"
+#include "profile.h"
+#include "multicore.h"
+#include "journal.h"
+#include "timeline.h"
+#include "debugger.h"
+#include "simulator.h"
 
- // The simulator fetch-decode-exe loop
-void simulator_main_loop(Registers *registers, Memory *memory, IORegisters *io, Disk *disk, IRQ2Data *irq2) {
-	uint16_t pc = 0;        // Program counter (12-bit)
-	int in_isr = 0;         // ISR state (0 = not in ISR, 1 = in ISR)
+ // The simulator fetch-decode-exe loop, the whole state lives in the Machine so it can be snapshotted
+void simulator_main_loop(Machine *machine, const ProgramImage *image, const DecodedProgram *program) {
+	run_machine(machine, image, program, UINT64_MAX);
+}
+
+// Execution engines of a single run
+typedef enum {
+	ENGINE_REFERENCE, // simulator_main_loop, the only one that writes trace.txt
+	ENGINE_FAST,      // Threaded code
+	ENGINE_BLOCK,     // Block cache
+	ENGINE_JIT        // Block cache with x86-64 code for hot blocks
+} Engine;
 
-	while (1) {
-		// Increment the clock register
-		increment_clock(io);
+static const char *const engine_names[] = { "ref", "fast", "block", "jit" };
 
-		// Update the timer
-		update_timer(io);
+// The program of a single run in every form the engines use, too large for the stack
+typedef struct {
+	ProgramImage image;
+	DecodedProgram decoded;
+	ThreadedProgram threaded;
+} Program;
 
-		// Check and trigger IRQ2 based on the current clock cycle
-		check_and_trigger_irq2(io, irq2, io->IORegister[8]);
+static Program program;
 
-		// Handle interrupts if any are pending
-		handle_interrupts(io, &pc, &in_isr);
+// Parse an engine name, returns 0 if the argument is not one
+static int parse_engine(const char *arg, Engine *engine) {
+	for (int i = 0; i < (int)(sizeof(engine_names) / sizeof(engine_names[0])); i++) {
+		if (strcmp(arg, engine_names[i]) == 0) {
+			*engine = (Engine)i;
+			return 1;
+		}
+	}
+	return 0;
+}
 
-		// Manage disk operations (e.g., read/write tasks)
-		handle_disk_command(memory, io, disk);
+// Run a machine until halt (or a trap) on an engine, the translation caches are built for this run only.
+// Returns 0 if the run stopped because a block could not be translated.
+static int run_engine(Engine engine, Machine *machine) {
+	static BlockCache cache;
+	JitState jit;
+	uint64_t executed;
+	int translated;
 
-		// Fetch the next instruction using the 12-bit PC
-		uint8_t instruction = fetch_instruction(memory, &pc);
+	switch (engine) {
+	case ENGINE_FAST:
+		run_machine_to_halt(machine, &program.threaded);
+		return 1;
 
-		// Decode the fetched instruction
-		Instruction* decoded;
-		decode_instruction(instruction, decoded, registers);
+	case ENGINE_BLOCK:
+	case ENGINE_JIT:
+		init_block_cache(&cache);
+		if (engine == ENGINE_JIT) {
+			init_jit(&jit);
+			executed = run_jit_engine(&jit, &cache, &program.threaded, &machine->registers, machine->memory,
+				&machine->io, machine->disk, &machine->irq2, &machine->pc, &machine->in_isr);
+			free_jit(&jit);
+		}
+		else {
+			executed = run_block_engine(&cache, &program.threaded, NULL, NULL, &machine->registers, machine->memory,
+				&machine->io, machine->disk, &machine->irq2, &machine->pc, &machine->in_isr);
+		}
+		translated = !cache.failed;
+		free_block_cache(&cache);
+		machine->halted = 1;
+		machine->cycles += executed;
+		return translated;
 
-		// Execute the decoded instruction
-		execute_instruction(decoded, registers, memory, io,  &pc, &in_isr);
+	default:
+		simulator_main_loop(machine, &program.image, &program.decoded);
+		return 1;
+	}
+}
 
+// Load a program and translate it for the engines, returns 0 if it could not be loaded
+static int load_program(const char *filename) {
+	init_program_image(&program.image);
+	if (!load_instruction_memory(filename, &program.image)) {
+		return 0;
 	}
+	predecode_program(&program.image, &program.decoded);
+	prepare_threaded_program(&program.decoded, &program.threaded);
+	return 1;
 }
 
-int main() {
-  	printf("Now we try to work with GIT");
-	printf("Hello, Simulator!\n");
+// Convert an image file: convert <imem|dmem|disk|monitor> <binary|text> <input> <output>
+static int convert_main(char *argv[]) {
+	ImageKind kind;
+	if (strcmp(argv[0], "imem") == 0) {
+		kind = IMAGE_INSTRUCTIONS;
+	}
+	else if (strcmp(argv[0], "dmem") == 0) {
+		kind = IMAGE_DATA;
+	}
+	else if (strcmp(argv[0], "disk") == 0) {
+		kind = IMAGE_DISK;
+	}
+	else if (strcmp(argv[0], "monitor") == 0) {
+		kind = IMAGE_MONITOR;
+	}
+	else {
+		printf("Error: Unknown image kind %s (expected imem, dmem, disk or monitor)\n", argv[0]);
+		return 1;
+	}
+
+	if (!convert_image(argv[2], argv[3], kind, strcmp(argv[1], "binary") == 0)) {
+		printf("Error: Could not convert %s to %s\n", argv[2], argv[3]);
+		return 1;
+	}
+	printf("Converted %s to %s\n", argv[2], argv[3]);
 	return 0;
 }
+
+// Parse a memory geometry option: imem=<depth>, dmem=<depth> or log|wrap|trap.
+// Returns 0 if the argument is not one of them.
+static int parse_geometry_option(const char *arg, MemoryGeometry *geometry) {
+	if (strncmp(arg, "imem=", 5) == 0) {
+		geometry->instruction_depth = parse_memory_depth(arg + 5);
+	}
+	else if (strncmp(arg, "dmem=", 5) == 0) {
+		geometry->data_depth = parse_memory_depth(arg + 5);
+	}
+	else if (strcmp(arg, "log") == 0) {
+		geometry->policy = MEMORY_LOG;
+	}
+	else if (strcmp(arg, "wrap") == 0) {
+		geometry->policy = MEMORY_WRAP;
+	}
+	else if (strcmp(arg, "trap") == 0) {
+		geometry->policy = MEMORY_TRAP;
+	}
+	else {
+		return 0;
+	}
+	return 1;
+}
+
+// Run a batch of input sets against one program:
+// batch <imemin> <manifest> [threads] [lockstep] [full|trimmed|dirty] [imem=N] [dmem=N] [log|wrap|trap]
+//       [monitor] [capture=<cycles per frame>]
+static int batch_main(int argc, char *argv[]) {
+	static ProgramImage image;
+	BatchManifest manifest;
+	MemoryGeometry geometry = default_memory_geometry();
+	int threads = 0;
+	int lockstep = 0;
+	DumpMode dump_mode = DUMP_FULL;
+	int monitor = 0;
+	uint32_t capture_period = 0;
+
+	for (int i = 2; i < argc; i++) {
+		if (parse_geometry_option(argv[i], &geometry)) {
+			continue;
+		}
+		if (strcmp(argv[i], "lockstep") == 0) {
+			lockstep = 1;
+		}
+		else if (strcmp(argv[i], "full") == 0) {
+			dump_mode = DUMP_FULL;
+		}
+		else if (strcmp(argv[i], "trimmed") == 0) {
+			dump_mode = DUMP_TRIMMED;
+		}
+		else if (strcmp(argv[i], "dirty") == 0) {
+			dump_mode = DUMP_DIRTY;
+		}
+		else if (strcmp(argv[i], "monitor") == 0) {
+			monitor = 1;
+		}
+		else if (strncmp(argv[i], "capture=", 8) == 0) {
+			monitor = 1;
+			capture_period = (uint32_t)strtoul(argv[i] + 8, NULL, 10);
+			if (capture_period == 0) {
+				printf("Error: Invalid monitor capture period %s\n", argv[i] + 8);
+				return 1;
+			}
+		}
+		else {
+			char *end;
+			long count = strtol(argv[i], &end, 10);
+			if (end == argv[i] || *end != '\0' || count < 0 || count > INT32_MAX) {
+				printf("Error: Unknown option %s\n", argv[i]);
+				return 1;
+			}
+			threads = (int)count;
+		}
+	}
+
+	if (!check_memory_geometry(&geometry)) {
+		return 1;
+	}
+
+	init_program_image(&image);
+	if (!load_instruction_memory(argv[0], &image) || !load_batch_manifest(argv[1], &manifest)) {
+		return 1;
+	}
+	manifest.dump_mode = dump_mode;
+	manifest.geometry = geometry;
+	manifest.monitor = monitor;
+	manifest.capture_period = capture_period;
+
+	double start = monotonic_time_ms();
+	int failed = run_batch(&image, &manifest, threads, lockstep);
+	print_batch_summary(&manifest, monotonic_time_ms() - start);
+
+	free_batch_manifest(&manifest);
+	return failed ? 1 : 0;
+}
+
+// Parse a dump mode option, returns 0 if the argument is not one
+static int parse_dump_mode(const char *arg, DumpMode *mode) {
+	if (strcmp(arg, "full") == 0) {
+		*mode = DUMP_FULL;
+	}
+	else if (strcmp(arg, "trimmed") == 0) {
+		*mode = DUMP_TRIMMED;
+	}
+	else if (strcmp(arg, "dirty") == 0) {
+		*mode = DUMP_DIRTY;
+	}
+	else {
+		return 0;
+	}
+	return 1;
+}
+
+// Output files of a run, in command line order after the four inputs. "-" skips a file.
+typedef enum {
+	OUT_DMEM,
+	OUT_REGS,
+	OUT_TRACE,
+	OUT_HWREG,
+	OUT_CYCLES,
+	OUT_LEDS,
+	OUT_DISPLAY,
+	OUT_DISK,
+	OUT_MONITOR,
+	OUT_MONITOR_YUV,
+	NUM_OUTPUTS
+} OutputFile;
+
+// Options of a run given after the file names
+typedef struct {
+	Engine engine;
+	MemoryGeometry geometry;
+	DumpMode dump_mode;
+	int exact_stepping;        // Step through idle loops on the ref engine
+	const char *disk_base;     // Raw base image of a runtime-sized disk, replaces diskin
+	uint64_t disk_sectors;     // Its sector count, 0 for the size of the base file
+	const char *disk_delta;    // Delta applied over the disk before the run
+	const char *delta_out;     // Delta of the sectors the run wrote
+	const char *capture;       // Monitor capture file
+	uint32_t capture_period;
+	const char *profile;       // Prefix of the profile report (.txt) and folded stacks (.folded)
+	const char *labels;        // Label file of the profile
+	const char *journal;       // Journal recorded by the run
+	uint64_t hash_period;      // Cycles between the state hashes of the journal
+	uint64_t snapshot_period;  // Cycles between its snapshots, 0 for the first one only
+} RunOptions;
+
+// Parse the options of a run, returns 0 on an invalid one
+static int parse_run_options(int argc, char *argv[], RunOptions *options) {
+	memset(options, 0, sizeof(*options));
+	options->engine = ENGINE_REFERENCE;
+	options->geometry = default_memory_geometry();
+	options->dump_mode = DUMP_FULL;
+
+	for (int i = 0; i < argc; i++) {
+		char *arg = argv[i];
+		if (parse_engine(arg, &options->engine) || parse_geometry_option(arg, &options->geometry) ||
+			parse_dump_mode(arg, &options->dump_mode)) {
+			continue;
+		}
+		if (strcmp(arg, "exact") == 0) {
+			options->exact_stepping = 1;
+		}
+		else if (strncmp(arg, "disk=", 5) == 0) {
+			// disk=<base>[:<sectors>]
+			char *colon = strrchr(arg + 5, ':');
+			if (colon != NULL) {
+				*colon = '\0';
+				options->disk_sectors = strtoull(colon + 1, NULL, 10);
+			}
+			options->disk_base = (arg[5] != '\0') ? arg + 5 : NULL;
+			if (options->disk_base == NULL && options->disk_sectors == 0) {
+				printf("Error: A blank disk image needs a sector count, disk=:<sectors>\n");
+				return 0;
+			}
+		}
+		else if (strncmp(arg, "delta=", 6) == 0) {
+			options->disk_delta = arg + 6;
+		}
+		else if (strncmp(arg, "deltaout=", 9) == 0) {
+			options->delta_out = arg + 9;
+		}
+		else if (strncmp(arg, "record=", 7) == 0) {
+			options->journal = arg + 7;
+		}
+		else if (strncmp(arg, "hashes=", 7) == 0) {
+			options->hash_period = strtoull(arg + 7, NULL, 10);
+		}
+		else if (strncmp(arg, "snapshots=", 10) == 0) {
+			options->snapshot_period = strtoull(arg + 10, NULL, 10);
+		}
+		else if (strncmp(arg, "capture=", 8) == 0) {
+			// capture=<cycles per frame>:<file>
+			char *colon = strchr(arg + 8, ':');
+			options->capture_period = (uint32_t)strtoul(arg + 8, NULL, 10);
+			if (colon == NULL || colon[1] == '\0' || options->capture_period == 0) {
+				printf("Error: Invalid monitor capture %s, expected capture=<cycles per frame>:<file>\n", arg + 8);
+				return 0;
+			}
+			options->capture = colon + 1;
+		}
+#ifdef SIM_PROFILE
+		else if (strncmp(arg, "profile=", 8) == 0) {
+			options->profile = arg + 8;
+		}
+		else if (strncmp(arg, "labels=", 7) == 0) {
+			options->labels = arg + 7;
+		}
+#endif
+		else {
+			printf("Error: Unknown option %s\n", arg);
+			return 0;
+		}
+	}
+
+	if (!check_memory_geometry(&options->geometry)) {
+		return 0;
+	}
+	if (options->profile != NULL && options->engine != ENGINE_REFERENCE) {
+		printf("Error: The profiler runs on the ref engine only\n");
+		return 0;
+	}
+	if (options->journal != NULL && (options->engine != ENGINE_REFERENCE || options->profile != NULL)) {
+		printf("Error: Journals are recorded on the ref engine only, without the profiler\n");
+		return 0;
+	}
+	if (options->journal != NULL && (options->disk_base != NULL || options->disk_sectors != 0)) {
+		printf("Error: Journals need the built-in disk, its snapshots do not cover disk images\n");
+		return 0;
+	}
+	return 1;
+}
+
+// Write regout.txt: R3 to R15
+static int write_register_file(const char *filename, const uint32_t regs[NUM_REGISTERS]) {
+	FILE *file = fopen(filename, "w");
+	if (!file) {
+		return 0;
+	}
+	for (int i = 3; i < NUM_REGISTERS; i++) {
+		fprintf(file, "%08X\n", regs[i]);
+	}
+	return fclose(file) == 0;
+}
+
+// Write cycles.txt
+static int write_cycle_count(const char *filename, uint64_t cycles) {
+	FILE *file = fopen(filename, "w");
+	if (!file) {
+		return 0;
+	}
+	fprintf(file, "%llu\n", (unsigned long long)cycles);
+	return fclose(file) == 0;
+}
+
+// Name of an output file, NULL if it is skipped
+static const char *output_name(char *outputs[], OutputFile file) {
+	return (strcmp(outputs[file], "-") == 0) ? NULL : outputs[file];
+}
+
+// How the file loaders name each SimInput in their messages
+static const struct {
+	const char *file;   // "Could not open <file> file"
+	const char *image;  // "Invalid <image> image"
+	const char *loaded; // "<loaded> loaded from", NULL if they print nothing
+} sim_input_names[] = {
+	{ "instruction memory", "instruction memory", "Instruction memory" },
+	{ "data memory", "data memory", "Data memory" },
+	{ "disk input", "disk", "Disk" },
+	{ "IRQ2 input", "IRQ2", NULL }
+};
+
+// Load an input file into a simulator with the messages of the file loaders, returns 0 if it failed
+static int load_sim_input(Simulator *sim, SimInput input, const char *filename) {
+	MappedFile file;
+
+	if (!map_file(filename, &file)) {
+		printf("Error: Could not open %s file: %s\n", sim_input_names[input].file, filename);
+		return 0;
+	}
+	SimStatus status = sim_load(sim, input, file.data, file.size);
+	unmap_file(&file);
+	if (status == SIM_ERROR_FORMAT) {
+		printf("Error: Invalid %s image: %s\n", sim_input_names[input].image, filename);
+		return 0;
+	}
+	if (status != SIM_OK) {
+		printf("Error: Could not load %s: %s\n", filename, sim_status_name(status));
+		return 0;
+	}
+	if (sim_input_names[input].loaded != NULL) {
+		printf("%s loaded from %s\n", sim_input_names[input].loaded, filename);
+	}
+	return 1;
+}
+
+// Set up the disk of a run: diskin (through the simulator when there is one), or a runtime-sized image,
+// then the optional delta
+static int load_run_disk(const RunOptions *options, const char *diskin, Simulator *sim, Disk *disk) {
+	if (options->disk_base == NULL && options->disk_sectors == 0) {
+		if (!((sim != NULL) ? load_sim_input(sim, SIM_INPUT_DISK, diskin) : load_disk(diskin, disk))) {
+			return 0;
+		}
+	}
+	else if (!open_disk_image(disk, options->disk_base, options->disk_sectors)) {
+		return 0;
+	}
+	if (options->disk_delta != NULL && !apply_disk_delta(disk, options->disk_delta)) {
+		printf("Error: Could not apply the disk delta %s\n", options->disk_delta);
+		return 0;
+	}
+	return 1;
+}
+
+// Load dmemin, the disk and irq2in of a run, through the simulator that owns the machine when there is one
+static int load_run_inputs(const RunOptions *options, char *argv[], Simulator *sim, Machine *machine) {
+	if (sim != NULL) {
+		return load_sim_input(sim, SIM_INPUT_DATA, argv[1]) && load_run_disk(options, argv[2], sim, machine->disk) &&
+			load_sim_input(sim, SIM_INPUT_IRQ2, argv[3]);
+	}
+	return load_data_memory(argv[1], machine->memory) && load_run_disk(options, argv[2], NULL, machine->disk) &&
+		load_irq2_events(argv[3], &machine->irq2);
+}
+
+// Free the machine of a run, with the simulator that owns it when there is one
+static void free_run_machine(Simulator *sim, Machine *machine) {
+	if (sim != NULL) {
+		sim_destroy(sim);
+	}
+	else {
+		free_machine(machine);
+	}
+}
+
+// Write the outputs of a finished run from its registers, cycle count, memory, disk and monitor
+static int write_run_outputs(const RunOptions *options, char *outputs[], const uint32_t regs[NUM_REGISTERS], uint64_t cycles,
+	const Machine *machine, const Monitor *monitor) {
+	const char *name;
+	int ok = 1;
+
+	if ((name = output_name(outputs, OUT_DMEM)) != NULL) {
+		ok &= write_data_memory(name, machine->memory, options->dump_mode);
+	}
+	if ((name = output_name(outputs, OUT_REGS)) != NULL && !write_register_file(name, regs)) {
+		printf("Error: Could not write register file: %s\n", name);
+		ok = 0;
+	}
+	if ((name = output_name(outputs, OUT_CYCLES)) != NULL && !write_cycle_count(name, cycles)) {
+		printf("Error: Could not write cycle count file: %s\n", name);
+		ok = 0;
+	}
+	if ((name = output_name(outputs, OUT_DISK)) != NULL) {
+		write_disk(name, machine->disk, options->dump_mode);
+	}
+	if (options->delta_out != NULL && !write_disk_delta(machine->disk, options->delta_out)) {
+		printf("Error: Could not write disk delta: %s\n", options->delta_out);
+		ok = 0;
+	}
+	if ((name = output_name(outputs, OUT_MONITOR)) != NULL &&
+		!write_text_dump(name, IMAGE_MONITOR, monitor->pixels, MONITOR_PIXELS, options->dump_mode, monitor->dirty)) {
+		printf("Error: Could not write monitor file: %s\n", name);
+		ok = 0;
+	}
+	if ((name = output_name(outputs, OUT_MONITOR_YUV)) != NULL && !write_monitor_yuv(monitor, name)) {
+		printf("Error: Could not write monitor file: %s\n", name);
+		ok = 0;
+	}
+	return ok;
+}
+
+#ifdef SIM_PROFILE
+// Profile a run on the reference engine and write the report and folded stacks
+static int run_profiled(const RunOptions *options, Machine *machine) {
+	char path[1024];
+	Profile profile;
+
+	if (!init_profile(&profile, pc_hex_digits(io_pc_mask(&machine->io)))) {
+		return 0;
+	}
+	if (options->labels != NULL && load_profile_labels(&profile, options->labels) < 0) {
+		free_profile(&profile);
+		return 0;
+	}
+	machine->profile = &profile;
+	simulator_main_loop(machine, &program.image, &program.decoded);
+	machine->profile = NULL;
+
+	snprintf(path, sizeof(path), "%s.txt", options->profile);
+	int ok = write_profile_report(&profile, path);
+	snprintf(path, sizeof(path), "%s.folded", options->profile);
+	ok &= write_profile_folded(&profile, path);
+	if (!ok) {
+		printf("Error: Could not write the profile %s\n", options->profile);
+	}
+	free_profile(&profile);
+	return ok;
+}
+#endif
+
+// Run one program with the classic file list:
+// imemin dmemin diskin irq2in dmemout regout trace hwregtrace cycles leds display7seg diskout monitor monitor.yuv
+//   [ref|fast|block|jit] [exact] [full|trimmed|dirty] [imem=N] [dmem=N] [log|wrap|trap] [disk=<base>[:<sectors>]]
+//   [delta=<file>] [deltaout=<file>] [capture=<cycles per frame>:<file>] [profile=<prefix>] [labels=<file>]
+//   [record=<journal> [hashes=<cycles>] [snapshots=<cycles>]]
+static int run_main(int argc, char *argv[]) {
+	static Machine own_machine;
+	static Monitor monitor;
+	static Trace trace;
+	RunOptions options;
+	Simulator *sim = NULL;
+	Machine *machine = &own_machine;
+	char **outputs = argv + 4;
+	uint32_t regs[NUM_REGISTERS];
+	uint64_t cycles;
+	int faulted;
+	uint32_t fault_address;
+	int ok = 1;
+
+	if (!parse_run_options(argc - 4 - NUM_OUTPUTS, argv + 4 + NUM_OUTPUTS, &options)) {
+		return 1;
+	}
+	if (options.engine != ENGINE_REFERENCE && output_name(outputs, OUT_TRACE) != NULL) {
+		printf("Error: trace.txt is written by the ref engine only, pass - for it to use %s\n", engine_names[options.engine]);
+		return 1;
+	}
+
+	// A plain ref run goes through the embeddable simulator; the other engines, the profiler and journals
+	// use the translated program forms and hooks it does not expose
+	if (options.engine == ENGINE_REFERENCE && options.profile == NULL && options.journal == NULL) {
+		SimStatus status = sim_create(&sim);
+		if (status == SIM_OK) {
+			status = sim_set_geometry(sim, options.geometry.instruction_depth, options.geometry.data_depth, options.geometry.policy);
+		}
+		if (status != SIM_OK) {
+			printf("Error: Could not create the simulator: %s\n", sim_status_name(status));
+			sim_destroy(sim);
+			return 1;
+		}
+		if (!load_sim_input(sim, SIM_INPUT_PROGRAM, argv[0])) {
+			sim_destroy(sim);
+			return 1;
+		}
+		machine = sim_machine(sim);
+	}
+	else if (!load_program(argv[0]) || !init_machine(machine) || !set_machine_geometry(machine, &options.geometry)) {
+		return 1;
+	}
+	machine->exact_stepping = options.exact_stepping;
+	if (!load_run_inputs(&options, argv, sim, machine)) {
+		free_run_machine(sim, machine);
+		return 1;
+	}
+
+	init_monitor(&monitor);
+	attach_monitor(&monitor, &machine->io);
+	if (options.capture != NULL && !start_monitor_capture(&monitor, options.capture, options.capture_period)) {
+		free_run_machine(sim, machine);
+		return 1;
+	}
+
+	const char *trace_files[TRACE_NUM_FILES] = {
+		output_name(outputs, OUT_TRACE), output_name(outputs, OUT_HWREG),
+		output_name(outputs, OUT_LEDS), output_name(outputs, OUT_DISPLAY)
+	};
+	int tracing = 0;
+	for (int i = 0; i < TRACE_NUM_FILES; i++) {
+		tracing |= trace_files[i] != NULL;
+	}
+	if (tracing) {
+		if (!trace_open(&trace, trace_files, 0, pc_hex_digits(io_pc_mask(&machine->io)))) {
+			free_run_machine(sim, machine);
+			return 1;
+		}
+		machine->io.trace = &trace;
+	}
+
+	if (sim != NULL) {
+		SimStop stop;
+		sim_run_until(sim, UINT64_MAX, &stop);
+		for (int i = 0; i < NUM_REGISTERS; i++) {
+			sim_get_register(sim, i, &regs[i]);
+		}
+		cycles = sim_cycles(sim);
+		faulted = stop == SIM_STOP_TRAP;
+		fault_address = sim_fault_address(sim);
+	}
+	else {
+#ifdef SIM_PROFILE
+		if (options.profile != NULL) {
+			ok &= run_profiled(&options, machine);
+		}
+		else
+#endif
+		if (options.journal != NULL) {
+			Journal journal;
+			if (create_journal(&journal, options.journal, hash_program(&program.image, options.geometry.instruction_depth),
+				options.hash_period, options.snapshot_period)) {
+				ok &= record_machine(&journal, machine, &program.image, &program.decoded);
+			}
+			else {
+				ok = 0;
+			}
+			free_journal(&journal);
+		}
+		else {
+			ok &= run_engine(options.engine, machine);
+		}
+		memcpy(regs, machine->registers.regs, sizeof(regs));
+		cycles = machine->cycles;
+		faulted = machine->memory->faulted;
+		fault_address = machine->memory->fault_address;
+	}
+
+	if (tracing) {
+		machine->io.trace = NULL;
+		if (!trace_close(&trace)) {
+			printf("Error: Could not write the trace files\n");
+			ok = 0;
+		}
+	}
+	if (options.capture != NULL && !finish_monitor_capture(&monitor, machine->io.IORegister[8])) {
+		printf("Error: Could not write the monitor capture %s\n", options.capture);
+		ok = 0;
+	}
+	ok &= write_run_outputs(&options, outputs, regs, cycles, machine, &monitor);
+	if (faulted) {
+		printf("Error: The run stopped on data memory address %d\n", (int)fault_address);
+		ok = 0;
+	}
+
+	free_run_machine(sim, machine);
+	return ok ? 0 : 1;
+}
+
+// Run one program on several cores sharing data memory and disk:
+// cores <N> <imemin> <dmemin> <diskin> <irq2in> <dmemout> <regout> <cycles> <diskout> [quantum=<cycles>]
+//   [shared] [full|trimmed|dirty] [imem=N] [dmem=N] [log|wrap|trap]
+// regout.txt holds R3 to R15 of every core in core order, cycles.txt the cycles of the last core to halt.
+static int cores_main(int argc, char *argv[]) {
+	static MulticoreSystem system;
+	MemoryGeometry geometry = default_memory_geometry();
+	DumpMode dump_mode = DUMP_FULL;
+	MemoryOrder order = MEMORY_ORDER_QUANTUM;
+	uint64_t quantum = MULTICORE_DEFAULT_QUANTUM;
+	int core_count = atoi(argv[0]);
+	int ok = 1;
+
+	for (int i = 9; i < argc; i++) {
+		if (parse_geometry_option(argv[i], &geometry) || parse_dump_mode(argv[i], &dump_mode)) {
+			continue;
+		}
+		if (strcmp(argv[i], "shared") == 0) {
+			order = MEMORY_ORDER_SHARED;
+		}
+		else if (strncmp(argv[i], "quantum=", 8) == 0) {
+			quantum = strtoull(argv[i] + 8, NULL, 10);
+			if (quantum == 0) {
+				printf("Error: Invalid quantum %s\n", argv[i] + 8);
+				return 1;
+			}
+		}
+		else {
+			printf("Error: Unknown option %s\n", argv[i]);
+			return 1;
+		}
+	}
+
+	if (!load_program(argv[1]) || !init_multicore_system(&system, core_count, &geometry, quantum, order)) {
+		return 1;
+	}
+	Machine *shared = &system.cores[0].machine;
+	if (!load_data_memory(argv[2], shared->memory) || !load_disk(argv[3], shared->disk) ||
+		!load_irq2_events(argv[4], &shared->irq2)) {
+		free_multicore_system(&system);
+		return 1;
+	}
+
+	double start = monotonic_time_ms();
+	uint64_t cycles = run_multicore_system(&system, &program.decoded);
+	printf("Ran %d cores for %llu cycles in %llu quanta of %llu cycles (%s memory order), %.3f ms\n", core_count,
+		(unsigned long long)cycles, (unsigned long long)system.quanta, (unsigned long long)system.quantum,
+		(order == MEMORY_ORDER_SHARED) ? "shared" : "quantum", monotonic_time_ms() - start);
+
+	ok &= write_data_memory(argv[5], shared->memory, dump_mode);
+	FILE *file = fopen(argv[6], "w");
+	if (file) {
+		for (int i = 0; i < core_count; i++) {
+			for (int r = 3; r < NUM_REGISTERS; r++) {
+				fprintf(file, "%08X\n", system.cores[i].machine.registers.regs[r]);
+			}
+		}
+	}
+	if (!file || fclose(file) != 0) {
+		printf("Error: Could not write register file: %s\n", argv[6]);
+		ok = 0;
+	}
+	if (!write_cycle_count(argv[7], cycles)) {
+		printf("Error: Could not write cycle count file: %s\n", argv[7]);
+		ok = 0;
+	}
+	write_disk(argv[8], shared->disk, dump_mode);
+	for (int i = 0; i < core_count; i++) {
+		if (system.cores[i].faulted) {
+			printf("Error: Core %d stopped on data memory address %d\n", i, (int)system.cores[i].fault_address);
+			ok = 0;
+		}
+	}
+
+	free_multicore_system(&system);
+	return ok ? 0 : 1;
+}
+
+// Replay a journal and check the run against it:
+// replay <imemin> <journal> <dmemout> <regout> <cycles> <diskout> [from=<cycle>] [to=<cycle>] [full|trimmed|dirty]
+// The replay starts at the last snapshot at or before from, the outputs hold the state reached at to.
+static int replay_main(int argc, char *argv[]) {
+	static Machine machine;
+	Journal journal;
+	DumpMode dump_mode = DUMP_FULL;
+	uint64_t from = 0;
+	uint64_t to = UINT64_MAX;
+	int ok = 1;
+
+	for (int i = 6; i < argc; i++) {
+		if (parse_dump_mode(argv[i], &dump_mode)) {
+			continue;
+		}
+		if (strncmp(argv[i], "from=", 5) == 0) {
+			from = strtoull(argv[i] + 5, NULL, 10);
+		}
+		else if (strncmp(argv[i], "to=", 3) == 0) {
+			to = strtoull(argv[i] + 3, NULL, 10);
+		}
+		else {
+			printf("Error: Unknown option %s\n", argv[i]);
+			return 1;
+		}
+	}
+
+	if (!load_program(argv[0]) || !load_journal(argv[1], &journal)) {
+		return 1;
+	}
+	if (!init_machine(&machine)) {
+		free_journal(&journal);
+		return 1;
+	}
+
+	double start = monotonic_time_ms();
+	ok = replay_machine(&journal, &machine, &program.image, &program.decoded, from, to);
+	printf("Replay %s at cycle %llu, %.3f ms\n", ok ? "matched the journal" : "stopped", (unsigned long long)machine.cycles,
+		monotonic_time_ms() - start);
+
+	if (machine.storage != NULL) {
+		ok &= write_data_memory(argv[2], machine.memory, dump_mode);
+		if (!write_register_file(argv[3], machine.registers.regs) || !write_cycle_count(argv[4], machine.cycles)) {
+			printf("Error: Could not write the register or cycle count file\n");
+			ok = 0;
+		}
+		write_disk(argv[5], machine.disk, dump_mode);
+	}
+
+	free_machine(&machine);
+	free_journal(&journal);
+	return ok ? 0 : 1;
+}
+
+// Debug a run with reverse execution and breakpoints, reading the commands of debugger.h from stdin:
+// debug <imemin> <dmemin> <diskin> <irq2in> [budget=<MB>] [undo=<entries>] [imem=N] [dmem=N] [log|wrap|trap]
+// budget bounds the memory of the checkpoints, undo the entries of the undo log.
+static int debug_main(int argc, char *argv[]) {
+	static Machine machine;
+	static Breakpoints breakpoints;
+	Timeline timeline;
+	MemoryGeometry geometry = default_memory_geometry();
+	size_t budget = 0;
+	size_t undo = 0;
+
+	for (int i = 4; i < argc; i++) {
+		if (parse_geometry_option(argv[i], &geometry)) {
+			continue;
+		}
+		if (strncmp(argv[i], "budget=", 7) == 0) {
+			budget = (size_t)strtoull(argv[i] + 7, NULL, 10) << 20;
+		}
+		else if (strncmp(argv[i], "undo=", 5) == 0) {
+			undo = (size_t)strtoull(argv[i] + 5, NULL, 10);
+		}
+		else {
+			printf("Error: Unknown option %s\n", argv[i]);
+			return 1;
+		}
+	}
+
+	if (!load_program(argv[0]) || !init_machine(&machine) || !set_machine_geometry(&machine, &geometry)) {
+		return 1;
+	}
+	if (!load_data_memory(argv[1], machine.memory) || !load_disk(argv[2], machine.disk) ||
+		!load_irq2_events(argv[3], &machine.irq2) || !init_timeline(&timeline, budget, undo)) {
+		free_machine(&machine);
+		return 1;
+	}
+	init_breakpoints(&breakpoints, &program.decoded);
+
+	int ok = run_debugger(&machine, &program.image, &program.decoded, &timeline, &breakpoints, stdin);
+
+	free_breakpoints(&breakpoints);
+	free_timeline(&timeline);
+	free_machine(&machine);
+	return ok ? 0 : 1;
+}
+
+// Load the inputs of a benchmark workload into a machine, quietly so the result line stays parseable
+static int load_workload(const char *dir, Machine *machine) {
+	char path[1024];
+
+	snprintf(path, sizeof(path), "%s/dmemin.txt", dir);
+	if (load_image(path, IMAGE_DATA, machine->memory->data) < 0) {
+		printf("Error: Could not load data memory file: %s\n", path);
+		return 0;
+	}
+	snprintf(path, sizeof(path), "%s/diskin.txt", dir);
+	if (load_image(path, IMAGE_DISK, machine->disk->data) < 0) {
+		printf("Error: Could not load disk input file: %s\n", path);
+		return 0;
+	}
+	snprintf(path, sizeof(path), "%s/irq2in.txt", dir);
+	if (read_irq2_events(path, &machine->irq2) <= 0) {
+		printf("Error: Could not load IRQ2 input file: %s\n", path);
+		return 0;
+	}
+	return 1;
+}
+
+// Time one benchmark workload (a directory with imemin, dmemin, diskin and irq2in.txt) and print
+// the result as one JSON line: bench <workload dir> [ref|fast|block|jit] [repeat=N] [exact]
+// Every repetition starts from power-on; the fastest one is reported. idle_cycles counts the
+// cycles the ref engine fast-forwarded, exact turns that off.
+static int bench_main(int argc, char *argv[]) {
+	static Machine machine;
+	static Monitor monitor;
+	char path[1024];
+	Engine engine = ENGINE_REFERENCE;
+	int repeat = 1;
+	int exact_stepping = 0;
+	uint64_t cycles = 0;
+	uint64_t idle_cycles = 0;
+	double best_ms = 0;
+
+	for (int i = 1; i < argc; i++) {
+		if (parse_engine(argv[i], &engine)) {
+			continue;
+		}
+		if (strcmp(argv[i], "exact") == 0) {
+			exact_stepping = 1;
+			continue;
+		}
+		if (strncmp(argv[i], "repeat=", 7) != 0 || (repeat = atoi(argv[i] + 7)) <= 0) {
+			printf("Error: Unknown bench option %s\n", argv[i]);
+			return 1;
+		}
+	}
+
+	snprintf(path, sizeof(path), "%s/imemin.txt", argv[0]);
+	init_program_image(&program.image);
+	if (load_image(path, IMAGE_INSTRUCTIONS, program.image.instructions) < 0) {
+		printf("Error: Could not load instruction memory file: %s\n", path);
+		return 1;
+	}
+	predecode_program(&program.image, &program.decoded);
+	prepare_threaded_program(&program.decoded, &program.threaded);
+
+	for (int run = 0; run < repeat; run++) {
+		if (!init_machine(&machine)) {
+			return 1;
+		}
+		if (!load_workload(argv[0], &machine)) {
+			free_machine(&machine);
+			return 1;
+		}
+		init_monitor(&monitor);
+		attach_monitor(&monitor, &machine.io);
+		machine.exact_stepping = exact_stepping;
+
+		double start = monotonic_time_ms();
+		int translated = run_engine(engine, &machine);
+		double wall_ms = monotonic_time_ms() - start;
+		uint64_t executed = machine.cycles;
+		idle_cycles = machine.idle_cycles;
+		free_machine(&machine);
+		if (!translated) {
+			return 1;
+		}
+
+		if (run > 0 && executed != cycles) {
+			printf("Error: Run %d of %s took %llu cycles instead of %llu\n", run, argv[0],
+				(unsigned long long)executed, (unsigned long long)cycles);
+			return 1;
+		}
+		cycles = executed;
+		if (run == 0 || wall_ms < best_ms) {
+			best_ms = wall_ms;
+		}
+	}
+
+	// The workload is named after its directory
+	const char *name = argv[0] + strlen(argv[0]);
+	while (name > argv[0] && (name[-1] == '/' || name[-1] == '\\')) {
+		name--;
+	}
+	const char *end = name;
+	while (name > argv[0] && name[-1] != '/' && name[-1] != '\\') {
+		name--;
+	}
+	double mips = (best_ms > 0) ? (double)cycles / (best_ms * 1000.0) : 0;
+	printf("{\"workload\":\"%.*s\",\"engine\":\"%s\",\"repeat\":%d,\"cycles\":%llu,\"wall_ms\":%.3f,\"mips\":%.2f,\"idle_cycles\":%llu,\"peak_rss_kb\":%ld}\n",
+		(int)(end - name), name, engine_names[engine], repeat, (unsigned long long)cycles, best_ms, mips,
+		(unsigned long long)idle_cycles, peak_resident_kb());
+	return 0;
+}
+
+// Print the command line forms
+static void print_usage(void) {
+	printf("Usage:\n");
+	printf("  sim imemin.txt dmemin.txt diskin.txt irq2in.txt dmemout.txt regout.txt trace.txt hwregtrace.txt\n");
+	printf("      cycles.txt leds.txt display7seg.txt diskout.txt monitor.txt monitor.yuv [options]\n");
+	printf("      (- for an output file skips it)\n");
+	printf("      options: ref|fast|block|jit exact full|trimmed|dirty imem=N dmem=N log|wrap|trap\n");
+	printf("               disk=<base>[:<sectors>] delta=<file> deltaout=<file> capture=<cycles per frame>:<file>\n");
+#ifdef SIM_PROFILE
+	printf("               profile=<prefix> labels=<file>\n");
+#endif
+	printf("               record=<journal> hashes=<cycles> snapshots=<cycles>\n");
+	printf("  sim bench <workload dir> [ref|fast|block|jit] [repeat=N] [exact]\n");
+	printf("  sim cores <N> imemin.txt dmemin.txt diskin.txt irq2in.txt dmemout.txt regout.txt cycles.txt diskout.txt\n");
+	printf("      [quantum=<cycles>] [shared] [full|trimmed|dirty] [imem=N] [dmem=N] [log|wrap|trap]\n");
+	printf("  sim replay imemin.txt <journal> dmemout.txt regout.txt cycles.txt diskout.txt [from=<cycle>] [to=<cycle>]\n");
+	printf("      [full|trimmed|dirty]\n");
+	printf("  sim debug imemin.txt dmemin.txt diskin.txt irq2in.txt [budget=<MB>] [undo=<entries>] [imem=N] [dmem=N]\n");
+	printf("      [log|wrap|trap], commands on stdin\n");
+	printf("  sim batch <imemin> <manifest> [threads] [lockstep] [full|trimmed|dirty] [imem=N] [dmem=N]\n");
+	printf("      [log|wrap|trap] [monitor] [capture=<cycles per frame>]\n");
+	printf("  sim convert <imem|dmem|disk|monitor> <binary|text> <input> <output>\n");
+}
+
+int main(int argc, char *argv[]) {
+	if (argc == 6 && strcmp(argv[1], "convert") == 0) {
+		return convert_main(argv + 2);
+	}
+	if (argc >= 4 && argc <= 12 && strcmp(argv[1], "batch") == 0) {
+		return batch_main(argc - 2, argv + 2);
+	}
+	if (argc >= 11 && argc <= 17 && strcmp(argv[1], "cores") == 0) {
+		return cores_main(argc - 2, argv + 2);
+	}
+	if (argc >= 8 && argc <= 11 && strcmp(argv[1], "replay") == 0) {
+		return replay_main(argc - 2, argv + 2);
+	}
+	if (argc >= 6 && argc <= 11 && strcmp(argv[1], "debug") == 0) {
+		return debug_main(argc - 2, argv + 2);
+	}
+	if (argc >= 3 && argc <= 6 && strcmp(argv[1], "bench") == 0) {
+		return bench_main(argc - 2, argv + 2);
+	}
+	if (argc >= 5 + NUM_OUTPUTS) {
+		return run_main(argc - 1, argv + 1);
+	}
+
+	print_usage();
+	return 1;
+}
@@ -1,106 +1,179 @@
 #define _CRT_SECURE_NO_WARNINGS
 #include "memory.h"
+#include "image.h"
 #include <stdio.h> 
 #include <string.h> 
 #include <stdlib.h>
 
 
-// Initialize the memory
-void init_memory(Memory *memory) {
+// Initialize the program image
+void init_program_image(ProgramImage *image) {
 	// Set all instruction memory lines to 0
-	for (int i = 0; i < INSTRUCTION_MEM_DEPTH; i++) {
-		memset(memory->instructions[i], 0, sizeof(memory->instructions[i]));
+	for (int i = 0; i < INSTRUCTION_MEM_MAX; i++) {
+		memset(image->instructions[i], 0, sizeof(image->instructions[i]));
 	}
+}
+
+// Initialize the memory
+void init_memory(Memory *memory) {
+	MemoryGeometry geometry = default_memory_geometry();
 
 	// Set all data memory lines to 0
-	for (int i = 0; i < DATA_MEM_DEPTH; i++) {
-		memory->data[i] = 0;
+	memset(memory->data, 0, sizeof(memory->data));
+	memset(memory->dirty, 0, sizeof(memory->dirty));
+	memory->watched = NULL;
+	memory->breakpoints = NULL;
+	set_memory_geometry(memory, &geometry);
+}
+
+// Return the default geometry
+MemoryGeometry default_memory_geometry(void) {
+	MemoryGeometry geometry;
+	geometry.instruction_depth = INSTRUCTION_MEM_DEPTH;
+	geometry.data_depth = DATA_MEM_DEPTH;
+	geometry.policy = MEMORY_LOG;
+	return geometry;
+}
+
+// Check a depth: a power of two no larger than the capacity
+static int is_valid_depth(uint32_t depth, uint32_t capacity) {
+	return depth != 0 && (depth & (depth - 1)) == 0 && depth <= capacity;
+}
+
+// Check a geometry
+int check_memory_geometry(const MemoryGeometry *geometry) {
+	if (!is_valid_depth(geometry->instruction_depth, INSTRUCTION_MEM_MAX)) {
+		printf("Error: Instruction memory depth %u must be a power of two up to %d\n", geometry->instruction_depth, INSTRUCTION_MEM_MAX);
+		return 0;
+	}
+	if (!is_valid_depth(geometry->data_depth, DATA_MEM_MAX)) {
+		printf("Error: Data memory depth %u must be a power of two up to %d\n", geometry->data_depth, DATA_MEM_MAX);
+		return 0;
+	}
+	return 1;
+}
+
+// Apply a geometry to the data memory
+void set_memory_geometry(Memory *memory, const MemoryGeometry *geometry) {
+	memory->depth = geometry->data_depth;
+	memory->mask = geometry->data_depth - 1;
+	memory->policy = geometry->policy;
+	memory->faulted = 0;
+	memory->fault_address = 0;
+	memory->reports = 0;
+}
+
+// Parse a memory depth such as 65536 or 64k
+uint32_t parse_memory_depth(const char *text) {
+	char *end;
+	unsigned long value = strtoul(text, &end, 10);
+	if (end == text) {
+		return 0;
 	}
+	if (*end == 'k' || *end == 'K') {
+		value *= 1024;
+		end++;
+	}
+	return (*end == '\0' && value <= 0xFFFFFFFFUL) ? (uint32_t)value : 0;
 }
 
 // Load the instruction memory
-void load_instruction_memory(const char *filename, Memory *memory) {
-	FILE *file = fopen(filename, "r");
-	if (!file) {
+int load_instruction_memory(const char *filename, ProgramImage *image) {
+	int count = load_image(filename, IMAGE_INSTRUCTIONS, image->instructions);
+	if (count == IMAGE_ERROR_OPEN) {
 		printf("Error: Could not open instruction memory file: %s\n", filename);
-		exit(1);
+		return 0;
 	}
-
-	char line[13]; // 12 hex digits + null terminator
-	int address = 0;
-	while (fgets(line, sizeof(line), file) && address < INSTRUCTION_MEM_DEPTH) {
-		line[strcspn(line, "\r\n")] = '\0'; // Remove newline characters
-		for (int i = 0; i < 6; i++) {
-			char byte_str[3] = { line[i * 2], line[i * 2 + 1], '\0' };
-			memory->instructions[address][i] = (uint8_t)strtol(byte_str, NULL, 16);
-		}
-		address++;
+	if (count < 0) {
+		printf("Error: Invalid instruction memory image: %s\n", filename);
+		return 0;
 	}
 
-	fclose(file);
 	printf("Instruction memory loaded from %s\n", filename);
+	return 1;
 }
 
 // Load the data memory
-void load_data_memory(const char *filename, Memory *memory) {
-	FILE *file = fopen(filename, "r");
-	if (!file) {
+int load_data_memory(const char *filename, Memory *memory) {
+	int count = load_image(filename, IMAGE_DATA, memory->data);
+	if (count == IMAGE_ERROR_OPEN) {
 		printf("Error: Could not open data memory file: %s\n", filename);
-		exit(1);
+		return 0;
 	}
-
-	char line[9]; // 8 hex digits + null terminator
-	int address = 0;
-	while (fgets(line, sizeof(line), file) && address < DATA_MEM_DEPTH) {
-		line[strcspn(line, "\r\n")] = '\0'; // Remove newline characters
-		memory->data[address] = (uint32_t)strtol(line, NULL, 16);
-		address++;
+	if (count < 0) {
+		printf("Error: Invalid data memory image: %s\n", filename);
+		return 0;
 	}
 
-	fclose(file);
+	if ((uint32_t)count > memory->depth) {
+		printf("Warning: %s has %d lines, only the first %u fit the data memory\n", filename, count, memory->depth);
+	}
 	printf("Data memory loaded from %s\n", filename);
+	return 1;
 }
 
 // Write the data memory
-void write_data_memory(const char *filename, const Memory *memory) {
-	FILE *file = fopen(filename, "w");
-	if (!file) {
+int write_data_memory(const char *filename, const Memory *memory, DumpMode mode) {
+	if (!write_text_dump(filename, IMAGE_DATA, memory->data, memory->depth, mode, memory->dirty)) {
 		printf("Error: Could not open data memory output file: %s\n", filename);
-		exit(1);
-	}
-
-	for (int i = 0; i < DATA_MEM_DEPTH; i++) {
-		fprintf(file, "%08X\n", memory->data[i]);
+		return 0;
 	}
 
-	fclose(file);
 	printf("Data memory written to %s\n", filename);
+	return 1;
 }
 
 
 // Read a 48-bit instruction from instruction memory
-const uint8_t *read_instruction(const Memory *memory, int address) {
-	if (address < 0 || address >= INSTRUCTION_MEM_DEPTH) {
+const uint8_t *read_instruction(const ProgramImage *image, int address) {
+	if (address < 0 || address >= INSTRUCTION_MEM_MAX) {
 		printf("Error: Invalid instruction memory address %d\n", address);
 		return NULL;
 	}
-	return memory->instructions[address];
+	return image->instructions[address];
+}
+
+// Apply the policy to an out-of-range address, returns 1 with the address to use or 0 to drop the access
+static int resolve_out_of_range(Memory *memory, uint32_t *address) {
+	switch (memory->policy) {
+	case MEMORY_WRAP:
+		*address &= memory->mask;
+		return 1;
+
+	case MEMORY_TRAP:
+		if (!memory->faulted) {
+			printf("Error: Data memory address %d out of range, stopping\n", (int)*address);
+			memory->faulted = 1;
+			memory->fault_address = *address;
+		}
+		return 0;
+
+	default:
+		printf("Error: Invalid data memory address %d\n", (int)*address);
+		memory->reports++;
+		return 0;
+	}
 }
 
-// Read a 32-bit word from data memory
-uint32_t read_data(const Memory *memory, int address) {
-	if (address < 0 || address >= DATA_MEM_DEPTH) {
-		printf("Error: Invalid data memory address %d\n", address);
+// Read a 32-bit word beyond the depth
+uint32_t read_data_out_of_range(Memory *memory, uint32_t address) {
+	if (!resolve_out_of_range(memory, &address)) {
 		return 0;
 	}
+	if (data_watched(memory, address)) {
+		watch_data_access(memory, address, memory->data[address], WATCH_READ);
+	}
 	return memory->data[address];
 }
 
-// Write a 32-bit word to data memory
-void write_data(Memory *memory, int address, uint32_t value) {
-	if (address < 0 || address >= DATA_MEM_DEPTH) {
-		printf("Error: Invalid data memory address %d\n", address);
+// Write a 32-bit word beyond the depth
+void write_data_out_of_range(Memory *memory, uint32_t address, uint32_t value) {
+	if (!resolve_out_of_range(memory, &address)) {
 		return;
 	}
+	if (data_watched(memory, address)) {
+		watch_data_access(memory, address, value, WATCH_WRITE);
+	}
 	memory->data[address] = value;
+	mark_data_dirty(memory, address);
 }
@@ -2,78 +2,210 @@
 #define MEMORY_H
 
 #include <stdint.h> 
+#include "image.h"
 
-// Memory sizes
+// Default memory sizes (the geometry of a machine that does not set one)
 #define INSTRUCTION_MEM_DEPTH 4096
 #define DATA_MEM_DEPTH 4096
 
+// Largest sizes a run may select, the storage is allocated at these capacities. The PC is
+// 16 bits wide with the top half left free for markers (LOCKSTEP_HALTED); the data capacity
+// can be raised with -DSIM_DATA_MEM_MAX=<words>.
+#define INSTRUCTION_MEM_MAX 32768
+#ifdef SIM_DATA_MEM_MAX
+#define DATA_MEM_MAX SIM_DATA_MEM_MAX
+#else
+#define DATA_MEM_MAX (1 << 18)
+#endif
+
+// Dirty tracking of data memory, one bit per block of words
+#define DATA_BLOCK_SHIFT 6
+#define DATA_BLOCK_WORDS (1 << DATA_BLOCK_SHIFT)
+#define DATA_BLOCKS (DATA_MEM_MAX / DATA_BLOCK_WORDS)
+
+// What happens on a data memory access beyond the depth
+typedef enum {
+	MEMORY_LOG = 0,  // Report the address, reads return 0 and writes are dropped
+	MEMORY_WRAP = 1, // The address wraps around the depth, silently
+	MEMORY_TRAP = 2  // Report the address and stop the machine after the instruction
+} MemoryPolicy;
+
+// Memory sizes of a run, both depths are powers of two
+typedef struct {
+	uint32_t instruction_depth; // Up to INSTRUCTION_MEM_MAX
+	uint32_t data_depth;        // Up to DATA_MEM_MAX
+	MemoryPolicy policy;
+} MemoryGeometry;
+
 
-// Structure to represent the memory
+// Structure to represent the program image (instruction memory). It is never written at
+// runtime, so one image is shared by every simulator instance running the same program.
 typedef struct {
-	uint8_t instructions[INSTRUCTION_MEM_DEPTH][6]; // Each instruction is 6 bytes (48 bits wide)
-	uint32_t data[DATA_MEM_DEPTH];                  // Data memory (32 bits wide)
+	uint8_t instructions[INSTRUCTION_MEM_MAX][6]; // Each instruction is 6 bytes (48 bits wide)
+} ProgramImage;
+
+// Structure to represent the data memory of one simulator instance
+typedef struct {
+	uint32_t data[DATA_MEM_MAX];                    // Data memory (32 bits wide), depth words are used
+	uint64_t dirty[(DATA_BLOCKS + 63) / 64];        // Blocks written since the memory was loaded
+	uint32_t depth;                                 // Number of words, a power of two
+	uint32_t mask;                                  // depth - 1, addresses up to it are in range
+	MemoryPolicy policy;                            // Out-of-range behaviour
+	int faulted;                                    // Set by a MEMORY_TRAP access, stops the machine
+	uint32_t fault_address;                         // Address of the trapped access
+	uint32_t reports;                               // Out-of-range accesses reported (MEMORY_LOG), see idle.h
+	const uint64_t *watched;                        // Blocks holding a data watchpoint, NULL when none
+	struct Breakpoints *breakpoints;                // Checks the accesses to the watched blocks (breakpoints.h)
 } Memory;
 
+// Accesses a watchpoint reacts to
+#define WATCH_READ 1
+#define WATCH_WRITE 2
+
+// Mark the block of a data memory address as written
+static inline void mark_data_dirty(Memory *memory, uint32_t address) {
+	uint32_t block = address >> DATA_BLOCK_SHIFT;
+	memory->dirty[block >> 6] |= (uint64_t)1 << (block & 63);
+}
+
+
+// Check whether the block of a data memory address holds a watchpoint
+static inline int data_watched(const Memory *memory, uint32_t address) {
+	uint32_t block = address >> DATA_BLOCK_SHIFT;
+	return memory->watched != NULL && ((memory->watched[block >> 6] >> (block & 63)) & 1);
+}
+
+
+// Out-of-range accesses, kept out of line so the in-range path is a single compare
+uint32_t read_data_out_of_range(Memory *memory, uint32_t address);
+void write_data_out_of_range(Memory *memory, uint32_t address, uint32_t value);
+
+// Access to a watched block, before a write stores its value (defined in breakpoints.c)
+void watch_data_access(Memory *memory, uint32_t address, uint32_t value, int access);
 
 // Function declaration
 
 
 /*
--Functionality: Initializes the memory. Sets all instruction and data memory lines to 0.
+-Functionality: Initializes the program image. Sets all instruction memory lines to 0.
+-parameter1: image - Pointer to the ProgramImage structure to initialize.
+*/
+void init_program_image(ProgramImage *image);
+
+
+/*
+-Functionality: Initializes the memory. Sets all data memory lines to 0, clears the dirty blocks
+ and selects the default geometry (DATA_MEM_DEPTH words, MEMORY_LOG).
 -parameter1: memory - Pointer to the Memory structure to initialize.
 */
 void init_memory(Memory *memory);
 
 
+/*
+-Functionality: Returns the default geometry: INSTRUCTION_MEM_DEPTH and DATA_MEM_DEPTH with MEMORY_LOG.
+-return The default MemoryGeometry.
+*/
+MemoryGeometry default_memory_geometry(void);
+
+
+/*
+-Functionality: Checks a geometry, printing the reason when it is not usable.
+-return 1 if both depths are powers of two within the capacities, 0 otherwise.
+-parameter1: geometry - Pointer to the MemoryGeometry to check.
+*/
+int check_memory_geometry(const MemoryGeometry *geometry);
+
+
+/*
+-Functionality: Applies a checked geometry to the data memory of a machine. The PC width
+ (and the irqhandler/irqreturn registers) follow the instruction depth and the diskbuffer
+ register follows the data depth; see set_io_geometry.
+-parameter1: memory - Pointer to the Memory structure, after init_memory.
+-parameter2: geometry - Pointer to the MemoryGeometry to apply.
+*/
+void set_memory_geometry(Memory *memory, const MemoryGeometry *geometry);
+
+
+/*
+-Functionality: Parses a memory depth given as a word count, with an optional k suffix (x1024).
+-return The depth, or 0 if the text is not a number.
+-parameter1: text - The text to parse.
+*/
+uint32_t parse_memory_depth(const char *text);
+
+
 /*
 -Functionality: Loads instruction memory from a file.
+-return 1 on success, 0 if the file could not be read or is not a valid image (the error is printed).
 -parameter1: filename - The name of the input file containing the instruction memory.
--parameter2: memory - Pointer to the Memory structure to load into.
+-parameter2: image - Pointer to the ProgramImage structure to load into.
  */
-void load_instruction_memory(const char *filename, Memory *memory);
+int load_instruction_memory(const char *filename, ProgramImage *image);
 
 
 /*
--Functionality: Loads data memory from a file.
+-Functionality: Loads data memory from a file. The loaded contents are not marked dirty.
+-return 1 on success, 0 if the file could not be read or is not a valid image (the error is printed).
 -parameter1: filename - The name of the input file containing the data memory.
--parameter2: memory -  Pointer to the Memory structure to load into.
+-parameter2: memory -  Pointer to the Memory structure to load into, lines beyond its depth are ignored.
  */
-void load_data_memory(const char *filename, Memory *memory);
+int load_data_memory(const char *filename, Memory *memory);
 
 
 /*
- -Functionality: Writes the contents of data memory to a file.
+-Functionality: Writes the contents of data memory (depth lines) to a file.
+-return 1 on success, 0 if the file could not be written (the error is printed).
 -parameter1: filename - The name of the output file to write the data memory into.
 -parameter2: memory - Pointer to the Memory structure containing the data memory.
+-parameter3: mode - The DumpMode, DUMP_FULL for the complete format.
  */
-void write_data_memory(const char *filename, const Memory *memory);
+int write_data_memory(const char *filename, const Memory *memory, DumpMode mode);
 
 
 /*
 -Functionality: Reads a 48-bit instruction from instruction memory.
 -return A pointer to the 48 - bit instruction(array of 6 bytes).
--parameter1: memory - Pointer to the Memory structure.
--parameter2: address - The address to read from (0 to 4095).
+-parameter1: image - Pointer to the ProgramImage structure.
+-parameter2: address - The address to read from (0 to INSTRUCTION_MEM_MAX - 1).
 */
-const uint8_t *read_instruction(const Memory *memory, int address);
+const uint8_t *read_instruction(const ProgramImage *image, int address);
 
 
 /*
--Functionality: Reads a 32-bit word from data memory.
+-Functionality: Reads a 32-bit word from data memory, out-of-range addresses follow the policy.
+ A read of a watched block is checked against the watchpoints.
 -return The 32-bit word at the specified address.
 -parameter1: memory - Pointer to the Memory structure.
--parameter2: address - The address to read from (0 to 4095).
+-parameter2: address - The address to read from (0 to depth - 1).
 */
-uint32_t read_data(const Memory *memory, int address);
+static inline uint32_t read_data(Memory *memory, uint32_t address) {
+	if (address <= memory->mask) {
+		if (data_watched(memory, address)) {
+			watch_data_access(memory, address, memory->data[address], WATCH_READ);
+		}
+		return memory->data[address];
+	}
+	return read_data_out_of_range(memory, address);
+}
 
 
 /*
--Functionality: Writes a 32-bit word to data memory.
--return The 32-bit word at the specified address.
--parameter1: memory - Pointer to the Memory structure to initialize.
--parameter2: address - The address to write to (0 to 4095).
+-Functionality: Writes a 32-bit word to data memory and marks its block dirty, out-of-range
+ addresses follow the policy. A write to a watched block is checked against the watchpoints.
+-parameter1: memory - Pointer to the Memory structure.
+-parameter2: address - The address to write to (0 to depth - 1).
 -parameter3: value - The value to write.
 */
-void write_data(Memory *memory, int address, uint32_t value);
+static inline void write_data(Memory *memory, uint32_t address, uint32_t value) {
+	if (address <= memory->mask) {
+		if (data_watched(memory, address)) {
+			watch_data_access(memory, address, value, WATCH_WRITE);
+		}
+		memory->data[address] = value;
+		mark_data_dirty(memory, address);
+		return;
+	}
+	write_data_out_of_range(memory, address, value);
+}
 
 #endif 
@@ -0,0 +1,197 @@
+#define _CRT_SECURE_NO_WARNINGS
+#include "monitor.h"
+#include <string.h>
+
+// Clear the monitor
+void init_monitor(Monitor *monitor) {
+	memset(monitor, 0, sizeof(*monitor));
+	monitor->capture_ok = 1;
+}
+
+// Little-endian field helpers for the capture format
+static void store_le16(uint8_t *bytes, uint32_t value) {
+	bytes[0] = (uint8_t)value;
+	bytes[1] = (uint8_t)(value >> 8);
+}
+
+static void store_le32(uint8_t *bytes, uint32_t value) {
+	store_le16(bytes, value);
+	store_le16(bytes + 2, value >> 16);
+}
+
+// Append bytes to the capture file
+static void put_capture(Monitor *monitor, const void *bytes, size_t size) {
+	if (monitor->capture_ok && fwrite(bytes, 1, size, monitor->capture) != size) {
+		monitor->capture_ok = 0;
+	}
+}
+
+// Is a row set in a row bitmap
+static int row_set(const uint64_t *rows, int row) {
+	return (rows[row >> 6] >> (row & 63)) & 1;
+}
+
+// Are there changes since the last captured frame
+static int has_changes(const Monitor *monitor) {
+	for (int i = 0; i < MONITOR_HEIGHT / 64; i++) {
+		if (monitor->changed[i] != 0) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+// Find the next region of changed pixels from row *row on: a run of changed rows cut to the union of
+// their column spans. A row only joins the run if that costs fewer bytes than starting a new region,
+// so a diagonal line is sent as small squares instead of one large one. Returns 0 after the last region.
+static int next_region(const Monitor *monitor, int *row, int *end, int *first, int *last) {
+	while (*row < MONITOR_HEIGHT && !row_set(monitor->changed, *row)) {
+		(*row)++;
+	}
+	if (*row >= MONITOR_HEIGHT) {
+		return 0;
+	}
+
+	*end = *row;
+	*first = monitor->first_column[*row];
+	*last = monitor->last_column[*row];
+	while (*end + 1 < MONITOR_HEIGHT && row_set(monitor->changed, *end + 1)) {
+		int next_first = monitor->first_column[*end + 1];
+		int next_last = monitor->last_column[*end + 1];
+		int merged_first = (next_first < *first) ? next_first : *first;
+		int merged_last = (next_last > *last) ? next_last : *last;
+		int height = *end - *row + 1;
+		int merged_size = (height + 1) * (merged_last - merged_first + 1);
+		int split_size = height * (*last - *first + 1) + 4 + (next_last - next_first + 1);
+		if (merged_size > split_size) {
+			break;
+		}
+		(*end)++;
+		*first = merged_first;
+		*last = merged_last;
+	}
+	return 1;
+}
+
+// Write the changed regions as a frame that ends at clks, and start the next frame
+static void write_frame(Monitor *monitor, uint32_t clks) {
+	uint8_t header[6];
+	int regions = 0;
+	int row, end, first, last;
+
+	for (row = 0; next_region(monitor, &row, &end, &first, &last); row = end + 1) {
+		regions++;
+	}
+	store_le32(header, clks);
+	store_le16(header + 4, (uint32_t)regions);
+	put_capture(monitor, header, sizeof(header));
+
+	for (row = 0; next_region(monitor, &row, &end, &first, &last); row = end + 1) {
+		uint8_t region[4] = { (uint8_t)first, (uint8_t)row, (uint8_t)(last - first), (uint8_t)(end - row) };
+		put_capture(monitor, region, sizeof(region));
+		for (int y = row; y <= end; y++) {
+			put_capture(monitor, &monitor->pixels[y * MONITOR_WIDTH + first], (size_t)(last - first + 1));
+		}
+	}
+
+	memset(monitor->changed, 0, sizeof(monitor->changed));
+	monitor->frames++;
+}
+
+// monitorcmd write: draw the pixel
+static void monitor_command(void *device, IORegisters *io, int reg_index, uint32_t previous) {
+	Monitor *monitor = device;
+	(void)previous;
+
+	if (io->IORegister[reg_index] != 1) {
+		return;
+	}
+	io->IORegister[reg_index] = 0; // The command is done, monitorcmd reads back as 0
+
+	// Frames are cut lazily: the changes so far were all made before this frame ended
+	uint32_t clks = io->IORegister[8];
+	if (monitor->capture != NULL && clks >= monitor->frame_end) {
+		if (has_changes(monitor)) {
+			write_frame(monitor, monitor->frame_end);
+		}
+		uint64_t frame_end = ((uint64_t)clks / monitor->period + 1) * monitor->period;
+		monitor->frame_end = (frame_end > UINT32_MAX) ? UINT32_MAX : (uint32_t)frame_end;
+	}
+
+	uint32_t address = io->IORegister[IO_MONITOR_ADDR];
+	uint8_t value = (uint8_t)io->IORegister[IO_MONITOR_DATA];
+	int row = (int)(address / MONITOR_WIDTH);
+	int column = (int)(address % MONITOR_WIDTH);
+	monitor->dirty[row >> 6] |= (uint64_t)1 << (row & 63);
+	if (monitor->pixels[address] == value) {
+		return;
+	}
+	monitor->pixels[address] = value;
+
+	if (!row_set(monitor->changed, row)) {
+		monitor->changed[row >> 6] |= (uint64_t)1 << (row & 63);
+		monitor->first_column[row] = (uint8_t)column;
+		monitor->last_column[row] = (uint8_t)column;
+	}
+	else if (column < monitor->first_column[row]) {
+		monitor->first_column[row] = (uint8_t)column;
+	}
+	else if (column > monitor->last_column[row]) {
+		monitor->last_column[row] = (uint8_t)column;
+	}
+}
+
+// Attach the monitor to the monitor registers
+int attach_monitor(Monitor *monitor, IORegisters *io) {
+	return attach_io_device(io, IO_MONITOR_CMD, NULL, monitor_command, monitor, 0);
+}
+
+// Start recording the changed regions
+int start_monitor_capture(Monitor *monitor, const char *filename, uint32_t period) {
+	uint8_t header[16];
+
+	monitor->capture = fopen(filename, "wb");
+	if (!monitor->capture) {
+		printf("Error: Could not create monitor capture file: %s\n", filename);
+		return 0;
+	}
+	monitor->period = (period > 0) ? period : 1;
+	monitor->frame_end = monitor->period;
+	monitor->frames = 0;
+	monitor->capture_ok = 1;
+	memset(monitor->changed, 0, sizeof(monitor->changed));
+
+	memcpy(header, MONITOR_CAPTURE_MAGIC, 4);
+	store_le16(header + 4, MONITOR_CAPTURE_VERSION);
+	store_le16(header + 6, MONITOR_WIDTH);
+	store_le16(header + 8, MONITOR_HEIGHT);
+	store_le16(header + 10, 0);
+	store_le32(header + 12, monitor->period);
+	put_capture(monitor, header, sizeof(header));
+	return monitor->capture_ok;
+}
+
+// Write the last frame and close the capture
+int finish_monitor_capture(Monitor *monitor, uint32_t clks) {
+	if (monitor->capture == NULL) {
+		return 0;
+	}
+	if (has_changes(monitor)) {
+		write_frame(monitor, (clks < monitor->frame_end) ? clks : monitor->frame_end);
+	}
+	int ok = monitor->capture_ok;
+	ok &= fclose(monitor->capture) == 0;
+	monitor->capture = NULL;
+	return ok;
+}
+
+// Write the frame as a raw YUV luma plane
+int write_monitor_yuv(const Monitor *monitor, const char *filename) {
+	FILE *file = fopen(filename, "wb");
+	if (!file) {
+		return 0;
+	}
+	int ok = fwrite(monitor->pixels, 1, sizeof(monitor->pixels), file) == sizeof(monitor->pixels);
+	ok &= fclose(file) == 0;
+	return ok;
+}
@@ -0,0 +1,90 @@
+#ifndef MONITOR_H
+#define MONITOR_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include "io.h"
+
+// Monitor constants: 256x256 pixels, 8-bit gray levels
+#define MONITOR_WIDTH 256
+#define MONITOR_HEIGHT 256
+#define MONITOR_PIXELS (MONITOR_WIDTH * MONITOR_HEIGHT)
+
+// Monitor registers: out monitorcmd=1 writes monitordata to the pixel at monitoraddr (row * 256 + column)
+#define IO_MONITOR_ADDR 20
+#define IO_MONITOR_DATA 21
+#define IO_MONITOR_CMD 22
+
+/*
+ Frame capture format (version 1), all fields little-endian:
+ -"SIMF", u16 version, u16 width, u16 height, u16 reserved, u32 period in cycles
+ -One record per frame with changed pixels:
+   u32 clks at the end of the frame, u16 region count, then per region
+   u8 x, u8 y, u8 width - 1, u8 height - 1 and its width * height pixels, row by row
+ A frame ends every period cycles, the last one when the capture is finished. Frames without
+ changes are left out. A region is a run of changed rows cut to the columns that changed in them.
+*/
+#define MONITOR_CAPTURE_MAGIC "SIMF"
+#define MONITOR_CAPTURE_VERSION 1
+
+// The monitor device
+typedef struct {
+	uint8_t pixels[MONITOR_PIXELS];            // The frame, row by row
+	uint64_t dirty[MONITOR_HEIGHT / 64];        // Rows written since power-on, for DUMP_DIRTY
+
+	// Changes since the last captured frame: the columns [first, last] of each changed row
+	uint64_t changed[MONITOR_HEIGHT / 64];
+	uint8_t first_column[MONITOR_HEIGHT];
+	uint8_t last_column[MONITOR_HEIGHT];
+
+	FILE *capture;       // Frame stream, NULL when not capturing
+	uint32_t period;     // Cycles per captured frame
+	uint32_t frame_end;  // clks value that ends the current frame
+	uint64_t frames;     // Frame records written
+	int capture_ok;      // 0 once a capture write failed
+} Monitor;
+
+
+// Function declarations
+
+/*
+-Functionality: Clears the monitor to black, with no capture.
+-parameter1: monitor - Pointer to the Monitor structure.
+*/
+void init_monitor(Monitor *monitor);
+
+/*
+-Functionality: Attaches the monitor to the monitor registers of a register file, after init_io.
+ Pixels are written when out sets monitorcmd to 1; monitorcmd reads back as 0.
+-return 1 on success, 0 if another device owns monitorcmd.
+-parameter1: monitor - Pointer to the Monitor structure.
+-parameter2: io - Pointer to the I/O registers structure.
+*/
+int attach_monitor(Monitor *monitor, IORegisters *io);
+
+/*
+-Functionality: Starts recording the changed regions of the monitor every period cycles.
+-return 1 on success, 0 if the file could not be created.
+-parameter1: monitor - Pointer to the Monitor structure.
+-parameter2: filename - Name of the capture file.
+-parameter3: period - Cycles per frame, at least 1.
+*/
+int start_monitor_capture(Monitor *monitor, const char *filename, uint32_t period);
+
+/*
+-Functionality: Writes the changes of the last frame and closes the capture file.
+-return 1 if the whole capture was written, 0 otherwise (also when no capture was started).
+-parameter1: monitor - Pointer to the Monitor structure.
+-parameter2: clks - Value of clks when the machine stopped.
+*/
+int finish_monitor_capture(Monitor *monitor, uint32_t clks);
+
+/*
+-Functionality: Writes the frame as a raw YUV file: the 8-bit luma plane only (a gray image).
+-return 1 on success, 0 if the file could not be written.
+-parameter1: monitor - Pointer to the Monitor structure.
+-parameter2: filename - Name of the output file.
+*/
+int write_monitor_yuv(const Monitor *monitor, const char *filename);
+
+#endif
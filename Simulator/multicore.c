@@ -0,0 +1,386 @@
+#define _CRT_SECURE_NO_WARNINGS
+#include "multicore.h"
+#include "instruction_fetch.h"
+#include "execution.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Polls of a barrier before its waiter starts yielding the processor
+#define MULTICORE_SPINS 1000
+
+// A store buffer copy has one written bit per word of a block
+#if DATA_BLOCK_WORDS != 64
+#error The store buffer needs 64-word data memory blocks
+#endif
+
+// in from IO_CORE_ID: the index of the core
+static uint32_t read_core_id(void *device, const IORegisters *io, int reg_index) {
+	(void)io;
+	(void)reg_index;
+	return ((const Core *)device)->id;
+}
+
+// Allocate the store buffer of a core. A quantum stores at most one block per cycle, plus the
+// three blocks a sector transfer of core 0 can span, at most one transfer per 1025 cycles.
+static int init_store_buffer(StoreBuffer *buffer, uint64_t quantum) {
+	uint64_t capacity = (quantum < DATA_BLOCKS) ? quantum + 3 * (quantum / 1024 + 1) : DATA_BLOCKS;
+	if (capacity > DATA_BLOCKS) {
+		capacity = DATA_BLOCKS;
+	}
+
+	buffer->count = 0;
+	buffer->capacity = (int)capacity;
+	buffer->slot = calloc(DATA_BLOCKS, sizeof(uint32_t));
+	buffer->words = malloc((size_t)capacity * DATA_BLOCK_WORDS * sizeof(uint32_t));
+	buffer->written = malloc((size_t)capacity * sizeof(uint64_t));
+	buffer->blocks = malloc((size_t)capacity * sizeof(uint32_t));
+	return buffer->slot && buffer->words && buffer->written && buffer->blocks;
+}
+
+// Release a store buffer
+static void free_store_buffer(StoreBuffer *buffer) {
+	free(buffer->slot);
+	free(buffer->words);
+	free(buffer->written);
+	free(buffer->blocks);
+	memset(buffer, 0, sizeof(*buffer));
+}
+
+// Allocate the cores, core 0 owns the shared storage
+int init_multicore_system(MulticoreSystem *system, int core_count, const MemoryGeometry *geometry, uint64_t quantum,
+	MemoryOrder order) {
+	memset(system, 0, sizeof(*system));
+	if (core_count < 1 || core_count > MULTICORE_MAX_CORES) {
+		printf("Error: Invalid core count %d (1 to %d)\n", core_count, MULTICORE_MAX_CORES);
+		return 0;
+	}
+	if (!check_memory_geometry(geometry)) {
+		return 0;
+	}
+
+	system->quantum = (quantum != 0) ? quantum : MULTICORE_DEFAULT_QUANTUM;
+	system->order = order;
+	system->cores = calloc(core_count, sizeof(Core));
+	if (!system->cores) {
+		printf("Error: Memory allocation failed for %d cores\n", core_count);
+		return 0;
+	}
+	system->core_count = core_count;
+
+	Machine *shared = &system->cores[0].machine;
+	if (!init_machine(shared)) {
+		free_multicore_system(system);
+		return 0;
+	}
+	set_machine_geometry(shared, geometry);
+
+	for (int i = 0; i < core_count; i++) {
+		Core *core = &system->cores[i];
+		core->id = (uint32_t)i;
+		core->system = system;
+		if (i > 0) {
+			// The storage of core 0, released with it
+			init_registers(&core->machine.registers);
+			init_io(&core->machine.io);
+			set_io_geometry(&core->machine.io, geometry);
+			core->machine.storage = shared->storage;
+			core->machine.memory = shared->memory;
+			core->machine.disk = shared->disk;
+		}
+		attach_io_device(&core->machine.io, IO_CORE_ID, read_core_id, NULL, core, 0);
+
+		if (order == MEMORY_ORDER_QUANTUM && !init_store_buffer(&core->buffer, system->quantum)) {
+			printf("Error: Memory allocation failed for the store buffer of core %d\n", i);
+			free_multicore_system(system);
+			return 0;
+		}
+	}
+	return 1;
+}
+
+// Release the cores and the shared storage
+void free_multicore_system(MulticoreSystem *system) {
+	for (int i = 0; i < system->core_count; i++) {
+		Core *core = &system->cores[i];
+		free_store_buffer(&core->buffer);
+		if (i == 0) {
+			free_machine(&core->machine);
+		}
+		else {
+			free_irq2_data(&core->machine.irq2);
+		}
+	}
+	free(system->cores);
+	system->cores = NULL;
+	system->core_count = 0;
+}
+
+// Apply the memory policy to an out-of-range address of a core, returns 1 with the address to use or 0 to drop the access
+static int resolve_core_address(Core *core, uint32_t *address) {
+	const Memory *memory = core->machine.memory;
+
+	switch (memory->policy) {
+	case MEMORY_WRAP:
+		*address &= memory->mask;
+		return 1;
+
+	case MEMORY_TRAP:
+		if (!core->faulted) {
+			printf("Error: Core %u data memory address %d out of range, stopping\n", core->id, (int)*address);
+			core->faulted = 1;
+			core->fault_address = *address;
+		}
+		return 0;
+
+	default:
+		printf("Error: Core %u invalid data memory address %d\n", core->id, (int)*address);
+		return 0;
+	}
+}
+
+// Read a data memory word as seen by a core
+static uint32_t core_load(Core *core, uint32_t address) {
+	Memory *memory = core->machine.memory;
+
+	if (address > memory->mask && !resolve_core_address(core, &address)) {
+		return 0;
+	}
+	if (core->system->order == MEMORY_ORDER_SHARED) {
+		return LOAD_ACQUIRE(&memory->data[address]);
+	}
+
+	// The core's own stores of this quantum, then the memory of the last barrier
+	uint32_t slot = core->buffer.slot[address >> DATA_BLOCK_SHIFT];
+	if (slot != 0) {
+		return core->buffer.words[(size_t)(slot - 1) * DATA_BLOCK_WORDS + (address & (DATA_BLOCK_WORDS - 1))];
+	}
+	return memory->data[address];
+}
+
+// Write a data memory word from a core
+static void core_store(Core *core, uint32_t address, uint32_t value) {
+	Memory *memory = core->machine.memory;
+	StoreBuffer *buffer = &core->buffer;
+
+	if (address > memory->mask && !resolve_core_address(core, &address)) {
+		return;
+	}
+	if (core->system->order == MEMORY_ORDER_SHARED) {
+		STORE_RELEASE(&memory->data[address], value);
+		uint32_t block = address >> DATA_BLOCK_SHIFT;
+		uint64_t bit = (uint64_t)1 << (block & 63);
+		if ((LOAD_MASK(&memory->dirty[block >> 6]) & bit) == 0) {
+			OR_MASK(&memory->dirty[block >> 6], bit);
+		}
+		return;
+	}
+
+	// Copy the block on its first store of the quantum
+	uint32_t block = address >> DATA_BLOCK_SHIFT;
+	uint32_t slot = buffer->slot[block];
+	if (slot == 0) {
+		slot = (uint32_t)++buffer->count;
+		buffer->slot[block] = slot;
+		buffer->blocks[slot - 1] = block;
+		buffer->written[slot - 1] = 0;
+		memcpy(&buffer->words[(size_t)(slot - 1) * DATA_BLOCK_WORDS], &memory->data[block << DATA_BLOCK_SHIFT],
+			DATA_BLOCK_WORDS * sizeof(uint32_t));
+	}
+	uint32_t word = address & (DATA_BLOCK_WORDS - 1);
+	buffer->words[(size_t)(slot - 1) * DATA_BLOCK_WORDS + word] = value;
+	buffer->written[slot - 1] |= (uint64_t)1 << word;
+}
+
+// Write the stores a core buffered during the quantum to the shared memory
+static void commit_store_buffer(Core *core) {
+	Memory *memory = core->machine.memory;
+	StoreBuffer *buffer = &core->buffer;
+
+	for (int i = 0; i < buffer->count; i++) {
+		uint32_t base = buffer->blocks[i] << DATA_BLOCK_SHIFT;
+		const uint32_t *words = &buffer->words[(size_t)i * DATA_BLOCK_WORDS];
+		uint64_t written = buffer->written[i];
+		for (int word = 0; written != 0; word++, written >>= 1) {
+			if (written & 1) {
+				memory->data[base + word] = words[word];
+			}
+		}
+		mark_data_dirty(memory, base);
+		buffer->slot[buffer->blocks[i]] = 0;
+	}
+	buffer->count = 0;
+}
+
+// Run the disk of core 0 for one cycle, its transfers go through the memory order like the core's lw/sw
+static void run_core_disk(Core *core) {
+	Machine *machine = &core->machine;
+	uint64_t sector;
+	int buffer, first, count;
+
+	int command = step_disk(&machine->io, machine->disk);
+	if ((command != 1 && command != 2) ||
+		!check_dma_request(&machine->io, machine->disk, machine->memory->depth, &sector, &buffer, &first, &count)) {
+		return;
+	}
+
+	uint8_t *bytes = disk_sector(machine->disk, sector);
+	if (command == 1) {
+		// Read sector: big-endian sector bytes to memory words
+		for (int i = first; i < first + count; i++) {
+			const uint8_t *b = bytes + i * 4;
+			core_store(core, (uint32_t)(buffer + i),
+				((uint32_t)b[0] << 24) | ((uint32_t)b[1] << 16) | ((uint32_t)b[2] << 8) | (uint32_t)b[3]);
+		}
+		return;
+	}
+
+	// Write sector, words outside data memory read as zero
+	mark_sector_dirty(machine->disk, sector);
+	if (count != SECTOR_WORDS) {
+		memset(bytes, 0, SECTOR_SIZE);
+	}
+	for (int i = first; i < first + count; i++) {
+		uint32_t word = core_load(core, (uint32_t)(buffer + i));
+		uint8_t *b = bytes + i * 4;
+		b[0] = (uint8_t)(word >> 24);
+		b[1] = (uint8_t)(word >> 16);
+		b[2] = (uint8_t)(word >> 8);
+		b[3] = (uint8_t)word;
+	}
+}
+
+// Run a core up to a cycle of the system, the cycles of run_machine with lw/sw through the memory order
+static void run_core(Core *core, const DecodedProgram *program, uint64_t target) {
+	Machine *machine = &core->machine;
+	IORegisters *io = &machine->io;
+
+	while (!machine->halted && machine->cycles < target) {
+		machine->cycles++;
+		increment_clock(io);
+		update_timer(io);
+		check_and_trigger_irq2(io, &machine->irq2, io->IORegister[8]);
+		handle_interrupts(io, &machine->pc, &machine->in_isr);
+		if (core->id == 0) {
+			run_core_disk(core);
+		}
+
+		const Instruction *decoded = fetch_decoded_instruction(program, &machine->pc);
+		load_immediates(&machine->registers, decoded);
+		Registers *registers = &machine->registers;
+		uint32_t address = get_register(registers, decoded->rs) + get_register(registers, decoded->rt);
+
+		switch (decoded->opcode) {
+		case 16: // lw
+			set_register(registers, decoded->rd, core_load(core, address) + get_register(registers, decoded->rm));
+			increment_pc(&machine->pc, io_pc_mask(io));
+			break;
+
+		case 17: // sw
+			core_store(core, address, get_register(registers, decoded->rm) + get_register(registers, decoded->rd));
+			increment_pc(&machine->pc, io_pc_mask(io));
+			break;
+
+		case 21: // halt, the halt cycle counts
+			machine->halted = 1;
+			break;
+
+		default:
+			execute_instruction(decoded, registers, machine->memory, io, &machine->pc, &machine->in_isr);
+			break;
+		}
+
+		// A trapped out-of-range access stops the core after the instruction
+		if (core->faulted) {
+			machine->halted = 1;
+		}
+	}
+}
+
+// Wait until a value another thread publishes reaches an expected one
+static void wait_for(const uint32_t *value, uint32_t expected) {
+	for (int spins = 0; LOAD_ACQUIRE(value) != expected; spins++) {
+		if (spins >= MULTICORE_SPINS) {
+			thread_yield();
+		}
+	}
+}
+
+// Thread of a core other than 0: runs one quantum per epoch until the system stops
+static void core_thread(void *argument) {
+	Core *core = argument;
+	MulticoreSystem *system = core->system;
+
+	for (uint32_t epoch = 1;; epoch++) {
+		wait_for(&system->epoch, epoch);
+		if (LOAD_FLAG(&system->stopping)) {
+			return;
+		}
+		run_core(core, system->program, system->target);
+		STORE_RELEASE(&core->done, epoch);
+	}
+}
+
+// Check whether every core halted
+static int all_cores_halted(const MulticoreSystem *system) {
+	for (int i = 0; i < system->core_count; i++) {
+		if (!system->cores[i].machine.halted) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+// Run every core until it halts
+uint64_t run_multicore_system(MulticoreSystem *system, const DecodedProgram *program) {
+	int threaded[MULTICORE_MAX_CORES] = { 0 };
+	uint64_t cycles = 0;
+
+	system->program = program;
+	for (int i = 1; i < system->core_count; i++) {
+		threaded[i] = thread_start(&system->cores[i].thread, core_thread, &system->cores[i]);
+		if (!threaded[i]) {
+			printf("Error: Could not start the thread of core %d, the calling thread runs it\n", i);
+		}
+	}
+
+	while (!all_cores_halted(system)) {
+		system->target += system->quantum;
+		system->quanta++;
+		uint32_t epoch = system->epoch + 1;
+		STORE_RELEASE(&system->epoch, epoch);
+
+		// Core 0 here, then the barrier
+		run_core(&system->cores[0], program, system->target);
+		for (int i = 1; i < system->core_count; i++) {
+			if (threaded[i]) {
+				wait_for(&system->cores[i].done, epoch);
+			}
+			else {
+				run_core(&system->cores[i], program, system->target);
+			}
+		}
+
+		// Every core is parked: publish the stores of the quantum in core order
+		if (system->order == MEMORY_ORDER_QUANTUM) {
+			for (int i = 0; i < system->core_count; i++) {
+				commit_store_buffer(&system->cores[i]);
+			}
+		}
+	}
+
+	STORE_FLAG(&system->stopping, 1);
+	STORE_RELEASE(&system->epoch, system->epoch + 1);
+	for (int i = 1; i < system->core_count; i++) {
+		if (threaded[i]) {
+			thread_join(&system->cores[i].thread);
+		}
+	}
+
+	for (int i = 0; i < system->core_count; i++) {
+		if (system->cores[i].machine.cycles > cycles) {
+			cycles = system->cores[i].machine.cycles;
+		}
+	}
+	return cycles;
+}
@@ -0,0 +1,111 @@
+#ifndef MULTICORE_H
+#define MULTICORE_H
+
+#include <stdint.h>
+#include "machine.h"            // A core is a Machine whose storage is shared
+#include "instruction_decode.h" // For the shared DecodedProgram
+#include "threads.h"
+
+/*
+ Several SIMP cores running one program over a shared data memory and disk.
+
+ Every core has its own registers, PC, ISR state and IO registers (interrupt enables, timer,
+ leds, ...) and runs on its own host thread. The cores meet at a barrier every quantum cycles.
+ The disk and the IRQ2 events belong to core 0, whose DMA transfers are ordered like its own
+ lw/sw. A program tells the cores apart by reading IO_CORE_ID.
+
+ Memory orders of the lw/sw traffic to the shared data memory:
+ -MEMORY_ORDER_QUANTUM (deterministic): during a quantum a core reads the memory as it was at the
+  last barrier, plus its own stores. Its stores stay in a private store buffer until the barrier,
+  where the buffers are committed in core order, so the highest core wins a word written by several
+  cores in the same quantum. The results do not depend on the host scheduling.
+ -MEMORY_ORDER_SHARED: every lw/sw is a single-copy atomic access of the shared word, visible to the
+  other cores as soon as the host makes it so. Accesses of different cores are only ordered by the
+  barriers, so racing programs may give different results from run to run.
+*/
+
+// Largest number of cores of a system
+#define MULTICORE_MAX_CORES 64
+
+// Default number of cycles between two barriers
+#define MULTICORE_DEFAULT_QUANTUM 1000
+
+// The reserved IO register, read-only on a multicore system: in returns the index of the core
+#define IO_CORE_ID 19
+
+// Ordering of the shared memory traffic
+typedef enum {
+	MEMORY_ORDER_QUANTUM = 0,
+	MEMORY_ORDER_SHARED = 1
+} MemoryOrder;
+
+// Stores of one core during a quantum, one private copy per data memory block written
+typedef struct {
+	uint32_t *slot;          // DATA_BLOCKS entries: copy index + 1 of a block, 0 if it has no copy
+	uint32_t *words;         // capacity copies of DATA_BLOCK_WORDS words
+	uint64_t *written;       // Words of each copy that were stored
+	uint32_t *blocks;        // Block number of each copy
+	int count;
+	int capacity;
+} StoreBuffer;
+
+struct MulticoreSystem;
+
+// One core
+typedef struct {
+	Machine machine;          // Registers, PC, ISR state, IO registers and IRQ2 events; memory and disk are shared
+	uint32_t id;
+	StoreBuffer buffer;       // MEMORY_ORDER_QUANTUM only
+	int faulted;              // Set by a MEMORY_TRAP access of this core, which stops it
+	uint32_t fault_address;
+	uint32_t done;            // Last quantum the core finished, set by its thread
+	struct MulticoreSystem *system;
+	Thread thread;
+} Core;
+
+// The cores and their synchronization
+typedef struct MulticoreSystem {
+	Core *cores;              // core_count entries, core 0 owns the shared storage
+	int core_count;
+	uint64_t quantum;         // Cycles between two barriers
+	MemoryOrder order;
+	const DecodedProgram *program;
+	uint64_t target;          // Cycle every core runs to in the current quantum
+	uint32_t epoch;           // Number of the current quantum, released to the core threads
+	int stopping;             // Set once every core halted, ends the core threads
+	uint64_t quanta;          // Quanta run
+} MulticoreSystem;
+
+
+// Function declarations
+
+/*
+-Functionality: Allocates a system of cores at the power-on state, sharing the data memory and
+ disk of core 0. The caller then loads the data memory, disk and IRQ2 events of cores[0].machine.
+-return 1 on success, 0 if the core count or the geometry is invalid or memory could not be allocated.
+-parameter1: system - Pointer to the MulticoreSystem structure.
+-parameter2: core_count - Number of cores, 1 to MULTICORE_MAX_CORES.
+-parameter3: geometry - Pointer to the MemoryGeometry of every core.
+-parameter4: quantum - Cycles between two barriers, 0 for MULTICORE_DEFAULT_QUANTUM.
+-parameter5: order - The MemoryOrder of the shared data memory.
+*/
+int init_multicore_system(MulticoreSystem *system, int core_count, const MemoryGeometry *geometry, uint64_t quantum,
+	MemoryOrder order);
+
+/*
+-Functionality: Releases the cores and the shared storage.
+-parameter1: system - Pointer to the MulticoreSystem structure.
+*/
+void free_multicore_system(MulticoreSystem *system);
+
+/*
+-Functionality: Runs every core until it halts (or traps under MEMORY_TRAP), core 0 on the calling
+ thread and the others on threads of their own. Each core follows the cycle behaviour of
+ run_machine, only its data memory accesses go through the MemoryOrder of the system.
+-return The cycles of the system, those of the core that halted last.
+-parameter1: system - Pointer to the MulticoreSystem with the inputs loaded.
+-parameter2: program - Pointer to the DecodedProgram run by every core.
+*/
+uint64_t run_multicore_system(MulticoreSystem *system, const DecodedProgram *program);
+
+#endif
@@ -0,0 +1,457 @@
+#define _CRT_SECURE_NO_WARNINGS
+#include "profile.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Instructions listed in the hottest instruction and loop tables
+#define PROFILE_TOP 20
+
+// Assembly names of the opcodes, the last one for invalid opcodes
+static const char *const opcode_names[PROFILE_OPCODES + 1] = {
+	"add", "sub", "mac", "and", "or", "xor", "sll", "sra", "srl",
+	"beq", "bne", "blt", "bgt", "ble", "bge", "jal", "lw", "sw", "reti", "in", "out", "halt", "invalid"
+};
+
+// Hash of two 16-bit keys
+static uint32_t hash_pair(uint32_t a, uint32_t b) {
+	return ((a << 16) ^ b) * 2654435761u;
+}
+
+// Add a node to the call tree, returns its index or PROFILE_NO_NODE if memory ran out
+static int add_node(Profile *profile, int parent, uint16_t function, int isr) {
+	if (profile->node_count == profile->node_capacity) {
+		int capacity = profile->node_capacity * 2;
+		ProfileNode *nodes = realloc(profile->nodes, (size_t)capacity * sizeof(ProfileNode));
+		if (!nodes) {
+			return PROFILE_NO_NODE;
+		}
+		profile->nodes = nodes;
+		profile->node_capacity = capacity;
+	}
+
+	// Keep the slot table at most half full
+	if (profile->node_count * 2 >= profile->slot_capacity) {
+		int capacity = profile->slot_capacity * 2;
+		int *slots = calloc((size_t)capacity, sizeof(int));
+		if (!slots) {
+			return PROFILE_NO_NODE;
+		}
+		for (int i = 1; i < profile->node_count; i++) {
+			const ProfileNode *node = &profile->nodes[i];
+			uint32_t slot = hash_pair((uint32_t)node->parent, node->function) & (capacity - 1);
+			while (slots[slot] != 0) {
+				slot = (slot + 1) & (capacity - 1);
+			}
+			slots[slot] = i + 1;
+		}
+		free(profile->node_slots);
+		profile->node_slots = slots;
+		profile->slot_capacity = capacity;
+	}
+
+	int index = profile->node_count++;
+	ProfileNode *node = &profile->nodes[index];
+	node->function = function;
+	node->isr = isr;
+	node->parent = parent;
+	node->cycles = 0;
+	if (parent != PROFILE_NO_NODE) {
+		uint32_t slot = hash_pair((uint32_t)parent, function) & (profile->slot_capacity - 1);
+		while (profile->node_slots[slot] != 0) {
+			slot = (slot + 1) & (profile->slot_capacity - 1);
+		}
+		profile->node_slots[slot] = index + 1;
+	}
+	return index;
+}
+
+// Find or add the frame of a function or ISR entered from a frame, recursion gets one node per depth
+static int child_node(Profile *profile, int parent, uint16_t function, int isr) {
+	uint32_t slot = hash_pair((uint32_t)parent, function) & (profile->slot_capacity - 1);
+	while (profile->node_slots[slot] != 0) {
+		int index = profile->node_slots[slot] - 1;
+		const ProfileNode *node = &profile->nodes[index];
+		if (node->parent == parent && node->function == function && node->isr == isr) {
+			return index;
+		}
+		slot = (slot + 1) & (profile->slot_capacity - 1);
+	}
+	return add_node(profile, parent, function, isr);
+}
+
+// Count a jal edge
+static void add_edge(Profile *profile, uint16_t caller, uint16_t callee) {
+	if (profile->edge_count * 2 >= profile->edge_capacity) {
+		int capacity = profile->edge_capacity * 2;
+		ProfileEdge *edges = calloc((size_t)capacity, sizeof(ProfileEdge));
+		if (!edges) {
+			return;
+		}
+		for (int i = 0; i < profile->edge_capacity; i++) {
+			const ProfileEdge *edge = &profile->edges[i];
+			if (edge->count == 0) {
+				continue;
+			}
+			uint32_t slot = hash_pair(edge->caller, edge->callee) & (capacity - 1);
+			while (edges[slot].count != 0) {
+				slot = (slot + 1) & (capacity - 1);
+			}
+			edges[slot] = *edge;
+		}
+		free(profile->edges);
+		profile->edges = edges;
+		profile->edge_capacity = capacity;
+	}
+
+	uint32_t slot = hash_pair(caller, callee) & (profile->edge_capacity - 1);
+	while (profile->edges[slot].count != 0) {
+		ProfileEdge *edge = &profile->edges[slot];
+		if (edge->caller == caller && edge->callee == callee) {
+			edge->count++;
+			return;
+		}
+		slot = (slot + 1) & (profile->edge_capacity - 1);
+	}
+	profile->edges[slot].caller = caller;
+	profile->edges[slot].callee = callee;
+	profile->edges[slot].count = 1;
+	profile->edge_count++;
+}
+
+// Allocate and clear the counters of a profile
+int init_profile(Profile *profile, int pc_digits) {
+	memset(profile, 0, sizeof(*profile));
+	profile->pc_digits = pc_digits;
+	profile->pc_counts = calloc(INSTRUCTION_MEM_MAX, sizeof(uint64_t));
+	profile->taken = calloc(INSTRUCTION_MEM_MAX, sizeof(uint64_t));
+	profile->branch_targets = calloc(INSTRUCTION_MEM_MAX, sizeof(uint16_t));
+	profile->edge_capacity = 64;
+	profile->edges = calloc((size_t)profile->edge_capacity, sizeof(ProfileEdge));
+	profile->node_capacity = 64;
+	profile->nodes = malloc((size_t)profile->node_capacity * sizeof(ProfileNode));
+	profile->slot_capacity = 128;
+	profile->node_slots = calloc((size_t)profile->slot_capacity, sizeof(int));
+	profile->stack_capacity = 64;
+	profile->return_stack = malloc((size_t)profile->stack_capacity * sizeof(uint16_t));
+	if (!profile->pc_counts || !profile->taken || !profile->branch_targets || !profile->edges || !profile->nodes ||
+		!profile->node_slots || !profile->return_stack) {
+		printf("Error: Memory allocation failed for the profiler\n");
+		free_profile(profile);
+		return 0;
+	}
+
+	profile->current = add_node(profile, PROFILE_NO_NODE, 0, 0);
+	profile->interrupted = PROFILE_NO_NODE;
+	return 1;
+}
+
+// Release a profile
+void free_profile(Profile *profile) {
+	free(profile->pc_counts);
+	free(profile->taken);
+	free(profile->branch_targets);
+	free(profile->edges);
+	free(profile->nodes);
+	free(profile->node_slots);
+	free(profile->return_stack);
+	for (int i = 0; i < profile->label_count; i++) {
+		free(profile->labels[i].name);
+	}
+	free(profile->labels);
+	memset(profile, 0, sizeof(*profile));
+}
+
+// Order labels by address
+static int compare_labels(const void *a, const void *b) {
+	const ProfileLabel *left = a;
+	const ProfileLabel *right = b;
+	return (int)left->address - (int)right->address;
+}
+
+// Load a label file
+int load_profile_labels(Profile *profile, const char *filename) {
+	char line[512];
+	char name[256];
+	char address[64];
+
+	FILE *file = fopen(filename, "r");
+	if (!file) {
+		printf("Error: Could not open label file: %s\n", filename);
+		return -1;
+	}
+
+	int loaded = 0;
+	while (fgets(line, sizeof(line), file)) {
+		if (sscanf(line, "%255s %63s", name, address) != 2 || name[0] == '#') {
+			continue;
+		}
+		long value = strtol(address, NULL, 0);
+		if (value < 0 || value >= INSTRUCTION_MEM_MAX) {
+			printf("Warning: Label %s at %s is outside the instruction memory\n", name, address);
+			continue;
+		}
+		if (profile->label_count == profile->label_capacity) {
+			int capacity = (profile->label_capacity == 0) ? 64 : profile->label_capacity * 2;
+			ProfileLabel *labels = realloc(profile->labels, (size_t)capacity * sizeof(ProfileLabel));
+			if (!labels) {
+				break;
+			}
+			profile->labels = labels;
+			profile->label_capacity = capacity;
+		}
+		ProfileLabel *label = &profile->labels[profile->label_count];
+		label->address = (uint16_t)value;
+		label->name = malloc(strlen(name) + 1);
+		if (!label->name) {
+			break;
+		}
+		strcpy(label->name, name);
+		profile->label_count++;
+		loaded++;
+	}
+	fclose(file);
+
+	qsort(profile->labels, (size_t)profile->label_count, sizeof(ProfileLabel), compare_labels);
+	return loaded;
+}
+
+// Enter a called function or an ISR: push the frame and the PC it returns to
+static void push_frame(Profile *profile, uint16_t function, uint16_t return_pc, int isr) {
+	if (profile->depth == profile->stack_capacity) {
+		int capacity = profile->stack_capacity * 2;
+		uint16_t *stack = realloc(profile->return_stack, (size_t)capacity * sizeof(uint16_t));
+		if (!stack) {
+			return; // The cycles stay with the caller
+		}
+		profile->return_stack = stack;
+		profile->stack_capacity = capacity;
+	}
+	int node = child_node(profile, profile->current, function, isr);
+	if (node != PROFILE_NO_NODE) {
+		profile->return_stack[profile->depth++] = return_pc;
+		profile->current = node;
+	}
+}
+
+// Record one executed cycle
+void profile_instruction(Profile *profile, uint16_t pc, int opcode, int in_isr, uint16_t next_pc) {
+	// handle_interrupts jumped to the handler before this instruction was fetched
+	if (in_isr && !profile->in_isr) {
+		profile->interrupted = profile->current;
+		profile->interrupted_depth = profile->depth;
+		push_frame(profile, pc, PROFILE_NO_RETURN, 1);
+	}
+	profile->in_isr = in_isr;
+
+	profile->pc_counts[pc]++;
+	profile->opcode_counts[(opcode >= 0 && opcode < PROFILE_OPCODES) ? opcode : PROFILE_OPCODES]++;
+	profile->nodes[profile->current].cycles++;
+	if (in_isr) {
+		profile->isr_cycles++;
+	}
+	else {
+		profile->main_cycles++;
+	}
+
+	if (opcode >= 9 && opcode <= 14) { // Branches
+		if (next_pc != (uint16_t)(pc + 1)) {
+			profile->taken[pc]++;
+			profile->branch_targets[pc] = next_pc;
+			// A branch to the return address of the frame is its return (beq $zero, $zero, $zero, $ra)
+			if (profile->depth > 0 && next_pc == profile->return_stack[profile->depth - 1]) {
+				profile->depth--;
+				profile->current = profile->nodes[profile->current].parent;
+			}
+		}
+	}
+	else if (opcode == 15) { // jal
+		add_edge(profile, pc, next_pc);
+		push_frame(profile, next_pc, (uint16_t)(pc + 1), 0);
+	}
+	else if (opcode == 18 && profile->interrupted != PROFILE_NO_NODE) { // reti
+		profile->current = profile->interrupted;
+		profile->depth = profile->interrupted_depth;
+		profile->interrupted = PROFILE_NO_NODE;
+		profile->in_isr = 0;
+	}
+}
+
+// Write "label" or "label+offset" for a PC, or the hex PC without labels
+static void format_symbol(const Profile *profile, uint16_t pc, char *out, size_t size) {
+	int low = 0;
+	int high = profile->label_count - 1;
+	int found = -1;
+
+	// Last label at or below pc
+	while (low <= high) {
+		int middle = (low + high) / 2;
+		if (profile->labels[middle].address <= pc) {
+			found = middle;
+			low = middle + 1;
+		}
+		else {
+			high = middle - 1;
+		}
+	}
+	if (found < 0) {
+		snprintf(out, size, "0x%0*X", profile->pc_digits, pc);
+	}
+	else if (profile->labels[found].address == pc) {
+		snprintf(out, size, "%s", profile->labels[found].name);
+	}
+	else {
+		snprintf(out, size, "%s+%d", profile->labels[found].name, pc - profile->labels[found].address);
+	}
+}
+
+// Order PCs by descending count, ties by PC
+static const uint64_t *sort_counts;
+static int compare_pcs(const void *a, const void *b) {
+	int left = *(const int *)a;
+	int right = *(const int *)b;
+	if (sort_counts[left] != sort_counts[right]) {
+		return (sort_counts[left] < sort_counts[right]) ? 1 : -1;
+	}
+	return left - right;
+}
+
+// Percentage of a total
+static double percent(uint64_t count, uint64_t total) {
+	return total ? 100.0 * (double)count / (double)total : 0.0;
+}
+
+// Write the text report
+int write_profile_report(const Profile *profile, const char *filename) {
+	uint64_t total = profile->main_cycles + profile->isr_cycles;
+	char symbol[300];
+	char target[300];
+
+	FILE *file = fopen(filename, "w");
+	if (!file) {
+		printf("Error: Could not create profile report: %s\n", filename);
+		return 0;
+	}
+
+	fprintf(file, "cycles %llu\nmain %llu (%.2f%%)\nisr %llu (%.2f%%)\n",
+		(unsigned long long)total, (unsigned long long)profile->main_cycles, percent(profile->main_cycles, total),
+		(unsigned long long)profile->isr_cycles, percent(profile->isr_cycles, total));
+
+	fprintf(file, "\nopcode mix\n");
+	for (int i = 0; i <= PROFILE_OPCODES; i++) {
+		if (profile->opcode_counts[i] != 0) {
+			fprintf(file, "  %-8s %14llu %7.2f%%\n", opcode_names[i], (unsigned long long)profile->opcode_counts[i],
+				percent(profile->opcode_counts[i], total));
+		}
+	}
+
+	// Hottest instructions
+	int *order = malloc(INSTRUCTION_MEM_MAX * sizeof(int));
+	int executed = 0;
+	if (order) {
+		for (int pc = 0; pc < INSTRUCTION_MEM_MAX; pc++) {
+			if (profile->pc_counts[pc] != 0) {
+				order[executed++] = pc;
+			}
+		}
+		sort_counts = profile->pc_counts;
+		qsort(order, (size_t)executed, sizeof(int), compare_pcs);
+		fprintf(file, "\nhot instructions\n");
+		for (int i = 0; i < executed && i < PROFILE_TOP; i++) {
+			format_symbol(profile, (uint16_t)order[i], symbol, sizeof(symbol));
+			fprintf(file, "  0x%0*X %-24s %14llu %7.2f%%\n", profile->pc_digits, order[i], symbol,
+				(unsigned long long)profile->pc_counts[order[i]], percent(profile->pc_counts[order[i]], total));
+		}
+	}
+
+	// Hot loops: the body of a taken backward branch, from its target to the branch
+	uint64_t *loop_cycles = calloc(INSTRUCTION_MEM_MAX, sizeof(uint64_t));
+	int loops = 0;
+	if (order && loop_cycles) {
+		for (int pc = 0; pc < INSTRUCTION_MEM_MAX; pc++) {
+			int start = profile->branch_targets[pc];
+			if (profile->taken[pc] == 0 || start > pc) {
+				continue;
+			}
+			for (int i = start; i <= pc; i++) {
+				loop_cycles[pc] += profile->pc_counts[i];
+			}
+			order[loops++] = pc;
+		}
+		sort_counts = loop_cycles;
+		qsort(order, (size_t)loops, sizeof(int), compare_pcs);
+		fprintf(file, "\nhot loops\n");
+		for (int i = 0; i < loops && i < PROFILE_TOP; i++) {
+			int pc = order[i];
+			format_symbol(profile, profile->branch_targets[pc], symbol, sizeof(symbol));
+			format_symbol(profile, (uint16_t)pc, target, sizeof(target));
+			fprintf(file, "  0x%0*X-0x%0*X %s .. %s  iterations %llu  cycles %llu %.2f%%\n", profile->pc_digits, profile->branch_targets[pc], profile->pc_digits, pc,
+				symbol, target, (unsigned long long)profile->taken[pc], (unsigned long long)loop_cycles[pc], percent(loop_cycles[pc], total));
+		}
+	}
+	free(loop_cycles);
+	free(order);
+
+	fprintf(file, "\nbranches\n");
+	for (int pc = 0; pc < INSTRUCTION_MEM_MAX; pc++) {
+		uint64_t count = profile->pc_counts[pc];
+		if (count == 0 || profile->taken[pc] == 0) {
+			continue;
+		}
+		format_symbol(profile, (uint16_t)pc, symbol, sizeof(symbol));
+		fprintf(file, "  0x%0*X %-24s taken %12llu  not taken %12llu  %6.2f%%\n", profile->pc_digits, pc, symbol,
+			(unsigned long long)profile->taken[pc], (unsigned long long)(count - profile->taken[pc]), percent(profile->taken[pc], count));
+	}
+
+	fprintf(file, "\ncalls\n");
+	for (int i = 0; i < profile->edge_capacity; i++) {
+		const ProfileEdge *edge = &profile->edges[i];
+		if (edge->count == 0) {
+			continue;
+		}
+		format_symbol(profile, edge->caller, symbol, sizeof(symbol));
+		format_symbol(profile, edge->callee, target, sizeof(target));
+		fprintf(file, "  %s -> %s %llu\n", symbol, target, (unsigned long long)edge->count);
+	}
+
+	int ok = !ferror(file);
+	ok &= fclose(file) == 0;
+	return ok;
+}
+
+// Write one folded stack: the frames from the root down to node
+static void write_stack(const Profile *profile, FILE *file, int node) {
+	char symbol[300];
+	const ProfileNode *frame = &profile->nodes[node];
+
+	if (frame->parent != PROFILE_NO_NODE) {
+		write_stack(profile, file, frame->parent);
+		fputc(';', file);
+		format_symbol(profile, frame->function, symbol, sizeof(symbol));
+		fprintf(file, frame->isr ? "[isr] %s" : "%s", symbol);
+	}
+	else if (profile->label_count > 0 && profile->labels[0].address == 0) {
+		fputs(profile->labels[0].name, file);
+	}
+	else {
+		fputs("main", file);
+	}
+}
+
+// Write the folded stacks
+int write_profile_folded(const Profile *profile, const char *filename) {
+	FILE *file = fopen(filename, "w");
+	if (!file) {
+		printf("Error: Could not create folded stacks file: %s\n", filename);
+		return 0;
+	}
+	for (int i = 0; i < profile->node_count; i++) {
+		if (profile->nodes[i].cycles != 0) {
+			write_stack(profile, file, i);
+			fprintf(file, " %llu\n", (unsigned long long)profile->nodes[i].cycles);
+		}
+	}
+	int ok = !ferror(file);
+	ok &= fclose(file) == 0;
+	return ok;
+}
@@ -0,0 +1,141 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdint.h>
+#include "memory.h"
+
+/*
+ Guest program profiler of the reference engine (run_machine). Build with SIM_PROFILE to compile it
+ in; without it the hooks below expand to nothing and Machine has no profile field, so the
+ simulator runs exactly as before.
+
+ Label file format: one "<name> <address>" pair per line (the address in decimal or 0x hex, counted
+ in instructions); blank lines and lines starting with '#' are skipped.
+*/
+
+#define PROFILE_OPCODES 22      // Opcodes 0 (add) to 21 (halt), anything else counts as invalid
+#define PROFILE_NO_NODE -1
+
+// A jal call-graph edge
+typedef struct {
+	uint16_t caller;        // PC of the jal
+	uint16_t callee;        // Jump target
+	uint64_t count;         // 0 for a free slot
+} ProfileEdge;
+
+// A node of the call tree: one frame of a call stack, under its caller's frame
+typedef struct {
+	uint16_t function;      // Entry PC of the function or ISR
+	int isr;                // 1 for an ISR frame
+	int parent;             // PROFILE_NO_NODE for the root
+	uint64_t cycles;        // Cycles spent in this frame itself
+} ProfileNode;
+
+#define PROFILE_NO_RETURN 0xFFFF // Return PC of an ISR frame, left by reti instead
+
+// A symbol of the label file
+typedef struct {
+	uint16_t address;
+	char *name;
+} ProfileLabel;
+
+// Counters of one profiled run
+typedef struct Profile {
+	uint64_t *pc_counts;    // Cycles per PC, INSTRUCTION_MEM_MAX entries
+	uint64_t *taken;        // Taken branches per PC, INSTRUCTION_MEM_MAX entries
+	uint16_t *branch_targets; // Target of the last taken branch per PC, a loop head if not above it
+	uint64_t opcode_counts[PROFILE_OPCODES + 1]; // The last one counts invalid opcodes
+	uint64_t main_cycles;   // Cycles outside ISRs
+	uint64_t isr_cycles;    // Cycles inside ISRs, reti included
+
+	ProfileEdge *edges;     // Open-addressing hash table of the jal edges
+	int edge_count;
+	int edge_capacity;      // Power of two
+
+	ProfileNode *nodes;     // Call tree, node 0 is the root (the code started at PC 0)
+	int node_count;
+	int node_capacity;
+	int *node_slots;        // Open-addressing hash table (parent, function) -> node index + 1
+	int slot_capacity;      // Power of two
+	int current;            // Frame of the running code
+	uint16_t *return_stack; // Return PC of every frame above the root
+	int depth;
+	int stack_capacity;
+	int interrupted;        // Frame the running ISR interrupted, PROFILE_NO_NODE outside ISRs
+	int interrupted_depth;
+	int in_isr;             // in_isr of the previous cycle
+
+	ProfileLabel *labels;   // Sorted by address
+	int label_count;
+	int label_capacity;
+	int pc_digits;          // Hex digits of a PC in the reports
+} Profile;
+
+
+#ifdef SIM_PROFILE
+// Record one cycle: the instruction at pc, the ISR state it ran in and the PC it left behind
+#define PROFILE_INSTRUCTION(profile, pc, opcode, in_isr, next_pc) \
+	do { \
+		if ((profile) != NULL) { \
+			profile_instruction((profile), (pc), (opcode), (in_isr), (next_pc)); \
+		} \
+	} while (0)
+#else
+#define PROFILE_INSTRUCTION(profile, pc, opcode, in_isr, next_pc) ((void)0)
+#endif
+
+
+// Function declarations
+
+/*
+-Functionality: Allocates the counters of a profile and clears them.
+-return 1 on success, 0 if memory could not be allocated.
+-parameter1: profile - Pointer to the Profile structure.
+-parameter2: pc_digits - Hex digits of a PC in the reports, pc_hex_digits of the instruction depth.
+*/
+int init_profile(Profile *profile, int pc_digits);
+
+/*
+-Functionality: Releases the counters and labels of a profile.
+-parameter1: profile - Pointer to the Profile structure.
+*/
+void free_profile(Profile *profile);
+
+/*
+-Functionality: Loads a label file used to symbolize the reports.
+-return The number of labels loaded, or -1 if the file could not be read.
+-parameter1: profile - Pointer to the Profile structure.
+-parameter2: filename - Name of the label file.
+*/
+int load_profile_labels(Profile *profile, const char *filename);
+
+/*
+-Functionality: Records one executed cycle. Called through PROFILE_INSTRUCTION.
+-parameter1: profile - Pointer to the Profile structure.
+-parameter2: pc - PC of the instruction.
+-parameter3: opcode - Its opcode.
+-parameter4: in_isr - 1 if it ran inside an ISR.
+-parameter5: next_pc - The PC after it.
+*/
+void profile_instruction(Profile *profile, uint16_t pc, int opcode, int in_isr, uint16_t next_pc);
+
+/*
+-Functionality: Writes the text report: main and ISR cycles, the opcode mix, the hottest
+ instructions and loops (the instructions from a backward branch's target up to it), the branch
+ taken ratios and the jal call edges.
+-return 1 on success, 0 if the file could not be written.
+-parameter1: profile - Pointer to the Profile structure.
+-parameter2: filename - Name of the output file.
+*/
+int write_profile_report(const Profile *profile, const char *filename);
+
+/*
+-Functionality: Writes the cycles of every call stack as folded stacks ("main;f;g 1234" per line),
+ the input of flamegraph.pl and similar tools. ISR frames are shown as "[isr] name".
+-return 1 on success, 0 if the file could not be written.
+-parameter1: profile - Pointer to the Profile structure.
+-parameter2: filename - Name of the output file.
+*/
+int write_profile_folded(const Profile *profile, const char *filename);
+
+#endif
@@ -0,0 +1,200 @@
+#define _CRT_SECURE_NO_WARNINGS
+#include "scheduler.h"
+#include <stdio.h>
+
+
+// Swap two heap entries and keep the index of their kinds up to date
+static void swap_entries(Scheduler *scheduler, int a, int b) {
+	ScheduledEvent temp = scheduler->heap[a];
+	scheduler->heap[a] = scheduler->heap[b];
+	scheduler->heap[b] = temp;
+	scheduler->heap_index[scheduler->heap[a].kind] = a;
+	scheduler->heap_index[scheduler->heap[b].kind] = b;
+}
+
+// Move an entry towards the root while it is earlier than its parent
+static void sift_up(Scheduler *scheduler, int position) {
+	while (position > 0) {
+		int parent = (position - 1) / 2;
+		if (scheduler->heap[parent].cycle <= scheduler->heap[position].cycle) {
+			break;
+		}
+		swap_entries(scheduler, parent, position);
+		position = parent;
+	}
+}
+
+// Move an entry towards the leaves while it is later than a child
+static void sift_down(Scheduler *scheduler, int position) {
+	while (1) {
+		int smallest = position;
+		int left = 2 * position + 1;
+		int right = left + 1;
+		if (left < scheduler->heap_size && scheduler->heap[left].cycle < scheduler->heap[smallest].cycle) {
+			smallest = left;
+		}
+		if (right < scheduler->heap_size && scheduler->heap[right].cycle < scheduler->heap[smallest].cycle) {
+			smallest = right;
+		}
+		if (smallest == position) {
+			break;
+		}
+		swap_entries(scheduler, smallest, position);
+		position = smallest;
+	}
+}
+
+// Initialize the scheduler from the current device state
+void init_scheduler(Scheduler *scheduler, const IORegisters *io, const Disk *disk, const IRQ2Data *irq2) {
+	scheduler->cycle = 0;
+	scheduler->synced_cycle = 0;
+	scheduler->heap_size = 0;
+	for (int kind = 0; kind < NUM_EVENTS; kind++) {
+		scheduler->heap_index[kind] = -1;
+	}
+
+	reschedule_devices(scheduler, io, disk, irq2);
+	request_cycle_check(scheduler); // The state handed over may hold a pending interrupt
+}
+
+// Schedule or reschedule an event
+void schedule_event(Scheduler *scheduler, EventKind kind, uint64_t cycle) {
+	int position = scheduler->heap_index[kind];
+
+	if (position < 0) {
+		position = scheduler->heap_size++;
+		scheduler->heap[position].kind = kind;
+		scheduler->heap_index[kind] = position;
+		scheduler->heap[position].cycle = cycle;
+		sift_up(scheduler, position);
+		return;
+	}
+
+	uint64_t previous = scheduler->heap[position].cycle;
+	scheduler->heap[position].cycle = cycle;
+	if (cycle < previous) {
+		sift_up(scheduler, position);
+	}
+	else {
+		sift_down(scheduler, position);
+	}
+}
+
+// Remove an event from the queue
+void cancel_event(Scheduler *scheduler, EventKind kind) {
+	int position = scheduler->heap_index[kind];
+	if (position < 0) {
+		return;
+	}
+
+	int last = --scheduler->heap_size;
+	if (position != last) {
+		swap_entries(scheduler, position, last);
+		scheduler->heap_index[kind] = -1;
+		sift_down(scheduler, position);
+		sift_up(scheduler, position);
+	}
+	else {
+		scheduler->heap_index[kind] = -1;
+	}
+}
+
+// Cycle of the earliest event
+uint64_t next_event_cycle(const Scheduler *scheduler) {
+	return (scheduler->heap_size > 0) ? scheduler->heap[0].cycle : UINT64_MAX;
+}
+
+// Bring the lazily advanced registers up to a cycle
+static void sync_to_cycle(Scheduler *scheduler, IORegisters *io, Disk *disk, uint64_t cycle) {
+	uint32_t cycles = (uint32_t)(cycle - scheduler->synced_cycle);
+	if (cycles == 0) {
+		return;
+	}
+
+	// No event lies in between, so each cycle only advanced these counters
+	skip_timer_cycles(io, cycles);
+	skip_disk_cycles(io, disk, cycles);
+	scheduler->synced_cycle = cycle;
+}
+
+// Bring clks, timercurrent and the disk timer up to the current cycle
+void sync_io_registers(Scheduler *scheduler, IORegisters *io, Disk *disk) {
+	sync_to_cycle(scheduler, io, disk, scheduler->cycle);
+}
+
+// Recompute the device events from the synced state
+void reschedule_devices(Scheduler *scheduler, const IORegisters *io, const Disk *disk, const IRQ2Data *irq2) {
+	const uint64_t wrap = (uint64_t)1 << 32; // A 32-bit counter needs a full wrap to match again
+	uint64_t cycles;
+
+	// Timer expiry, from the timer device
+	cycles = timer_cycles_to_event(io);
+	if (cycles != UINT64_MAX) {
+		schedule_event(scheduler, EVENT_TIMER, scheduler->cycle + cycles);
+	}
+	else {
+		cancel_event(scheduler, EVENT_TIMER);
+	}
+
+	// Next IRQ2 event, matched against clks after it is incremented
+	if (irq2->current_index < irq2->count) {
+		cycles = (uint32_t)((uint32_t)irq2->events[irq2->current_index] - io->IORegister[IO_CLKS]);
+		schedule_event(scheduler, EVENT_IRQ2, scheduler->cycle + ((cycles == 0) ? wrap : cycles));
+	}
+	else {
+		cancel_event(scheduler, EVENT_IRQ2);
+	}
+
+	// Disk completion, or a pending command starting on the next cycle, from the disk device
+	cycles = disk_cycles_to_event(io, disk);
+	if (cycles != UINT64_MAX) {
+		schedule_event(scheduler, EVENT_DISK, scheduler->cycle + cycles);
+	}
+	else {
+		cancel_event(scheduler, EVENT_DISK);
+	}
+}
+
+// Request the full per-cycle handling on the next cycle
+void request_cycle_check(Scheduler *scheduler) {
+	int position = scheduler->heap_index[EVENT_CHECK];
+	if (position < 0 || scheduler->heap[position].cycle > scheduler->cycle + 1) {
+		schedule_event(scheduler, EVENT_CHECK, scheduler->cycle + 1);
+	}
+}
+
+// React to an out instruction
+void scheduler_io_written(Scheduler *scheduler, const IORegisters *io, int reg_index) {
+	if (reg_index >= 0 && reg_index < NUM_IO_REGISTERS && (io->bus[reg_index].flags & IO_WAKES_SCHEDULER)) {
+		request_cycle_check(scheduler);
+	}
+}
+
+// Run the full per-cycle handling of the current cycle
+void run_due_cycle(Scheduler *scheduler, Memory *memory, IORegisters *io, Disk *disk, IRQ2Data *irq2, uint16_t *pc, int *in_isr) {
+	sync_to_cycle(scheduler, io, disk, scheduler->cycle - 1);
+
+	increment_clock(io);
+	if (io->active & IO_ACTIVE_TIMER) {
+		update_timer(io);
+	}
+	check_and_trigger_irq2(io, irq2, io->IORegister[IO_CLKS]);
+	handle_interrupts(io, pc, in_isr);
+	if (io->active & IO_ACTIVE_DISK) {
+		handle_disk_command(memory, io, disk);
+	}
+	scheduler->synced_cycle = scheduler->cycle;
+
+	cancel_event(scheduler, EVENT_CHECK);
+	reschedule_devices(scheduler, io, disk, irq2);
+
+	// A disk completion raises irq1 after the interrupt check, it is taken on the next cycle
+	if (!*in_isr && interrupt_pending(io)) {
+		request_cycle_check(scheduler);
+	}
+}
+
+// Advance cycles with no due event
+void skip_cycles(Scheduler *scheduler, uint32_t cycles) {
+	scheduler->cycle += cycles;
+}
@@ -0,0 +1,123 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <stdint.h>
+#include "memory.h"     // For the disk DMA
+#include "io.h"         // For the clock, timer and status registers
+#include "disk.h"       // For the disk timer
+#include "interrupts.h" // For the IRQ2 events and interrupt handling
+
+// Kinds of scheduled events
+typedef enum {
+	EVENT_TIMER,   // timercurrent reaches timermax (IO registers 11/12/13)
+	EVENT_IRQ2,    // clks reaches the next IRQ2 cycle
+	EVENT_DISK,    // A disk command starts or completes
+	EVENT_CHECK,   // Run the full per-cycle handling (after out/reti, or a pending interrupt)
+	NUM_EVENTS
+} EventKind;
+
+// One entry of the event queue
+typedef struct {
+	uint64_t cycle; // Absolute cycle the event is due on
+	int kind;       // EventKind
+} ScheduledEvent;
+
+// Central event queue keyed by absolute cycle number (indexed binary min-heap)
+typedef struct {
+	uint64_t cycle;                  // Current cycle, its per-cycle handling is done
+	uint64_t synced_cycle;           // Cycle the clks/timercurrent/disk timer registers reflect
+	ScheduledEvent heap[NUM_EVENTS];
+	int heap_size;
+	int heap_index[NUM_EVENTS];      // Position of each kind in the heap, -1 when not scheduled
+} Scheduler;
+
+
+// Function declaration
+
+/*
+-Functionality: Initializes the scheduler from the current device state. The first cycle always
+ runs the full per-cycle handling.
+-parameter1: scheduler - Pointer to the Scheduler structure.
+-parameter2: io - Pointer to the IORegisters structure.
+-parameter3: disk - Pointer to the Disk structure.
+-parameter4: irq2 - Pointer to the IRQ2Data structure.
+*/
+void init_scheduler(Scheduler *scheduler, const IORegisters *io, const Disk *disk, const IRQ2Data *irq2);
+
+/*
+-Functionality: Schedules (or reschedules) an event.
+-parameter1: scheduler - Pointer to the Scheduler structure.
+-parameter2: kind - The EventKind.
+-parameter3: cycle - The absolute cycle the event is due on.
+*/
+void schedule_event(Scheduler *scheduler, EventKind kind, uint64_t cycle);
+
+/*
+-Functionality: Removes an event from the queue, if scheduled.
+-parameter1: scheduler - Pointer to the Scheduler structure.
+-parameter2: kind - The EventKind.
+*/
+void cancel_event(Scheduler *scheduler, EventKind kind);
+
+/*
+-Functionality: Returns the cycle of the earliest scheduled event.
+-return The absolute cycle, UINT64_MAX when nothing is scheduled.
+-parameter1: scheduler - Pointer to the Scheduler structure.
+*/
+uint64_t next_event_cycle(const Scheduler *scheduler);
+
+/*
+-Functionality: Brings clks, timercurrent and the disk timer up to the current cycle.
+ Must be called before IO registers are read or written.
+-parameter1: scheduler - Pointer to the Scheduler structure.
+-parameter2: io - Pointer to the IORegisters structure.
+-parameter3: disk - Pointer to the Disk structure.
+*/
+void sync_io_registers(Scheduler *scheduler, IORegisters *io, Disk *disk);
+
+/*
+-Functionality: Recomputes the timer, IRQ2 and disk events from the synced device state.
+-parameter1: scheduler - Pointer to the Scheduler structure.
+-parameter2: io - Pointer to the IORegisters structure.
+-parameter3: disk - Pointer to the Disk structure.
+-parameter4: irq2 - Pointer to the IRQ2Data structure.
+*/
+void reschedule_devices(Scheduler *scheduler, const IORegisters *io, const Disk *disk, const IRQ2Data *irq2);
+
+/*
+-Functionality: Requests the full per-cycle handling on the next cycle, e.g. after reti.
+-parameter1: scheduler - Pointer to the Scheduler structure.
+*/
+void request_cycle_check(Scheduler *scheduler);
+
+/*
+-Functionality: Notifies the scheduler of an out instruction. Writes to registers flagged
+ IO_WAKES_SCHEDULER on the bus (interrupt, clock, timer, disk and devices that raise interrupts)
+ reschedule the events on the next cycle.
+-parameter1: scheduler - Pointer to the Scheduler structure.
+-parameter2: io - Pointer to the I/O registers structure.
+-parameter3: reg_index - The IO register that was written.
+*/
+void scheduler_io_written(Scheduler *scheduler, const IORegisters *io, int reg_index);
+
+/*
+-Functionality: Runs the full per-cycle handling of the current cycle (clock, timer, IRQ2,
+ interrupts, disk) exactly like simulator_main_loop, then reschedules the events.
+-parameter1: scheduler - Pointer to the Scheduler structure, cycle already advanced.
+-parameter2: memory - Pointer to the Memory structure.
+-parameter3: io - Pointer to the IORegisters structure.
+-parameter4: disk - Pointer to the Disk structure.
+-parameter5: irq2 - Pointer to the IRQ2Data structure.
+-parameter6: pc - Pointer to the Program counter.
+-parameter7: in_isr - Pointer to the flag the indicates if the code is in the ISR.
+*/
+void run_due_cycle(Scheduler *scheduler, Memory *memory, IORegisters *io, Disk *disk, IRQ2Data *irq2, uint16_t *pc, int *in_isr);
+
+/*
+-Functionality: Advances several cycles that are known to have no due event.
+-parameter1: scheduler - Pointer to the Scheduler structure.
+-parameter2: cycles - Number of cycles, all before next_event_cycle.
+*/
+void skip_cycles(Scheduler *scheduler, uint32_t cycles);
+
+#endif
@@ -0,0 +1,317 @@
+#define _CRT_SECURE_NO_WARNINGS
+#include "simulator.h"
+#include "machine.h"
+#include "breakpoints.h"
+#include <stdlib.h>
+#include <string.h>
+
+// One simulated machine with its program and points
+struct Simulator {
+	DecodedProgram program;  // First, it is cache-line aligned
+	ProgramImage image;
+	Machine machine;
+	MemoryGeometry geometry;
+	Breakpoints breakpoints;
+};
+
+// Create a simulator at power-on
+SimStatus sim_create(Simulator **sim) {
+	Simulator *created = cache_aligned_alloc(sizeof(Simulator));
+	if (!created) {
+		return SIM_ERROR_MEMORY;
+	}
+	if (!init_machine(&created->machine)) {
+		cache_aligned_free(created);
+		return SIM_ERROR_MEMORY;
+	}
+	created->geometry = default_memory_geometry();
+	set_machine_geometry(&created->machine, &created->geometry);
+	init_program_image(&created->image);
+	predecode_program(&created->image, &created->program);
+	init_breakpoints(&created->breakpoints, &created->program);
+
+	*sim = created;
+	return SIM_OK;
+}
+
+// Destroy a simulator
+void sim_destroy(Simulator *sim) {
+	if (sim == NULL) {
+		return;
+	}
+	free_breakpoints(&sim->breakpoints);
+	free_machine(&sim->machine);
+	cache_aligned_free(sim);
+}
+
+// Select the memory geometry
+SimStatus sim_set_geometry(Simulator *sim, uint32_t instruction_depth, uint32_t data_depth, MemoryPolicy policy) {
+	MemoryGeometry geometry;
+	geometry.instruction_depth = instruction_depth;
+	geometry.data_depth = data_depth;
+	geometry.policy = policy;
+
+	if (!set_machine_geometry(&sim->machine, &geometry)) {
+		return SIM_ERROR_ARGUMENT;
+	}
+	sim->geometry = geometry;
+	return SIM_OK;
+}
+
+// Map a load_image_buffer result to a status, it only fails to open a buffer when an allocation fails
+static SimStatus image_status(int count) {
+	if (count == IMAGE_ERROR_OPEN) {
+		return SIM_ERROR_MEMORY;
+	}
+	return (count < 0) ? SIM_ERROR_FORMAT : SIM_OK;
+}
+
+// Load the program, re-decoding it
+static SimStatus load_program_buffer(Simulator *sim, const void *data, size_t size) {
+	// The marks of the points live in the decoded entries about to be rewritten
+	free_breakpoints(&sim->breakpoints);
+	init_program_image(&sim->image);
+	SimStatus status = image_status(load_image_buffer(data, size, IMAGE_INSTRUCTIONS, sim->image.instructions));
+	if (status != SIM_OK) {
+		init_program_image(&sim->image);
+	}
+	predecode_program(&sim->image, &sim->program);
+	return status;
+}
+
+// Load an input from a buffer
+SimStatus sim_load(Simulator *sim, SimInput input, const void *data, size_t size) {
+	IRQ2Data irq2;
+
+	switch (input) {
+	case SIM_INPUT_PROGRAM:
+		return load_program_buffer(sim, data, size);
+
+	case SIM_INPUT_DATA:
+		return image_status(load_image_buffer(data, size, IMAGE_DATA, sim->machine.memory->data));
+
+	case SIM_INPUT_DISK:
+		return image_status(load_image_buffer(data, size, IMAGE_DISK, sim->machine.disk->data));
+
+	case SIM_INPUT_IRQ2:
+		if (parse_irq2_events(data, size, &irq2) < 0) {
+			return SIM_ERROR_MEMORY;
+		}
+		free_irq2_data(&sim->machine.irq2);
+		sim->machine.irq2 = irq2;
+		return SIM_OK;
+	}
+	return SIM_ERROR_ARGUMENT;
+}
+
+// Return the machine to power-on
+SimStatus sim_reset(Simulator *sim) {
+	Machine machine;
+
+	if (!init_machine(&machine)) {
+		return SIM_ERROR_MEMORY;
+	}
+	set_machine_geometry(&machine, &sim->geometry);
+	free_machine(&sim->machine);
+	sim->machine = machine;
+	return SIM_OK;
+}
+
+// Why the last run returned
+static SimStop stop_reason(const Simulator *sim) {
+	if (sim->machine.memory->faulted) {
+		return SIM_STOP_TRAP;
+	}
+	if (sim->machine.halted) {
+		return SIM_STOP_HALT;
+	}
+	if (sim->breakpoints.hit != 0) {
+		return SIM_STOP_BREAKPOINT;
+	}
+	return SIM_STOP_CYCLE;
+}
+
+// Run up to a number of cycles on the reference loop
+static void run_cycles(Simulator *sim, uint64_t cycles) {
+	// Only arm the points when there are some, so idle loops are still fast-forwarded without them
+	sim->breakpoints.hit = 0;
+	if (sim->breakpoints.count > 0) {
+		attach_breakpoints(&sim->breakpoints, &sim->machine);
+	}
+	run_machine(&sim->machine, &sim->image, &sim->program, cycles);
+	detach_breakpoints(&sim->machine);
+}
+
+// Run up to a number of cycles
+SimStatus sim_step(Simulator *sim, uint64_t cycles, SimStop *stop) {
+	uint64_t target = (cycles > UINT64_MAX - sim->machine.cycles) ? UINT64_MAX : sim->machine.cycles + cycles;
+	return sim_run_until(sim, target, stop);
+}
+
+// Run until a cycle count
+SimStatus sim_run_until(Simulator *sim, uint64_t cycle, SimStop *stop) {
+	if (cycle > sim->machine.cycles) {
+		run_cycles(sim, cycle - sim->machine.cycles);
+	}
+	else {
+		sim->breakpoints.hit = 0;
+	}
+	if (stop != NULL) {
+		*stop = stop_reason(sim);
+	}
+	return SIM_OK;
+}
+
+// Add a point
+static SimStatus add_point(Simulator *sim, const Breakpoint *point, int *id) {
+	int added = add_breakpoint(&sim->breakpoints, point, io_pc_mask(&sim->machine.io));
+	if (added == 0) {
+		return SIM_ERROR_MEMORY;
+	}
+	if (id != NULL) {
+		*id = added;
+	}
+	return SIM_OK;
+}
+
+// Add a breakpoint
+SimStatus sim_add_breakpoint(Simulator *sim, uint16_t pc, uint64_t ignore, int *id) {
+	Breakpoint point;
+
+	if (pc > io_pc_mask(&sim->machine.io)) {
+		return SIM_ERROR_ARGUMENT;
+	}
+	memset(&point, 0, sizeof(point));
+	point.kind = BREAK_PC;
+	point.address = pc;
+	point.ignore = ignore;
+	return add_point(sim, &point, id);
+}
+
+// Add a watchpoint
+SimStatus sim_add_watchpoint(Simulator *sim, int io, uint32_t address, int access, uint64_t ignore, int *id) {
+	Breakpoint point;
+
+	if (address >= (io ? NUM_IO_REGISTERS : DATA_MEM_MAX) || access == 0 || (access & ~(WATCH_READ | WATCH_WRITE)) != 0) {
+		return SIM_ERROR_ARGUMENT;
+	}
+	memset(&point, 0, sizeof(point));
+	point.kind = io ? BREAK_IO : BREAK_DATA;
+	point.address = address;
+	point.access = access;
+	point.ignore = ignore;
+	return add_point(sim, &point, id);
+}
+
+// Remove a point
+SimStatus sim_remove_point(Simulator *sim, int id) {
+	return remove_breakpoint(&sim->breakpoints, id) ? SIM_OK : SIM_ERROR_ARGUMENT;
+}
+
+// The point that stopped the last run
+int sim_stopped_by(const Simulator *sim) {
+	return sim->breakpoints.hit;
+}
+
+// The cycles run since power-on
+uint64_t sim_cycles(const Simulator *sim) {
+	return sim->machine.cycles;
+}
+
+// The PC
+uint16_t sim_pc(const Simulator *sim) {
+	return sim->machine.pc;
+}
+
+// Whether the machine stopped for good
+int sim_halted(const Simulator *sim) {
+	return sim->machine.halted;
+}
+
+// The machine behind the handle
+struct Machine *sim_machine(Simulator *sim) {
+	return &sim->machine;
+}
+
+// The address of the trapped access
+uint32_t sim_fault_address(const Simulator *sim) {
+	return sim->machine.memory->faulted ? sim->machine.memory->fault_address : 0;
+}
+
+// Read a register
+SimStatus sim_get_register(const Simulator *sim, int reg_index, uint32_t *value) {
+	if (reg_index < 0 || reg_index >= NUM_REGISTERS) {
+		return SIM_ERROR_ARGUMENT;
+	}
+	*value = sim->machine.registers.regs[reg_index];
+	return SIM_OK;
+}
+
+// Write a register
+SimStatus sim_set_register(Simulator *sim, int reg_index, uint32_t value) {
+	if (reg_index < 0 || reg_index >= NUM_REGISTERS) {
+		return SIM_ERROR_ARGUMENT;
+	}
+	set_register(&sim->machine.registers, reg_index, value);
+	return SIM_OK;
+}
+
+// Read an IO register
+SimStatus sim_get_io(const Simulator *sim, int reg_index, uint32_t *value) {
+	if (reg_index < 0 || reg_index >= NUM_IO_REGISTERS) {
+		return SIM_ERROR_ARGUMENT;
+	}
+	*value = sim->machine.io.IORegister[reg_index];
+	return SIM_OK;
+}
+
+// Check a range of data memory words against the depth
+static int data_range_valid(const Simulator *sim, uint32_t address, uint32_t count) {
+	uint32_t depth = sim->machine.memory->depth;
+	return count <= depth && address <= depth - count;
+}
+
+// Read data memory words
+SimStatus sim_read_data(const Simulator *sim, uint32_t address, uint32_t *words, uint32_t count) {
+	if (!data_range_valid(sim, address, count)) {
+		return SIM_ERROR_ARGUMENT;
+	}
+	memcpy(words, &sim->machine.memory->data[address], count * sizeof(uint32_t));
+	return SIM_OK;
+}
+
+// Write data memory words
+SimStatus sim_write_data(Simulator *sim, uint32_t address, const uint32_t *words, uint32_t count) {
+	if (!data_range_valid(sim, address, count)) {
+		return SIM_ERROR_ARGUMENT;
+	}
+	for (uint32_t i = 0; i < count; i++) {
+		sim->machine.memory->data[address + i] = words[i];
+		mark_data_dirty(sim->machine.memory, address + i);
+	}
+	return SIM_OK;
+}
+
+// Read a disk sector
+SimStatus sim_read_sector(const Simulator *sim, uint64_t sector, uint8_t *bytes) {
+	if (sector >= disk_sector_count(sim->machine.disk)) {
+		return SIM_ERROR_ARGUMENT;
+	}
+	memcpy(bytes, disk_sector(sim->machine.disk, sector), SECTOR_SIZE);
+	return SIM_OK;
+}
+
+// Name a status
+const char *sim_status_name(SimStatus status) {
+	switch (status) {
+	case SIM_OK:
+		return "ok";
+	case SIM_ERROR_MEMORY:
+		return "out of memory";
+	case SIM_ERROR_ARGUMENT:
+		return "invalid argument";
+	case SIM_ERROR_FORMAT:
+		return "invalid image";
+	}
+	return "unknown status";
+}
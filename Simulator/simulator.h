@@ -0,0 +1,256 @@
+#ifndef SIMULATOR_H
+#define SIMULATOR_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "memory.h"
+
+/*
+ The embeddable simulator (libsim.a): one SIMP machine behind an opaque handle, for hosts that
+ drive it from their own code (a test harness, a GUI, a fuzzer) instead of through the sim CLI.
+
+ Its inputs are loaded from memory buffers holding the contents of the usual input files: imemin,
+ dmemin and diskin in the hex text or binary image format (image.h), irq2in as decimal cycles.
+ It runs on the reference loop, with the breakpoints and watchpoints of breakpoints.h. No call
+ exits the process: halt and a trapped access stop the run and are reported through a SimStop,
+ and every failure comes back as a SimStatus (a failed allocation may still print an error line).
+
+ A typical host:
+  sim_create(&sim); sim_load(sim, SIM_INPUT_PROGRAM, imem, imem_size); ...
+  while (sim_run_until(sim, sim_cycles(sim) + frame, &stop) == SIM_OK && stop == SIM_STOP_CYCLE) { ... }
+  sim_destroy(sim);
+*/
+
+// The handle of one simulated machine
+typedef struct Simulator Simulator;
+
+// Result of a call
+typedef enum {
+	SIM_OK = 0,
+	SIM_ERROR_MEMORY = 1,   // Memory could not be allocated, the simulator is unchanged
+	SIM_ERROR_ARGUMENT = 2, // An argument is out of range, e.g. a register or address
+	SIM_ERROR_FORMAT = 3    // An input buffer is not a valid image
+} SimStatus;
+
+// Inputs of a machine
+typedef enum {
+	SIM_INPUT_PROGRAM = 0,  // imemin
+	SIM_INPUT_DATA = 1,     // dmemin
+	SIM_INPUT_DISK = 2,     // diskin
+	SIM_INPUT_IRQ2 = 3      // irq2in
+} SimInput;
+
+// Why a run returned
+typedef enum {
+	SIM_STOP_CYCLE = 0,     // It reached the requested cycle
+	SIM_STOP_HALT = 1,      // The machine fetched halt
+	SIM_STOP_TRAP = 2,      // An out-of-range access under MEMORY_TRAP, see sim_fault_address
+	SIM_STOP_BREAKPOINT = 3 // A breakpoint or watchpoint, see sim_stopped_by
+} SimStop;
+
+
+// Function declarations
+
+/*
+-Functionality: Creates a simulator at power-on with the default geometry and empty inputs.
+-return SIM_OK, or SIM_ERROR_MEMORY.
+-parameter1: sim - Receives the handle.
+*/
+SimStatus sim_create(Simulator **sim);
+
+/*
+-Functionality: Destroys a simulator and everything it owns.
+-parameter1: sim - The handle, may be NULL.
+*/
+void sim_destroy(Simulator *sim);
+
+/*
+-Functionality: Selects the memory geometry, as the imem=, dmem= and log|wrap|trap options of the CLI.
+ Load the data memory afterwards so it fits the new depth.
+-return SIM_OK, or SIM_ERROR_ARGUMENT if a depth is not a power of two within the capacity.
+-parameter1: sim - The handle.
+-parameter2: instruction_depth - Instruction memory depth, up to INSTRUCTION_MEM_MAX.
+-parameter3: data_depth - Data memory depth, up to DATA_MEM_MAX.
+-parameter4: policy - The MemoryPolicy of out-of-range data accesses.
+*/
+SimStatus sim_set_geometry(Simulator *sim, uint32_t instruction_depth, uint32_t data_depth, MemoryPolicy policy);
+
+/*
+-Functionality: Loads an input from a buffer. Loading a program removes every breakpoint and watchpoint,
+ and leaves an empty program if it fails; data and disk images are written over the current contents,
+ so load them at power-on.
+-return SIM_OK, SIM_ERROR_FORMAT if the image is not valid (a binary image with a bad header or a truncated
+ payload, or a text line without hex digits), or SIM_ERROR_MEMORY.
+-parameter1: sim - The handle.
+-parameter2: input - The SimInput.
+-parameter3: data - The contents of the input file.
+-parameter4: size - Its size in bytes.
+*/
+SimStatus sim_load(Simulator *sim, SimInput input, const void *data, size_t size);
+
+/*
+-Functionality: Returns the machine to power-on. The program, geometry and points are kept; the data
+ memory, disk and IRQ2 events are cleared and need to be loaded again.
+-return SIM_OK, or SIM_ERROR_MEMORY (the machine is left as it was).
+-parameter1: sim - The handle.
+*/
+SimStatus sim_reset(Simulator *sim);
+
+/*
+-Functionality: Runs up to a number of cycles, stopping early at halt, a trap or a point.
+-return SIM_OK.
+-parameter1: sim - The handle.
+-parameter2: cycles - Cycles to run.
+-parameter3: stop - Receives why the run returned, may be NULL.
+*/
+SimStatus sim_step(Simulator *sim, uint64_t cycles, SimStop *stop);
+
+/*
+-Functionality: Runs until the cycle count reaches a cycle, or halt, a trap or a point. A halted machine
+ returns at once with SIM_STOP_HALT.
+-return SIM_OK.
+-parameter1: sim - The handle.
+-parameter2: cycle - Cycle count to stop at, UINT64_MAX to run until halt.
+-parameter3: stop - Receives why the run returned, may be NULL.
+*/
+SimStatus sim_run_until(Simulator *sim, uint64_t cycle, SimStop *stop);
+
+/*
+-Functionality: Adds a breakpoint, stopping a run before the instruction at a PC is fetched.
+-return SIM_OK, SIM_ERROR_ARGUMENT if the PC is beyond the instruction depth, or SIM_ERROR_MEMORY.
+-parameter1: sim - The handle.
+-parameter2: pc - The PC.
+-parameter3: ignore - Hits let through before it stops a run.
+-parameter4: id - Receives its id, may be NULL.
+*/
+SimStatus sim_add_breakpoint(Simulator *sim, uint16_t pc, uint64_t ignore, int *id);
+
+/*
+-Functionality: Adds a watchpoint, stopping a run after an instruction that accesses a data memory word
+ or an IO register.
+-return SIM_OK, SIM_ERROR_ARGUMENT if the address or access is not valid, or SIM_ERROR_MEMORY.
+-parameter1: sim - The handle.
+-parameter2: io - 1 to watch the IO register at address, 0 for the data memory word.
+-parameter3: address - The address or IO register.
+-parameter4: access - WATCH_READ, WATCH_WRITE or both.
+-parameter5: ignore - Hits let through before it stops a run.
+-parameter6: id - Receives its id, may be NULL.
+*/
+SimStatus sim_add_watchpoint(Simulator *sim, int io, uint32_t address, int access, uint64_t ignore, int *id);
+
+/*
+-Functionality: Removes a breakpoint or watchpoint.
+-return SIM_OK, or SIM_ERROR_ARGUMENT if there is no point with the id.
+-parameter1: sim - The handle.
+-parameter2: id - Its id.
+*/
+SimStatus sim_remove_point(Simulator *sim, int id);
+
+/*
+-Functionality: Returns the point that stopped the last run.
+-return Its id, 0 if the last run did not stop at a point.
+-parameter1: sim - The handle.
+*/
+int sim_stopped_by(const Simulator *sim);
+
+/*
+-Functionality: Returns the cycles run since power-on.
+-return The cycle count.
+-parameter1: sim - The handle.
+*/
+uint64_t sim_cycles(const Simulator *sim);
+
+/*
+-Functionality: Returns the PC, the address of the next instruction.
+-return The PC.
+-parameter1: sim - The handle.
+*/
+uint16_t sim_pc(const Simulator *sim);
+
+/*
+-Functionality: Tells if the machine stopped for good, on halt or a trap.
+-return 1 if it did, 0 otherwise.
+-parameter1: sim - The handle.
+*/
+int sim_halted(const Simulator *sim);
+
+/*
+-Functionality: Returns the Machine behind the handle (machine.h), for a host that attaches what the calls
+ here do not cover, as the sim CLI does with its trace files, monitor and disk images. Change it between
+ runs only.
+-return The Machine, owned by the simulator.
+-parameter1: sim - The handle.
+*/
+struct Machine *sim_machine(Simulator *sim);
+
+/*
+-Functionality: Returns the address of the access that trapped the machine.
+-return The address, 0 if it did not trap.
+-parameter1: sim - The handle.
+*/
+uint32_t sim_fault_address(const Simulator *sim);
+
+/*
+-Functionality: Reads a register.
+-return SIM_OK, or SIM_ERROR_ARGUMENT if there is no such register.
+-parameter1: sim - The handle.
+-parameter2: reg_index - The register, 0 to NUM_REGISTERS - 1.
+-parameter3: value - Receives its value.
+*/
+SimStatus sim_get_register(const Simulator *sim, int reg_index, uint32_t *value);
+
+/*
+-Functionality: Writes a register, writes to $zero, $imm1 and $imm2 are dropped as on the machine.
+-return SIM_OK, or SIM_ERROR_ARGUMENT if there is no such register.
+-parameter1: sim - The handle.
+-parameter2: reg_index - The register, 0 to NUM_REGISTERS - 1.
+-parameter3: value - The value.
+*/
+SimStatus sim_set_register(Simulator *sim, int reg_index, uint32_t value);
+
+/*
+-Functionality: Reads an IO register.
+-return SIM_OK, or SIM_ERROR_ARGUMENT if there is no such register.
+-parameter1: sim - The handle.
+-parameter2: reg_index - The IO register, 0 to NUM_IO_REGISTERS - 1.
+-parameter3: value - Receives its value.
+*/
+SimStatus sim_get_io(const Simulator *sim, int reg_index, uint32_t *value);
+
+/*
+-Functionality: Reads data memory words, without triggering watchpoints.
+-return SIM_OK, or SIM_ERROR_ARGUMENT if the words are beyond the data depth.
+-parameter1: sim - The handle.
+-parameter2: address - First word.
+-parameter3: words - Receives the words.
+-parameter4: count - Number of words.
+*/
+SimStatus sim_read_data(const Simulator *sim, uint32_t address, uint32_t *words, uint32_t count);
+
+/*
+-Functionality: Writes data memory words, without triggering watchpoints. They are marked dirty.
+-return SIM_OK, or SIM_ERROR_ARGUMENT if the words are beyond the data depth.
+-parameter1: sim - The handle.
+-parameter2: address - First word.
+-parameter3: words - The words.
+-parameter4: count - Number of words.
+*/
+SimStatus sim_write_data(Simulator *sim, uint32_t address, const uint32_t *words, uint32_t count);
+
+/*
+-Functionality: Reads a disk sector.
+-return SIM_OK, or SIM_ERROR_ARGUMENT if there is no such sector.
+-parameter1: sim - The handle.
+-parameter2: sector - The sector.
+-parameter3: bytes - Receives its SECTOR_SIZE bytes.
+*/
+SimStatus sim_read_sector(const Simulator *sim, uint64_t sector, uint8_t *bytes);
+
+/*
+-Functionality: Names a status, for messages.
+-return A static string.
+-parameter1: status - The SimStatus.
+*/
+const char *sim_status_name(SimStatus status);
+
+#endif
@@ -0,0 +1,434 @@
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE // For memfd_create
+#endif
+#define _CRT_SECURE_NO_WARNINGS
+#include "snapshot.h"
+#include "image.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Copy-on-write forks through a sealed shared memory file on Linux
+#if defined(__linux__) && !defined(SIM_NO_COW)
+#define SIM_SNAPSHOT_COW
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+// Largest snapshot file without the IRQ2 events and the data memory words
+#define SNAPSHOT_DIRTY_WORDS ((DATA_BLOCKS + 63) / 64 + (DISK_SECTORS + 63) / 64)
+#define SNAPSHOT_FIXED_SIZE (8 + 12 + 4 * NUM_REGISTERS + 4 * NUM_IO_REGISTERS + 12 + 4 + 8 + 4 + DISK_SECTORS / 8 + DISK_SECTORS * SECTOR_SIZE + 8 * SNAPSHOT_DIRTY_WORDS)
+
+// Output position of a snapshot being written
+typedef struct {
+	uint8_t *next;
+} SnapshotWriter;
+
+// Input position of a snapshot being read
+typedef struct {
+	const uint8_t *next;
+	const uint8_t *end;
+	int ok;             // 0 once a read ran past the end
+} SnapshotReader;
+
+// Append little-endian fields
+static void put_u8(SnapshotWriter *writer, uint8_t value) {
+	*writer->next++ = value;
+}
+
+static void put_u16(SnapshotWriter *writer, uint16_t value) {
+	put_u8(writer, (uint8_t)value);
+	put_u8(writer, (uint8_t)(value >> 8));
+}
+
+static void put_u32(SnapshotWriter *writer, uint32_t value) {
+	put_u16(writer, (uint16_t)value);
+	put_u16(writer, (uint16_t)(value >> 16));
+}
+
+static void put_u64(SnapshotWriter *writer, uint64_t value) {
+	put_u32(writer, (uint32_t)value);
+	put_u32(writer, (uint32_t)(value >> 32));
+}
+
+// Read little-endian fields, zero past the end
+static const uint8_t *get_bytes(SnapshotReader *reader, size_t count) {
+	if (!reader->ok || (size_t)(reader->end - reader->next) < count) {
+		reader->ok = 0;
+		return NULL;
+	}
+	const uint8_t *bytes = reader->next;
+	reader->next += count;
+	return bytes;
+}
+
+static uint32_t get_u8(SnapshotReader *reader) {
+	const uint8_t *bytes = get_bytes(reader, 1);
+	return bytes ? bytes[0] : 0;
+}
+
+static uint32_t get_u16(SnapshotReader *reader) {
+	const uint8_t *bytes = get_bytes(reader, 2);
+	return bytes ? (uint32_t)bytes[0] | ((uint32_t)bytes[1] << 8) : 0;
+}
+
+static uint32_t get_u32(SnapshotReader *reader) {
+	uint32_t low = get_u16(reader);
+	return low | (get_u16(reader) << 16);
+}
+
+static uint64_t get_u64(SnapshotReader *reader) {
+	uint64_t low = get_u32(reader);
+	return low | ((uint64_t)get_u32(reader) << 32);
+}
+
+// Allocate the storage of a snapshot, writable until seal_storage
+static MachineStorage *allocate_storage(MachineSnapshot *snapshot) {
+	snapshot->fd = -1;
+	snapshot->size = sizeof(MachineStorage);
+
+#ifdef SIM_SNAPSHOT_COW
+	size_t page = (size_t)sysconf(_SC_PAGESIZE);
+	size_t size = (sizeof(MachineStorage) + page - 1) / page * page;
+	int fd = memfd_create("simp-snapshot", MFD_CLOEXEC);
+	if (fd >= 0 && ftruncate(fd, (off_t)size) == 0) {
+		void *view = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		if (view != MAP_FAILED) {
+			snapshot->fd = fd;
+			snapshot->size = size;
+			return view;
+		}
+	}
+	if (fd >= 0) {
+		close(fd);
+	}
+#endif
+
+	return malloc(sizeof(MachineStorage));
+}
+
+// Make the storage of a snapshot read-only
+static void seal_storage(MachineSnapshot *snapshot) {
+#ifdef SIM_SNAPSHOT_COW
+	if (snapshot->fd >= 0) {
+		mprotect((void *)snapshot->storage, snapshot->size, PROT_READ);
+	}
+#else
+	(void)snapshot;
+#endif
+}
+
+// Copy an IRQ2 event list
+static int *copy_events(const int *events, int count) {
+	int *copy = malloc((count > 0 ? (size_t)count : 1) * sizeof(int));
+	if (copy && count > 0) {
+		memcpy(copy, events, (size_t)count * sizeof(int));
+	}
+	return copy;
+}
+
+// Take a snapshot of a machine
+int take_snapshot(const Machine *machine, MachineSnapshot *snapshot) {
+	memset(snapshot, 0, sizeof(*snapshot));
+	if (machine->disk->image != NULL) {
+		printf("Error: Snapshots of a machine with a disk image are not supported\n");
+		return 0;
+	}
+	snapshot->registers = machine->registers;
+	init_io(&snapshot->io);
+	copy_io_registers(&snapshot->io, &machine->io);
+	snapshot->irq2_index = machine->irq2.current_index;
+	snapshot->irq2_count = machine->irq2.count;
+	snapshot->pc = machine->pc;
+	snapshot->in_isr = machine->in_isr;
+	snapshot->halted = machine->halted;
+	snapshot->cycles = machine->cycles;
+
+	snapshot->irq2_events = copy_events(machine->irq2.events, machine->irq2.count);
+	MachineStorage *storage = allocate_storage(snapshot);
+	if (!snapshot->irq2_events || !storage) {
+		printf("Error: Memory allocation failed while taking a snapshot\n");
+		snapshot->storage = storage;
+		free_snapshot(snapshot);
+		return 0;
+	}
+
+	memcpy(storage, machine->storage, sizeof(MachineStorage));
+	snapshot->storage = storage;
+	seal_storage(snapshot);
+	return 1;
+}
+
+// Restore a snapshot into a machine
+int restore_snapshot(Machine *machine, const MachineSnapshot *snapshot) {
+	int *events = copy_events(snapshot->irq2_events, snapshot->irq2_count);
+	if (!events) {
+		printf("Error: Memory allocation failed while restoring a snapshot\n");
+		return 0;
+	}
+
+	// The watchpoints belong to the machine, not to the copied storage
+	const uint64_t *watched = (machine->memory != NULL) ? machine->memory->watched : NULL;
+	struct Breakpoints *breakpoints = (machine->memory != NULL) ? machine->memory->breakpoints : NULL;
+
+#ifdef SIM_SNAPSHOT_COW
+	// A private mapping of the sealed file: pages are shared until this machine writes them
+	void *view = MAP_FAILED;
+	if (snapshot->fd >= 0) {
+		view = mmap(NULL, snapshot->size, PROT_READ | PROT_WRITE, MAP_PRIVATE, snapshot->fd, 0);
+	}
+	if (view != MAP_FAILED) {
+		set_machine_storage(machine, view, snapshot->size);
+	}
+	else
+#endif
+	{
+		if (machine->storage == NULL || machine->mapped_size > 0) {
+			MachineStorage *storage = malloc(sizeof(MachineStorage));
+			if (!storage) {
+				printf("Error: Memory allocation failed while restoring a snapshot\n");
+				free(events);
+				return 0;
+			}
+			set_machine_storage(machine, storage, 0);
+		}
+		else {
+			close_disk_image(machine->disk);
+		}
+		memcpy(machine->storage, snapshot->storage, sizeof(MachineStorage));
+	}
+
+	machine->memory->watched = watched;
+	machine->memory->breakpoints = breakpoints;
+	machine->registers = snapshot->registers;
+	copy_io_registers(&machine->io, &snapshot->io);
+
+	free_irq2_data(&machine->irq2);
+	machine->irq2.events = events;
+	machine->irq2.count = snapshot->irq2_count;
+	machine->irq2.capacity = snapshot->irq2_count;
+	machine->irq2.current_index = snapshot->irq2_index;
+
+	machine->pc = snapshot->pc;
+	machine->in_isr = snapshot->in_isr;
+	machine->halted = snapshot->halted;
+	machine->cycles = snapshot->cycles;
+	return 1;
+}
+
+// Release a snapshot
+void free_snapshot(MachineSnapshot *snapshot) {
+	if (snapshot->storage != NULL) {
+#ifdef SIM_SNAPSHOT_COW
+		if (snapshot->fd >= 0) {
+			munmap((void *)snapshot->storage, snapshot->size);
+			close(snapshot->fd);
+		}
+		else
+#endif
+		{
+			free((void *)snapshot->storage);
+		}
+	}
+	free(snapshot->irq2_events);
+	memset(snapshot, 0, sizeof(*snapshot));
+	snapshot->fd = -1;
+}
+
+// Encode a snapshot in the compact binary format
+uint8_t *encode_snapshot(const MachineSnapshot *snapshot, size_t *size) {
+	const Memory *memory = &snapshot->storage->memory;
+	const Disk *disk = &snapshot->storage->disk;
+	uint8_t bitmap[DISK_SECTORS / 8];
+	static const uint8_t zero_sector[SECTOR_SIZE];
+	int words = (int)memory->depth;
+
+	uint8_t *buffer = malloc(SNAPSHOT_FIXED_SIZE + 4 * (size_t)snapshot->irq2_count + 4 * (size_t)memory->depth);
+	if (!buffer) {
+		return NULL;
+	}
+	SnapshotWriter writer = { buffer };
+
+	memcpy(writer.next, SNAPSHOT_MAGIC, 4);
+	writer.next += 4;
+	put_u16(&writer, SNAPSHOT_VERSION);
+	put_u16(&writer, 0);
+
+	put_u64(&writer, snapshot->cycles);
+	put_u16(&writer, snapshot->pc);
+	put_u8(&writer, (uint8_t)snapshot->in_isr);
+	put_u8(&writer, (uint8_t)snapshot->halted);
+	for (int i = 0; i < NUM_REGISTERS; i++) {
+		put_u32(&writer, snapshot->registers.regs[i]);
+	}
+	for (int i = 0; i < NUM_IO_REGISTERS; i++) {
+		put_u32(&writer, snapshot->io.IORegister[i]);
+	}
+	put_u32(&writer, (uint32_t)io_pc_mask(&snapshot->io) + 1);
+	put_u32(&writer, memory->depth);
+	put_u32(&writer, (uint32_t)memory->policy);
+	put_u32(&writer, (uint32_t)disk->timer);
+
+	put_u32(&writer, (uint32_t)snapshot->irq2_index);
+	put_u32(&writer, (uint32_t)snapshot->irq2_count);
+	for (int i = 0; i < snapshot->irq2_count; i++) {
+		put_u32(&writer, (uint32_t)snapshot->irq2_events[i]);
+	}
+
+	while (words > 0 && memory->data[words - 1] == 0) {
+		words--;
+	}
+	put_u32(&writer, (uint32_t)words);
+	for (int i = 0; i < words; i++) {
+		put_u32(&writer, memory->data[i]);
+	}
+
+	memset(bitmap, 0, sizeof(bitmap));
+	for (int sector = 0; sector < DISK_SECTORS; sector++) {
+		if (memcmp(disk->data[sector], zero_sector, SECTOR_SIZE) != 0) {
+			bitmap[sector / 8] |= (uint8_t)(1u << (sector % 8));
+		}
+	}
+	memcpy(writer.next, bitmap, sizeof(bitmap));
+	writer.next += sizeof(bitmap);
+	for (int sector = 0; sector < DISK_SECTORS; sector++) {
+		if (bitmap[sector / 8] & (1u << (sector % 8))) {
+			memcpy(writer.next, disk->data[sector], SECTOR_SIZE);
+			writer.next += SECTOR_SIZE;
+		}
+	}
+
+	for (int i = 0; i < (DATA_BLOCKS + 63) / 64; i++) {
+		put_u64(&writer, memory->dirty[i]);
+	}
+	for (int i = 0; i < (DISK_SECTORS + 63) / 64; i++) {
+		put_u64(&writer, disk->dirty[i]);
+	}
+
+	*size = (size_t)(writer.next - buffer);
+	return buffer;
+}
+
+// Write a snapshot in the compact binary format
+int save_snapshot(const MachineSnapshot *snapshot, const char *filename) {
+	size_t size;
+	uint8_t *buffer = encode_snapshot(snapshot, &size);
+	if (!buffer) {
+		return 0;
+	}
+
+	FILE *file = fopen(filename, "wb");
+	int ok = file != NULL && fwrite(buffer, 1, size, file) == size;
+	if (file != NULL && fclose(file) != 0) {
+		ok = 0;
+	}
+	free(buffer);
+	return ok;
+}
+
+// Decode a snapshot encoded by encode_snapshot
+int decode_snapshot(const uint8_t *data, size_t size, const char *name, MachineSnapshot *snapshot) {
+	MachineStorage *storage;
+	MemoryGeometry geometry;
+
+	memset(snapshot, 0, sizeof(*snapshot));
+	snapshot->fd = -1;
+
+	SnapshotReader reader = { data, data + size, 1 };
+	const uint8_t *magic = get_bytes(&reader, 4);
+	if (!magic || memcmp(magic, SNAPSHOT_MAGIC, 4) != 0 || get_u16(&reader) != SNAPSHOT_VERSION) {
+		printf("Error: %s is not a version %d snapshot\n", name, SNAPSHOT_VERSION);
+		return 0;
+	}
+	get_u16(&reader); // Reserved
+
+	snapshot->cycles = get_u64(&reader);
+	snapshot->pc = (uint16_t)get_u16(&reader);
+	snapshot->in_isr = (int)get_u8(&reader);
+	snapshot->halted = (int)get_u8(&reader);
+	init_registers(&snapshot->registers);
+	for (int i = 0; i < NUM_REGISTERS; i++) {
+		snapshot->registers.regs[i] = get_u32(&reader);
+	}
+	init_io(&snapshot->io);
+	for (int i = 0; i < NUM_IO_REGISTERS; i++) {
+		snapshot->io.IORegister[i] = get_u32(&reader);
+	}
+	geometry.instruction_depth = get_u32(&reader);
+	geometry.data_depth = get_u32(&reader);
+	geometry.policy = (MemoryPolicy)get_u32(&reader);
+	int timer = (int)get_u32(&reader);
+
+	snapshot->irq2_index = (int)get_u32(&reader);
+	uint32_t count = get_u32(&reader);
+	const uint8_t *events = get_bytes(&reader, 4 * (size_t)count);
+	if (!reader.ok || count > (uint32_t)(size / 4) || (uint32_t)snapshot->irq2_index > count ||
+		!check_memory_geometry(&geometry) || geometry.policy > MEMORY_TRAP || snapshot->pc >= geometry.instruction_depth) {
+		printf("Error: Invalid snapshot file: %s\n", name);
+		return 0;
+	}
+	set_io_geometry(&snapshot->io, &geometry);
+
+	snapshot->irq2_count = (int)count;
+	snapshot->irq2_events = malloc((count > 0 ? count : 1) * sizeof(int));
+	storage = allocate_storage(snapshot);
+	snapshot->storage = storage;
+	if (!snapshot->irq2_events || !storage) {
+		printf("Error: Memory allocation failed while loading a snapshot\n");
+		free_snapshot(snapshot);
+		return 0;
+	}
+	for (uint32_t i = 0; i < count; i++) {
+		const uint8_t *b = events + 4 * i;
+		snapshot->irq2_events[i] = (int)((uint32_t)b[0] | ((uint32_t)b[1] << 8) | ((uint32_t)b[2] << 16) | ((uint32_t)b[3] << 24));
+	}
+
+	memset(storage, 0, sizeof(MachineStorage));
+	set_memory_geometry(&storage->memory, &geometry);
+	storage->disk.timer = timer;
+	uint32_t words = get_u32(&reader);
+	if (words > geometry.data_depth) {
+		reader.ok = 0;
+	}
+	for (uint32_t i = 0; i < words && reader.ok; i++) {
+		storage->memory.data[i] = get_u32(&reader);
+	}
+	const uint8_t *bitmap = get_bytes(&reader, DISK_SECTORS / 8);
+	for (int sector = 0; sector < DISK_SECTORS && reader.ok; sector++) {
+		if (bitmap[sector / 8] & (1u << (sector % 8))) {
+			const uint8_t *bytes = get_bytes(&reader, SECTOR_SIZE);
+			if (bytes) {
+				memcpy(storage->disk.data[sector], bytes, SECTOR_SIZE);
+			}
+		}
+	}
+	for (int i = 0; i < (DATA_BLOCKS + 63) / 64; i++) {
+		storage->memory.dirty[i] = get_u64(&reader);
+	}
+	for (int i = 0; i < (DISK_SECTORS + 63) / 64; i++) {
+		storage->disk.dirty[i] = get_u64(&reader);
+	}
+
+	if (!reader.ok) {
+		printf("Error: Truncated snapshot file: %s\n", name);
+		free_snapshot(snapshot);
+		return 0;
+	}
+	seal_storage(snapshot);
+	return 1;
+}
+
+// Read a snapshot written by save_snapshot
+int load_snapshot(const char *filename, MachineSnapshot *snapshot) {
+	MappedFile file;
+
+	if (!map_file(filename, &file)) {
+		memset(snapshot, 0, sizeof(*snapshot));
+		snapshot->fd = -1;
+		printf("Error: Could not open snapshot file: %s\n", filename);
+		return 0;
+	}
+	int ok = decode_snapshot(file.data, file.size, filename, snapshot);
+	unmap_file(&file);
+	return ok;
+}
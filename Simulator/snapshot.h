@@ -0,0 +1,105 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "machine.h"
+
+/*
+ Snapshot file format (version 3), all fields little-endian:
+ -"SIMS", u16 version, u16 reserved
+ -u64 cycles, u16 pc, u8 in_isr, u8 halted
+ -u32 registers[NUM_REGISTERS], u32 io[NUM_IO_REGISTERS]
+ -u32 instruction depth, u32 data depth, u32 MemoryPolicy
+ -i32 disk timer
+ -u32 irq2 current_index, u32 irq2 count, i32 events[count]
+ -u32 word count n, u32 data memory[n] (trailing zero words are left out)
+ -u8 sector bitmap[DISK_SECTORS / 8], then the SECTOR_SIZE bytes of every sector with its bit set
+   (all-zero sectors are left out)
+ -u64 dirty data blocks[(DATA_BLOCKS + 63) / 64], u64 dirty sectors[(DISK_SECTORS + 63) / 64], the
+   Memory and Disk dirty bitmaps, so a restored machine writes the same delta outputs
+*/
+#define SNAPSHOT_MAGIC "SIMS"
+#define SNAPSHOT_VERSION 3
+
+// A frozen copy of a whole machine. On Linux the data memory and disk live in a sealed shared
+// memory file, so every machine restored from it maps them copy-on-write: a page is only copied
+// when that machine writes to it.
+typedef struct {
+	Registers registers;
+	IORegisters io;          // No trace or device attached
+	int irq2_index;
+	int irq2_count;
+	int *irq2_events;
+	uint16_t pc;
+	int in_isr;
+	int halted;
+	uint64_t cycles;
+
+	const MachineStorage *storage; // Read-only
+	size_t size;             // Size of the storage mapping
+	int fd;                  // Shared memory file, -1 when storage is a heap copy
+} MachineSnapshot;
+
+
+// Function declaration
+
+/*
+-Functionality: Takes a snapshot of a machine between two cycles. Only the built-in disk is supported.
+-return 1 on success, 0 if memory could not be allocated or the disk has an image attached.
+-parameter1: machine - Pointer to the Machine structure.
+-parameter2: snapshot - Pointer to the MachineSnapshot structure to fill.
+*/
+int take_snapshot(const Machine *machine, MachineSnapshot *snapshot);
+
+/*
+-Functionality: Restores a snapshot into a machine (initialized with init_machine). Any number of
+ machines may be forked from one snapshot; on Linux their data memory and disk start as
+ copy-on-write views of it, elsewhere they are copied. The trace, devices and watchpoints of the machine are kept.
+-return 1 on success, 0 if memory could not be allocated.
+-parameter1: machine - Pointer to the Machine structure.
+-parameter2: snapshot - Pointer to the MachineSnapshot structure.
+*/
+int restore_snapshot(Machine *machine, const MachineSnapshot *snapshot);
+
+/*
+-Functionality: Releases a snapshot. Machines restored from it stay valid.
+-parameter1: snapshot - Pointer to the MachineSnapshot structure.
+*/
+void free_snapshot(MachineSnapshot *snapshot);
+
+/*
+-Functionality: Encodes a snapshot in the compact binary format.
+-return A buffer to release with free, NULL if memory could not be allocated.
+-parameter1: snapshot - Pointer to the MachineSnapshot structure.
+-parameter2: size - Receives the size of the encoded snapshot.
+*/
+uint8_t *encode_snapshot(const MachineSnapshot *snapshot, size_t *size);
+
+/*
+-Functionality: Writes a snapshot in the compact binary format.
+-return 1 on success, 0 if the file could not be written.
+-parameter1: snapshot - Pointer to the MachineSnapshot structure.
+-parameter2: filename - Name of the output file.
+*/
+int save_snapshot(const MachineSnapshot *snapshot, const char *filename);
+
+/*
+-Functionality: Decodes a snapshot encoded by encode_snapshot, e.g. one embedded in another file.
+-return 1 on success, 0 if the data is not a valid snapshot.
+-parameter1: data - The encoded snapshot.
+-parameter2: size - Its size in bytes.
+-parameter3: name - Name of the snapshot in the error messages.
+-parameter4: snapshot - Pointer to the MachineSnapshot structure to fill.
+*/
+int decode_snapshot(const uint8_t *data, size_t size, const char *name, MachineSnapshot *snapshot);
+
+/*
+-Functionality: Reads a snapshot written by save_snapshot.
+-return 1 on success, 0 if the file could not be read or is not a valid snapshot.
+-parameter1: filename - Name of the input file.
+-parameter2: snapshot - Pointer to the MachineSnapshot structure to fill.
+*/
+int load_snapshot(const char *filename, MachineSnapshot *snapshot);
+
+#endif
@@ -0,0 +1,139 @@
+#define _CRT_SECURE_NO_WARNINGS
+#include "threads.h"
+
+#ifdef _WIN32
+#include <process.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+
+// Run the entry point of a thread
+static unsigned __stdcall thread_trampoline(void *argument) {
+	Thread *thread = argument;
+	thread->function(thread->argument);
+	return 0;
+}
+
+// Start a thread
+int thread_start(Thread *thread, ThreadFunction function, void *argument) {
+	thread->function = function;
+	thread->argument = argument;
+	thread->handle = (HANDLE)_beginthreadex(NULL, 0, thread_trampoline, thread, 0, NULL);
+	return thread->handle != NULL;
+}
+
+// Wait for a thread to finish
+void thread_join(Thread *thread) {
+	WaitForSingleObject(thread->handle, INFINITE);
+	CloseHandle(thread->handle);
+}
+
+// Give up the time slice
+void thread_yield(void) {
+	SwitchToThread();
+}
+
+// Sleep briefly
+void thread_nap(void) {
+	Sleep(1);
+}
+
+// Monotonic wall clock
+double monotonic_time_ms(void) {
+	LARGE_INTEGER counter, frequency;
+	QueryPerformanceCounter(&counter);
+	QueryPerformanceFrequency(&frequency);
+	return (double)counter.QuadPart * 1000.0 / (double)frequency.QuadPart;
+}
+
+// Number of online processors
+int cpu_count(void) {
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return (info.dwNumberOfProcessors > 0) ? (int)info.dwNumberOfProcessors : 1;
+}
+
+// Peak working set of the process
+long peak_resident_kb(void) {
+	PROCESS_MEMORY_COUNTERS counters;
+	if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+		return 0;
+	}
+	return (long)(counters.PeakWorkingSetSize / 1024);
+}
+
+void mutex_init(Mutex *mutex) { InitializeCriticalSection(&mutex->lock); }
+void mutex_lock(Mutex *mutex) { EnterCriticalSection(&mutex->lock); }
+void mutex_unlock(Mutex *mutex) { LeaveCriticalSection(&mutex->lock); }
+void mutex_destroy(Mutex *mutex) { DeleteCriticalSection(&mutex->lock); }
+
+#else
+
+// Run the entry point of a thread
+static void *thread_trampoline(void *argument) {
+	Thread *thread = argument;
+	thread->function(thread->argument);
+	return NULL;
+}
+
+// Start a thread
+int thread_start(Thread *thread, ThreadFunction function, void *argument) {
+	thread->function = function;
+	thread->argument = argument;
+	return pthread_create(&thread->handle, NULL, thread_trampoline, thread) == 0;
+}
+
+// Wait for a thread to finish
+void thread_join(Thread *thread) {
+	pthread_join(thread->handle, NULL);
+}
+
+// Give up the time slice
+void thread_yield(void) {
+	sched_yield();
+}
+
+// Sleep briefly
+void thread_nap(void) {
+	struct timespec delay = { 0, 200000 }; // 0.2 ms
+	nanosleep(&delay, NULL);
+}
+
+// Monotonic wall clock
+double monotonic_time_ms(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (double)now.tv_sec * 1000.0 + (double)now.tv_nsec / 1e6;
+}
+
+// Number of online processors
+int cpu_count(void) {
+	long count = sysconf(_SC_NPROCESSORS_ONLN);
+	return (count > 0) ? (int)count : 1;
+}
+
+// Peak resident set size of the process, ru_maxrss is in kilobytes on Linux
+long peak_resident_kb(void) {
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) != 0) {
+		return 0;
+	}
+#ifdef __APPLE__
+	return usage.ru_maxrss / 1024; // Bytes on macOS
+#else
+	return usage.ru_maxrss;
+#endif
+}
+
+void mutex_init(Mutex *mutex) { pthread_mutex_init(&mutex->lock, NULL); }
+void mutex_lock(Mutex *mutex) { pthread_mutex_lock(&mutex->lock); }
+void mutex_unlock(Mutex *mutex) { pthread_mutex_unlock(&mutex->lock); }
+void mutex_destroy(Mutex *mutex) { pthread_mutex_destroy(&mutex->lock); }
+
+#endif
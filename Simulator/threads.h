@@ -0,0 +1,110 @@
+#ifndef THREADS_H
+#define THREADS_H
+
+#include <stdint.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
+// Words shared between threads: 32-bit counters and indices with acquire/release ordering, int
+// flags, and 64-bit masks that only collect bits (relaxed loads and or)
+#if defined(_MSC_VER)
+#include <intrin.h>
+// MSVC volatile accesses have acquire/release semantics (/volatile:ms)
+#define LOAD_ACQUIRE(p) (*(volatile uint32_t *)(p))
+#define STORE_RELEASE(p, v) (*(volatile uint32_t *)(p) = (v))
+#define LOAD_FLAG(p) (*(volatile int *)(p))
+#define STORE_FLAG(p, v) (*(volatile int *)(p) = (v))
+#define LOAD_MASK(p) (*(volatile uint64_t *)(p))
+#define OR_MASK(p, v) _InterlockedOr64((volatile __int64 *)(p), (__int64)(v))
+#else
+#define LOAD_ACQUIRE(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define STORE_RELEASE(p, v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#define LOAD_FLAG(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define STORE_FLAG(p, v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#define LOAD_MASK(p) __atomic_load_n((p), __ATOMIC_RELAXED)
+#define OR_MASK(p, v) __atomic_fetch_or((p), (v), __ATOMIC_RELAXED)
+#endif
+
+// Entry point of a thread
+typedef void (*ThreadFunction)(void *argument);
+
+// A joinable thread
+typedef struct {
+#ifdef _WIN32
+	HANDLE handle;
+#else
+	pthread_t handle;
+#endif
+	ThreadFunction function;
+	void *argument;
+} Thread;
+
+// A mutual exclusion lock
+typedef struct {
+#ifdef _WIN32
+	CRITICAL_SECTION lock;
+#else
+	pthread_mutex_t lock;
+#endif
+} Mutex;
+
+
+// Function declaration
+
+/*
+-Functionality: Starts a thread. The Thread structure must stay valid until thread_join.
+-return 1 on success, 0 if the thread could not be created.
+-parameter1: thread - Pointer to the Thread structure.
+-parameter2: function - The thread entry point.
+-parameter3: argument - Argument passed to the entry point.
+*/
+int thread_start(Thread *thread, ThreadFunction function, void *argument);
+
+/*
+-Functionality: Waits for a thread started with thread_start to finish.
+-parameter1: thread - Pointer to the Thread structure.
+*/
+void thread_join(Thread *thread);
+
+/*
+-Functionality: Gives up the rest of the time slice of the calling thread.
+*/
+void thread_yield(void);
+
+/*
+-Functionality: Sleeps for a short while (a fraction of a millisecond where the host allows it).
+*/
+void thread_nap(void);
+
+/*
+-Functionality: Returns a monotonic wall clock reading.
+-return Milliseconds since an arbitrary fixed point.
+*/
+double monotonic_time_ms(void);
+
+/*
+-Functionality: Returns the number of online processors.
+-return The processor count, at least 1.
+*/
+int cpu_count(void);
+
+/*
+-Functionality: Returns the peak resident memory of the process so far.
+-return The peak resident set (working set on Windows) in kilobytes, 0 if the host does not report it.
+*/
+long peak_resident_kb(void);
+
+/*
+-Functionality: Initializes, locks, unlocks and destroys a mutex.
+-parameter1: mutex - Pointer to the Mutex structure.
+*/
+void mutex_init(Mutex *mutex);
+void mutex_lock(Mutex *mutex);
+void mutex_unlock(Mutex *mutex);
+void mutex_destroy(Mutex *mutex);
+
+#endif
@@ -0,0 +1,351 @@
+#define _CRT_SECURE_NO_WARNINGS
+#include "timeline.h"
+#include "snapshot.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// What an undo entry restores, its index in the low 28 bits of the key
+typedef enum {
+	UNDO_FRAME = 0,      // First entry of a cycle
+	UNDO_REGISTER = 1,
+	UNDO_IO = 2,
+	UNDO_MEMORY = 3,     // Data memory address
+	UNDO_SECTOR = 4,     // Sector * SECTOR_WORDS + word of the built-in disk
+	UNDO_PC = 5,
+	UNDO_ISR = 6,
+	UNDO_HALTED = 7,
+	UNDO_FAULTED = 8,
+	UNDO_DISK_TIMER = 9,
+	UNDO_IRQ2 = 10
+} UndoKind;
+
+#define UNDO_KEY(kind, index) (((uint32_t)(kind) << 28) | (uint32_t)(index))
+#define UNDO_KIND(key) ((key) >> 28)
+#define UNDO_INDEX(key) ((key) & 0x0fffffffu)
+
+// Smallest undo log, room for a few cycles with a sector transfer each
+#define UNDO_MIN_ENTRIES 4096
+
+// Allocate an empty timeline
+int init_timeline(Timeline *timeline, size_t budget, size_t undo_entries) {
+	memset(timeline, 0, sizeof(*timeline));
+	timeline->spacing = TIMELINE_MIN_SPACING;
+	timeline->budget = (budget != 0) ? budget : TIMELINE_DEFAULT_BUDGET;
+	timeline->undo_capacity = (undo_entries != 0) ? undo_entries : TIMELINE_DEFAULT_UNDO;
+	if (timeline->undo_capacity < UNDO_MIN_ENTRIES) {
+		timeline->undo_capacity = UNDO_MIN_ENTRIES;
+	}
+
+	timeline->undo = malloc(timeline->undo_capacity * sizeof(UndoEntry));
+	if (!timeline->undo) {
+		printf("Error: Memory allocation failed for the undo log\n");
+		return 0;
+	}
+	return 1;
+}
+
+// Release a timeline
+void free_timeline(Timeline *timeline) {
+	for (int i = 0; i < timeline->count; i++) {
+		free(timeline->checkpoints[i].data);
+	}
+	free(timeline->checkpoints);
+	free(timeline->undo);
+	memset(timeline, 0, sizeof(*timeline));
+}
+
+// Drop the oldest cycle of the undo log
+static void drop_oldest_frame(Timeline *timeline) {
+	do {
+		timeline->undo_tail = (timeline->undo_tail + 1) % timeline->undo_capacity;
+		timeline->undo_used--;
+	} while (timeline->undo_used > 0 && UNDO_KIND(timeline->undo[timeline->undo_tail].key) != UNDO_FRAME);
+	timeline->frames--;
+}
+
+// Append an entry, making room by dropping the oldest cycles
+static void push_undo(Timeline *timeline, uint32_t key, uint32_t old) {
+	if (timeline->undo_used == timeline->undo_capacity) {
+		drop_oldest_frame(timeline);
+	}
+	UndoEntry *entry = &timeline->undo[(timeline->undo_tail + timeline->undo_used) % timeline->undo_capacity];
+	entry->key = key;
+	entry->old = old;
+	timeline->undo_used++;
+}
+
+// Log what the open cycle changed
+static void close_frame(Timeline *timeline, const Machine *machine) {
+	if (!timeline->open) {
+		return;
+	}
+	timeline->open = 0;
+
+	for (int i = 0; i < NUM_REGISTERS; i++) {
+		if (machine->registers.regs[i] != timeline->regs[i]) {
+			push_undo(timeline, UNDO_KEY(UNDO_REGISTER, i), timeline->regs[i]);
+		}
+	}
+	for (int i = 0; i < NUM_IO_REGISTERS; i++) {
+		if (machine->io.IORegister[i] != timeline->io[i]) {
+			push_undo(timeline, UNDO_KEY(UNDO_IO, i), timeline->io[i]);
+		}
+	}
+	if (machine->pc != timeline->pc) {
+		push_undo(timeline, UNDO_KEY(UNDO_PC, 0), timeline->pc);
+	}
+	if (machine->in_isr != timeline->in_isr) {
+		push_undo(timeline, UNDO_KEY(UNDO_ISR, 0), (uint32_t)timeline->in_isr);
+	}
+	if (machine->halted != timeline->halted) {
+		push_undo(timeline, UNDO_KEY(UNDO_HALTED, 0), (uint32_t)timeline->halted);
+	}
+	if (machine->memory->faulted != timeline->faulted) {
+		push_undo(timeline, UNDO_KEY(UNDO_FAULTED, 0), (uint32_t)timeline->faulted);
+	}
+	if (machine->disk->timer != timeline->disk_timer) {
+		push_undo(timeline, UNDO_KEY(UNDO_DISK_TIMER, 0), (uint32_t)timeline->disk_timer);
+	}
+	if (machine->irq2.current_index != timeline->irq2_index) {
+		push_undo(timeline, UNDO_KEY(UNDO_IRQ2, 0), (uint32_t)timeline->irq2_index);
+	}
+}
+
+// Log the previous cycle and open the next one
+void timeline_cycle(Timeline *timeline, const Machine *machine) {
+	const IORegisters *io = &machine->io;
+	const Memory *memory = machine->memory;
+
+	close_frame(timeline, machine);
+	push_undo(timeline, UNDO_KEY(UNDO_FRAME, 0), 0);
+	timeline->frames++;
+	timeline->open = 1;
+	memcpy(timeline->regs, machine->registers.regs, sizeof(timeline->regs));
+	memcpy(timeline->io, io->IORegister, sizeof(timeline->io));
+	timeline->pc = machine->pc;
+	timeline->in_isr = machine->in_isr;
+	timeline->halted = machine->halted;
+	timeline->faulted = memory->faulted;
+	timeline->disk_timer = machine->disk->timer;
+	timeline->irq2_index = machine->irq2.current_index;
+
+	// A disk command starting this cycle transfers a sector: keep what it overwrites
+	uint32_t command = io->IORegister[14];
+	if (io->IORegister[17] == 1 || (command != 1 && command != 2)) {
+		return;
+	}
+	uint64_t sector = ((uint64_t)io->IORegister[DISK_SECTOR_HIGH_REGISTER] << DISK_SECTOR_LOW_BITS) | io->IORegister[15];
+	if (sector >= DISK_SECTORS) {
+		return;
+	}
+	if (command == 2) {
+		for (int word = 0; word < SECTOR_WORDS; word++) {
+			uint32_t old;
+			memcpy(&old, machine->disk->data[sector] + word * 4, 4);
+			push_undo(timeline, UNDO_KEY(UNDO_SECTOR, sector * SECTOR_WORDS + word), old);
+		}
+		return;
+	}
+	int64_t buffer = (int32_t)io->IORegister[16];
+	for (int64_t address = buffer; address < buffer + SECTOR_WORDS; address++) {
+		if (address >= 0 && address < (int64_t)memory->depth) {
+			push_undo(timeline, UNDO_KEY(UNDO_MEMORY, address), memory->data[address]);
+		}
+	}
+}
+
+// Log the data memory word a sw overwrites
+void timeline_instruction(Timeline *timeline, const Machine *machine, const Instruction *decoded) {
+	const Memory *memory = machine->memory;
+
+	if (decoded->opcode != 17) {
+		return;
+	}
+	uint32_t address = machine->registers.regs[decoded->rs] + machine->registers.regs[decoded->rt];
+	if (address > memory->mask) {
+		if (memory->policy != MEMORY_WRAP) {
+			return; // Dropped or trapped, the memory is not written
+		}
+		address &= memory->mask;
+	}
+	push_undo(timeline, UNDO_KEY(UNDO_MEMORY, address), memory->data[address]);
+}
+
+// Undo the last cycle of the log
+static void undo_frame(Timeline *timeline, Machine *machine) {
+	for (;;) {
+		timeline->undo_used--;
+		const UndoEntry *entry = &timeline->undo[(timeline->undo_tail + timeline->undo_used) % timeline->undo_capacity];
+		uint32_t index = UNDO_INDEX(entry->key);
+
+		switch (UNDO_KIND(entry->key)) {
+		case UNDO_FRAME:
+			timeline->frames--;
+			machine->cycles--;
+			return;
+		case UNDO_REGISTER:
+			machine->registers.regs[index] = entry->old;
+			break;
+		case UNDO_IO:
+			machine->io.IORegister[index] = entry->old;
+			refresh_io_devices(&machine->io);
+			break;
+		case UNDO_MEMORY:
+			machine->memory->data[index] = entry->old;
+			break;
+		case UNDO_SECTOR:
+			memcpy(machine->disk->data[index / SECTOR_WORDS] + (index % SECTOR_WORDS) * 4, &entry->old, 4);
+			break;
+		case UNDO_PC:
+			machine->pc = (uint16_t)entry->old;
+			break;
+		case UNDO_ISR:
+			machine->in_isr = (int)entry->old;
+			break;
+		case UNDO_HALTED:
+			machine->halted = (int)entry->old;
+			break;
+		case UNDO_FAULTED:
+			machine->memory->faulted = (int)entry->old;
+			break;
+		case UNDO_DISK_TIMER:
+			machine->disk->timer = (int)entry->old;
+			break;
+		case UNDO_IRQ2:
+			machine->irq2.current_index = (int)entry->old;
+			break;
+		}
+	}
+}
+
+// Keep every other checkpoint and double the spacing until they fit the budget
+static void thin_checkpoints(Timeline *timeline) {
+	while (timeline->bytes > timeline->budget && timeline->count > 2) {
+		uint64_t spacing = timeline->spacing * 2;
+		int kept = 1;
+
+		for (int i = 1; i < timeline->count; i++) {
+			Checkpoint *checkpoint = &timeline->checkpoints[i];
+			if (checkpoint->cycle % spacing == 0) {
+				timeline->checkpoints[kept++] = *checkpoint;
+			}
+			else {
+				timeline->bytes -= checkpoint->size;
+				free(checkpoint->data);
+			}
+		}
+		timeline->count = kept;
+		timeline->spacing = spacing;
+	}
+}
+
+// Take a checkpoint of a machine, after the last one
+static int add_checkpoint(Timeline *timeline, const Machine *machine) {
+	MachineSnapshot snapshot;
+	size_t size;
+
+	if (timeline->count == timeline->capacity) {
+		int capacity = (timeline->capacity == 0) ? 64 : timeline->capacity * 2;
+		Checkpoint *checkpoints = realloc(timeline->checkpoints, capacity * sizeof(Checkpoint));
+		if (!checkpoints) {
+			printf("Error: Memory allocation failed for a checkpoint\n");
+			return 0;
+		}
+		timeline->checkpoints = checkpoints;
+		timeline->capacity = capacity;
+	}
+
+	if (!take_snapshot(machine, &snapshot)) {
+		return 0;
+	}
+	uint8_t *encoded = encode_snapshot(&snapshot, &size);
+	free_snapshot(&snapshot);
+	if (!encoded) {
+		return 0;
+	}
+
+	Checkpoint *checkpoint = &timeline->checkpoints[timeline->count++];
+	checkpoint->cycle = machine->cycles;
+	checkpoint->data = encoded;
+	checkpoint->size = size;
+	timeline->bytes += size;
+	thin_checkpoints(timeline);
+	return 1;
+}
+
+// Run forward, taking the checkpoints that fall due
+uint64_t timeline_run(Timeline *timeline, Machine *machine, const ProgramImage *image, const DecodedProgram *program,
+	uint64_t cycles) {
+	uint64_t start = machine->cycles;
+	uint64_t end = (cycles > UINT64_MAX - start) ? UINT64_MAX : start + cycles;
+
+	machine->timeline = timeline;
+	while (!machine->halted && machine->cycles < end) {
+		uint64_t last = (timeline->count > 0) ? timeline->checkpoints[timeline->count - 1].cycle : 0;
+		if (timeline->count == 0 || (machine->cycles > last && machine->cycles % timeline->spacing == 0)) {
+			if (!add_checkpoint(timeline, machine)) {
+				break;
+			}
+		}
+
+		uint64_t next = machine->cycles - machine->cycles % timeline->spacing + timeline->spacing;
+		uint64_t chunk = ((next < end) ? next : end) - machine->cycles;
+
+		// A breakpoint ends the run early
+		if (run_machine(machine, image, program, chunk) < chunk && !machine->halted) {
+			break;
+		}
+	}
+	machine->timeline = NULL;
+	return machine->cycles - start;
+}
+
+// Restore a checkpoint, the undo log starts over from it
+static int restore_checkpoint(Timeline *timeline, Machine *machine, const Checkpoint *checkpoint) {
+	MachineSnapshot snapshot;
+
+	if (!decode_snapshot(checkpoint->data, checkpoint->size, "checkpoint", &snapshot)) {
+		return 0;
+	}
+	int ok = restore_snapshot(machine, &snapshot);
+	free_snapshot(&snapshot);
+
+	timeline->undo_tail = 0;
+	timeline->undo_used = 0;
+	timeline->frames = 0;
+	timeline->open = 0;
+	return ok;
+}
+
+// Move to a cycle
+int timeline_seek(Timeline *timeline, Machine *machine, const ProgramImage *image, const DecodedProgram *program,
+	uint64_t cycle) {
+	// Back through the undo log when it reaches the cycle
+	if (cycle < machine->cycles) {
+		close_frame(timeline, machine);
+		if (machine->cycles - cycle <= timeline->frames) {
+			while (machine->cycles > cycle) {
+				undo_frame(timeline, machine);
+			}
+			return 1;
+		}
+	}
+
+	// Otherwise from the last checkpoint before it, unless the machine is already past that one
+	int index = timeline->count - 1;
+	while (index >= 0 && timeline->checkpoints[index].cycle > cycle) {
+		index--;
+	}
+	if (cycle < machine->cycles && index < 0) {
+		printf("Error: Cycle %llu precedes the first checkpoint\n", (unsigned long long)cycle);
+		return 0;
+	}
+	if ((cycle < machine->cycles || (index >= 0 && timeline->checkpoints[index].cycle > machine->cycles)) &&
+		!restore_checkpoint(timeline, machine, &timeline->checkpoints[index])) {
+		return 0;
+	}
+
+	timeline_run(timeline, machine, image, program, cycle - machine->cycles);
+	return machine->cycles == cycle;
+}
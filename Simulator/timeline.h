@@ -0,0 +1,133 @@
+#ifndef TIMELINE_H
+#define TIMELINE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "machine.h"
+
+/*
+ Reverse execution of the reference loop.
+
+ A timeline keeps encoded snapshots of the machine (checkpoints) every spacing cycles, and an undo
+ log of the last cycles: the old value of every register, IO register, PC, ISR state, disk timer,
+ IRQ2 position, data memory word and disk sector word a cycle changed. Stepping back within the
+ undo log applies it in reverse; seeking further back restores the last checkpoint before the
+ target and runs forward to it (which refills the undo log up to the target).
+
+ The checkpoints share a memory budget. When they outgrow it every other one is dropped and the
+ spacing doubles, so memory stays bounded and a seek never runs more than spacing cycles forward:
+ the spacing is the smallest power-of-two multiple of TIMELINE_MIN_SPACING whose checkpoints fit.
+ Devices outside the Machine (the monitor, traces) are not rolled back. Only the built-in disk is
+ supported, like snapshots.
+*/
+
+// Initial cycles between two checkpoints
+#define TIMELINE_MIN_SPACING (1u << 16)
+
+// Defaults of init_timeline
+#define TIMELINE_DEFAULT_BUDGET ((size_t)64 << 20)   // Bytes of checkpoints
+#define TIMELINE_DEFAULT_UNDO ((size_t)1 << 20)      // Undo log entries
+
+// A checkpoint, an encoded snapshot (snapshot.h)
+typedef struct {
+	uint64_t cycle;
+	uint8_t *data;
+	size_t size;
+} Checkpoint;
+
+// One undo log entry: what was changed (kind << 28 | index) and its old value
+typedef struct {
+	uint32_t key;
+	uint32_t old;
+} UndoEntry;
+
+// Checkpoints and undo log of one machine
+typedef struct Timeline {
+	Checkpoint *checkpoints;   // By cycle
+	int count;
+	int capacity;
+	uint64_t spacing;
+	size_t bytes;              // Size of all the checkpoints
+	size_t budget;
+
+	UndoEntry *undo;           // Ring of entries, each cycle starts with a frame marker
+	size_t undo_capacity;
+	size_t undo_tail;          // Oldest entry
+	size_t undo_used;
+	uint64_t frames;           // Cycles the undo log can step back
+
+	// State at the start of the cycle being run, compared with the state at its end
+	int open;
+	uint32_t regs[NUM_REGISTERS];
+	uint32_t io[NUM_IO_REGISTERS];
+	uint16_t pc;
+	int in_isr;
+	int halted;
+	int faulted;
+	int disk_timer;
+	int irq2_index;
+} Timeline;
+
+
+// Function declarations
+
+/*
+-Functionality: Allocates an empty timeline.
+-return 1 on success, 0 if memory could not be allocated.
+-parameter1: timeline - Pointer to the Timeline structure.
+-parameter2: budget - Bytes the checkpoints may use, 0 for TIMELINE_DEFAULT_BUDGET.
+-parameter3: undo_entries - Entries of the undo log, 0 for TIMELINE_DEFAULT_UNDO (a cycle takes a
+ few, a sector transfer SECTOR_WORDS more).
+*/
+int init_timeline(Timeline *timeline, size_t budget, size_t undo_entries);
+
+/*
+-Functionality: Releases a timeline.
+-parameter1: timeline - Pointer to the Timeline structure.
+*/
+void free_timeline(Timeline *timeline);
+
+/*
+-Functionality: Runs a machine forward on the reference loop, taking the checkpoints that fall due
+ and logging every cycle, until halt or a breakpoint of the machine. The idle fast-forward is off
+ while the timeline is attached.
+-return The number of cycles run.
+-parameter1: timeline - Pointer to the Timeline structure.
+-parameter2: machine - Pointer to the Machine structure, the same one on every call.
+-parameter3: image - Pointer to the ProgramImage, for the trace.
+-parameter4: program - Pointer to the DecodedProgram.
+-parameter5: cycles - Largest number of cycles to run, UINT64_MAX to run until halt.
+*/
+uint64_t timeline_run(Timeline *timeline, Machine *machine, const ProgramImage *image, const DecodedProgram *program,
+	uint64_t cycles);
+
+/*
+-Functionality: Moves a machine to a cycle: back through the undo log, or from the last checkpoint
+ before it, or forward. Detach the breakpoints of the machine first, or they may stop it short.
+-return 1 if the machine reached the cycle, 0 if it halted first or the cycle precedes the first checkpoint.
+-parameter1: timeline - Pointer to the Timeline structure.
+-parameter2: machine - Pointer to the Machine structure.
+-parameter3: image - Pointer to the ProgramImage.
+-parameter4: program - Pointer to the DecodedProgram.
+-parameter5: cycle - The cycle to move to, counted from power-on.
+*/
+int timeline_seek(Timeline *timeline, Machine *machine, const ProgramImage *image, const DecodedProgram *program,
+	uint64_t cycle);
+
+/*
+-Functionality: Called by run_machine at the start of every cycle: logs the previous cycle and
+ notes the state the new one starts from, including the memory a disk read is about to overwrite.
+-parameter1: timeline - Pointer to the Timeline structure.
+-parameter2: machine - Pointer to the Machine structure.
+*/
+void timeline_cycle(Timeline *timeline, const Machine *machine);
+
+/*
+-Functionality: Called by run_machine before an instruction executes: logs the word a sw overwrites.
+-parameter1: timeline - Pointer to the Timeline structure.
+-parameter2: machine - Pointer to the Machine structure.
+-parameter3: decoded - The instruction, with its immediates loaded.
+*/
+void timeline_instruction(Timeline *timeline, const Machine *machine, const Instruction *decoded);
+
+#endif
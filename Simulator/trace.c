@@ -0,0 +1,268 @@
+#define _CRT_SECURE_NO_WARNINGS
+#include "trace.h"
+#include "io.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Records formatted before the writer thread frees their slots
+#define TRACE_RELEASE_BATCH 256
+
+// Longest formatted line: the CPU record, 3 + 1 + 12 + 16 * 9 + 1 characters
+#define TRACE_MAX_LINE 192
+
+// Two upper-case hex digits for every byte value
+static char hex_pairs[256][2];
+
+// Fill the hex pair table
+static void init_hex_pairs(void) {
+	static const char digits[] = "0123456789ABCDEF";
+	for (int i = 0; i < 256; i++) {
+		hex_pairs[i][0] = digits[i >> 4];
+		hex_pairs[i][1] = digits[i & 0xF];
+	}
+}
+
+// Format a 32-bit value as 8 hex digits
+static char *put_hex32(char *out, uint32_t value) {
+	memcpy(out, hex_pairs[value >> 24], 2);
+	memcpy(out + 2, hex_pairs[(value >> 16) & 0xFF], 2);
+	memcpy(out + 4, hex_pairs[(value >> 8) & 0xFF], 2);
+	memcpy(out + 6, hex_pairs[value & 0xFF], 2);
+	return out + 8;
+}
+
+// Format an unsigned value in decimal
+static char *put_decimal(char *out, uint32_t value) {
+	char digits[10];
+	int count = 0;
+	do {
+		digits[count++] = (char)('0' + value % 10);
+		value /= 10;
+	} while (value != 0);
+	while (count > 0) {
+		*out++ = digits[--count];
+	}
+	return out;
+}
+
+// Write a file buffer out
+static void flush_buffer(Trace *trace, int file) {
+	if (trace->used[file] > 0) {
+		if (fwrite(trace->buffers[file], 1, trace->used[file], trace->files[file]) != trace->used[file]) {
+			trace->write_error = 1;
+		}
+		trace->used[file] = 0;
+	}
+}
+
+// Format one record into the buffer of its file
+static void format_record(Trace *trace, const TraceRecord *record) {
+	int file;
+	switch (record->kind) {
+	case TRACE_RECORD_CPU:      file = TRACE_FILE_CPU; break;
+	case TRACE_RECORD_LEDS:     file = TRACE_FILE_LEDS; break;
+	case TRACE_RECORD_DISPLAY:  file = TRACE_FILE_DISPLAY; break;
+	default:                    file = TRACE_FILE_HWREG; break;
+	}
+
+	if (trace->used[file] + TRACE_MAX_LINE > TRACE_BUFFER_SIZE) {
+		flush_buffer(trace, file);
+	}
+	char *out = trace->buffers[file] + trace->used[file];
+	char *start = out;
+
+	if (record->kind == TRACE_RECORD_CPU) {
+		// PC (3 digits, 4 beyond 4096 instructions) INST (12 digits) R0 .. R15
+		for (int shift = 4 * (trace->pc_digits - 1); shift >= 0; shift -= 4) {
+			*out++ = hex_pairs[(record->pc >> shift) & 0xF][1];
+		}
+		*out++ = ' ';
+		for (int i = 0; i < 6; i++) {
+			memcpy(out, hex_pairs[record->instruction[i]], 2);
+			out += 2;
+		}
+		for (int i = 0; i < NUM_REGISTERS; i++) {
+			*out++ = ' ';
+			out = put_hex32(out, record->regs[i]);
+		}
+	}
+	else if (record->kind == TRACE_RECORD_IO_READ || record->kind == TRACE_RECORD_IO_WRITE) {
+		// CYCLE READ/WRITE NAME DATA
+		const char *name = io_register_name(record->reg_index);
+		size_t length = strlen(name);
+		out = put_decimal(out, record->cycle);
+		if (record->kind == TRACE_RECORD_IO_READ) {
+			memcpy(out, " READ ", 6);
+			out += 6;
+		}
+		else {
+			memcpy(out, " WRITE ", 7);
+			out += 7;
+		}
+		memcpy(out, name, length);
+		out += length;
+		*out++ = ' ';
+		out = put_hex32(out, record->value);
+	}
+	else {
+		// CYCLE VALUE
+		out = put_decimal(out, record->cycle);
+		*out++ = ' ';
+		out = put_hex32(out, record->value);
+	}
+	*out++ = '\n';
+
+	trace->used[file] += (size_t)(out - start);
+}
+
+// Writer thread: drain the ring in bulk and write large blocks
+static void writer_thread(void *argument) {
+	Trace *trace = argument;
+	uint32_t tail = trace->tail;
+
+	while (1) {
+		uint32_t head = LOAD_ACQUIRE(&trace->head);
+		if (head == tail) {
+			if (LOAD_FLAG(&trace->stopping) && LOAD_ACQUIRE(&trace->head) == tail) {
+				break;
+			}
+			thread_nap();
+			continue;
+		}
+
+		while (tail != head) {
+			format_record(trace, &trace->records[tail & trace->mask]);
+			tail++;
+			if ((tail & (TRACE_RELEASE_BATCH - 1)) == 0) {
+				STORE_RELEASE(&trace->tail, tail);
+			}
+		}
+		STORE_RELEASE(&trace->tail, tail);
+	}
+
+	for (int file = 0; file < TRACE_NUM_FILES; file++) {
+		if (trace->enabled[file]) {
+			flush_buffer(trace, file);
+		}
+	}
+}
+
+// Open the trace files and start the writer thread
+int trace_open(Trace *trace, const char *const filenames[TRACE_NUM_FILES], uint32_t capacity, int pc_digits) {
+	memset(trace, 0, sizeof(*trace));
+	init_hex_pairs();
+	trace->pc_digits = pc_digits;
+
+	if (capacity == 0) {
+		capacity = TRACE_RING_CAPACITY;
+	}
+	uint32_t size = TRACE_RELEASE_BATCH;
+	while (size < capacity) {
+		size <<= 1;
+	}
+	trace->mask = size - 1;
+	trace->records = malloc((size_t)size * sizeof(TraceRecord));
+	if (!trace->records) {
+		printf("Error: Memory allocation failed for the trace buffer\n");
+		return 0;
+	}
+
+	for (int file = 0; file < TRACE_NUM_FILES; file++) {
+		if (filenames[file] == NULL) {
+			continue;
+		}
+		trace->files[file] = fopen(filenames[file], "w");
+		trace->buffers[file] = malloc(TRACE_BUFFER_SIZE);
+		if (!trace->files[file] || !trace->buffers[file]) {
+			printf("Error: Could not open trace file: %s\n", filenames[file]);
+			trace_close(trace);
+			return 0;
+		}
+		trace->enabled[file] = 1;
+	}
+
+	if (!thread_start(&trace->thread, writer_thread, trace)) {
+		printf("Error: Could not start the trace writer thread\n");
+		trace_close(trace);
+		return 0;
+	}
+	trace->started = 1;
+	return 1;
+}
+
+// Drain the ring, stop the writer thread and close the files
+int trace_close(Trace *trace) {
+	int ok;
+
+	if (trace->started) {
+		STORE_FLAG(&trace->stopping, 1);
+		thread_join(&trace->thread);
+	}
+
+	ok = !trace->write_error;
+	for (int file = 0; file < TRACE_NUM_FILES; file++) {
+		if (trace->files[file] != NULL && fclose(trace->files[file]) != 0) {
+			ok = 0;
+		}
+		free(trace->buffers[file]);
+	}
+	free(trace->records);
+	memset(trace, 0, sizeof(*trace));
+	return ok;
+}
+
+// Return a free record slot, applying backpressure while the ring is full
+TraceRecord *trace_reserve(Trace *trace) {
+	uint32_t capacity = trace->mask + 1;
+
+	while (trace->head - trace->cached_tail >= capacity) {
+		trace->cached_tail = LOAD_ACQUIRE(&trace->tail);
+		if (trace->head - trace->cached_tail >= capacity) {
+			thread_yield();
+		}
+	}
+	return &trace->records[trace->head & trace->mask];
+}
+
+// Publish the reserved record
+void trace_commit(Trace *trace) {
+	STORE_RELEASE(&trace->head, trace->head + 1);
+}
+
+// Record the CPU state of one cycle
+void trace_cpu(Trace *trace, uint16_t pc, const uint8_t *instruction, const uint32_t *regs) {
+	if (!trace->enabled[TRACE_FILE_CPU]) {
+		return;
+	}
+	TraceRecord *record = trace_reserve(trace);
+	record->kind = TRACE_RECORD_CPU;
+	record->pc = pc;
+	memcpy(record->instruction, instruction, sizeof(record->instruction));
+	memcpy(record->regs, regs, sizeof(record->regs));
+	trace_commit(trace);
+}
+
+// Record an in/out access and the leds/display7seg changes
+void trace_io_access(Trace *trace, int is_write, uint32_t cycle, int reg_index, uint32_t value, uint32_t previous) {
+	TraceRecord *record;
+
+	if (trace->enabled[TRACE_FILE_HWREG]) {
+		record = trace_reserve(trace);
+		record->kind = is_write ? TRACE_RECORD_IO_WRITE : TRACE_RECORD_IO_READ;
+		record->reg_index = (uint8_t)reg_index;
+		record->cycle = cycle;
+		record->value = value;
+		trace_commit(trace);
+	}
+
+	if (is_write && value != previous && (reg_index == 9 || reg_index == 10)) {
+		int file = (reg_index == 9) ? TRACE_FILE_LEDS : TRACE_FILE_DISPLAY;
+		if (trace->enabled[file]) {
+			record = trace_reserve(trace);
+			record->kind = (reg_index == 9) ? TRACE_RECORD_LEDS : TRACE_RECORD_DISPLAY;
+			record->cycle = cycle;
+			record->value = value;
+			trace_commit(trace);
+		}
+	}
+}
@@ -0,0 +1,124 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include "registers.h" // For NUM_REGISTERS
+#include "threads.h"   // For the writer thread
+
+// Default number of records in the ring buffer (a power of two)
+#define TRACE_RING_CAPACITY (1u << 16)
+
+// Size of the formatting buffer of each output file
+#define TRACE_BUFFER_SIZE (1u << 20)
+
+// Output files of the trace
+typedef enum {
+	TRACE_FILE_CPU,     // trace.txt: PC, instruction and registers of every cycle
+	TRACE_FILE_HWREG,   // hwregtrace.txt: in/out accesses to the IO registers
+	TRACE_FILE_LEDS,    // leds.txt: changes of the leds register
+	TRACE_FILE_DISPLAY, // display7seg.txt: changes of the display7seg register
+	TRACE_NUM_FILES
+} TraceFile;
+
+// Kinds of trace records
+typedef enum {
+	TRACE_RECORD_CPU,
+	TRACE_RECORD_IO_READ,
+	TRACE_RECORD_IO_WRITE,
+	TRACE_RECORD_LEDS,
+	TRACE_RECORD_DISPLAY
+} TraceRecordKind;
+
+// One fixed-size record, filled by the simulation thread and formatted by the writer thread
+typedef struct {
+	uint8_t kind;                  // TraceRecordKind
+	uint8_t reg_index;             // IO register (IO records)
+	uint16_t pc;                   // Program counter (CPU records)
+	uint32_t cycle;                // Clock cycle (IO, leds and display records)
+	uint32_t value;                // Value read or written (IO, leds and display records)
+	uint8_t instruction[6];        // Raw 48-bit instruction (CPU records)
+	uint8_t reserved[2];
+	uint32_t regs[NUM_REGISTERS];  // Registers before the instruction executes (CPU records)
+} TraceRecord;
+
+// Asynchronous trace: a single-producer/single-consumer ring drained by a writer thread
+typedef struct Trace {
+	TraceRecord *records;
+	uint32_t mask;                 // Capacity - 1
+
+	// Written by the simulation thread only
+	uint32_t head;                 // Next record to fill
+	uint32_t cached_tail;          // Last tail seen by the producer
+	char producer_pad[64];
+
+	// Written by the writer thread only
+	uint32_t tail;                 // Next record to format
+	char consumer_pad[64];
+
+	int stopping;                  // Set by trace_close
+	int enabled[TRACE_NUM_FILES];  // 1 for the files that are written
+	FILE *files[TRACE_NUM_FILES];
+	char *buffers[TRACE_NUM_FILES];
+	size_t used[TRACE_NUM_FILES];
+	int write_error;               // 1 if the writer thread failed to write a file
+	int started;                   // 1 once the writer thread runs
+	int pc_digits;                 // Hex digits of the PC in trace.txt
+	Thread thread;
+} Trace;
+
+
+// Function declaration
+
+/*
+-Functionality: Opens the trace files and starts the writer thread. A NULL filename disables that file.
+-return 1 on success, 0 if a file could not be opened or the thread could not be started.
+-parameter1: trace - Pointer to the Trace structure.
+-parameter2: filenames - TRACE_NUM_FILES output file names, indexed by TraceFile.
+-parameter3: capacity - Number of records in the ring, rounded up to a power of two (0 for TRACE_RING_CAPACITY).
+-parameter4: pc_digits - Hex digits of the PC in trace.txt, pc_hex_digits of the instruction depth.
+*/
+int trace_open(Trace *trace, const char *const filenames[TRACE_NUM_FILES], uint32_t capacity, int pc_digits);
+
+/*
+-Functionality: Waits until every record is written, stops the writer thread and closes the files.
+-return 1 if everything was written, 0 on a write error.
+-parameter1: trace - Pointer to the Trace structure.
+*/
+int trace_close(Trace *trace);
+
+/*
+-Functionality: Returns a free record slot, waiting for the writer thread while the ring is full.
+-return A pointer to the record to fill, published with trace_commit.
+-parameter1: trace - Pointer to the Trace structure.
+*/
+TraceRecord *trace_reserve(Trace *trace);
+
+/*
+-Functionality: Publishes the record returned by trace_reserve to the writer thread.
+-parameter1: trace - Pointer to the Trace structure.
+*/
+void trace_commit(Trace *trace);
+
+/*
+-Functionality: Records the CPU state of one cycle (trace.txt).
+-parameter1: trace - Pointer to the Trace structure.
+-parameter2: pc - The program counter.
+-parameter3: instruction - The raw 48-bit instruction.
+-parameter4: regs - The registers, with $imm1 and $imm2 already loaded.
+*/
+void trace_cpu(Trace *trace, uint16_t pc, const uint8_t *instruction, const uint32_t *regs);
+
+/*
+-Functionality: Records an in/out access to an IO register (hwregtrace.txt) and, for out, a change
+ of the leds or display7seg register (leds.txt, display7seg.txt).
+-parameter1: trace - Pointer to the Trace structure.
+-parameter2: is_write - 1 for out, 0 for in.
+-parameter3: cycle - The clock cycle.
+-parameter4: reg_index - The IO register.
+-parameter5: value - The value read or written.
+-parameter6: previous - The register value before the access.
+*/
+void trace_io_access(Trace *trace, int is_write, uint32_t cycle, int reg_index, uint32_t value, uint32_t previous);
+
+#endif
@@ -0,0 +1,518 @@
+#define _CRT_SECURE_NO_WARNINGS
+#include "assembler.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Opcodes in encoding order, as in execute_instruction
+static const char *const opcode_names[] = {
+	"add", "sub", "mac", "and", "or", "xor", "sll", "sra", "srl",
+	"beq", "bne", "blt", "bgt", "ble", "bge", "jal", "lw", "sw",
+	"reti", "in", "out", "halt"
+};
+#define NUM_OPCODES ((int)(sizeof(opcode_names) / sizeof(opcode_names[0])))
+
+// Register names in encoding order
+static const char *const register_names[] = {
+	"zero", "imm1", "imm2", "v0", "a0", "a1", "a2", "t0",
+	"t1", "t2", "s0", "s1", "s2", "gp", "sp", "ra"
+};
+#define NUM_REGISTER_NAMES 16
+
+// Operands of an instruction: rd, rs, rt, rm, imm1, imm2
+#define NUM_OPERANDS 6
+
+static const char hex_digits[] = "0123456789ABCDEF";
+
+// A piece of a source line
+typedef struct {
+	const char *start;
+	const char *end;
+} Token;
+
+// Allocate an empty program
+int init_assembled_program(AssembledProgram *program) {
+	memset(program, 0, sizeof(*program));
+	program->instructions = calloc(INSTRUCTION_MEM_MAX, sizeof(uint64_t));
+	program->data = calloc(DATA_MEM_MAX, sizeof(uint32_t));
+	if (!program->instructions || !program->data || !init_symbol_table(&program->symbols)) {
+		printf("Error: Memory allocation failed for the assembled program\n");
+		free_assembled_program(program);
+		return 0;
+	}
+	return 1;
+}
+
+// Release a program
+void free_assembled_program(AssembledProgram *program) {
+	free(program->instructions);
+	free(program->data);
+	free_symbol_table(&program->symbols);
+	program->instructions = NULL;
+	program->data = NULL;
+}
+
+// Print an error of a source line
+static void report(AssembledProgram *program, int line, const char *format, ...) {
+	va_list args;
+
+	program->errors++;
+	if (program->errors > ASM_MAX_ERRORS) {
+		return;
+	}
+	printf("Error: line %d: ", line);
+	va_start(args, format);
+	vprintf(format, args);
+	va_end(args);
+	printf("\n");
+}
+
+// Character classes of the source
+static int is_space(char c) {
+	return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+static int is_identifier_start(char c) {
+	return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_' || c == '.';
+}
+
+static int is_identifier_char(char c) {
+	return is_identifier_start(c) || (c >= '0' && c <= '9');
+}
+
+// Compare a token with a lower-case keyword, ignoring case
+static int token_is(Token token, const char *keyword) {
+	const char *p = token.start;
+	for (; p < token.end && *keyword != '\0'; p++, keyword++) {
+		char c = (*p >= 'A' && *p <= 'Z') ? (char)(*p - 'A' + 'a') : *p;
+		if (c != *keyword) {
+			return 0;
+		}
+	}
+	return p == token.end && *keyword == '\0';
+}
+
+// Strip the blanks around a token
+static Token trim(Token token) {
+	while (token.start < token.end && is_space(*token.start)) {
+		token.start++;
+	}
+	while (token.end > token.start && is_space(token.end[-1])) {
+		token.end--;
+	}
+	return token;
+}
+
+// Split off the labels in front of a statement, defining them at address when define is set.
+// Returns the statement: an opcode or directive with its operands, empty for a blank line.
+static Token split_labels(AssembledProgram *program, Token line, int line_number, int address, int define) {
+	for (;;) {
+		line = trim(line);
+		const char *p = line.start;
+		if (p == line.end || !is_identifier_start(*p)) {
+			return line;
+		}
+		while (p < line.end && is_identifier_char(*p)) {
+			p++;
+		}
+		const char *name_end = p;
+		while (p < line.end && is_space(*p)) {
+			p++;
+		}
+		if (p == line.end || *p != ':') {
+			return line;
+		}
+
+		if (define) {
+			int length = (int)(name_end - line.start);
+			Symbol *symbol = add_symbol(&program->symbols, line.start, length, address, line_number);
+			if (!symbol) {
+				program->errors++;
+			}
+			else if (symbol->line != line_number || symbol->value != address) {
+				report(program, line_number, "label %.*s is already defined on line %d", length, line.start, symbol->line);
+			}
+		}
+		line.start = p + 1;
+	}
+}
+
+// Split the mnemonic (or directive) off a statement
+static Token split_mnemonic(Token *statement) {
+	Token mnemonic = { statement->start, statement->start };
+	while (mnemonic.end < statement->end && !is_space(*mnemonic.end)) {
+		mnemonic.end++;
+	}
+	statement->start = mnemonic.end;
+	return mnemonic;
+}
+
+// Parse a number: optional sign, decimal or 0x hex. Returns 0 if the token is not a number.
+static int parse_number(Token token, int64_t *value) {
+	const char *p = token.start;
+	int negative = 0;
+	int base = 10;
+	int64_t result = 0;
+
+	if (p < token.end && (*p == '-' || *p == '+')) {
+		negative = (*p == '-');
+		p++;
+	}
+	if (token.end - p > 2 && p[0] == '0' && (p[1] == 'x' || p[1] == 'X')) {
+		base = 16;
+		p += 2;
+	}
+	if (p == token.end) {
+		return 0;
+	}
+	for (; p < token.end; p++) {
+		int digit;
+		if (*p >= '0' && *p <= '9') {
+			digit = *p - '0';
+		}
+		else if (base == 16 && *p >= 'a' && *p <= 'f') {
+			digit = *p - 'a' + 10;
+		}
+		else if (base == 16 && *p >= 'A' && *p <= 'F') {
+			digit = *p - 'A' + 10;
+		}
+		else {
+			return 0;
+		}
+		result = result * base + digit;
+		if (result > 0xFFFFFFFFLL) {
+			return 0;
+		}
+	}
+	*value = negative ? -result : result;
+	return 1;
+}
+
+// Parse a number or a label. Returns 0 (after reporting it) if it is neither.
+static int parse_value(AssembledProgram *program, Token token, int line_number, int64_t *value) {
+	if (parse_number(token, value)) {
+		return 1;
+	}
+	if (token.start < token.end && is_identifier_start(*token.start)) {
+		const Symbol *symbol = find_symbol(&program->symbols, token.start, (int)(token.end - token.start));
+		if (symbol) {
+			*value = symbol->value;
+			return 1;
+		}
+		report(program, line_number, "undefined label %.*s", (int)(token.end - token.start), token.start);
+		return 0;
+	}
+	report(program, line_number, "invalid value '%.*s'", (int)(token.end - token.start), token.start);
+	return 0;
+}
+
+// Parse a register: $name or $number. Returns -1 (after reporting it) if it is not one.
+static int parse_register(AssembledProgram *program, Token token, int line_number) {
+	int64_t number;
+
+	if (token.start < token.end && *token.start == '$') {
+		Token name = { token.start + 1, token.end };
+		for (int i = 0; i < NUM_REGISTER_NAMES; i++) {
+			if (token_is(name, register_names[i])) {
+				return i;
+			}
+		}
+		if (name.start < name.end && *name.start != '-' && *name.start != '+' &&
+			parse_number(name, &number) && number < NUM_REGISTER_NAMES) {
+			return (int)number;
+		}
+	}
+	report(program, line_number, "invalid register '%.*s'", (int)(token.end - token.start), token.start);
+	return -1;
+}
+
+// Split comma-separated operands. Returns their number, or -1 if there are more than max.
+static int split_operands(Token text, Token *operands, int max) {
+	int count = 0;
+
+	text = trim(text);
+	if (text.start == text.end) {
+		return 0;
+	}
+	for (;;) {
+		const char *comma = memchr(text.start, ',', (size_t)(text.end - text.start));
+		if (count == max) {
+			return -1;
+		}
+		Token operand = { text.start, comma ? comma : text.end };
+		operands[count++] = trim(operand);
+		if (!comma) {
+			return count;
+		}
+		text.start = comma + 1;
+	}
+}
+
+// Encode an instruction statement
+static void encode_instruction(AssembledProgram *program, Token mnemonic, Token operands_text, int line_number, int address) {
+	Token operands[NUM_OPERANDS];
+	int opcode = -1;
+	int registers[4];
+	int64_t immediates[2];
+
+	for (int i = 0; i < NUM_OPCODES; i++) {
+		if (token_is(mnemonic, opcode_names[i])) {
+			opcode = i;
+			break;
+		}
+	}
+	if (opcode < 0) {
+		report(program, line_number, "unknown opcode %.*s", (int)(mnemonic.end - mnemonic.start), mnemonic.start);
+		return;
+	}
+	if (split_operands(operands_text, operands, NUM_OPERANDS) != NUM_OPERANDS) {
+		report(program, line_number, "%s takes 6 operands: rd, rs, rt, rm, imm1, imm2", opcode_names[opcode]);
+		return;
+	}
+
+	for (int i = 0; i < 4; i++) {
+		registers[i] = parse_register(program, operands[i], line_number);
+		if (registers[i] < 0) {
+			return;
+		}
+	}
+	for (int i = 0; i < 2; i++) {
+		if (!parse_value(program, operands[4 + i], line_number, &immediates[i])) {
+			return;
+		}
+		if (immediates[i] < ASM_IMMEDIATE_MIN || immediates[i] > ASM_IMMEDIATE_MAX) {
+			report(program, line_number, "imm%d value %lld does not fit in 12 bits", i + 1, (long long)immediates[i]);
+			return;
+		}
+	}
+
+	program->instructions[address] = ((uint64_t)opcode << 40) |
+		((uint64_t)registers[0] << 36) | ((uint64_t)registers[1] << 32) |
+		((uint64_t)registers[2] << 28) | ((uint64_t)registers[3] << 24) |
+		((uint64_t)(immediates[0] & 0xFFF) << 12) | (uint64_t)(immediates[1] & 0xFFF);
+}
+
+// Encode a .word directive: .word address value
+static void encode_word(AssembledProgram *program, Token operands_text, int line_number) {
+	Token operands[2];
+	int64_t address, value;
+	int count = 0;
+
+	// The operands are separated by blanks or a comma
+	Token text = trim(operands_text);
+	while (text.start < text.end && count < 2) {
+		Token operand = { text.start, text.start };
+		while (operand.end < text.end && !is_space(*operand.end) && *operand.end != ',') {
+			operand.end++;
+		}
+		operands[count++] = operand;
+		text.start = operand.end;
+		while (text.start < text.end && (is_space(*text.start) || *text.start == ',')) {
+			text.start++;
+		}
+	}
+	if (count != 2 || text.start != text.end) {
+		report(program, line_number, ".word takes an address and a value");
+		return;
+	}
+
+	if (!parse_value(program, operands[0], line_number, &address) || !parse_value(program, operands[1], line_number, &value)) {
+		return;
+	}
+	if (address < 0 || address >= DATA_MEM_MAX) {
+		report(program, line_number, ".word address %lld is outside the data memory", (long long)address);
+		return;
+	}
+	if (value < INT32_MIN || value > UINT32_MAX) {
+		report(program, line_number, ".word value %lld does not fit in 32 bits", (long long)value);
+		return;
+	}
+	program->data[address] = (uint32_t)value;
+	if (address >= program->data_count) {
+		program->data_count = (int)address + 1;
+	}
+}
+
+// One pass over the source: the first defines the labels, the second encodes the statements
+static void assemble_pass(AssembledProgram *program, const char *source, size_t size, int pass) {
+	const char *end = source + size;
+	int line_number = 0;
+	int address = 0;
+
+	for (const char *p = source; p < end && program->errors <= ASM_MAX_ERRORS;) {
+		const char *newline = memchr(p, '\n', (size_t)(end - p));
+		const char *line_end = newline ? newline : end;
+		const char *comment = memchr(p, '#', (size_t)(line_end - p));
+		Token line = { p, comment ? comment : line_end };
+		p = newline ? newline + 1 : end;
+		line_number++;
+
+		Token statement = split_labels(program, line, line_number, address, pass == 1);
+		if (statement.start == statement.end) {
+			continue;
+		}
+		Token mnemonic = split_mnemonic(&statement);
+
+		if (*mnemonic.start == '.') {
+			if (!token_is(mnemonic, ".word")) {
+				if (pass == 1) {
+					report(program, line_number, "unknown directive %.*s", (int)(mnemonic.end - mnemonic.start), mnemonic.start);
+				}
+			}
+			else if (pass == 2) {
+				encode_word(program, statement, line_number);
+			}
+			continue;
+		}
+
+		if (address >= INSTRUCTION_MEM_MAX) {
+			if (pass == 1 && address == INSTRUCTION_MEM_MAX) {
+				report(program, line_number, "the program does not fit in %d instructions", INSTRUCTION_MEM_MAX);
+			}
+			address++;
+			continue;
+		}
+		if (pass == 2) {
+			encode_instruction(program, mnemonic, statement, line_number, address);
+		}
+		address++;
+	}
+	program->instruction_count = (address < INSTRUCTION_MEM_MAX) ? address : INSTRUCTION_MEM_MAX;
+}
+
+// Assemble a source text
+int assemble(AssembledProgram *program, const char *source, size_t size) {
+	assemble_pass(program, source, size, 1);
+	if (program->errors <= ASM_MAX_ERRORS) {
+		assemble_pass(program, source, size, 2); // Reports the statement errors too
+	}
+	if (program->errors > ASM_MAX_ERRORS) {
+		printf("Error: %d errors, stopped after %d\n", program->errors, ASM_MAX_ERRORS);
+	}
+	return program->errors == 0;
+}
+
+// Store a little-endian 32-bit field
+static void store_le32(uint8_t *bytes, uint32_t value) {
+	for (int i = 0; i < 4; i++) {
+		bytes[i] = (uint8_t)(value >> (8 * i));
+	}
+}
+
+// Write a buffer to a new file
+static int write_file(const char *filename, const void *buffer, size_t size) {
+	FILE *file = fopen(filename, "wb");
+	if (!file) {
+		printf("Error: Could not create output file: %s\n", filename);
+		return 0;
+	}
+	int ok = fwrite(buffer, 1, size, file) == size;
+	ok &= fclose(file) == 0;
+	if (!ok) {
+		printf("Error: Could not write output file: %s\n", filename);
+	}
+	return ok;
+}
+
+// Write entries as hex text lines of digits digits, or as a binary image of entry_size bytes each
+// (most significant byte first for instructions, little-endian for data words)
+static int write_entries(const char *filename, ImageKind kind, const uint64_t *wide, const uint32_t *words,
+	int count, int binary) {
+	int digits = (kind == IMAGE_INSTRUCTIONS) ? 12 : 8;
+	int entry_size = digits / 2;
+	size_t size = binary ? 16 + (size_t)count * entry_size : (size_t)count * (digits + 1);
+	uint8_t *buffer = malloc(size > 0 ? size : 1);
+	uint8_t *out = buffer;
+
+	if (!buffer) {
+		printf("Error: Memory allocation failed for output file: %s\n", filename);
+		return 0;
+	}
+	if (binary) {
+		memcpy(out, IMAGE_MAGIC, 4);
+		out[4] = IMAGE_VERSION & 0xFF;
+		out[5] = IMAGE_VERSION >> 8;
+		out[6] = (uint8_t)kind;
+		out[7] = 0;
+		store_le32(out + 8, (uint32_t)count);
+		store_le32(out + 12, (uint32_t)entry_size);
+		out += 16;
+	}
+	for (int i = 0; i < count; i++) {
+		uint64_t value = wide ? wide[i] : words[i];
+		if (binary && kind == IMAGE_DATA) {
+			store_le32(out, (uint32_t)value);
+			out += 4;
+		}
+		else if (binary) {
+			for (int byte = entry_size - 1; byte >= 0; byte--) {
+				*out++ = (uint8_t)(value >> (8 * byte));
+			}
+		}
+		else {
+			for (int digit = digits - 1; digit >= 0; digit--) {
+				*out++ = (uint8_t)hex_digits[(value >> (4 * digit)) & 0xF];
+			}
+			*out++ = '\n';
+		}
+	}
+
+	int ok = write_file(filename, buffer, size);
+	free(buffer);
+	return ok;
+}
+
+// Write the instructions
+int write_instruction_image(const AssembledProgram *program, const char *filename, int binary) {
+	return write_entries(filename, IMAGE_INSTRUCTIONS, program->instructions, NULL, program->instruction_count, binary);
+}
+
+// Write the data words
+int write_data_image(const AssembledProgram *program, const char *filename, int binary) {
+	int count = (program->data_count > 0) ? program->data_count : 1;
+	return write_entries(filename, IMAGE_DATA, NULL, program->data, count, binary);
+}
+
+// Order symbols by address, then by name
+static int compare_symbols(const void *a, const void *b) {
+	const Symbol *left = a;
+	const Symbol *right = b;
+	if (left->value != right->value) {
+		return (left->value < right->value) ? -1 : 1;
+	}
+	int length = (left->length < right->length) ? left->length : right->length;
+	int order = memcmp(left->name, right->name, (size_t)length);
+	return (order != 0) ? order : left->length - right->length;
+}
+
+// Write the labels sorted by address
+int write_label_file(const AssembledProgram *program, const char *filename) {
+	const SymbolTable *table = &program->symbols;
+	Symbol *sorted = malloc((size_t)(table->count > 0 ? table->count : 1) * sizeof(Symbol));
+	int count = 0;
+
+	if (!sorted) {
+		printf("Error: Memory allocation failed for the label file\n");
+		return 0;
+	}
+	for (int i = 0; i < table->capacity; i++) {
+		if (table->slots[i].name != NULL) {
+			sorted[count++] = table->slots[i];
+		}
+	}
+	qsort(sorted, (size_t)count, sizeof(Symbol), compare_symbols);
+
+	FILE *file = fopen(filename, "w");
+	if (!file) {
+		printf("Error: Could not create label file: %s\n", filename);
+		free(sorted);
+		return 0;
+	}
+	for (int i = 0; i < count; i++) {
+		fprintf(file, "%.*s %d\n", sorted[i].length, sorted[i].name, sorted[i].value);
+	}
+	int ok = fclose(file) == 0;
+	free(sorted);
+	return ok;
+}
@@ -0,0 +1,90 @@
+#ifndef ASSEMBLER_H
+#define ASSEMBLER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "symbols.h"
+#include "../Simulator/memory.h" // For INSTRUCTION_MEM_MAX, DATA_MEM_MAX and the image formats
+
+/*
+ SIMP assembly, one statement per line:
+   label: op rd, rs, rt, rm, imm1, imm2    # comment
+   .word address value
+ Opcodes and registers are those of execute_instruction ($zero, $imm1, $imm2, $v0, $a0-$a2, $t0-$t2,
+ $s0-$s2, $gp, $sp, $ra, or $0-$15). Immediates are decimal or 0x hex numbers or labels and must fit
+ the 12-bit fields (-2048 to 4095, values above 2047 read back sign-extended). A .word value is
+ 32 bits and may also be a label.
+*/
+
+// Range of a 12-bit immediate field
+#define ASM_IMMEDIATE_MIN -2048
+#define ASM_IMMEDIATE_MAX 4095
+
+// Errors reported before the assembler gives up
+#define ASM_MAX_ERRORS 50
+
+// The result of assembling one source file
+typedef struct {
+	uint64_t *instructions;  // 48-bit instruction words, INSTRUCTION_MEM_MAX entries
+	int instruction_count;
+	uint32_t *data;          // Data memory words set by .word, DATA_MEM_MAX entries
+	int data_count;          // Highest .word address + 1
+	SymbolTable symbols;     // Names point into the source text
+	int errors;
+} AssembledProgram;
+
+
+// Function declarations
+
+/*
+-Functionality: Allocates an empty program.
+-return 1 on success, 0 if memory could not be allocated.
+-parameter1: program - Pointer to the AssembledProgram structure.
+*/
+int init_assembled_program(AssembledProgram *program);
+
+/*
+-Functionality: Releases a program.
+-parameter1: program - Pointer to the AssembledProgram structure.
+*/
+void free_assembled_program(AssembledProgram *program);
+
+/*
+-Functionality: Assembles a source text in two passes over it: the first defines the labels, the
+ second encodes every statement in place. Errors are printed with their line numbers.
+-return 1 on success, 0 if the source has errors.
+-parameter1: program - Pointer to an empty AssembledProgram, which keeps pointers into source.
+-parameter2: source - The source text, which must outlive the program.
+-parameter3: size - Length of the source text.
+*/
+int assemble(AssembledProgram *program, const char *source, size_t size);
+
+/*
+-Functionality: Writes the instructions as an imemin.txt hex text file or a binary image.
+-return 1 on success, 0 if the file could not be written.
+-parameter1: program - Pointer to the AssembledProgram structure.
+-parameter2: filename - Name of the output file.
+-parameter3: binary - 1 for the binary image format of image.h.
+*/
+int write_instruction_image(const AssembledProgram *program, const char *filename, int binary);
+
+/*
+-Functionality: Writes the .word data up to its highest address as a dmemin.txt hex text file or
+ a binary image (one zero word for a program without data).
+-return 1 on success, 0 if the file could not be written.
+-parameter1: program - Pointer to the AssembledProgram structure.
+-parameter2: filename - Name of the output file.
+-parameter3: binary - 1 for the binary image format of image.h.
+*/
+int write_data_image(const AssembledProgram *program, const char *filename, int binary);
+
+/*
+-Functionality: Writes the labels as "<name> <address>" lines sorted by address, the label file
+ of the simulator's profiler.
+-return 1 on success, 0 if the file could not be written.
+-parameter1: program - Pointer to the AssembledProgram structure.
+-parameter2: filename - Name of the output file.
+*/
+int write_label_file(const AssembledProgram *program, const char *filename);
+
+#endif
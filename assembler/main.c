@@ -1,3 +1,96 @@
-int main{
-    return 0;
+#define _CRT_SECURE_NO_WARNINGS
+// Standard Library Includes
+#include <stdio.h>    // For input/output operations (e.g., printf, fopen)
+#include <stdlib.h>   // For memory allocation and exit handling
+#include <string.h>   // For the command line arguments
+#include <time.h>     // For the assembly time
+
+// Assembler Includes
+#include "assembler.h"
+
+// Read a whole source file into a heap buffer
+static char *read_source(const char *filename, size_t *size) {
+	FILE *file = fopen(filename, "rb");
+	if (!file) {
+		printf("Error: Could not open source file: %s\n", filename);
+		return NULL;
+	}
+
+	size_t capacity = 1 << 16;
+	char *text = malloc(capacity);
+	*size = 0;
+	while (text) {
+		*size += fread(text + *size, 1, capacity - *size, file);
+		if (*size < capacity) {
+			break;
+		}
+		capacity *= 2;
+		char *grown = realloc(text, capacity);
+		if (!grown) {
+			free(text);
+		}
+		text = grown;
+	}
+	if (!text) {
+		printf("Error: Memory allocation failed for source file: %s\n", filename);
+	}
+	else if (ferror(file)) {
+		printf("Error: Could not read source file: %s\n", filename);
+		free(text);
+		text = NULL;
+	}
+	fclose(file);
+	return text;
+}
+
+// Assemble a program: asm <program.asm> <imemin> <dmemin> [binary] [labels=<file>]
+int main(int argc, char *argv[]) {
+	AssembledProgram program;
+	const char *labels = NULL;
+	int binary = 0;
+	size_t size;
+
+	if (argc < 4 || argc > 6) {
+		printf("Usage: asm <program.asm> <imemin> <dmemin> [binary] [labels=<file>]\n");
+		return 1;
+	}
+	for (int i = 4; i < argc; i++) {
+		if (strcmp(argv[i], "binary") == 0) {
+			binary = 1;
+		}
+		else if (strncmp(argv[i], "labels=", 7) == 0) {
+			labels = argv[i] + 7;
+		}
+		else {
+			printf("Error: Unknown option %s\n", argv[i]);
+			return 1;
+		}
+	}
+
+	clock_t start = clock();
+	char *source = read_source(argv[1], &size);
+	if (!source) {
+		return 1;
+	}
+	if (!init_assembled_program(&program)) {
+		free(source);
+		return 1;
+	}
+
+	int ok = assemble(&program, source, size);
+	if (ok) {
+		ok = write_instruction_image(&program, argv[2], binary);
+		ok &= write_data_image(&program, argv[3], binary);
+		if (labels != NULL) {
+			ok &= write_label_file(&program, labels);
+		}
+	}
+	if (ok) {
+		printf("Assembled %d instructions, %d data words and %d labels in %.3f ms\n", program.instruction_count,
+			program.data_count, program.symbols.count, (double)(clock() - start) * 1000.0 / CLOCKS_PER_SEC);
+	}
+
+	free_assembled_program(&program);
+	free(source);
+	return ok ? 0 : 1;
 }
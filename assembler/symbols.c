@@ -0,0 +1,94 @@
+#define _CRT_SECURE_NO_WARNINGS
+#include "symbols.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SYMBOL_TABLE_INITIAL 1024
+
+// FNV-1a hash of a name
+static uint32_t hash_name(const char *name, int length) {
+	uint32_t hash = 2166136261u;
+	for (int i = 0; i < length; i++) {
+		hash = (hash ^ (uint8_t)name[i]) * 16777619u;
+	}
+	return hash;
+}
+
+// Find the slot of a name, or the free slot where it would go
+static Symbol *find_slot(const SymbolTable *table, const char *name, int length, uint32_t hash) {
+	uint32_t mask = (uint32_t)table->capacity - 1;
+	for (uint32_t i = hash & mask;; i = (i + 1) & mask) {
+		Symbol *slot = &table->slots[i];
+		if (slot->name == NULL ||
+			(slot->hash == hash && slot->length == length && memcmp(slot->name, name, (size_t)length) == 0)) {
+			return slot;
+		}
+	}
+}
+
+// Initialize an empty symbol table
+int init_symbol_table(SymbolTable *table) {
+	table->slots = calloc(SYMBOL_TABLE_INITIAL, sizeof(Symbol));
+	table->capacity = SYMBOL_TABLE_INITIAL;
+	table->count = 0;
+	if (!table->slots) {
+		printf("Error: Memory allocation failed for the symbol table\n");
+		return 0;
+	}
+	return 1;
+}
+
+// Release the slots
+void free_symbol_table(SymbolTable *table) {
+	free(table->slots);
+	table->slots = NULL;
+	table->capacity = 0;
+	table->count = 0;
+}
+
+// Double the table, rehashing every symbol
+static int grow_symbol_table(SymbolTable *table) {
+	SymbolTable grown;
+	grown.capacity = table->capacity * 2;
+	grown.count = table->count;
+	grown.slots = calloc((size_t)grown.capacity, sizeof(Symbol));
+	if (!grown.slots) {
+		printf("Error: Memory allocation failed for the symbol table\n");
+		return 0;
+	}
+	for (int i = 0; i < table->capacity; i++) {
+		const Symbol *symbol = &table->slots[i];
+		if (symbol->name != NULL) {
+			*find_slot(&grown, symbol->name, symbol->length, symbol->hash) = *symbol;
+		}
+	}
+	free(table->slots);
+	*table = grown;
+	return 1;
+}
+
+// Add a label
+Symbol *add_symbol(SymbolTable *table, const char *name, int length, int value, int line) {
+	if ((table->count + 1) * 2 > table->capacity && !grow_symbol_table(table)) {
+		return NULL;
+	}
+
+	uint32_t hash = hash_name(name, length);
+	Symbol *slot = find_slot(table, name, length, hash);
+	if (slot->name == NULL) {
+		slot->name = name;
+		slot->length = length;
+		slot->hash = hash;
+		slot->value = value;
+		slot->line = line;
+		table->count++;
+	}
+	return slot;
+}
+
+// Look a label up
+const Symbol *find_symbol(const SymbolTable *table, const char *name, int length) {
+	const Symbol *slot = find_slot(table, name, length, hash_name(name, length));
+	return (slot->name != NULL) ? slot : NULL;
+}
@@ -0,0 +1,59 @@
+#ifndef SYMBOLS_H
+#define SYMBOLS_H
+
+#include <stdint.h>
+
+// A label: its name points into the source text, which outlives the table
+typedef struct {
+	const char *name;   // NULL for a free slot
+	int length;
+	uint32_t hash;
+	int value;          // Instruction address
+	int line;           // Line of the definition
+} Symbol;
+
+// Open-addressing hash table of the labels, kept under half full
+typedef struct {
+	Symbol *slots;
+	int capacity;       // Power of two
+	int count;
+} SymbolTable;
+
+
+// Function declarations
+
+/*
+-Functionality: Initializes an empty symbol table.
+-return 1 on success, 0 if memory could not be allocated.
+-parameter1: table - Pointer to the SymbolTable structure.
+*/
+int init_symbol_table(SymbolTable *table);
+
+/*
+-Functionality: Releases the slots of a symbol table.
+-parameter1: table - Pointer to the SymbolTable structure.
+*/
+void free_symbol_table(SymbolTable *table);
+
+/*
+-Functionality: Adds a label.
+-return The new symbol, the existing one if the name is already defined (check its line), or NULL
+ if memory could not be allocated.
+-parameter1: table - Pointer to the SymbolTable structure.
+-parameter2: name - The label name, not NUL-terminated.
+-parameter3: length - Length of the name.
+-parameter4: value - Its instruction address.
+-parameter5: line - Line of the definition.
+*/
+Symbol *add_symbol(SymbolTable *table, const char *name, int length, int value, int line);
+
+/*
+-Functionality: Looks a label up.
+-return The symbol, or NULL if it is not defined.
+-parameter1: table - Pointer to the SymbolTable structure.
+-parameter2: name - The label name, not NUL-terminated.
+-parameter3: length - Length of the name.
+*/
+const Symbol *find_symbol(const SymbolTable *table, const char *name, int length);
+
+#endif
@@ -0,0 +1,42 @@
+#!/bin/sh
+# Run every workload of bench/workloads on each engine and print one JSON line per run:
+#   {"commit":...,"date":...,"workload":...,"engine":...,"repeat":...,"cycles":...,"wall_ms":...,"mips":...,
+#    "idle_cycles":...,"peak_rss_kb":...}
+# wall_ms is the fastest of REPEAT runs from power-on, mips is cycles per microsecond of it and
+# peak_rss_kb the peak resident memory of the process, which runs a single workload.
+# The lines are also appended to RESULTS, so regressions can be tracked across commits.
+#
+# Environment: SIM (default build/sim), ENGINES (default "ref fast block jit"), REPEAT (default 3),
+# RESULTS (default bench/results.jsonl).
+
+BENCH_DIR=$(cd "$(dirname "$0")" && pwd)
+SIM=${SIM:-build/sim}
+ENGINES=${ENGINES:-ref fast block jit}
+REPEAT=${REPEAT:-3}
+RESULTS=${RESULTS:-$BENCH_DIR/results.jsonl}
+
+if [ ! -x "$SIM" ]; then
+	echo "Error: Simulator $SIM not found, run make first" >&2
+	exit 1
+fi
+
+COMMIT=$(git -C "$BENCH_DIR" rev-parse --short HEAD 2>/dev/null || echo unknown)
+if [ -n "$(git -C "$BENCH_DIR" status --porcelain --untracked-files=no 2>/dev/null)" ]; then
+	COMMIT="$COMMIT-dirty"
+fi
+DATE=$(date -u +%Y-%m-%dT%H:%M:%SZ)
+
+status=0
+for workload in "$BENCH_DIR"/workloads/*/; do
+	for engine in $ENGINES; do
+		if ! line=$("$SIM" bench "$workload" "$engine" "repeat=$REPEAT"); then
+			echo "$line" >&2
+			status=1
+			continue
+		fi
+		line="{\"commit\":\"$COMMIT\",\"date\":\"$DATE\",${line#\{}"
+		echo "$line"
+		echo "$line" >> "$RESULTS"
+	done
+done
+exit $status
@@ -0,0 +1,99 @@
+#!/bin/sh
+# Run every workload of bench/workloads on each engine and compare the outputs with the
+# reference loop: dmemout, regout, cycles, hwregtrace and diskout of a single run, and
+# dmemout, regout, cycles and diskout of a lockstep batch of each workload.
+# Prints one line per run, "ok" or the output files that differ, and exits with 1 if any differ.
+#
+# Environment: SIM (default build/sim), ENGINES (default "fast block jit"), LANES (default 4, the
+# jobs of the lockstep batch), CHECK_DIR (default a temporary directory, removed afterwards).
+
+BENCH_DIR=$(cd "$(dirname "$0")" && pwd)
+SIM=${SIM:-build/sim}
+ENGINES=${ENGINES:-fast block jit}
+LANES=${LANES:-4}
+OUTPUTS="dmemout.txt regout.txt cycles.txt hwregtrace.txt diskout.txt"
+BATCH_OUTPUTS="dmemout.txt regout.txt cycles.txt diskout.txt"
+
+if [ ! -x "$SIM" ]; then
+	echo "Error: Simulator $SIM not found, run make first" >&2
+	exit 1
+fi
+
+if [ -n "$CHECK_DIR" ]; then
+	WORK=$CHECK_DIR
+	mkdir -p "$WORK"
+else
+	WORK=$(mktemp -d)
+	trap 'rm -rf "$WORK"' EXIT
+fi
+
+# run <workload dir> <output dir> <engine>
+run() {
+	mkdir -p "$2"
+	"$SIM" "$1/imemin.txt" "$1/dmemin.txt" "$1/diskin.txt" "$1/irq2in.txt" \
+		"$2/dmemout.txt" "$2/regout.txt" - "$2/hwregtrace.txt" "$2/cycles.txt" - - \
+		"$2/diskout.txt" - - "$3" > "$2/stdout.txt" 2>&1
+}
+
+# compare <output dir> <reference dir> <files>, prints the files that differ
+compare() {
+	dir=$1
+	reference=$2
+	shift 2
+	differ=""
+	for file in "$@"; do
+		if ! cmp -s "$dir/$file" "$reference/$file"; then
+			differ="$differ $file"
+		fi
+	done
+	echo "$differ"
+}
+
+status=0
+for workload in "$BENCH_DIR"/workloads/*/; do
+	workload=${workload%/}
+	name=$(basename "$workload")
+	if ! run "$workload" "$WORK/$name/ref" ref; then
+		echo "$name ref: failed"
+		status=1
+		continue
+	fi
+
+	for engine in $ENGINES; do
+		run "$workload" "$WORK/$name/$engine" "$engine"
+		differ=$(compare "$WORK/$name/$engine" "$WORK/$name/ref" $OUTPUTS)
+		if [ -n "$differ" ]; then
+			echo "$name $engine: differs in$differ"
+			status=1
+		else
+			echo "$name $engine: ok"
+		fi
+	done
+
+	# The same workload on every lane of a lockstep batch
+	manifest="$WORK/$name/manifest.txt"
+	: > "$manifest"
+	lane=0
+	while [ $lane -lt "$LANES" ]; do
+		echo "$workload/dmemin.txt $workload/diskin.txt $workload/irq2in.txt $WORK/$name/lockstep$lane" >> "$manifest"
+		lane=$((lane + 1))
+	done
+	if ! "$SIM" batch "$workload/imemin.txt" "$manifest" 1 lockstep > "$WORK/$name/batch.txt" 2>&1; then
+		echo "$name lockstep: failed"
+		status=1
+		continue
+	fi
+	lane=0
+	differ=""
+	while [ $lane -lt "$LANES" ]; do
+		differ="$differ$(compare "$WORK/$name/lockstep$lane" "$WORK/$name/ref" $BATCH_OUTPUTS)"
+		lane=$((lane + 1))
+	done
+	if [ -n "$differ" ]; then
+		echo "$name lockstep: differs in$differ"
+		status=1
+	else
+		echo "$name lockstep: ok"
+	fi
+done
+exit $status
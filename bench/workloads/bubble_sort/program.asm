@@ -0,0 +1,546 @@
+# Bubble sort: copy the 512 signed words at 0x200 (from dmemin) to 0x600 and sort them
+# ascending with an early exit, 20 times.
+	add $s2, $zero, $zero, $zero, 0, 0           # pass = 0
+pass:
+	add $a0, $zero, $zero, $zero, 0, 0           # copy the input
+copy:
+	lw $t0, $a0, $imm1, $zero, 0x200, 0
+	sw $t0, $a0, $imm1, $zero, 0x600, 0
+	add $a0, $a0, $imm1, $zero, 1, 0
+	blt $zero, $a0, $imm1, $imm2, 512, copy
+	add $s0, $zero, $imm1, $zero, 511, 0         # end = n - 1
+outer:
+	add $a0, $zero, $imm1, $zero, 0x600, 0       # p = &work[0]
+	add $a1, $a0, $s0, $zero, 0, 0               # last = &work[end]
+	add $s1, $zero, $zero, $zero, 0, 0           # swapped = 0
+inner:
+	lw $t0, $a0, $zero, $zero, 0, 0
+	lw $t1, $a0, $imm1, $zero, 1, 0
+	ble $zero, $t0, $t1, $imm1, noswap, 0
+	sw $t1, $a0, $zero, $zero, 0, 0
+	sw $t0, $a0, $imm1, $zero, 1, 0
+	add $s1, $zero, $imm1, $zero, 1, 0
+noswap:
+	add $a0, $a0, $imm1, $zero, 1, 0
+	blt $zero, $a0, $a1, $imm1, inner, 0
+	sub $s0, $s0, $imm1, $zero, 1, 0
+	beq $zero, $s1, $zero, $imm1, sorted, 0
+	bgt $zero, $s0, $zero, $imm1, outer, 0
+sorted:
+	add $s2, $s2, $imm1, $zero, 1, 0
+	blt $zero, $s2, $imm1, $imm2, 20, pass
+	halt $zero, $zero, $zero, $zero, 0, 0
+
+# Input
+.word 0x200 810071
+.word 0x201 987738
+.word 0x202 780597
+.word 0x203 -881404
+.word 0x204 -807933
+.word 0x205 -822011
+.word 0x206 -242808
+.word 0x207 752168
+.word 0x208 -645406
+.word 0x209 543440
+.word 0x20A 696516
+.word 0x20B 404526
+.word 0x20C 790620
+.word 0x20D -353792
+.word 0x20E -472392
+.word 0x20F 270757
+.word 0x210 -554945
+.word 0x211 272555
+.word 0x212 -925060
+.word 0x213 218873
+.word 0x214 428676
+.word 0x215 -667848
+.word 0x216 -96821
+.word 0x217 338971
+.word 0x218 -174704
+.word 0x219 685416
+.word 0x21A 516266
+.word 0x21B 804062
+.word 0x21C 67591
+.word 0x21D 991026
+.word 0x21E -219734
+.word 0x21F 141221
+.word 0x220 962329
+.word 0x221 -67074
+.word 0x222 52911
+.word 0x223 -437459
+.word 0x224 889969
+.word 0x225 -924662
+.word 0x226 826688
+.word 0x227 -942444
+.word 0x228 -236607
+.word 0x229 -25047
+.word 0x22A 954223
+.word 0x22B -332131
+.word 0x22C 903689
+.word 0x22D -203051
+.word 0x22E -111624
+.word 0x22F 870218
+.word 0x230 854017
+.word 0x231 102583
+.word 0x232 -655043
+.word 0x233 175475
+.word 0x234 -627889
+.word 0x235 -504814
+.word 0x236 -516392
+.word 0x237 -949966
+.word 0x238 -629392
+.word 0x239 -318126
+.word 0x23A -635958
+.word 0x23B -713325
+.word 0x23C 69897
+.word 0x23D 70016
+.word 0x23E -245673
+.word 0x23F 77385
+.word 0x240 414486
+.word 0x241 174175
+.word 0x242 -618647
+.word 0x243 873955
+.word 0x244 -65431
+.word 0x245 670926
+.word 0x246 -130372
+.word 0x247 540151
+.word 0x248 101771
+.word 0x249 901264
+.word 0x24A 905216
+.word 0x24B 599886
+.word 0x24C -236101
+.word 0x24D 656220
+.word 0x24E 244629
+.word 0x24F -258055
+.word 0x250 -241070
+.word 0x251 801383
+.word 0x252 -65155
+.word 0x253 -661972
+.word 0x254 581261
+.word 0x255 -161426
+.word 0x256 499780
+.word 0x257 548935
+.word 0x258 -32361
+.word 0x259 373447
+.word 0x25A 112236
+.word 0x25B -475919
+.word 0x25C 27633
+.word 0x25D -414681
+.word 0x25E 939513
+.word 0x25F 44518
+.word 0x260 50339
+.word 0x261 80855
+.word 0x262 743833
+.word 0x263 669786
+.word 0x264 -257768
+.word 0x265 387655
+.word 0x266 851472
+.word 0x267 -46449
+.word 0x268 886808
+.word 0x269 894098
+.word 0x26A -33188
+.word 0x26B -264372
+.word 0x26C 190563
+.word 0x26D 522291
+.word 0x26E 930072
+.word 0x26F 169335
+.word 0x270 517861
+.word 0x271 -42543
+.word 0x272 20492
+.word 0x273 381782
+.word 0x274 -534829
+.word 0x275 972573
+.word 0x276 -319124
+.word 0x277 708515
+.word 0x278 467108
+.word 0x279 751177
+.word 0x27A -651727
+.word 0x27B 838565
+.word 0x27C 904089
+.word 0x27D 292571
+.word 0x27E -437675
+.word 0x27F 621065
+.word 0x280 911297
+.word 0x281 6142
+.word 0x282 -350800
+.word 0x283 -363941
+.word 0x284 676167
+.word 0x285 481020
+.word 0x286 742875
+.word 0x287 57486
+.word 0x288 178995
+.word 0x289 85795
+.word 0x28A 64004
+.word 0x28B 366115
+.word 0x28C 291443
+.word 0x28D 233009
+.word 0x28E -147151
+.word 0x28F -346016
+.word 0x290 532871
+.word 0x291 -564174
+.word 0x292 25311
+.word 0x293 73514
+.word 0x294 -231188
+.word 0x295 959063
+.word 0x296 434938
+.word 0x297 307081
+.word 0x298 849833
+.word 0x299 -841927
+.word 0x29A 644754
+.word 0x29B 720503
+.word 0x29C -283909
+.word 0x29D 522426
+.word 0x29E -982339
+.word 0x29F 903487
+.word 0x2A0 709303
+.word 0x2A1 -598600
+.word 0x2A2 561922
+.word 0x2A3 -777373
+.word 0x2A4 -876774
+.word 0x2A5 204635
+.word 0x2A6 369251
+.word 0x2A7 -897429
+.word 0x2A8 -427269
+.word 0x2A9 240885
+.word 0x2AA -524751
+.word 0x2AB 431259
+.word 0x2AC 836038
+.word 0x2AD 920657
+.word 0x2AE -777145
+.word 0x2AF 582028
+.word 0x2B0 95473
+.word 0x2B1 -713739
+.word 0x2B2 790848
+.word 0x2B3 -442491
+.word 0x2B4 -486551
+.word 0x2B5 729620
+.word 0x2B6 -558594
+.word 0x2B7 978832
+.word 0x2B8 846713
+.word 0x2B9 -873364
+.word 0x2BA -113078
+.word 0x2BB 883175
+.word 0x2BC 503576
+.word 0x2BD 592596
+.word 0x2BE -933158
+.word 0x2BF -880890
+.word 0x2C0 -240083
+.word 0x2C1 -244568
+.word 0x2C2 -639540
+.word 0x2C3 -476758
+.word 0x2C4 410891
+.word 0x2C5 -950838
+.word 0x2C6 -826140
+.word 0x2C7 -758360
+.word 0x2C8 -858513
+.word 0x2C9 -946849
+.word 0x2CA -914280
+.word 0x2CB 529711
+.word 0x2CC 926506
+.word 0x2CD -955656
+.word 0x2CE -217559
+.word 0x2CF -463780
+.word 0x2D0 -732011
+.word 0x2D1 705727
+.word 0x2D2 962861
+.word 0x2D3 -670500
+.word 0x2D4 540960
+.word 0x2D5 -614672
+.word 0x2D6 97002
+.word 0x2D7 450171
+.word 0x2D8 -995940
+.word 0x2D9 -191410
+.word 0x2DA 236183
+.word 0x2DB -909485
+.word 0x2DC 665469
+.word 0x2DD -480270
+.word 0x2DE -682450
+.word 0x2DF -923939
+.word 0x2E0 -991201
+.word 0x2E1 -278159
+.word 0x2E2 968101
+.word 0x2E3 290250
+.word 0x2E4 316500
+.word 0x2E5 557050
+.word 0x2E6 567995
+.word 0x2E7 -762781
+.word 0x2E8 -400159
+.word 0x2E9 -292812
+.word 0x2EA 25006
+.word 0x2EB -935385
+.word 0x2EC -353269
+.word 0x2ED -59106
+.word 0x2EE 156586
+.word 0x2EF 606355
+.word 0x2F0 269103
+.word 0x2F1 551780
+.word 0x2F2 -904009
+.word 0x2F3 891673
+.word 0x2F4 -446474
+.word 0x2F5 584738
+.word 0x2F6 -157252
+.word 0x2F7 808679
+.word 0x2F8 303579
+.word 0x2F9 479215
+.word 0x2FA -678181
+.word 0x2FB -8510
+.word 0x2FC -527035
+.word 0x2FD -804014
+.word 0x2FE 385857
+.word 0x2FF 441572
+.word 0x300 -336659
+.word 0x301 758255
+.word 0x302 -785988
+.word 0x303 -949241
+.word 0x304 -60850
+.word 0x305 653414
+.word 0x306 834511
+.word 0x307 988297
+.word 0x308 -732537
+.word 0x309 86924
+.word 0x30A 226741
+.word 0x30B 638000
+.word 0x30C -175919
+.word 0x30D 21148
+.word 0x30E 79619
+.word 0x30F -312217
+.word 0x310 -698368
+.word 0x311 833840
+.word 0x312 -284765
+.word 0x313 -456636
+.word 0x314 -450888
+.word 0x315 271037
+.word 0x316 -119709
+.word 0x317 370100
+.word 0x318 -962182
+.word 0x319 466902
+.word 0x31A 170106
+.word 0x31B -705205
+.word 0x31C 406268
+.word 0x31D -880922
+.word 0x31E -469490
+.word 0x31F -929628
+.word 0x320 -723802
+.word 0x321 -662013
+.word 0x322 -641994
+.word 0x323 -798942
+.word 0x324 -49173
+.word 0x325 331850
+.word 0x326 -514185
+.word 0x327 65896
+.word 0x328 921825
+.word 0x329 484979
+.word 0x32A 959013
+.word 0x32B -934147
+.word 0x32C -482506
+.word 0x32D -512468
+.word 0x32E 497088
+.word 0x32F -67402
+.word 0x330 -845760
+.word 0x331 -474075
+.word 0x332 -831328
+.word 0x333 239914
+.word 0x334 -521424
+.word 0x335 308966
+.word 0x336 660071
+.word 0x337 678156
+.word 0x338 308433
+.word 0x339 487925
+.word 0x33A -245384
+.word 0x33B -461852
+.word 0x33C 435627
+.word 0x33D -112870
+.word 0x33E -415446
+.word 0x33F 103500
+.word 0x340 574285
+.word 0x341 -989882
+.word 0x342 -683088
+.word 0x343 -925553
+.word 0x344 -193115
+.word 0x345 -142839
+.word 0x346 -663962
+.word 0x347 -766850
+.word 0x348 73913
+.word 0x349 517855
+.word 0x34A -815826
+.word 0x34B -494869
+.word 0x34C -786277
+.word 0x34D -790761
+.word 0x34E -958473
+.word 0x34F -618822
+.word 0x350 574091
+.word 0x351 -514456
+.word 0x352 -779329
+.word 0x353 -544177
+.word 0x354 -948746
+.word 0x355 92063
+.word 0x356 404021
+.word 0x357 -26077
+.word 0x358 -48192
+.word 0x359 -350458
+.word 0x35A 123094
+.word 0x35B 345865
+.word 0x35C -203077
+.word 0x35D -554461
+.word 0x35E 435891
+.word 0x35F 901199
+.word 0x360 594936
+.word 0x361 -559304
+.word 0x362 528679
+.word 0x363 690471
+.word 0x364 -90395
+.word 0x365 -107455
+.word 0x366 72696
+.word 0x367 -955284
+.word 0x368 218605
+.word 0x369 240135
+.word 0x36A -892553
+.word 0x36B 848507
+.word 0x36C -123357
+.word 0x36D 948003
+.word 0x36E 101140
+.word 0x36F 219160
+.word 0x370 -619944
+.word 0x371 930672
+.word 0x372 -803315
+.word 0x373 391024
+.word 0x374 683289
+.word 0x375 6219
+.word 0x376 -232057
+.word 0x377 -959142
+.word 0x378 88861
+.word 0x379 932421
+.word 0x37A -751297
+.word 0x37B 280332
+.word 0x37C -231430
+.word 0x37D -392706
+.word 0x37E 447862
+.word 0x37F 955483
+.word 0x380 -219385
+.word 0x381 -353502
+.word 0x382 -960039
+.word 0x383 833638
+.word 0x384 437200
+.word 0x385 -135441
+.word 0x386 -787849
+.word 0x387 -779765
+.word 0x388 -358435
+.word 0x389 -583944
+.word 0x38A 762890
+.word 0x38B 626000
+.word 0x38C 410485
+.word 0x38D 730976
+.word 0x38E -967029
+.word 0x38F 703014
+.word 0x390 -53297
+.word 0x391 -874191
+.word 0x392 -138754
+.word 0x393 336504
+.word 0x394 18928
+.word 0x395 -28306
+.word 0x396 -563275
+.word 0x397 865504
+.word 0x398 234687
+.word 0x399 286721
+.word 0x39A -845253
+.word 0x39B -988826
+.word 0x39C -403656
+.word 0x39D -949371
+.word 0x39E -217968
+.word 0x39F -358647
+.word 0x3A0 961404
+.word 0x3A1 517425
+.word 0x3A2 -839467
+.word 0x3A3 -540378
+.word 0x3A4 583316
+.word 0x3A5 28538
+.word 0x3A6 -596594
+.word 0x3A7 -757217
+.word 0x3A8 198632
+.word 0x3A9 -216935
+.word 0x3AA -178376
+.word 0x3AB 501402
+.word 0x3AC -28549
+.word 0x3AD -707101
+.word 0x3AE 580372
+.word 0x3AF -276611
+.word 0x3B0 -171536
+.word 0x3B1 861624
+.word 0x3B2 -744715
+.word 0x3B3 -466984
+.word 0x3B4 -744630
+.word 0x3B5 -742138
+.word 0x3B6 -831157
+.word 0x3B7 292981
+.word 0x3B8 782727
+.word 0x3B9 -298538
+.word 0x3BA 344256
+.word 0x3BB -179795
+.word 0x3BC -555384
+.word 0x3BD 452597
+.word 0x3BE -778958
+.word 0x3BF -948266
+.word 0x3C0 296421
+.word 0x3C1 382358
+.word 0x3C2 -13554
+.word 0x3C3 629931
+.word 0x3C4 -909445
+.word 0x3C5 517327
+.word 0x3C6 480177
+.word 0x3C7 44275
+.word 0x3C8 -390248
+.word 0x3C9 -250091
+.word 0x3CA -41527
+.word 0x3CB -703324
+.word 0x3CC 675041
+.word 0x3CD -213752
+.word 0x3CE -435987
+.word 0x3CF 15444
+.word 0x3D0 103738
+.word 0x3D1 815700
+.word 0x3D2 1514
+.word 0x3D3 508999
+.word 0x3D4 526545
+.word 0x3D5 686844
+.word 0x3D6 -121365
+.word 0x3D7 954658
+.word 0x3D8 32053
+.word 0x3D9 753230
+.word 0x3DA 426532
+.word 0x3DB -377642
+.word 0x3DC -172314
+.word 0x3DD -514243
+.word 0x3DE -672007
+.word 0x3DF 25065
+.word 0x3E0 251067
+.word 0x3E1 -455988
+.word 0x3E2 150416
+.word 0x3E3 -103145
+.word 0x3E4 458817
+.word 0x3E5 424260
+.word 0x3E6 466337
+.word 0x3E7 926402
+.word 0x3E8 -823188
+.word 0x3E9 228722
+.word 0x3EA 526309
+.word 0x3EB 715162
+.word 0x3EC 207437
+.word 0x3ED -798784
+.word 0x3EE -850767
+.word 0x3EF -253294
+.word 0x3F0 -630620
+.word 0x3F1 143501
+.word 0x3F2 -692766
+.word 0x3F3 690942
+.word 0x3F4 -125975
+.word 0x3F5 883671
+.word 0x3F6 -859828
+.word 0x3F7 674723
+.word 0x3F8 -819332
+.word 0x3F9 911273
+.word 0x3FA 878000
+.word 0x3FB 428904
+.word 0x3FC 698295
+.word 0x3FD 359126
+.word 0x3FE -921207
+.word 0x3FF -730485
@@ -0,0 +1,33 @@
+# Disk sector copy: read sectors 0-31 (from diskin) by DMA into a buffer at 0x100, add up their
+# words and write them to sectors 32-63, polling diskstatus; 200 times.
+# The checksum of all passes is stored at 0x000.
+	add $s2, $zero, $zero, $zero, 0, 0           # pass = 0
+	add $v0, $zero, $zero, $zero, 0, 0           # checksum = 0
+	out $zero, $imm1, $zero, $imm2, 16, 0x100    # diskbuffer = 0x100
+pass:
+	add $s0, $zero, $zero, $zero, 0, 0           # sector = 0
+sector:
+	out $zero, $imm1, $zero, $s0, 15, 0          # disksector = sector
+	out $zero, $imm1, $zero, $imm2, 14, 1        # diskcmd = read
+	jal $ra, $zero, $zero, $imm1, wait, 0
+	add $a0, $zero, $imm1, $zero, 0x100, 0
+	add $a1, $zero, $imm1, $zero, 0x180, 0
+sum:
+	lw $t0, $a0, $zero, $zero, 0, 0
+	add $v0, $v0, $t0, $zero, 0, 0
+	add $a0, $a0, $imm1, $zero, 1, 0
+	blt $zero, $a0, $a1, $imm1, sum, 0
+	add $t0, $s0, $imm1, $zero, 32, 0            # disksector = sector + 32
+	out $zero, $imm1, $zero, $t0, 15, 0
+	out $zero, $imm1, $zero, $imm2, 14, 2        # diskcmd = write
+	jal $ra, $zero, $zero, $imm1, wait, 0
+	add $s0, $s0, $imm1, $zero, 1, 0
+	blt $zero, $s0, $imm1, $imm2, 32, sector
+	add $s2, $s2, $imm1, $zero, 1, 0
+	blt $zero, $s2, $imm1, $imm2, 200, pass
+	sw $v0, $zero, $zero, $zero, 0, 0
+	halt $zero, $zero, $zero, $zero, 0, 0
+wait:
+	in $t1, $zero, $imm1, $zero, 17, 0           # diskstatus
+	bne $zero, $t1, $zero, $imm1, wait, 0
+	beq $zero, $zero, $zero, $ra, 0, 0
@@ -0,0 +1,42 @@
+# IRQ2 bursts: a sieve of Eratosthenes over 2000 flags at 0x400 runs 600 times while irq2in
+# raises bursts of 32 external interrupts, 10 cycles apart, every 100000 cycles.
+# The ISR counts the interrupts in $gp and logs the clks of each one in a 256-entry ring at 0x100.
+# The interrupt count is stored at 0x000 and the number of primes at 0x001.
+	add $t0, $zero, $imm1, $zero, isr, 0
+	out $zero, $imm1, $zero, $t0, 6, 0           # irqhandler = isr
+	out $zero, $imm1, $zero, $imm2, 2, 1         # irq2enable = 1
+	add $a1, $zero, $zero, $zero, 0, 0           # pass = 0
+pass:
+	add $a0, $zero, $zero, $zero, 0, 0           # clear the flags
+clear:
+	sw $zero, $a0, $imm1, $zero, 0x400, 0
+	add $a0, $a0, $imm1, $zero, 1, 0
+	blt $zero, $a0, $imm1, $imm2, 2000, clear
+	add $s0, $zero, $imm1, $zero, 2, 0           # p = 2
+	add $v0, $zero, $zero, $zero, 0, 0           # primes = 0
+sieve:
+	lw $t0, $s0, $imm1, $zero, 0x400, 0
+	bne $zero, $t0, $zero, $imm1, next, 0        # composite
+	add $v0, $v0, $imm1, $zero, 1, 0
+	mac $a0, $s0, $s0, $zero, 0, 0               # m = p * p
+	bge $zero, $a0, $imm1, $imm2, 2000, next
+mark:
+	sw $zero, $a0, $imm1, $imm2, 0x400, 1        # flags[m] = 1
+	add $a0, $a0, $s0, $zero, 0, 0               # m += p
+	blt $zero, $a0, $imm1, $imm2, 2000, mark
+next:
+	add $s0, $s0, $imm1, $zero, 1, 0
+	blt $zero, $s0, $imm1, $imm2, 2000, sieve
+	add $a1, $a1, $imm1, $zero, 1, 0
+	blt $zero, $a1, $imm1, $imm2, 600, pass
+	out $zero, $imm1, $zero, $zero, 2, 0         # irq2enable = 0
+	sw $gp, $zero, $zero, $zero, 0, 0
+	sw $v0, $zero, $imm1, $zero, 1, 0
+	halt $zero, $zero, $zero, $zero, 0, 0
+isr:
+	out $zero, $imm1, $zero, $zero, 5, 0         # irq2status = 0
+	in $sp, $zero, $imm1, $zero, 8, 0            # clks
+	and $s1, $gp, $imm1, $zero, 255, 0
+	sw $sp, $s1, $imm1, $zero, 0x100, 0          # ring[count % 256] = clks
+	add $gp, $gp, $imm1, $zero, 1, 0
+	reti $zero, $zero, $zero, $zero, 0, 0
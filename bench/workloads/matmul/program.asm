@@ -0,0 +1,546 @@
+# Matrix multiply: C = A * B for 16x16 signed word matrices, 1000 times.
+# A at 0x100, B at 0x200 (row by row, from dmemin), C at 0x300.
+	add $s2, $zero, $zero, $zero, 0, 0           # pass = 0
+pass:
+	add $s0, $zero, $zero, $zero, 0, 0           # i = 0
+row:
+	add $s1, $zero, $zero, $zero, 0, 0           # j = 0
+col:
+	add $v0, $zero, $zero, $zero, 0, 0           # sum = 0
+	sll $a0, $s0, $imm1, $zero, 4, 0             # a0 = &A[i][0]
+	add $a0, $a0, $imm1, $zero, 0x100, 0
+	add $a1, $s1, $imm1, $zero, 0x200, 0         # a1 = &B[0][j]
+	add $t2, $zero, $imm1, $zero, 16, 0          # k = 16
+dot:
+	lw $t0, $a0, $zero, $zero, 0, 0              # A[i][k]
+	lw $t1, $a1, $zero, $zero, 0, 0              # B[k][j]
+	mac $v0, $t0, $t1, $v0, 0, 0                 # sum += A[i][k] * B[k][j]
+	add $a0, $a0, $imm1, $zero, 1, 0
+	add $a1, $a1, $imm1, $zero, 16, 0
+	sub $t2, $t2, $imm1, $zero, 1, 0
+	bne $zero, $t2, $zero, $imm1, dot, 0
+	sll $t0, $s0, $imm1, $zero, 4, 0             # C[i][j] = sum
+	add $t0, $t0, $s1, $imm1, 0x300, 0
+	sw $v0, $t0, $zero, $zero, 0, 0
+	add $s1, $s1, $imm1, $zero, 1, 0
+	blt $zero, $s1, $imm1, $imm2, 16, col
+	add $s0, $s0, $imm1, $zero, 1, 0
+	blt $zero, $s0, $imm1, $imm2, 16, row
+	add $s2, $s2, $imm1, $zero, 1, 0
+	blt $zero, $s2, $imm1, $imm2, 1000, pass
+	halt $zero, $zero, $zero, $zero, 0, 0
+
+# A
+.word 0x100 -66
+.word 0x101 45
+.word 0x102 95
+.word 0x103 -84
+.word 0x104 -35
+.word 0x105 -70
+.word 0x106 26
+.word 0x107 94
+.word 0x108 15
+.word 0x109 20
+.word 0x10A 66
+.word 0x10B -3
+.word 0x10C -47
+.word 0x10D -76
+.word 0x10E 24
+.word 0x10F -93
+.word 0x110 -1
+.word 0x111 10
+.word 0x112 55
+.word 0x113 95
+.word 0x114 96
+.word 0x115 -100
+.word 0x116 78
+.word 0x117 14
+.word 0x118 -32
+.word 0x119 84
+.word 0x11A -42
+.word 0x11B 51
+.word 0x11C -74
+.word 0x11D -19
+.word 0x11E -93
+.word 0x11F -95
+.word 0x120 -94
+.word 0x121 66
+.word 0x122 38
+.word 0x123 -98
+.word 0x124 -3
+.word 0x125 75
+.word 0x126 -45
+.word 0x127 8
+.word 0x128 85
+.word 0x129 -93
+.word 0x12A 35
+.word 0x12B -44
+.word 0x12C 95
+.word 0x12D 12
+.word 0x12E 26
+.word 0x12F 41
+.word 0x130 -41
+.word 0x131 -12
+.word 0x132 -41
+.word 0x133 73
+.word 0x134 -44
+.word 0x135 94
+.word 0x136 17
+.word 0x137 -26
+.word 0x138 -95
+.word 0x139 6
+.word 0x13A 42
+.word 0x13B 64
+.word 0x13C -75
+.word 0x13D -53
+.word 0x13E 61
+.word 0x13F 85
+.word 0x140 -25
+.word 0x141 -70
+.word 0x142 90
+.word 0x143 -15
+.word 0x144 84
+.word 0x145 82
+.word 0x146 28
+.word 0x147 8
+.word 0x148 29
+.word 0x149 71
+.word 0x14A -52
+.word 0x14B -23
+.word 0x14C -28
+.word 0x14D 50
+.word 0x14E 27
+.word 0x14F 29
+.word 0x150 0
+.word 0x151 50
+.word 0x152 -92
+.word 0x153 22
+.word 0x154 -38
+.word 0x155 90
+.word 0x156 3
+.word 0x157 6
+.word 0x158 70
+.word 0x159 -56
+.word 0x15A -7
+.word 0x15B 40
+.word 0x15C 79
+.word 0x15D 98
+.word 0x15E 72
+.word 0x15F 88
+.word 0x160 -5
+.word 0x161 -78
+.word 0x162 12
+.word 0x163 69
+.word 0x164 30
+.word 0x165 -73
+.word 0x166 99
+.word 0x167 -59
+.word 0x168 33
+.word 0x169 0
+.word 0x16A -6
+.word 0x16B 25
+.word 0x16C 87
+.word 0x16D -93
+.word 0x16E 20
+.word 0x16F -89
+.word 0x170 -22
+.word 0x171 80
+.word 0x172 57
+.word 0x173 51
+.word 0x174 48
+.word 0x175 0
+.word 0x176 65
+.word 0x177 -57
+.word 0x178 -57
+.word 0x179 28
+.word 0x17A -42
+.word 0x17B -97
+.word 0x17C 97
+.word 0x17D -49
+.word 0x17E 38
+.word 0x17F 40
+.word 0x180 -41
+.word 0x181 3
+.word 0x182 31
+.word 0x183 -12
+.word 0x184 47
+.word 0x185 -10
+.word 0x186 17
+.word 0x187 -32
+.word 0x188 68
+.word 0x189 40
+.word 0x18A 55
+.word 0x18B 86
+.word 0x18C -99
+.word 0x18D -2
+.word 0x18E 100
+.word 0x18F 89
+.word 0x190 31
+.word 0x191 -67
+.word 0x192 32
+.word 0x193 99
+.word 0x194 43
+.word 0x195 -48
+.word 0x196 9
+.word 0x197 -86
+.word 0x198 23
+.word 0x199 -7
+.word 0x19A 45
+.word 0x19B 41
+.word 0x19C -49
+.word 0x19D 29
+.word 0x19E 5
+.word 0x19F 24
+.word 0x1A0 -9
+.word 0x1A1 6
+.word 0x1A2 -12
+.word 0x1A3 -100
+.word 0x1A4 37
+.word 0x1A5 38
+.word 0x1A6 59
+.word 0x1A7 56
+.word 0x1A8 -16
+.word 0x1A9 17
+.word 0x1AA 53
+.word 0x1AB -93
+.word 0x1AC -42
+.word 0x1AD 62
+.word 0x1AE -55
+.word 0x1AF 40
+.word 0x1B0 49
+.word 0x1B1 -54
+.word 0x1B2 -77
+.word 0x1B3 41
+.word 0x1B4 -35
+.word 0x1B5 -92
+.word 0x1B6 72
+.word 0x1B7 -82
+.word 0x1B8 -79
+.word 0x1B9 -96
+.word 0x1BA 15
+.word 0x1BB -97
+.word 0x1BC 93
+.word 0x1BD 93
+.word 0x1BE -29
+.word 0x1BF -37
+.word 0x1C0 -32
+.word 0x1C1 -72
+.word 0x1C2 59
+.word 0x1C3 -53
+.word 0x1C4 -12
+.word 0x1C5 -26
+.word 0x1C6 -83
+.word 0x1C7 -58
+.word 0x1C8 -60
+.word 0x1C9 -35
+.word 0x1CA 35
+.word 0x1CB -57
+.word 0x1CC 68
+.word 0x1CD -31
+.word 0x1CE 65
+.word 0x1CF 82
+.word 0x1D0 -25
+.word 0x1D1 16
+.word 0x1D2 79
+.word 0x1D3 -18
+.word 0x1D4 27
+.word 0x1D5 21
+.word 0x1D6 -71
+.word 0x1D7 -94
+.word 0x1D8 -21
+.word 0x1D9 -2
+.word 0x1DA -13
+.word 0x1DB 7
+.word 0x1DC -52
+.word 0x1DD -34
+.word 0x1DE -73
+.word 0x1DF -36
+.word 0x1E0 86
+.word 0x1E1 30
+.word 0x1E2 -47
+.word 0x1E3 55
+.word 0x1E4 10
+.word 0x1E5 -95
+.word 0x1E6 -43
+.word 0x1E7 -96
+.word 0x1E8 1
+.word 0x1E9 -63
+.word 0x1EA -91
+.word 0x1EB 84
+.word 0x1EC -59
+.word 0x1ED 14
+.word 0x1EE 80
+.word 0x1EF 29
+.word 0x1F0 73
+.word 0x1F1 9
+.word 0x1F2 39
+.word 0x1F3 -44
+.word 0x1F4 61
+.word 0x1F5 77
+.word 0x1F6 32
+.word 0x1F7 15
+.word 0x1F8 -43
+.word 0x1F9 34
+.word 0x1FA 66
+.word 0x1FB -93
+.word 0x1FC 1
+.word 0x1FD 72
+.word 0x1FE 47
+.word 0x1FF -18
+# B
+.word 0x200 68
+.word 0x201 61
+.word 0x202 9
+.word 0x203 -85
+.word 0x204 88
+.word 0x205 -24
+.word 0x206 -68
+.word 0x207 -46
+.word 0x208 -88
+.word 0x209 -22
+.word 0x20A -82
+.word 0x20B -81
+.word 0x20C -21
+.word 0x20D -24
+.word 0x20E 90
+.word 0x20F -60
+.word 0x210 6
+.word 0x211 44
+.word 0x212 -36
+.word 0x213 -67
+.word 0x214 -98
+.word 0x215 43
+.word 0x216 -91
+.word 0x217 51
+.word 0x218 -45
+.word 0x219 45
+.word 0x21A 17
+.word 0x21B -57
+.word 0x21C 99
+.word 0x21D 80
+.word 0x21E 59
+.word 0x21F 30
+.word 0x220 -91
+.word 0x221 -4
+.word 0x222 -49
+.word 0x223 -12
+.word 0x224 -75
+.word 0x225 -48
+.word 0x226 46
+.word 0x227 72
+.word 0x228 10
+.word 0x229 51
+.word 0x22A -51
+.word 0x22B 26
+.word 0x22C -74
+.word 0x22D 70
+.word 0x22E -1
+.word 0x22F -25
+.word 0x230 29
+.word 0x231 27
+.word 0x232 -96
+.word 0x233 -17
+.word 0x234 56
+.word 0x235 2
+.word 0x236 -28
+.word 0x237 -96
+.word 0x238 -60
+.word 0x239 -49
+.word 0x23A -17
+.word 0x23B 44
+.word 0x23C 100
+.word 0x23D -66
+.word 0x23E -14
+.word 0x23F 9
+.word 0x240 -46
+.word 0x241 -32
+.word 0x242 72
+.word 0x243 -76
+.word 0x244 -3
+.word 0x245 40
+.word 0x246 -12
+.word 0x247 75
+.word 0x248 36
+.word 0x249 24
+.word 0x24A 96
+.word 0x24B 36
+.word 0x24C -40
+.word 0x24D -84
+.word 0x24E 85
+.word 0x24F -90
+.word 0x250 -79
+.word 0x251 -66
+.word 0x252 -57
+.word 0x253 -58
+.word 0x254 37
+.word 0x255 -46
+.word 0x256 -32
+.word 0x257 94
+.word 0x258 -15
+.word 0x259 53
+.word 0x25A 29
+.word 0x25B -35
+.word 0x25C -6
+.word 0x25D -14
+.word 0x25E -13
+.word 0x25F -71
+.word 0x260 -26
+.word 0x261 -40
+.word 0x262 54
+.word 0x263 99
+.word 0x264 83
+.word 0x265 25
+.word 0x266 -66
+.word 0x267 48
+.word 0x268 41
+.word 0x269 97
+.word 0x26A -74
+.word 0x26B -18
+.word 0x26C -90
+.word 0x26D 4
+.word 0x26E -82
+.word 0x26F -3
+.word 0x270 -63
+.word 0x271 -68
+.word 0x272 -13
+.word 0x273 -71
+.word 0x274 57
+.word 0x275 50
+.word 0x276 100
+.word 0x277 -4
+.word 0x278 -81
+.word 0x279 46
+.word 0x27A 40
+.word 0x27B -43
+.word 0x27C 44
+.word 0x27D -80
+.word 0x27E -32
+.word 0x27F -7
+.word 0x280 -25
+.word 0x281 44
+.word 0x282 36
+.word 0x283 -71
+.word 0x284 17
+.word 0x285 -30
+.word 0x286 -73
+.word 0x287 -89
+.word 0x288 -25
+.word 0x289 -97
+.word 0x28A 57
+.word 0x28B 71
+.word 0x28C -97
+.word 0x28D -77
+.word 0x28E 5
+.word 0x28F -71
+.word 0x290 -90
+.word 0x291 -52
+.word 0x292 -39
+.word 0x293 50
+.word 0x294 7
+.word 0x295 -59
+.word 0x296 -71
+.word 0x297 15
+.word 0x298 -58
+.word 0x299 74
+.word 0x29A -39
+.word 0x29B -60
+.word 0x29C 90
+.word 0x29D -74
+.word 0x29E 11
+.word 0x29F -4
+.word 0x2A0 38
+.word 0x2A1 -25
+.word 0x2A2 40
+.word 0x2A3 -36
+.word 0x2A4 82
+.word 0x2A5 22
+.word 0x2A6 -20
+.word 0x2A7 -75
+.word 0x2A8 -47
+.word 0x2A9 66
+.word 0x2AA -19
+.word 0x2AB -90
+.word 0x2AC -94
+.word 0x2AD -98
+.word 0x2AE -25
+.word 0x2AF 85
+.word 0x2B0 52
+.word 0x2B1 -19
+.word 0x2B2 15
+.word 0x2B3 0
+.word 0x2B4 -20
+.word 0x2B5 2
+.word 0x2B6 -84
+.word 0x2B7 -84
+.word 0x2B8 -19
+.word 0x2B9 53
+.word 0x2BA 16
+.word 0x2BB -72
+.word 0x2BC -36
+.word 0x2BD -45
+.word 0x2BE 100
+.word 0x2BF 58
+.word 0x2C0 99
+.word 0x2C1 38
+.word 0x2C2 76
+.word 0x2C3 20
+.word 0x2C4 69
+.word 0x2C5 -9
+.word 0x2C6 -34
+.word 0x2C7 -54
+.word 0x2C8 38
+.word 0x2C9 -47
+.word 0x2CA -22
+.word 0x2CB -50
+.word 0x2CC -37
+.word 0x2CD -8
+.word 0x2CE -80
+.word 0x2CF -29
+.word 0x2D0 -78
+.word 0x2D1 92
+.word 0x2D2 14
+.word 0x2D3 -77
+.word 0x2D4 66
+.word 0x2D5 47
+.word 0x2D6 64
+.word 0x2D7 -14
+.word 0x2D8 -42
+.word 0x2D9 -1
+.word 0x2DA -22
+.word 0x2DB -90
+.word 0x2DC -17
+.word 0x2DD -53
+.word 0x2DE -19
+.word 0x2DF 48
+.word 0x2E0 -23
+.word 0x2E1 -38
+.word 0x2E2 -15
+.word 0x2E3 -75
+.word 0x2E4 39
+.word 0x2E5 56
+.word 0x2E6 48
+.word 0x2E7 52
+.word 0x2E8 -77
+.word 0x2E9 -38
+.word 0x2EA -44
+.word 0x2EB -95
+.word 0x2EC -38
+.word 0x2ED 2
+.word 0x2EE -82
+.word 0x2EF -32
+.word 0x2F0 41
+.word 0x2F1 -82
+.word 0x2F2 86
+.word 0x2F3 -81
+.word 0x2F4 -95
+.word 0x2F5 62
+.word 0x2F6 -98
+.word 0x2F7 -26
+.word 0x2F8 92
+.word 0x2F9 -9
+.word 0x2FA 26
+.word 0x2FB 20
+.word 0x2FC -61
+.word 0x2FD -75
+.word 0x2FE 28
+.word 0x2FF 99
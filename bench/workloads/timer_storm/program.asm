@@ -0,0 +1,40 @@
+# Timer interrupt storm: the timer raises irq0 every 12 cycles while the main code fills a
+# 1024-word table at 0x400 with xorshift32 values (seeded from 0x001), 1000 times.
+# The ISR counts the ticks in $gp, shows them on display7seg and moves the leds every 256 ticks.
+# The tick count is stored at 0x000.
+	add $t0, $zero, $imm1, $zero, isr, 0
+	out $zero, $imm1, $zero, $t0, 6, 0           # irqhandler = isr
+	out $zero, $imm1, $zero, $imm2, 13, 12       # timermax = 12
+	out $zero, $imm1, $zero, $imm2, 11, 1        # timerenable = 1
+	out $zero, $imm1, $zero, $imm2, 0, 1         # irq0enable = 1
+	lw $v0, $zero, $imm1, $zero, 1, 0            # x = seed
+	add $a1, $zero, $zero, $zero, 0, 0           # round = 0
+round:
+	add $a0, $zero, $zero, $zero, 0, 0           # i = 0
+fill:
+	sll $t0, $v0, $imm1, $zero, 13, 0            # x ^= x << 13
+	xor $v0, $v0, $t0, $zero, 0, 0
+	srl $t0, $v0, $imm1, $zero, 17, 0            # x ^= x >> 17
+	xor $v0, $v0, $t0, $zero, 0, 0
+	sll $t0, $v0, $imm1, $zero, 5, 0             # x ^= x << 5
+	xor $v0, $v0, $t0, $zero, 0, 0
+	sw $v0, $a0, $imm1, $zero, 0x400, 0          # table[i] = x
+	add $a0, $a0, $imm1, $zero, 1, 0
+	blt $zero, $a0, $imm1, $imm2, 1024, fill
+	add $a1, $a1, $imm1, $zero, 1, 0
+	blt $zero, $a1, $imm1, $imm2, 1000, round
+	out $zero, $imm1, $zero, $zero, 0, 0         # irq0enable = 0
+	sw $gp, $zero, $zero, $zero, 0, 0
+	halt $zero, $zero, $zero, $zero, 0, 0
+isr:
+	out $zero, $imm1, $zero, $zero, 3, 0         # irq0status = 0
+	add $gp, $gp, $imm1, $zero, 1, 0             # ticks++
+	out $zero, $imm1, $zero, $gp, 10, 0          # display7seg = ticks
+	and $sp, $gp, $imm1, $zero, 255, 0
+	bne $zero, $sp, $zero, $imm1, done, 0
+	srl $sp, $gp, $imm1, $zero, 8, 0             # leds = ticks / 256
+	out $zero, $imm1, $zero, $sp, 9, 0
+done:
+	reti $zero, $zero, $zero, $zero, 0, 0
+
+.word 0x001 0x2545F491